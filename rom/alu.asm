@@ -0,0 +1,25 @@
+; SPDX-License-Identifier: GPL-3.0-or-later
+; ALU heavy loop for lotec-sim -b, most carry and compare results are
+; overwritten before they are read.
+start:
+	LI FLAGS, #$00
+	LI R0, #$00
+	LI R1, #$01
+	LI R2, #$00
+	LI R3, #$00
+loop:
+	ADDI R0, #$35
+	SHLI R1, R0, #$03
+	XOR R2, R0
+	CMPI R0, #$80
+	SUBI R3, #$01
+	ADD R2, R1
+	CMP R2, R3
+	SHRI R1, #$01
+	ADDI R4, #$07
+	CMP R4, R1
+	XOR R4, R2
+	CMPI R3, #$00
+	BNE loop
+	STB R2, $0000
+	B start
@@ -0,0 +1,36 @@
+; SPDX-License-Identifier: GPL-3.0-or-later
+; Mailbox for lotec-multi: CPU 0 takes 16 numbers out of the mailbox at $00
+; and adds them up in $02, the other CPUs put their number in when it is
+; empty until CPU 0 sets $01.
+start:
+	CMPI R0, #$00
+	BEQ consumer
+producer:
+	LDB R1, $0001
+	CMPI R1, #$00
+	BNE done
+	LDB R1, $0000
+	CMPI R1, #$00
+	BNE producer
+	STB R0, $0000
+	B producer
+consumer:
+	LI R3, #$00
+	LI R4, #$10
+next:
+	LDB R1, $0000
+	CMPI R1, #$00
+	BEQ next
+	LI FLAGS, #$00
+	ADD R3, R1
+	LI R1, #$00
+	STB R1, $0000
+	LI FLAGS, #$00
+	SUBI R4, #$01
+	CMPI R4, #$00
+	BNE next
+	STB R3, $0002
+	LI R1, #$01
+	STB R1, $0001
+done:
+	B done
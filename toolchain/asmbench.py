@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-3.0-or-later
+# Benchmark of lotec-ass: writes a synthetic source with one label every
+# few lines, referenced by branches and by immediates with all address
+# suffixes, and times the assembler on it. The addresses wrap around the
+# 64K words of the ROM, the output is only used for timing.
+import getopt
+import os
+import random
+import subprocess
+import sys
+import tempfile
+import time
+
+def usage():
+	print("asmbench.py [-n lines] [-e every] [-a assembler] [-k source]")
+	print("Times lotec-ass on a synthetic source")
+	print(" -n lines      Number of lines (default 1000000)")
+	print(" -e every      Lines per label (default 4)")
+	print(" -a assembler  Assembler to run (default bin/lotec-ass next to this script)")
+	print(" -k source     Keep the source in this file")
+
+def generate(f, lines, every):
+	rnd = random.Random(1)
+	suffixes = ["", "@ha", "@la", "@hi", "@lo"]
+	labels = (lines + every - 1) // every
+	n = 0
+	f.write("; generated by asmbench.py\n")
+	for i in range(labels):
+		f.write("L%u:\n" % i)
+		n += 1
+		for j in range(every - 2):
+			if n >= lines - 1:
+				break
+			# A label anywhere in the file, also defined later
+			suffix = suffixes[rnd.randrange(len(suffixes))]
+			if suffix == "":
+				f.write("\tLI R%u, #$%02X\n" % (j % 5, rnd.randrange(256)))
+			else:
+				f.write("\tLI R%u, #L%u%s\n" % (j % 5, rnd.randrange(labels), suffix))
+			n += 1
+		if n >= lines:
+			break
+		f.write("\tBNE L%u\n" % i)
+		n += 1
+		if n >= lines:
+			break
+
+def main():
+	lines = 1000000
+	every = 4
+	ass = os.path.join(os.path.dirname(os.path.abspath(__file__)), "bin", "lotec-ass")
+	keep = None
+	try:
+		opts, args = getopt.getopt(sys.argv[1:], "n:e:a:k:")
+	except getopt.GetoptError:
+		usage()
+		return 1
+	for opt, arg in opts:
+		if opt == "-n":
+			lines = int(arg, 0)
+		elif opt == "-e":
+			every = int(arg, 0)
+		elif opt == "-a":
+			ass = arg
+		elif opt == "-k":
+			keep = arg
+	if args or (lines < 1) or (every < 2):
+		usage()
+		return 1
+
+	if keep is not None:
+		name = keep
+		f = open(name, "w")
+	else:
+		fd, name = tempfile.mkstemp(suffix=".asm")
+		f = os.fdopen(fd, "w")
+	generate(f, lines, every)
+	f.close()
+
+	size = os.path.getsize(name)
+	try:
+		start = time.monotonic()
+		with open(os.devnull, "w") as null:
+			rv = subprocess.call([ass, name], stdout=null)
+		duration = time.monotonic() - start
+	finally:
+		if keep is None:
+			os.unlink(name)
+	if rv != 0:
+		print("Error: %s failed with %d." % (ass, rv), file=sys.stderr)
+		return 3
+	print("%u lines, %u labels, %.1f MB: %.3f s, %.0f k lines/s, %.1f MB/s" % (lines,
+		(lines + every - 1) // every, size / 1e6, duration, lines / duration / 1e3 if duration > 0 else 0.0,
+		size / duration / 1e6 if duration > 0 else 0.0))
+	return 0
+
+sys.exit(main())
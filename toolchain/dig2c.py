@@ -0,0 +1,1118 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+# Compiles a Digital circuit (dig/lotec.dig) to C. The wires and tunnels are
+# joined to nets, the combinational elements are sorted by level and printed
+# as straight-line code, the registers are updated at the rising edges of
+# their clocks. The generated file implements the interface of
+# src/lotec-netlist.h, with -f the one of src/lotec-faultnet.h, which runs 64
+# copies of the circuit with stuck-at faults at once.
+#
+# usage: dig2c.py [-f] circuit.dig output.c
+
+import sys
+import xml.etree.ElementTree as ET
+
+# Elements kept in state variables, updated at the rising edge of pin C
+STATE_ELEMENTS = ("Register", "D_FF", "Counter", "CounterPreset")
+
+class DigError(Exception):
+	pass
+
+class Element:
+	def __init__(self, index, kind, x, y, attrs):
+		self.index = index
+		self.kind = kind
+		self.x = x
+		self.y = y
+		self.attrs = attrs
+		self.pins = {}		# pin name -> net
+		self.level = 0
+
+	def attr(self, key, default):
+		return self.attrs.get(key, default)
+
+	def num(self, key, default):
+		return int(self.attrs.get(key, default), 0)
+
+	def name(self):
+		label = self.attrs.get("Label")
+		if label:
+			return "%s '%s'" % (self.kind, label)
+		return "%s at %d,%d" % (self.kind, self.x, self.y)
+
+class Net:
+	def __init__(self, index):
+		self.index = index
+		self.names = []		# tunnel names
+		self.width = None
+		self.driver = None	# (element, pin), None for buses and undriven nets
+		self.bus = []		# Driver elements of a bus
+		self.readers = []	# (element, pin)
+
+	def name(self):
+		if self.names:
+			return self.names[0]
+		return "n%d" % self.index
+
+class Netlist:
+	def __init__(self):
+		self.elements = []
+		self.nets = []
+		self.clock = None	# net of the Clock element
+		self.order = []		# combinational elements and buses by level
+		self.levels = 0
+
+def read_attrs(ve):
+	attrs = {}
+	for entry in ve.find("elementAttributes"):
+		key = entry[0].text
+		value = entry[1]
+		if value.tag == "rotation":
+			attrs[key] = value.attrib["rotation"]
+		elif value.tag == "inverterConfig":
+			attrs[key] = [c.text for c in value]
+		else:
+			attrs[key] = value.text
+	return attrs
+
+def expand_splitting(spec):
+	widths = []
+	for part in spec.split(","):
+		part = part.strip()
+		if "*" in part:
+			w, n = part.split("*")
+			widths += [int(w)] * int(n)
+		else:
+			widths.append(int(part))
+	return widths
+
+# Pins of a gate with the inputs on the left and the output on the right,
+# the middle input position is left free for an even number of inputs.
+def gate_pins(ins, outs, width=60):
+	pins = []
+	n = len(ins)
+	for i, name in enumerate(ins):
+		gap = 20 if (len(outs) == 1 and n % 2 == 0 and i >= n // 2) else 0
+		pins.append((name, "i", 0, i * 20 + gap))
+	for i, name in enumerate(outs):
+		y = (n // 2) * 20 if len(outs) == 1 else i * 20
+		pins.append((name, "o", width, y))
+	return pins
+
+# Pins of an element: name, direction, position relative to the element
+# before rotation and width.
+def element_pins(e):
+	k = e.kind
+	bits = e.num("Bits", "1")
+	if k in ("And", "Or", "XOr", "NAnd", "NOr"):
+		n = e.num("Inputs", "2")
+		pins = gate_pins(["In_%d" % (i + 1) for i in range(n)], ["out"])
+		inverted = e.attr("inverterConfig", [])
+		return [(name, d, x - 20 if name in inverted else x, y, bits) for name, d, x, y in pins]
+	if k == "Register":
+		return [("D", "i", 0, 0, bits), ("C", "i", 0, 20, 1), ("en", "i", 0, 40, 1), ("Q", "o", 60, 20, bits)]
+	if k == "D_FF":
+		return [("D", "i", 0, 0, bits), ("C", "i", 0, 20, 1), ("Q", "o", 60, 0, bits), ("~Q", "o", 60, 20, bits)]
+	if k in ("Add", "Sub"):
+		return [("a", "i", 0, 0, bits), ("b", "i", 0, 20, bits), ("c_i", "i", 0, 40, 1),
+			("s", "o", 60, 0, bits), ("c_o", "o", 60, 20, 1)]
+	if k == "Comparator":
+		return [("a", "i", 0, 0, bits), ("b", "i", 0, 20, bits),
+			(">", "o", 60, 0, 1), ("=", "o", 60, 20, 1), ("<", "o", 60, 40, 1)]
+	if k == "BarrelShifter":
+		shift = max(1, (bits - 1).bit_length())
+		return [("in", "i", 0, 0, bits), ("shift", "i", 0, 40, shift), ("out", "o", 60, 20, bits)]
+	if k == "BitExtender":
+		return [("in", "i", 0, 0, e.num("inputBits", "8")), ("out", "o", 60, 0, e.num("outputBits", "16"))]
+	if k == "Decoder":
+		sel = e.num("Selector Bits", "1")
+		n = 1 << sel
+		return [("sel", "i", 20, n * 20, sel)] + [("out_%d" % i, "o", 40, i * 20, 1) for i in range(n)]
+	if k == "Multiplexer":
+		sel = e.num("Selector Bits", "1")
+		n = 1 << sel
+		return ([("sel", "i", 20, n * 20, sel)] +
+			[("in_%d" % i, "i", 0, i * 20 + (20 if n == 2 and i == 1 else 0), bits) for i in range(n)] +
+			[("out", "o", 40, n * 10, bits)])
+	if k == "PriorityEncoder":
+		sel = e.num("Selector Bits", "1")
+		return ([("in%d" % i, "i", 0, i * 20, 1) for i in range(1 << sel)] +
+			[("num", "o", 80, 0, sel), ("any", "o", 80, 20, 1)])
+	if k == "Counter":
+		return [("en", "i", 0, 0, 1), ("C", "i", 0, 20, 1), ("clr", "i", 0, 40, 1),
+			("out", "o", 60, 0, bits), ("ovf", "o", 60, 20, 1)]
+	if k == "CounterPreset":
+		return [("en", "i", 0, 0, 1), ("C", "i", 0, 20, 1), ("dir", "i", 0, 40, 1), ("in", "i", 0, 60, bits),
+			("ld", "i", 0, 80, 1), ("clr", "i", 0, 100, 1), ("out", "o", 60, 0, bits), ("ovf", "o", 60, 20, 1)]
+	if k == "ROM":
+		return [("A", "i", 0, 0, e.num("AddrBits", "8")), ("sel", "i", 0, 40, 1), ("D", "o", 60, 20, bits)]
+	if k == "RAMAsync":
+		return [("A", "i", 0, 0, e.num("AddrBits", "8")), ("D", "i", 0, 20, bits), ("we", "i", 0, 40, 1),
+			("Q", "o", 60, 20, bits)]
+	if k == "Driver":
+		return [("in", "i", -20, 0, bits), ("sel", "i", 0, -20, 1), ("out", "o", 20, 0, bits)]
+	if k == "Splitter":
+		spread = e.num("splitterSpreading", "1")
+		ins = expand_splitting(e.attr("Input Splitting", "4,4"))
+		outs = expand_splitting(e.attr("Output Splitting", "8"))
+		return ([("in%d" % i, "i", 0, i * 20 * spread, w) for i, w in enumerate(ins)] +
+			[("out%d" % i, "o", 20, i * 20 * spread, w) for i, w in enumerate(outs)])
+	if k in ("Const", "Clock", "Reset"):
+		return [("out", "o", 0, 0, bits if k == "Const" else 1)]
+	if k in ("Out", "Tunnel"):
+		return [("in", "i", 0, 0, bits)]
+	raise DigError("Element %s is not supported" % e.name())
+
+def rotate(x, y, rotation):
+	for _ in range(rotation):
+		x, y = y, -x
+	return x, y
+
+def load(filename):
+	root = ET.parse(filename).getroot()
+	nl = Netlist()
+	for index, ve in enumerate(root.find("visualElements")):
+		pos = ve.find("pos").attrib
+		nl.elements.append(Element(index, ve.find("elementName").text, int(pos["x"]), int(pos["y"]),
+			read_attrs(ve)))
+
+	# Join the points connected by wires, tunnels of the same name and pins
+	# placed on a wire to nets.
+	parent = {}
+	def find(p):
+		parent.setdefault(p, p)
+		while parent[p] != p:
+			parent[p] = parent[parent[p]]
+			p = parent[p]
+		return p
+	def union(a, b):
+		parent[find(a)] = find(b)
+
+	wires = []
+	for w in root.find("wires"):
+		a = (int(w.find("p1").attrib["x"]), int(w.find("p1").attrib["y"]))
+		b = (int(w.find("p2").attrib["x"]), int(w.find("p2").attrib["y"]))
+		union(a, b)
+		wires.append((a, b))
+	def on_wire(p):
+		for a, b in wires:
+			if a[0] == b[0] == p[0] and min(a[1], b[1]) < p[1] < max(a[1], b[1]):
+				return a
+			if a[1] == b[1] == p[1] and min(a[0], b[0]) < p[0] < max(a[0], b[0]):
+				return a
+		return None
+	for a, b in list(wires):
+		for p in (a, b):
+			w = on_wire(p)
+			if w is not None:
+				union(p, w)
+
+	tunnels = {}
+	for e in nl.elements:
+		if e.kind == "Tunnel":
+			name = e.attr("NetName", "")
+			if name in tunnels:
+				union((e.x, e.y), tunnels[name])
+			else:
+				tunnels[name] = (e.x, e.y)
+				find((e.x, e.y))
+
+	points = set(parent)
+	pin_point = {}
+	for e in nl.elements:
+		if e.kind == "Tunnel":
+			continue
+		for name, d, px, py, width in element_pins(e):
+			rx, ry = rotate(px, py, int(e.attr("rotation", "0")))
+			p = (e.x + rx, e.y + ry)
+			if p not in points:
+				w = on_wire(p)
+				if w is not None:
+					union(p, w)
+					points.add(p)
+			pin_point[(e.index, name)] = find(p) if p in points else None
+
+	nets = {}
+	def net_of(p):
+		root = find(p)
+		if root not in nets:
+			nets[root] = Net(len(nl.nets))
+			nl.nets.append(nets[root])
+		return nets[root]
+
+	for e in nl.elements:
+		if e.kind == "Tunnel":
+			net_of((e.x, e.y)).names.append(e.attr("NetName", ""))
+	for e in nl.elements:
+		if e.kind in ("Tunnel", "Out"):
+			continue
+		for name, d, px, py, width in element_pins(e):
+			p = pin_point[(e.index, name)]
+			if p is None:
+				if d == "i":
+					raise DigError("Input %s of %s is not connected" % (name, e.name()))
+				continue
+			net = net_of(p)
+			e.pins[name] = net
+			if d == "i":
+				net.readers.append((e, name))
+			elif e.kind == "Driver":
+				net.bus.append(e)
+			elif net.driver is not None:
+				raise DigError("Net %s is driven by %s and %s" % (net.name(), net.driver[0].name(), e.name()))
+			else:
+				net.driver = (e, name)
+			if d == "o":
+				if (net.width is not None) and (net.width != width):
+					raise DigError("Net %s has %d and %d bits" % (net.name(), net.width, width))
+				net.width = width
+
+	for net in nl.nets:
+		if net.bus and net.driver is not None:
+			raise DigError("Net %s is driven by %s and drivers" % (net.name(), net.driver[0].name()))
+		if net.width is None:
+			net.width = 1
+		if net.readers and net.driver is None and not net.bus:
+			raise DigError("Net %s is not driven" % net.name())
+	for e in nl.elements:
+		if e.kind == "Clock":
+			if nl.clock is not None:
+				raise DigError("More than one clock")
+			nl.clock = e.pins.get("out")
+		if e.kind in ("ROM", "RAMAsync") and sum(1 for o in nl.elements if o.kind == e.kind) > 1:
+			raise DigError("More than one %s" % e.kind)
+	levelize(nl)
+	return nl
+
+# Combinational nodes: elements computing outputs from inputs and buses
+# computing their value from the drivers. Sources (state, constants, clock and
+# reset) are level 0.
+def comb_inputs(node):
+	if isinstance(node, Net):
+		nets = []
+		for d in node.bus:
+			nets += [d.pins["in"], d.pins["sel"]]
+		return nets
+	return [net for name, net in node.pins.items() if (node, name) in net.readers]
+
+def levelize(nl):
+	nodes = []
+	for e in nl.elements:
+		if e.kind in STATE_ELEMENTS + ("Const", "Clock", "Reset", "Out", "Tunnel", "Driver"):
+			continue
+		nodes.append(e)
+	nodes += [net for net in nl.nets if net.bus]
+
+	def outputs(node):
+		if isinstance(node, Net):
+			return [node]
+		return [net for name, net in node.pins.items() if net.driver == (node, name)]
+	producer = {}
+	for node in nodes:
+		for net in outputs(node):
+			producer[net.index] = node
+
+	level = {}
+	visiting = set()
+	def visit(node):
+		key = id(node)
+		if key in level:
+			return level[key]
+		if key in visiting:
+			raise DigError("Combinational loop through %s" % (node.name()))
+		visiting.add(key)
+		lv = 1
+		for net in comb_inputs(node):
+			if net.index in producer:
+				lv = max(lv, visit(producer[net.index]) + 1)
+		visiting.discard(key)
+		level[key] = lv
+		return lv
+
+	sys.setrecursionlimit(10000)
+	for node in nodes:
+		node.level = visit(node)
+	nl.order = sorted(nodes, key=lambda node: node.level)
+	nl.levels = max([node.level for node in nodes] + [0])
+
+def mask(width):
+	return "0x%XU" % ((1 << width) - 1)
+
+def n(net):
+	return "n[%d]" % net.index
+
+# C statements computing the outputs of a combinational node
+def emit_node(node):
+	if isinstance(node, Net):
+		lines = ["%s = 0;" % n(node)]
+		for d in node.bus:
+			lines.append("if (%s) %s = %s;" % (n(d.pins["sel"]), n(node), n(d.pins["in"])))
+		return lines
+	e = node
+	k = e.kind
+	p = e.pins
+	out = lambda name: name in p and p[name].driver == (e, name)
+	lines = []
+	if k in ("And", "Or", "XOr", "NAnd", "NOr"):
+		width = p["out"].width
+		inverted = e.attr("inverterConfig", [])
+		terms = []
+		for name in sorted((name for name in p if name.startswith("In_")), key=lambda s: int(s[3:])):
+			terms.append(("~" if name in inverted else "") + n(p[name]))
+		op = {"And": " & ", "NAnd": " & ", "Or": " | ", "NOr": " | ", "XOr": " ^ "}[k]
+		expr = "(%s)" % op.join(terms)
+		if k in ("NAnd", "NOr"):
+			expr = "~" + expr
+		lines.append("%s = %s & %s;" % (n(p["out"]), expr, mask(width)))
+	elif k in ("Add", "Sub"):
+		width = e.num("Bits", "1")
+		op = "+" if k == "Add" else "-"
+		lines.append("t = (uint64_t)%s %s %s %s %s;" % (n(p["a"]), op, n(p["b"]), op, n(p["c_i"])))
+		if out("s"):
+			lines.append("%s = t & %s;" % (n(p["s"]), mask(width)))
+		if out("c_o"):
+			lines.append("%s = (t >> %d) & 1;" % (n(p["c_o"]), width))
+	elif k == "Comparator":
+		a, b = n(p["a"]), n(p["b"])
+		if e.attr("Signed", "false") == "true":
+			width = e.num("Bits", "1")
+			a = "((int32_t)(%s << %d) >> %d)" % (a, 32 - width, 32 - width)
+			b = "((int32_t)(%s << %d) >> %d)" % (b, 32 - width, 32 - width)
+		for name, op in ((">", ">"), ("=", "=="), ("<", "<")):
+			if out(name):
+				lines.append("%s = %s %s %s;" % (n(p[name]), a, op, b))
+	elif k == "BarrelShifter":
+		if e.attr("barrelShifterMode", "logical") != "logical" or e.attr("barrelSigned", "false") != "false":
+			raise DigError("Only logical shifts by unsigned amounts are supported by %s" % e.name())
+		width = e.num("Bits", "1")
+		op = ">>" if e.attr("direction", "left") == "right" else "<<"
+		lines.append("%s = ((uint64_t)%s %s %s) & %s;" % (n(p["out"]), n(p["in"]), op, n(p["shift"]), mask(width)))
+	elif k == "BitExtender":
+		iw = e.num("inputBits", "8")
+		ow = e.num("outputBits", "16")
+		lines.append("%s = (uint32_t)((int32_t)(%s << %d) >> %d) & %s;" % (n(p["out"]), n(p["in"]),
+			32 - iw, 32 - iw, mask(ow)))
+	elif k == "Decoder":
+		for name in p:
+			if name.startswith("out_") and out(name):
+				lines.append("%s = %s == %s;" % (n(p[name]), n(p["sel"]), name[4:]))
+	elif k == "Multiplexer":
+		sel = e.num("Selector Bits", "1")
+		ins = [n(p["in_%d" % i]) for i in range(1 << sel)]
+		if sel == 1:
+			lines.append("%s = %s ? %s : %s;" % (n(p["out"]), n(p["sel"]), ins[1], ins[0]))
+		else:
+			lines.append("switch (%s) {" % n(p["sel"]))
+			for i, v in enumerate(ins):
+				lines.append("\tcase %d: %s = %s; break;" % (i, n(p["out"]), v))
+			lines.append("\tdefault: break;")
+			lines.append("}")
+	elif k == "PriorityEncoder":
+		sel = e.num("Selector Bits", "1")
+		num = n(p["num"]) if out("num") else "t"
+		lines.append("%s = 0;" % num)
+		for i in range(1 << sel):
+			lines.append("if (%s) %s = %d;" % (n(p["in%d" % i]), num, i))
+		if out("any"):
+			lines.append("%s = %s;" % (n(p["any"]), " | ".join(n(p["in%d" % i]) for i in range(1 << sel))))
+	elif k == "ROM":
+		lines.append("%s = %s ? g->rom[%s] : 0;" % (n(p["D"]), n(p["sel"]), n(p["A"])))
+	elif k == "RAMAsync":
+		lines.append("if (%s) g->ram[%s] = %s;" % (n(p["we"]), n(p["A"]), n(p["D"])))
+		if out("Q"):
+			lines.append("%s = g->ram[%s];" % (n(p["Q"]), n(p["A"])))
+	elif k == "Splitter":
+		ins = expand_splitting(e.attr("Input Splitting", "4,4"))
+		outs = expand_splitting(e.attr("Output Splitting", "8"))
+		terms = []
+		shift = 0
+		for i, w in enumerate(ins):
+			terms.append("((uint64_t)%s << %d)" % (n(p["in%d" % i]), shift) if shift else n(p["in%d" % i]))
+			shift += w
+		lines.append("t = %s;" % " | ".join(terms))
+		shift = 0
+		for i, w in enumerate(outs):
+			if out("out%d" % i):
+				lines.append("%s = (t >> %d) & %s;" % (n(p["out%d" % i]), shift, mask(w)))
+			shift += w
+	else:
+		raise DigError("Element %s is not supported" % e.name())
+	return lines
+
+# C statements computing the next state of a clocked element into the
+# temporary variables next[] and the statement storing it
+def emit_state(e, slot):
+	p = e.pins
+	k = e.kind
+	q = p.get("Q", p.get("out"))
+	width = e.num("Bits", "1")
+	if q is None and "~Q" not in p:
+		return ("", "")
+	if k == "Register":
+		return ("next[%d] = %s ? %s : %s;" % (slot, n(p["en"]), n(p["D"]), n(q)),
+			"%s = next[%d];" % (n(q), slot))
+	if k == "D_FF":
+		store = "%s = next[%d];" % (n(q), slot) if q is not None else ""
+		if "~Q" in p:
+			store += " %s = ~next[%d] & %s;" % (n(p["~Q"]), slot, mask(width))
+		return ("next[%d] = %s;" % (slot, n(p["D"])), store.strip())
+	if k == "Counter":
+		return ("next[%d] = %s ? 0 : (%s + %s) & %s;" % (slot, n(p["clr"]), n(q), n(p["en"]), mask(width)),
+			"%s = next[%d];" % (n(q), slot))
+	if k == "CounterPreset":
+		return ("next[%d] = %s ? 0 : %s ? %s : (%s + (%s ? (%s ? %s : 1U) : 0)) & %s;" % (slot,
+			n(p["clr"]), n(p["ld"]), n(p["in"]), n(q), n(p["en"]), n(p["dir"]), mask(width), mask(width)),
+			"%s = next[%d];" % (n(q), slot))
+	raise DigError("Element %s is not supported" % e.name())
+
+def emit_c(nl, fout, source):
+	state = [e for e in nl.elements if e.kind in STATE_ELEMENTS]
+	for e in state:
+		if "C" not in e.pins:
+			raise DigError("Clock of %s is not connected" % e.name())
+	clocks = []
+	for e in state:
+		if e.pins["C"] is not nl.clock and e.pins["C"] not in clocks:
+			clocks.append(e.pins["C"])
+	rom = next((e for e in nl.elements if e.kind == "ROM"), None)
+	ram = next((e for e in nl.elements if e.kind == "RAMAsync"), None)
+
+	w = fout.write
+	w("/* SPDX-License-Identifier: GPL-3.0-or-later */\n")
+	w("/* Generated by dig2c.py from %s, don't edit.\n" % source)
+	w(" * %d elements, %d nets, %d levels, %d clocked elements on %d derived clocks\n" % (
+		sum(1 for e in nl.elements if e.kind != "Tunnel"), len(nl.nets), nl.levels, len(state), len(clocks)))
+	w(" */\n")
+	w("#include <stdint.h>\n#include <stdlib.h>\n#include <string.h>\n\n#include \"lotec-netlist.h\"\n\n")
+	w("#define NUM_NETS %d\n#define NUM_STATE %d\n#define NUM_CLOCKS %d\n" % (len(nl.nets), len(state),
+		max(1, len(clocks))))
+	w("#define ROM_SIZE %d\n#define RAM_SIZE_GATES %d\n\n" % (
+		(1 << rom.num("AddrBits", "8")) if rom else 0, (1 << ram.num("AddrBits", "8")) if ram else 0))
+	w("struct lotec_netlist {\n")
+	w("\tuint32_t n[NUM_NETS];\n")
+	w("\tuint8_t clk[NUM_CLOCKS];\t/* derived clocks after the last evaluation */\n")
+	if rom:
+		w("\t%s rom[ROM_SIZE];\n" % ("uint16_t" if rom.num("Bits", "1") <= 16 else "uint32_t"))
+	if ram:
+		w("\tuint8_t ram[RAM_SIZE_GATES];\n" if ram.num("Bits", "1") <= 8 else "\tuint32_t ram[RAM_SIZE_GATES];\n")
+	w("};\n\n")
+
+	w("/* Names of the tunnels and the labels of the elements driving nets */\n")
+	w("static const struct {\n\tconst char *name;\n\tint net;\n\tunsigned int width;\n} names[] = {\n")
+	for net in nl.nets:
+		for name in net.names:
+			w("\t{ \"%s\", %d, %d },\n" % (name, net.index, net.width))
+	for e in nl.elements:
+		label = e.attr("Label", "")
+		out = e.pins.get("Q", e.pins.get("out", e.pins.get("D") if e.kind == "ROM" else None))
+		if label and out is not None and e.kind != "Out":
+			w("\t{ \"%s\", %d, %d },\n" % (label, out.index, out.width))
+	w("};\n\n")
+
+	w("/* Evaluate the combinational logic, level by level */\n")
+	w("static void eval(struct lotec_netlist *g)\n{\n\tuint32_t *restrict n = g->n;\n\tuint64_t t;\n")
+	level = 0
+	for node in nl.order:
+		if node.level != level:
+			level = node.level
+			w("\n\t/* level %d */\n" % level)
+		for line in emit_node(node):
+			w("\t%s\n" % line)
+	w("\t(void)t;\n}\n\n")
+
+	def emit_clocked(elements, indent):
+		if not elements:
+			return
+		w("%suint32_t next[%d];\n\n" % (indent, len(elements)))
+		stores = []
+		for i, e in enumerate(elements):
+			sample, store = emit_state(e, i)
+			w("%s%s\n" % (indent, sample))
+			stores.append(store)
+		for store in stores:
+			w("%s%s\n" % (indent, store))
+
+	w("/* One period of the clock: the elements it clocks are updated at its\n")
+	w(" * rising edge, then those on derived clocks which rose, until the\n")
+	w(" * derived clocks settle.\n */\n")
+	w("void lotec_netlist_clock(struct lotec_netlist *g)\n{\n\tuint32_t *restrict n = g->n;\n")
+	w("\tint rose;\n\tint i;\n\n\t{\n")
+	emit_clocked([e for e in state if e.pins["C"] is nl.clock], "\t\t")
+	w("\t}\n\teval(g);\n")
+	if clocks:
+		w("\tfor (i = 0; i < %d; i++) {\n\t\trose = 0;\n" % (len(state) + 1))
+		for c, net in enumerate(clocks):
+			w("\t\tif (%s && !g->clk[%d]) {\n\t\t\trose |= 1 << %d;\n\t\t}\n" % (n(net), c, c))
+			w("\t\tg->clk[%d] = %s;\n" % (c, n(net)))
+		w("\t\tif (!rose) {\n\t\t\tbreak;\n\t\t}\n")
+		for c, net in enumerate(clocks):
+			w("\t\tif (rose & (1 << %d)) {\n" % c)
+			emit_clocked([e for e in state if e.pins["C"] is net], "\t\t\t")
+			w("\t\t}\n")
+		w("\t\teval(g);\n\t}\n")
+	else:
+		w("\t(void)rose;\n\t(void)i;\n")
+	w("}\n\n")
+
+	w("""/* Clear the state and settle the logic, the ROM and RAM are kept. */
+void lotec_netlist_reset(struct lotec_netlist *g)
+{
+	uint32_t *restrict n = g->n;
+
+	memset(g->n, 0, sizeof(g->n));
+""")
+	for e in nl.elements:
+		if e.kind == "Const":
+			w("\t%s = 0x%XU;\n" % (n(e.pins["out"]), e.num("Value", "1") & ((1 << e.pins["out"].width) - 1)))
+	w("\teval(g);\n")
+	for c, net in enumerate(clocks):
+		w("\tg->clk[%d] = %s;\n" % (c, n(net)))
+	w("}\n\n")
+
+	w("""struct lotec_netlist *lotec_netlist_alloc(void)
+{
+	struct lotec_netlist *g;
+
+	g = calloc(1, sizeof(*g));
+	if (g != NULL) {
+		lotec_netlist_reset(g);
+	}
+	return g;
+}
+
+void lotec_netlist_free(struct lotec_netlist *g)
+{
+	free(g);
+}
+
+void lotec_netlist_eval(struct lotec_netlist *g)
+{
+	eval(g);
+}
+
+int lotec_netlist_find(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		if (strcmp(names[i].name, name) == 0) {
+			return names[i].net;
+		}
+	}
+	return -1;
+}
+
+uint32_t lotec_netlist_get(const struct lotec_netlist *g, int net)
+{
+	return g->n[net];
+}
+
+void lotec_netlist_set(struct lotec_netlist *g, int net, uint32_t value)
+{
+	g->n[net] = value;
+}
+
+""")
+	if rom:
+		w("void *lotec_netlist_rom(struct lotec_netlist *g, uint32_t *size)\n{\n\t*size = ROM_SIZE;\n\treturn g->rom;\n}\n\n")
+	else:
+		w("void *lotec_netlist_rom(struct lotec_netlist *g, uint32_t *size)\n{\n\t(void)g;\n\t*size = 0;\n\treturn NULL;\n}\n\n")
+	if ram:
+		w("void *lotec_netlist_ram(struct lotec_netlist *g, uint32_t *size)\n{\n\t*size = RAM_SIZE_GATES;\n\treturn g->ram;\n}\n")
+	else:
+		w("void *lotec_netlist_ram(struct lotec_netlist *g, uint32_t *size)\n{\n\t(void)g;\n\t*size = 0;\n\treturn NULL;\n}\n")
+
+# Bit-parallel fault simulation: every bit of a net is a 64 bit word, bit k of
+# which is the value in machine k. Every net bit is forced by the masks of the
+# stuck-at faults when it is computed, so 64 machines with a fault each run in
+# one pass.
+
+def s(net, i):
+	return "s[%d]" % (net.offset + i)
+
+def put(net, i, expr):
+	k = net.offset + i
+	return "s[%d] = ((%s) & m0[%d]) | m1[%d];" % (k, expr, k, k)
+
+def emit_fault_node(node):
+	if isinstance(node, Net):
+		lines = []
+		for i in range(node.width):
+			lines.append("c = 0;")
+			for d in node.bus:
+				lines.append("c = (%s & %s) | (~%s & c);" % (s(d.pins["sel"], 0), s(d.pins["in"], i),
+					s(d.pins["sel"], 0)))
+			lines.append(put(node, i, "c"))
+		return lines
+	e = node
+	k = e.kind
+	p = e.pins
+	out = lambda name: name in p and p[name].driver == (e, name)
+	lines = []
+	if k in ("And", "Or", "XOr", "NAnd", "NOr"):
+		inverted = e.attr("inverterConfig", [])
+		names = sorted((name for name in p if name.startswith("In_")), key=lambda s: int(s[3:]))
+		op = {"And": " & ", "NAnd": " & ", "Or": " | ", "NOr": " | ", "XOr": " ^ "}[k]
+		for i in range(p["out"].width):
+			expr = "(%s)" % op.join(("~" if name in inverted else "") + s(p[name], i) for name in names)
+			if k in ("NAnd", "NOr"):
+				expr = "~" + expr
+			lines.append(put(p["out"], i, expr))
+	elif k in ("Add", "Sub"):
+		# Ripple carry, a - b - c_i is a + ~b + ~c_i with the borrow ~carry
+		inv = "~" if k == "Sub" else ""
+		lines.append("c = %s%s;" % (inv, s(p["c_i"], 0)))
+		for i in range(e.num("Bits", "1")):
+			a, b = s(p["a"], i), inv + s(p["b"], i)
+			lines.append("d = %s ^ %s;" % (a, b))
+			if out("s"):
+				lines.append(put(p["s"], i, "d ^ c"))
+			lines.append("c = (%s & %s) | (c & d);" % (a, b))
+		if out("c_o"):
+			lines.append(put(p["c_o"], 0, inv + "c"))
+	elif k == "Comparator":
+		# Borrow of a - b and equality, the sign bits are inverted for signed
+		width = e.num("Bits", "1")
+		signed = e.attr("Signed", "false") == "true"
+		lines.append("c = 0;")
+		lines.append("e = ~0ULL;")
+		for i in range(width):
+			inv = "~" if signed and i == width - 1 else ""
+			a, b = inv + s(p["a"], i), inv + s(p["b"], i)
+			lines.append("d = %s ^ %s;" % (s(p["a"], i), s(p["b"], i)))
+			lines.append("c = (~(%s) & (%s)) | (~d & c);" % (a, b))
+			lines.append("e &= ~d;")
+		if out(">"):
+			lines.append(put(p[">"], 0, "~c & ~e"))
+		if out("="):
+			lines.append(put(p["="], 0, "e"))
+		if out("<"):
+			lines.append(put(p["<"], 0, "c"))
+	elif k == "BarrelShifter":
+		if e.attr("barrelShifterMode", "logical") != "logical" or e.attr("barrelSigned", "false") != "false":
+			raise DigError("Only logical shifts by unsigned amounts are supported by %s" % e.name())
+		width = e.num("Bits", "1")
+		right = e.attr("direction", "left") == "right"
+		for i in range(width):
+			lines.append("x[%d] = %s;" % (i, s(p["in"], i)))
+		for j in range(p["shift"].width):
+			amount = 1 << j
+			sel = s(p["shift"], j)
+			for i in range(width):
+				src = i + amount if right else i - amount
+				moved = "(%s & x[%d])" % (sel, src) if 0 <= src < width else "0"
+				lines.append("y[%d] = %s | (~%s & x[%d]);" % (i, moved, sel, i))
+			for i in range(width):
+				lines.append("x[%d] = y[%d];" % (i, i))
+		for i in range(width):
+			lines.append(put(p["out"], i, "x[%d]" % i))
+	elif k == "BitExtender":
+		iw = e.num("inputBits", "8")
+		for i in range(e.num("outputBits", "16")):
+			lines.append(put(p["out"], i, s(p["in"], min(i, iw - 1))))
+	elif k == "Decoder":
+		sel = p["sel"]
+		for name in p:
+			if name.startswith("out_") and out(name):
+				v = int(name[4:])
+				terms = [("" if (v >> j) & 1 else "~") + s(sel, j) for j in range(sel.width)]
+				lines.append(put(p[name], 0, " & ".join(terms)))
+	elif k == "Multiplexer":
+		sel = p["sel"]
+		ins = [p["in_%d" % v] for v in range(1 << sel.width)]
+		for v in range(len(ins)):
+			terms = [("" if (v >> j) & 1 else "~") + s(sel, j) for j in range(sel.width)]
+			lines.append("x[%d] = %s;" % (v, " & ".join(terms)))
+		for i in range(p["out"].width):
+			lines.append(put(p["out"], i, " | ".join("(x[%d] & %s)" % (v, s(net, i)) for v, net in enumerate(ins))))
+	elif k == "PriorityEncoder":
+		sel = e.num("Selector Bits", "1")
+		for j in range(sel):
+			lines.append("y[%d] = 0;" % j)
+		for v in range(1 << sel):
+			for j in range(sel):
+				if (v >> j) & 1:
+					lines.append("y[%d] |= %s;" % (j, s(p["in%d" % v], 0)))
+				else:
+					lines.append("y[%d] &= ~%s;" % (j, s(p["in%d" % v], 0)))
+		if out("num"):
+			for j in range(sel):
+				lines.append(put(p["num"], j, "y[%d]" % j))
+		if out("any"):
+			lines.append(put(p["any"], 0, " | ".join(s(p["in%d" % v], 0) for v in range(1 << sel))))
+	elif k == "ROM":
+		lines.append("rom_read(f, &%s, %d, %s, x);" % (s(p["A"], 0), p["A"].width, s(p["sel"], 0)))
+		for i in range(p["D"].width):
+			lines.append(put(p["D"], i, "x[%d]" % i))
+	elif k == "RAMAsync":
+		lines.append("ram_write(f, &%s, %d, %s, &%s);" % (s(p["A"], 0), p["A"].width, s(p["we"], 0),
+			s(p["D"], 0)))
+		if out("Q"):
+			lines.append("ram_read(f, &%s, %d, x);" % (s(p["A"], 0), p["A"].width))
+			for i in range(p["Q"].width):
+				lines.append(put(p["Q"], i, "x[%d]" % i))
+	elif k == "Splitter":
+		bits = []
+		for i, w in enumerate(expand_splitting(e.attr("Input Splitting", "4,4"))):
+			bits += [s(p["in%d" % i], j) for j in range(w)]
+		shift = 0
+		for i, w in enumerate(expand_splitting(e.attr("Output Splitting", "8"))):
+			if out("out%d" % i):
+				for j in range(w):
+					lines.append(put(p["out%d" % i], j, bits[shift + j] if shift + j < len(bits) else "0"))
+			shift += w
+	else:
+		raise DigError("Element %s is not supported" % e.name())
+	return lines
+
+# Statements computing the next state of a clocked element into nx[] and
+# the statements storing it in the machines of the mask r
+def emit_fault_state(e, slot):
+	p = e.pins
+	k = e.kind
+	q = p.get("Q", p.get("out"))
+	if q is None and "~Q" not in p:
+		return [], []
+	width = e.num("Bits", "1")
+	sample = []
+	if k == "Register":
+		for i in range(width):
+			sample.append("nx[%d] = (%s & %s) | (~%s & %s);" % (slot + i, s(p["en"], 0), s(p["D"], i),
+				s(p["en"], 0), s(q, i)))
+	elif k == "D_FF":
+		for i in range(width):
+			sample.append("nx[%d] = %s;" % (slot + i, s(p["D"], i)))
+	elif k == "Counter":
+		sample.append("c = %s;" % s(p["en"], 0))
+		for i in range(width):
+			sample.append("nx[%d] = (%s ^ c) & ~%s;" % (slot + i, s(q, i), s(p["clr"], 0)))
+			sample.append("c &= %s;" % s(q, i))
+	elif k == "CounterPreset":
+		sample.append("c = 0;")
+		for i in range(width):
+			y = s(p["en"], 0) if i == 0 else "(%s & %s)" % (s(p["en"], 0), s(p["dir"], 0))
+			sample.append("d = %s ^ %s;" % (s(q, i), y))
+			sample.append("nx[%d] = (((%s & %s) | (~%s & (d ^ c)))) & ~%s;" % (slot + i, s(p["ld"], 0),
+				s(p["in"], i), s(p["ld"], 0), s(p["clr"], 0)))
+			sample.append("c = (%s & %s) | (c & d);" % (s(q, i), y))
+	else:
+		raise DigError("Element %s is not supported" % e.name())
+	store = []
+	for i in range(width):
+		if q is not None:
+			store.append(put(q, i, "(r & nx[%d]) | (~r & %s)" % (slot + i, s(q, i))))
+		if "~Q" in p:
+			store.append(put(p["~Q"], i, "(r & ~nx[%d]) | (~r & %s)" % (slot + i, s(p["~Q"], i))))
+	return sample, store
+
+def emit_faults(nl, fout, source):
+	state = [e for e in nl.elements if e.kind in STATE_ELEMENTS]
+	for e in state:
+		if "C" not in e.pins:
+			raise DigError("Clock of %s is not connected" % e.name())
+	clocks = []
+	for e in state:
+		if e.pins["C"] is not nl.clock and e.pins["C"] not in clocks:
+			clocks.append(e.pins["C"])
+	rom = next((e for e in nl.elements if e.kind == "ROM"), None)
+	ram = next((e for e in nl.elements if e.kind == "RAMAsync"), None)
+	if rom is None or ram is None or rom.num("Bits", "1") > 16 or ram.num("Bits", "1") > 8:
+		raise DigError("Fault simulation needs a ROM of up to 16 and a RAM of up to 8 bits")
+	offset = 0
+	for net in nl.nets:
+		net.offset = offset
+		offset += net.width
+	num_bits = offset
+	state_bits = sum(e.num("Bits", "1") for e in state)
+	labels = {}
+	for e in nl.elements:
+		label = e.attr("Label", "")
+		o = e.pins.get("Q", e.pins.get("out", e.pins.get("D") if e.kind == "ROM" else None))
+		if label and o is not None and e.kind != "Out":
+			labels.setdefault(o.index, label)
+
+	w = fout.write
+	w("/* SPDX-License-Identifier: GPL-3.0-or-later */\n")
+	w("/* Generated by dig2c.py -f from %s, don't edit.\n" % source)
+	w(" * %d nets of %d bits, %d levels, %d clocked elements on %d derived clocks\n" % (
+		len(nl.nets), num_bits, nl.levels, len(state), len(clocks)))
+	w(" */\n")
+	w("#include <stdint.h>\n#include <stdlib.h>\n#include <string.h>\n\n#include \"lotec-faultnet.h\"\n\n")
+	w("#define NUM_NETS %d\n#define NUM_BITS %d\n#define NUM_CLOCKS %d\n" % (len(nl.nets), num_bits,
+		max(1, len(clocks))))
+	w("#define ROM_ADDR_BITS %d\n#define ROM_DATA_BITS %d\n" % (rom.num("AddrBits", "8"), rom.num("Bits", "1")))
+	w("#define RAM_ADDR_BITS %d\n#define RAM_DATA_BITS %d\n\n" % (ram.num("AddrBits", "8"), ram.num("Bits", "1")))
+	w("""struct lotec_faultnet {
+	uint64_t s[NUM_BITS];
+	uint64_t m0[NUM_BITS];	/* cleared by stuck-at-0 faults */
+	uint64_t m1[NUM_BITS];	/* set by stuck-at-1 faults */
+	uint64_t clk[NUM_CLOCKS];	/* derived clocks after the last evaluation */
+	const uint16_t *rom;
+	uint32_t rom_size;
+	uint64_t ram[1 << RAM_ADDR_BITS][RAM_DATA_BITS];
+};
+
+""")
+	w("/* Nets by number as in lotec-netlist.c, the clock has no faults */\n")
+	w("static const struct lotec_faultnet_net nets[NUM_NETS] = {\n")
+	for net in nl.nets:
+		name = net.names[0] if net.names else labels.get(net.index, "n%d" % net.index)
+		w("\t{ \"%s\", %d, %d, %d },\n" % (name, net.offset, net.width, 0 if net is nl.clock else 1))
+	w("};\n\n")
+
+	w("""/* The address of machine k, bit k of the slices a */
+static inline uint32_t lane_addr(const uint64_t *a, unsigned int bits, unsigned int k)
+{
+	uint32_t addr = 0;
+	unsigned int i;
+
+	for (i = 0; i < bits; i++) {
+		addr |= ((a[i] >> k) & 1) << i;
+	}
+	return addr;
+}
+
+/* Whether all machines have the same address, which is then in *addr */
+static inline int same_addr(const uint64_t *a, unsigned int bits, uint32_t *addr)
+{
+	unsigned int i;
+
+	*addr = 0;
+	for (i = 0; i < bits; i++) {
+		if ((a[i] + 1) > 1) {
+			return 0;
+		}
+		*addr |= (a[i] & 1) << i;
+	}
+	return 1;
+}
+
+static void rom_read(const struct lotec_faultnet *f, const uint64_t *a, unsigned int bits, uint64_t sel,
+	uint64_t *d)
+{
+	uint32_t addr;
+	uint32_t v;
+	unsigned int i;
+	unsigned int k;
+
+	if (((sel + 1) <= 1) && same_addr(a, bits, &addr)) {
+		v = (sel && (addr < f->rom_size)) ? f->rom[addr] : 0;
+		for (i = 0; i < ROM_DATA_BITS; i++) {
+			d[i] = -(uint64_t)((v >> i) & 1);
+		}
+		return;
+	}
+	memset(d, 0, ROM_DATA_BITS * sizeof(*d));
+	for (k = 0; k < 64; k++) {
+		addr = lane_addr(a, bits, k);
+		v = (((sel >> k) & 1) && (addr < f->rom_size)) ? f->rom[addr] : 0;
+		for (i = 0; i < ROM_DATA_BITS; i++) {
+			d[i] |= (uint64_t)((v >> i) & 1) << k;
+		}
+	}
+}
+
+static void ram_write(struct lotec_faultnet *f, const uint64_t *a, unsigned int bits, uint64_t we,
+	const uint64_t *d)
+{
+	uint64_t *word;
+	uint32_t addr;
+	unsigned int i;
+	unsigned int k;
+
+	if (we == 0) {
+		return;
+	}
+	if (same_addr(a, bits, &addr)) {
+		word = f->ram[addr];
+		for (i = 0; i < RAM_DATA_BITS; i++) {
+			word[i] = (word[i] & ~we) | (d[i] & we);
+		}
+		return;
+	}
+	for (k = 0; k < 64; k++) {
+		if ((we >> k) & 1) {
+			word = f->ram[lane_addr(a, bits, k)];
+			for (i = 0; i < RAM_DATA_BITS; i++) {
+				word[i] = (word[i] & ~(1ULL << k)) | (d[i] & (1ULL << k));
+			}
+		}
+	}
+}
+
+static void ram_read(const struct lotec_faultnet *f, const uint64_t *a, unsigned int bits, uint64_t *q)
+{
+	const uint64_t *word;
+	uint32_t addr;
+	unsigned int i;
+	unsigned int k;
+
+	if (same_addr(a, bits, &addr)) {
+		memcpy(q, f->ram[addr], RAM_DATA_BITS * sizeof(*q));
+		return;
+	}
+	memset(q, 0, RAM_DATA_BITS * sizeof(*q));
+	for (k = 0; k < 64; k++) {
+		word = f->ram[lane_addr(a, bits, k)];
+		for (i = 0; i < RAM_DATA_BITS; i++) {
+			q[i] |= word[i] & (1ULL << k);
+		}
+	}
+}
+
+""")
+	w("/* Evaluate the combinational logic of all machines, level by level */\n")
+	w("static void eval(struct lotec_faultnet *f)\n{\n\tuint64_t *restrict s = f->s;\n")
+	w("\tconst uint64_t *restrict m0 = f->m0;\n\tconst uint64_t *restrict m1 = f->m1;\n")
+	w("\tuint64_t x[64];\n\tuint64_t y[64];\n\tuint64_t c;\n\tuint64_t d;\n\tuint64_t e;\n")
+	level = 0
+	for node in nl.order:
+		if node.level != level:
+			level = node.level
+			w("\n\t/* level %d */\n" % level)
+		for line in emit_fault_node(node):
+			w("\t%s\n" % line)
+	w("\t(void)x;\n\t(void)y;\n\t(void)c;\n\t(void)d;\n\t(void)e;\n}\n\n")
+
+	def emit_clocked(elements, indent):
+		stores = []
+		slot = 0
+		for e in elements:
+			sample, store = emit_fault_state(e, slot)
+			slot += e.num("Bits", "1")
+			for line in sample:
+				w("%s%s\n" % (indent, line))
+			stores += store
+		for line in stores:
+			w("%s%s\n" % (indent, line))
+
+	w("/* One period of the clock in all machines, see lotec_netlist_clock().\n")
+	w(" * A derived clock rises in the machines of the mask r.\n */\n")
+	w("void lotec_faultnet_clock(struct lotec_faultnet *f)\n{\n\tuint64_t *restrict s = f->s;\n")
+	w("\tconst uint64_t *restrict m0 = f->m0;\n\tconst uint64_t *restrict m1 = f->m1;\n")
+	w("\tuint64_t nx[%d];\n\tuint64_t rose[NUM_CLOCKS];\n\tuint64_t any;\n" % max(1, state_bits))
+	w("\tuint64_t r = ~0ULL;\n\tuint64_t c;\n\tuint64_t d;\n\tint i;\n\n")
+	emit_clocked([e for e in state if e.pins["C"] is nl.clock], "\t")
+	w("\teval(f);\n")
+	if clocks:
+		w("\tfor (i = 0; i < %d; i++) {\n\t\tany = 0;\n" % (len(state) + 1))
+		for c, net in enumerate(clocks):
+			w("\t\trose[%d] = %s & ~f->clk[%d];\n" % (c, s(net, 0), c))
+			w("\t\tf->clk[%d] = %s;\n" % (c, s(net, 0)))
+			w("\t\tany |= rose[%d];\n" % c)
+		w("\t\tif (!any) {\n\t\t\tbreak;\n\t\t}\n")
+		for c, net in enumerate(clocks):
+			w("\t\tif (rose[%d]) {\n\t\t\tr = rose[%d];\n" % (c, c))
+			emit_clocked([e for e in state if e.pins["C"] is net], "\t\t\t")
+			w("\t\t}\n")
+		w("\t\teval(f);\n\t}\n")
+	else:
+		w("\t(void)rose;\n\t(void)any;\n\t(void)i;\n")
+	w("\t(void)r;\n\t(void)c;\n\t(void)d;\n}\n\n")
+
+	w("""/* Set the faults, clear the state and settle the logic. Bit k of sa0[i]
+ * and sa1[i] sticks bit i of the nets at 0 or 1 in machine k. The ROM and
+ * RAM are kept.
+ */
+void lotec_faultnet_reset(struct lotec_faultnet *f, const uint64_t *sa0, const uint64_t *sa1)
+{
+	uint64_t *s = f->s;
+	const uint64_t *m0 = f->m0;
+	const uint64_t *m1 = f->m1;
+	unsigned int i;
+
+	for (i = 0; i < NUM_BITS; i++) {
+		f->m0[i] = ~sa0[i];
+		f->m1[i] = sa1[i] & ~sa0[i];
+		f->s[i] = f->m1[i];
+	}
+""")
+	for e in nl.elements:
+		if e.kind in ("Const", "Reset"):
+			net = e.pins["out"]
+			value = e.num("Value", "1") if e.kind == "Const" else 0
+			for i in range(net.width):
+				w("\t%s\n" % put(net, i, "~0ULL" if (value >> i) & 1 else "0"))
+	w("\teval(f);\n")
+	for c, net in enumerate(clocks):
+		w("\tf->clk[%d] = %s;\n" % (c, s(net, 0)))
+	w("}\n\n")
+
+	w("""struct lotec_faultnet *lotec_faultnet_alloc(void)
+{
+	return calloc(1, sizeof(struct lotec_faultnet));
+}
+
+void lotec_faultnet_free(struct lotec_faultnet *f)
+{
+	free(f);
+}
+
+const struct lotec_faultnet_net *lotec_faultnet_nets(unsigned int *num, unsigned int *bits)
+{
+	*num = NUM_NETS;
+	*bits = NUM_BITS;
+	return nets;
+}
+
+const uint64_t *lotec_faultnet_slices(const struct lotec_faultnet *f)
+{
+	return f->s;
+}
+
+void lotec_faultnet_set_rom(struct lotec_faultnet *f, const uint16_t *words, uint32_t size)
+{
+	f->rom = words;
+	f->rom_size = (size < (1U << ROM_ADDR_BITS)) ? size : (1U << ROM_ADDR_BITS);
+}
+
+/* Set the RAM of all machines to ram, the bytes after size to 0 */
+void lotec_faultnet_set_ram(struct lotec_faultnet *f, const uint8_t *ram, uint32_t size)
+{
+	uint32_t a;
+	unsigned int i;
+
+	for (a = 0; a < (1U << RAM_ADDR_BITS); a++) {
+		for (i = 0; i < RAM_DATA_BITS; i++) {
+			f->ram[a][i] = (a < size) ? -(uint64_t)((ram[a] >> i) & 1) : 0;
+		}
+	}
+}
+
+/* The machines whose RAM differs from ram, the bytes after size are 0 */
+uint64_t lotec_faultnet_ram_differs(const struct lotec_faultnet *f, const uint8_t *ram, uint32_t size)
+{
+	uint64_t differs = 0;
+	uint32_t a;
+	unsigned int i;
+
+	for (a = 0; a < (1U << RAM_ADDR_BITS); a++) {
+		for (i = 0; i < RAM_DATA_BITS; i++) {
+			differs |= f->ram[a][i] ^ ((a < size) ? -(uint64_t)((ram[a] >> i) & 1) : 0);
+		}
+	}
+	return differs;
+}
+""")
+
+def main():
+	args = sys.argv[1:]
+	faults = len(args) == 3 and args[0] == "-f"
+	if faults:
+		args = args[1:]
+	if len(args) != 2:
+		print("usage: dig2c.py [-f] circuit.dig output.c", file=sys.stderr)
+		print(" -f  Generate the bit-parallel fault simulator", file=sys.stderr)
+		return 1
+	try:
+		nl = load(args[0])
+		with open(args[1], "w") as fout:
+			(emit_faults if faults else emit_c)(nl, fout, args[0].split("/")[-1])
+	except (DigError, ET.ParseError, OSError) as err:
+		print("Error: %s." % err, file=sys.stderr)
+		return 3
+	return 0
+
+if __name__ == "__main__":
+	sys.exit(main())
@@ -0,0 +1,389 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+# Static timing analysis of a Digital circuit (dig/lotec.dig) with the
+# delays of a library of parts (74hc.lib). The circuit is read by dig2c.py.
+# The clocks derived from the master clock by the clock divider are decoded
+# from its count; paths start at the outputs of the clocked elements, run
+# through the combinational elements, the ROM and the RAM, and end at the
+# inputs of the clocked elements and the RAM writes. Every path must settle
+# within the master clock periods between its launching and its capturing
+# clock edge, which gives the minimum master clock period.
+#
+# usage: dig2sta.py [-l library] [-n paths] circuit.dig
+
+import getopt
+import os
+import sys
+import xml.etree.ElementTree as ET
+
+from dig2c import DigError, Net, STATE_ELEMENTS, comb_inputs, expand_splitting, load
+
+GATES = ("And", "Or", "XOr", "NAnd", "NOr")
+
+DEFAULT_LIBRARY = os.path.join(os.path.dirname(os.path.abspath(__file__)), "74hc.lib")
+DEFAULT_PATHS = 10
+
+def read_library(filename):
+	lib = {}
+	with open(filename) as fin:
+		for number, line in enumerate(fin, 1):
+			fields = line.split("#")[0].split()
+			if not fields:
+				continue
+			try:
+				values = [float(v) for v in fields[1:]]
+			except ValueError:
+				values = []
+			if len(values) not in (1, 3):
+				raise DigError("Invalid line %d in %s" % (number, filename))
+			lib[fields[0]] = (values[0], values[1], values[2]) if len(values) == 3 else (values[0], 0, 0)
+	return lib
+
+def lookup(lib, key):
+	if key not in lib:
+		raise DigError("No delay for %s in the library" % key)
+	return lib[key]
+
+# Units of the width of an element the delay of the library grows with
+def element_size(e):
+	k = e.kind
+	if k in GATES:
+		return e.num("Inputs", "2")
+	if k in ("Add", "Sub", "Comparator"):
+		return e.num("Bits", "1")
+	if k in ("Decoder", "Multiplexer", "PriorityEncoder"):
+		return e.num("Selector Bits", "1")
+	if k == "BarrelShifter":
+		return e.pins["shift"].width
+	return 1
+
+def node_delay(lib, node):
+	if isinstance(node, Net):
+		return lookup(lib, "Driver")[0]
+	delay, size, extra = lookup(lib, node.kind)
+	if size > 0:
+		delay += extra * (-(-element_size(node) // int(size)) - 1)
+	if node.kind in GATES and node.attr("inverterConfig", []):
+		delay += lookup(lib, "Inverter")[0]
+	return delay
+
+def node_outputs(node):
+	if isinstance(node, Net):
+		return [node]
+	return [net for name, net in node.pins.items() if net.driver == (node, name)]
+
+def node_name(node):
+	if isinstance(node, Net):
+		return "bus %s" % node.name()
+	return node.name()
+
+def state_outputs(e):
+	return [net for name, net in e.pins.items() if net.driver == (e, name)]
+
+# Value of a net of the clock logic for the given values of the clocked
+# elements
+def evaluate(net, values):
+	if net.index in values:
+		return values[net.index]
+	if net.driver is None:
+		raise DigError("Clock logic drives %s by a bus" % net.name())
+	e, pin = net.driver
+	k = e.kind
+	p = e.pins
+	m = (1 << net.width) - 1
+	if k in GATES:
+		inverted = e.attr("inverterConfig", [])
+		v = None
+		for name in sorted((n for n in p if n.startswith("In_")), key=lambda s: int(s[3:])):
+			x = evaluate(p[name], values)
+			if name in inverted:
+				x = ~x & m
+			if v is None:
+				v = x
+			elif k in ("And", "NAnd"):
+				v &= x
+			elif k in ("Or", "NOr"):
+				v |= x
+			else:
+				v ^= x
+		v = (~v if k in ("NAnd", "NOr") else v) & m
+	elif k == "Splitter":
+		t = 0
+		shift = 0
+		for i, w in enumerate(expand_splitting(e.attr("Input Splitting", "4,4"))):
+			t |= evaluate(p["in%d" % i], values) << shift
+			shift += w
+		shift = 0
+		for i, w in enumerate(expand_splitting(e.attr("Output Splitting", "8"))):
+			if p.get("out%d" % i) is net:
+				v = (t >> shift) & ((1 << w) - 1)
+			shift += w
+	elif k == "Decoder":
+		v = int(evaluate(p["sel"], values) == int(pin[4:]))
+	elif k == "Const":
+		v = e.num("Value", "1") & m
+	else:
+		raise DigError("Clock logic contains %s" % e.name())
+	values[net.index] = v
+	return v
+
+# Clocked elements in the combinational cone of a net
+def cone_state(net, seen=None):
+	seen = set() if seen is None else seen
+	if net.index in seen:
+		return []
+	seen.add(net.index)
+	if net.driver is None:
+		return []
+	e = net.driver[0]
+	if e.kind in STATE_ELEMENTS:
+		return [e]
+	found = []
+	for n in comb_inputs(e):
+		found += cone_state(n, seen)
+	return found
+
+class Clock:
+	def __init__(self, net, name):
+		self.net = net
+		self.name = name
+		self.rise = None	# count of the divider at the rising edge
+		self.delay = 0.0	# after the edge of the master clock
+		self.phase = "divider"
+
+# Derived clocks and the number of master clock periods of the divider
+def find_clocks(nl):
+	state = [e for e in nl.elements if e.kind in STATE_ELEMENTS]
+	master = Clock(nl.clock, "master clock")
+	clocks = {nl.clock.index: master}
+	for e in state:
+		net = e.pins["C"]
+		if net.index not in clocks:
+			clocks[net.index] = Clock(net, net.name())
+	dividers = []
+	for clock in clocks.values():
+		if clock is not master:
+			for e in cone_state(clock.net):
+				if e.kind != "Counter" or e.pins["C"] is not nl.clock:
+					raise DigError("Clock %s is not decoded from a counter on the master clock" % clock.name)
+				if e not in dividers:
+					dividers.append(e)
+	if len(dividers) > 1:
+		raise DigError("More than one clock divider")
+	count = 1
+	if dividers:
+		divider = dividers[0]
+		count = 1 << divider.num("Bits", "1")
+		out = divider.pins["out"]
+		for clock in clocks.values():
+			if clock is master:
+				continue
+			levels = [evaluate(clock.net, {out.index: v}) for v in range(count)]
+			rises = [v for v in range(count) if levels[v] and not levels[v - 1]]
+			if len(rises) != 1:
+				raise DigError("Clock %s doesn't rise once per count of %s" % (clock.name, divider.name()))
+			clock.rise = rises[0]
+	return master, clocks, count
+
+# Latest arrival at the nets from the outputs of the clocked elements of a
+# clock, with the node and input net it comes from. Derived clock nets are
+# only passed by the clock logic.
+def propagate(nl, lib, sources, clock_nets, through_clocks):
+	arrival = {}
+	for e in sources:
+		clk2q = lookup(lib, e.kind + ".clk2q")[0]
+		for net in state_outputs(e):
+			arrival[net.index] = (clk2q, e, None)
+	for node in nl.order:
+		best = None
+		for net in comb_inputs(node):
+			if net.index in arrival and (through_clocks or net.index not in clock_nets):
+				if best is None or arrival[net.index][0] > arrival[best.index][0]:
+					best = net
+		if best is None:
+			continue
+		t = arrival[best.index][0] + node_delay(lib, node)
+		for net in node_outputs(node):
+			if net.index not in clock_nets or through_clocks:
+				arrival[net.index] = (t, node, best)
+	return arrival
+
+def trace(arrival, net):
+	steps = []
+	while net is not None:
+		t, node, prev = arrival[net.index]
+		steps.append((t, node, net))
+		net = prev
+	steps.reverse()
+	return steps
+
+# Inputs of the clocked elements and the RAM: element, pin, capturing clock,
+# setup time
+def endpoints(nl, lib, clocks):
+	ends = []
+	for e in nl.elements:
+		if e.kind in STATE_ELEMENTS:
+			setup = lookup(lib, e.kind + ".setup")[0]
+			for name, net in e.pins.items():
+				if name != "C" and (e, name) in net.readers:
+					ends.append((e, name, clocks[e.pins["C"].index], setup))
+		elif e.kind == "RAMAsync":
+			gating = [clocks[i] for i in clocks if clocks[i].rise is not None and
+				clock_in_cone(e.pins["we"], clocks[i].net)]
+			if len(gating) != 1:
+				raise DigError("Write of %s is not gated by one derived clock" % e.name())
+			setup = lookup(lib, "RAMAsync.setup")[0]
+			for name in ("A", "D", "we"):
+				ends.append((e, name, gating[0], setup))
+	return ends
+
+def clock_in_cone(net, clock_net, seen=None):
+	seen = set() if seen is None else seen
+	if net is clock_net:
+		return True
+	if net.index in seen or net.driver is None or net.driver[0].kind in STATE_ELEMENTS:
+		return False
+	seen.add(net.index)
+	return any(clock_in_cone(n, clock_net, seen) for n in comb_inputs(net.driver[0]))
+
+# The clocks capturing paths from the ROM are the fetch phase, the others
+# the execute phase.
+def name_phases(nl, ends):
+	rom = next((e for e in nl.elements if e.kind == "ROM"), None)
+	if rom is None:
+		return
+	for e, name, clock, setup in ends:
+		if clock.rise is not None and any(n.driver == (rom, "D") for n in cone_nets(e.pins[name])):
+			clock.phase = "fetch"
+	for e, name, clock, setup in ends:
+		if clock.rise is not None and clock.phase != "fetch":
+			clock.phase = "execute"
+
+def cone_nets(net, seen=None):
+	seen = set() if seen is None else seen
+	if net.index in seen:
+		return []
+	seen.add(net.index)
+	nets = [net]
+	if net.driver is not None and net.driver[0].kind not in STATE_ELEMENTS:
+		for n in comb_inputs(net.driver[0]):
+			nets += cone_nets(n, seen)
+	for d in net.bus:
+		for n in (d.pins["in"], d.pins["sel"]):
+			nets += cone_nets(n, seen)
+	return nets
+
+def analyze(nl, lib):
+	master, clocks, count = find_clocks(nl)
+	clock_nets = set(i for i in clocks if clocks[i] is not master)
+	state = [e for e in nl.elements if e.kind in STATE_ELEMENTS]
+
+	# Insertion delay of the derived clocks
+	arrival = propagate(nl, lib, [e for e in state if e.pins["C"] is master.net], clock_nets, True)
+	for i in clock_nets:
+		clocks[i].delay = arrival[i][0] if i in arrival else 0.0
+
+	ends = endpoints(nl, lib, clocks)
+	name_phases(nl, ends)
+	paths = []
+	for launch in clocks.values():
+		sources = [e for e in state if e.pins["C"] is launch.net]
+		arrival = propagate(nl, lib, sources, clock_nets, False)
+		for e, name, capture, setup in ends:
+			net = e.pins[name]
+			if net.index not in arrival:
+				continue
+			if launch.rise is None or capture.rise is None:
+				periods = 1
+			else:
+				periods = (capture.rise - launch.rise) % count or count
+			total = launch.delay + arrival[net.index][0] + setup - capture.delay
+			paths.append({
+				"launch": launch, "capture": capture, "element": e, "pin": name, "setup": setup,
+				"periods": periods, "total": total, "period": total / periods,
+				"steps": trace(arrival, net)})
+	# The worst path to every endpoint
+	worst = {}
+	for p in paths:
+		key = (p["element"].index, p["pin"])
+		if key not in worst or p["period"] > worst[key]["period"]:
+			worst[key] = p
+	return clocks, count, sorted(worst.values(), key=lambda p: -p["period"])
+
+def mhz(period):
+	return 1000.0 / period if period > 0 else 0.0
+
+def report(fout, source, library, clocks, count, paths, num_paths):
+	w = fout.write
+	w("circuit %s, library %s\n" % (source, library))
+	derived = sorted((c for c in clocks.values() if c.rise is not None), key=lambda c: c.rise)
+	if derived:
+		w("clock divider: %d master clock periods\n" % count)
+	for c in derived:
+		w("  %s rises at count %d, %.1f ns after the master clock (%s)\n" % (c.name, c.rise, c.delay, c.phase))
+
+	w("\n%-10s %-8s %9s %10s %8s %10s %9s\n" % ("phase", "capture", "endpoints", "worst", "periods",
+		"min period", "max clock"))
+	for c in derived + [c for c in clocks.values() if c.rise is None]:
+		ps = [p for p in paths if p["capture"] is c]
+		if not ps:
+			continue
+		p = ps[0]
+		w("%-10s %-8s %9d %7.1f ns %8d %7.1f ns %5.1f MHz\n" % (c.phase, c.name, len(ps), p["total"],
+			p["periods"], p["period"], mhz(p["period"])))
+	if not paths:
+		w("no paths\n")
+		return
+	period = paths[0]["period"]
+	w("\nminimum master clock period %.1f ns: %.2f MHz master clock" % (period, mhz(period)))
+	if derived:
+		w(", %.2f M instructions/s" % (mhz(period) / count))
+	w("\n")
+
+	for rank, p in enumerate(paths[:num_paths], 1):
+		w("\n#%d %s: %s %s, %.1f ns in %d periods, %.1f ns per period\n" % (rank, p["capture"].phase,
+			p["element"].name(), p["pin"], p["total"], p["periods"], p["period"]))
+		w("  %8s %7s  %-36s %s\n" % ("time", "delay", "element", "net"))
+		w("  %8.1f %7s  %-36s\n" % (p["launch"].delay, "", "%s rises" % p["launch"].name))
+		last = 0.0
+		for t, node, net in p["steps"]:
+			w("  %8.1f %7.1f  %-36s %s\n" % (p["launch"].delay + t, t - last, node_name(node), net.name()))
+			last = t
+		w("  %8.1f %7.1f  %-36s\n" % (p["launch"].delay + last + p["setup"], p["setup"], "setup"))
+		w("  %8s %7s  %s rises %d periods later, %.1f ns after the master clock\n" % ("", "",
+			p["capture"].name, p["periods"], p["capture"].delay))
+
+def usage():
+	print("usage: dig2sta.py [-l library] [-n paths] circuit.dig", file=sys.stderr)
+	print(" -l library  Delays of the parts (default %s)" % DEFAULT_LIBRARY, file=sys.stderr)
+	print(" -n paths    Number of critical paths to print (default %d)" % DEFAULT_PATHS, file=sys.stderr)
+
+def main():
+	library = DEFAULT_LIBRARY
+	num_paths = DEFAULT_PATHS
+	try:
+		opts, args = getopt.getopt(sys.argv[1:], "l:n:")
+		for opt, value in opts:
+			if opt == "-l":
+				library = value
+			else:
+				num_paths = int(value, 0)
+	except (getopt.GetoptError, ValueError):
+		usage()
+		return 1
+	if len(args) != 1:
+		usage()
+		return 1
+	try:
+		lib = read_library(library)
+		nl = load(args[0])
+		clocks, count, paths = analyze(nl, lib)
+	except (DigError, ET.ParseError, OSError) as err:
+		print("Error: %s." % err, file=sys.stderr)
+		return 3
+	report(sys.stdout, args[0].split("/")[-1], library.split("/")[-1], clocks, count, paths, num_paths)
+	return 0
+
+if __name__ == "__main__":
+	sys.exit(main())
@@ -0,0 +1,41 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-3.0-or-later
+# Writes a ROM which fills the code cache of the JIT until it is flushed,
+# for comparing -e jit with the interpreter. A dispatcher at 0 jumps with
+# J R4, R2 to an ever changing word of the sleds every 64 words from $1000,
+# each sled runs into LI PCH / LI PCL back to the dispatcher. The blocks
+# start at any word of a sled and are chained to the J of the dispatcher.
+import sys
+
+def main():
+	if len(sys.argv) != 2:
+		print("flushrom.py file")
+		print("Writes a ROM which makes the JIT flush its code cache")
+		return 1
+
+	words = [0] * 0x10000
+	dispatcher = [
+		(2 << 11) | (2 << 8) | 0x01,		# ADDI R2, #$01
+		(7 << 11) | (2 << 8) | 0x00,		# CMPI R2, #$00
+		(31 << 11) | (4 << 8) | 0x01,		# BNE go
+		(2 << 11) | (3 << 8) | 0x3B,		# ADDI R3, #$3B
+		(17 << 11) | (4 << 8) | (3 << 5),	# go: MOV R4, R3
+		(4 << 11) | (4 << 8) | 0x10,		# ORI R4, #$10
+		(30 << 11) | (0 << 8) | (4 << 5) | (2 << 2),	# J R4, R2
+	]
+	words[0:len(dispatcher)] = dispatcher
+	for sled in range(0x1000, 0x10000, 64):
+		for i in range(0, 62, 2):
+			words[sled + i] = (24 << 11) | (0 << 8) | (1 << 5) | (0 << 2)	# SHR R0, R1, R0
+			words[sled + i + 1] = (25 << 11) | (1 << 8) | (1 << 5) | (0 << 2)	# ROL R1, R0
+		words[sled + 61] = (5 << 11) | (1 << 8) | ((sled >> 6) & 0xFF)	# XORI R1, #imm
+		words[sled + 62] = (1 << 11) | (7 << 8) | 0x00		# LI PCH, #$00
+		words[sled + 63] = (1 << 11) | (6 << 8) | 0x00		# LI PCL, #$00
+
+	with open(sys.argv[1], "w") as f:
+		f.write("v2.0 raw\n")
+		for w in words:
+			f.write("%x\n" % w)
+	return 0
+
+sys.exit(main())
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-3.0-or-later
+# Writes ROMs of random instructions as hex files for lotec-ass output, for
+# checking the engines against each other. The instructions are drawn from
+# the implemented opcodes, branches go a short distance and the last
+# instruction branches back to the first, so the ROMs loop and set and test
+# the flags a lot. J and writes to PCL are rare, they leave the ROM.
+import getopt
+import os
+import random
+import sys
+
+OPCODES = [0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 17, 18, 19, 20, 21, 22, 23, 24, 25, 28, 29, 30, 31]
+
+def usage():
+	print("randrom.py [-n roms] [-w words] [-s seed] directory")
+	print("Writes ROMs of random instructions")
+	print(" -n roms       Number of ROMs (default 16)")
+	print(" -w words      Instructions per ROM, 2 - 128 (default 128)")
+	print(" -s seed       Seed of the random numbers (default 1)")
+
+def insn(rnd, words, pc):
+	op = rnd.choice(OPCODES)
+	if op == 31:
+		# B within the ROM, not to itself
+		offset = 0
+		while offset == 0:
+			offset = rnd.randrange(-16, 16)
+		target = min(max(pc + 1 + offset, 0), words - 1)
+		return (op << 11) | (rnd.randrange(8) << 8) | ((target - pc - 1) & 0xFF)
+	if op == 30:
+		# J with the registers as address, mostly never taken
+		cond = rnd.choice([1, 2, 3, 4, 5, 6]) if rnd.randrange(16) == 0 else 7
+		return (op << 11) | (cond << 8) | (rnd.randrange(8) << 5) | (rnd.randrange(8) << 2)
+	if rnd.randrange(64) == 0:
+		rd = rnd.choice([6, 7])
+	else:
+		rd = rnd.choice([0, 1, 2, 3, 4, 5, 5])
+	return (op << 11) | (rd << 8) | (rnd.randrange(256) & (0xFF if op < 17 or op >= 28 else 0xFC))
+
+def main():
+	roms = 16
+	words = 128
+	seed = 1
+	try:
+		opts, args = getopt.getopt(sys.argv[1:], "n:w:s:")
+	except getopt.GetoptError:
+		usage()
+		return 1
+	for opt, arg in opts:
+		if opt == "-n":
+			roms = int(arg, 0)
+		elif opt == "-w":
+			words = int(arg, 0)
+		elif opt == "-s":
+			seed = int(arg, 0)
+	if (len(args) != 1) or (words < 2) or (words > 128):
+		usage()
+		return 1
+
+	os.makedirs(args[0], exist_ok=True)
+	rnd = random.Random(seed)
+	for i in range(roms):
+		with open(os.path.join(args[0], "random%03u.hex" % i), "w") as f:
+			f.write("v2.0 raw\n")
+			for pc in range(words - 1):
+				f.write("%x\n" % insn(rnd, words, pc))
+			f.write("%x\n" % ((31 << 11) | (-words & 0xFF)))
+	return 0
+
+sys.exit(main())
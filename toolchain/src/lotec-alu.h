@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef LOTECALU_H
+#define LOTECALU_H
+
+#include <stdint.h>
+
+#include "lotec-cpu.h"
+
+/* The ALU mirrors dig/lotec.dig: ADD and SUB use the carry flag as input, but
+ * only ADDI, SUBI and the shifts write it. Only CMP and CMPI write the
+ * greater, equal and less flags.
+ */
+static inline uint8_t alu_add(uint8_t a, uint8_t b, uint8_t *flags)
+{
+	unsigned int t;
+
+	t = a + b + (*flags & FLAG_C);
+	*flags = (*flags & ~FLAG_C) | ((t >> 8) & 1);
+	return t;
+}
+
+static inline uint8_t alu_sub(uint8_t a, uint8_t b, uint8_t *flags)
+{
+	unsigned int t;
+
+	t = a - b - (*flags & FLAG_C);
+	*flags = (*flags & ~FLAG_C) | ((t >> 8) & 1);
+	return t;
+}
+
+static inline uint8_t alu_cmp(uint8_t a, uint8_t b, uint8_t flags)
+{
+	return (flags & FLAG_C) | ((a > b) << 1) | ((a == b) << 2) | ((a < b) << 3);
+}
+
+/* Both barrel shifters work on 18 bits. SHL shifts {Rd, Rs, C} and takes the
+ * result from bits 9 - 16 and the carry from bit 17. SHR shifts {C, Rs, Rd, 0}
+ * and takes the result from bits 1 - 8 and the carry from bit 0. Shifting
+ * Rd by 8 + n with Rs = Rd is a shift, shifting by less is a rotation.
+ */
+static inline uint8_t alu_shl(uint8_t a, uint8_t b, uint8_t n, uint8_t *flags)
+{
+	uint32_t v;
+
+	v = (*flags & FLAG_C) | ((uint32_t)b << 1) | ((uint32_t)a << 9);
+	v <<= n;
+	*flags = (*flags & ~FLAG_C) | ((v >> 17) & 1);
+	return v >> 9;
+}
+
+static inline uint8_t alu_shr(uint8_t a, uint8_t b, uint8_t n, uint8_t *flags)
+{
+	uint32_t v;
+
+	v = ((uint32_t)a << 1) | ((uint32_t)b << 9) | ((uint32_t)(*flags & FLAG_C) << 17);
+	v >>= n;
+	*flags = (*flags & ~FLAG_C) | (v & 1);
+	return v >> 1;
+}
+
+#endif
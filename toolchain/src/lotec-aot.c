@@ -0,0 +1,801 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lotec-cpu.h"
+#include "lotec-disasm.h"
+
+/* Ahead of time translation of a ROM image to C. Every reachable instruction
+ * becomes a few lines of C in address order, B becomes a goto and J or writes
+ * to PCL whose target is not known at translation time go through a dense
+ * table of label addresses. The generated program runs the ROM from reset
+ * and prints the same state as lotec-sim.
+ */
+
+/* Value of a register in the constant propagation */
+#define CP_UNDEF -1
+#define CP_NAC 0x100
+
+/* Tracked registers: R0 - R4 and the PCH latch */
+#define CP_PCH 5
+#define CP_REGS 6
+
+struct cp_state {
+	int16_t v[CP_REGS];
+};
+
+struct aot {
+	const struct lotec_rom *rom;
+	uint32_t size;
+	struct cp_state *in;
+	uint8_t *reached;
+	uint8_t *label;
+	uint32_t *work;
+	uint32_t num_work;
+	int dynamic;
+	int outside;
+};
+
+/* The generated program takes the ALU of the simulator from lotec-alu.h, it
+ * is compiled with the sources of the toolchain in the include path.
+ */
+static const char preamble[] =
+	"#include <stdio.h>\n"
+	"#include <stdint.h>\n"
+	"#include <stdlib.h>\n"
+	"#include <string.h>\n"
+	"#include <unistd.h>\n"
+	"\n"
+	"#include \"lotec-alu.h\"\n"
+	"\n"
+	"struct cpu {\n"
+	"\tuint8_t r[5];\n"
+	"\tuint8_t flags;\n"
+	"\tuint8_t pch;\n"
+	"\tuint16_t pc;\n"
+	"\tuint64_t cycles;\n"
+	"\tuint64_t insns;\n"
+	"\tuint8_t ram[RAM_SIZE];\n"
+	"};\n"
+	"\n"
+	"static const uint16_t cond_mask[8] = {\n"
+	"\t0xFFFF, 0xF0F0, 0xCCCC, 0xFF00, 0x0F0F, 0xFCFC, 0xFFF0, 0x0000,\n"
+	"};\n"
+	"\n"
+	"#define COND(cond) ((cond_mask[(cond)] >> flags) & 1)\n"
+	"\n"
+	"/* Check the cycle budget before executing the instruction at address a */\n"
+	"#define STEP(a) do { \\\n"
+	"\t\tif (budget <= 0) { \\\n"
+	"\t\t\tpc = (a); \\\n"
+	"\t\t\tgoto out; \\\n"
+	"\t\t} \\\n"
+	"\t\tbudget--; \\\n"
+	"\t} while (0)\n"
+	"\n"
+	"/* The NOP fetched after a taken branch */\n"
+	"#define TAKEN() do { \\\n"
+	"\t\tbudget--; \\\n"
+	"\t\tbubbles++; \\\n"
+	"\t} while (0)\n"
+	"\n";
+
+static const char postamble[] =
+	"static void print_state(const struct cpu *cpu, int reason, int dump_ram)\n"
+	"{\n"
+	"\tint i;\n"
+	"\n"
+	"\tprintf(\"exit=%s\\n\", (reason == EXIT_HALT) ? \"halt\" : \"limit\");\n"
+	"\tprintf(\"R0=%02X R1=%02X R2=%02X R3=%02X R4=%02X FLAGS=%02X PCH=%02X PC=$%04X\\n\",\n"
+	"\t\tcpu->r[0], cpu->r[1], cpu->r[2], cpu->r[3], cpu->r[4],\n"
+	"\t\tcpu->flags, cpu->pch, cpu->pc << 1);\n"
+	"\tprintf(\"cycles=%llu insns=%llu\\n\",\n"
+	"\t\t(unsigned long long)cpu->cycles, (unsigned long long)cpu->insns);\n"
+	"\tif (!dump_ram) {\n"
+	"\t\treturn;\n"
+	"\t}\n"
+	"\tfor (i = 0; i < RAM_SIZE; i++) {\n"
+	"\t\tif ((i % 16) == 0) {\n"
+	"\t\t\tprintf(\"%02X:\", i);\n"
+	"\t\t}\n"
+	"\t\tprintf(\" %02X\", cpu->ram[i]);\n"
+	"\t\tif ((i % 16) == 15) {\n"
+	"\t\t\tprintf(\"\\n\");\n"
+	"\t\t}\n"
+	"\t}\n"
+	"}\n"
+	"\n"
+	"/* Run the ROM from reset once per RAM image given on the command line. */\n"
+	"int main(int argc, char *argv[])\n"
+	"{\n"
+	"\tstruct cpu cpu;\n"
+	"\tuint64_t max_cycles = 100000000ULL;\n"
+	"\tint dump_ram = 0;\n"
+	"\tint reason;\n"
+	"\tint opt;\n"
+	"\tint i;\n"
+	"\tFILE *fin;\n"
+	"\n"
+	"\twhile ((opt = getopt(argc, argv, \"c:m\")) != -1) {\n"
+	"\t\tswitch (opt) {\n"
+	"\t\t\tcase 'c':\n"
+	"\t\t\t\tmax_cycles = strtoull(optarg, NULL, 0);\n"
+	"\t\t\t\tbreak;\n"
+	"\t\t\tcase 'm':\n"
+	"\t\t\t\tdump_ram = 1;\n"
+	"\t\t\t\tbreak;\n"
+	"\t\t\tdefault:\n"
+	"\t\t\t\tprintf(\"%s [-c cycles] [-m] [RAM file ...]\\n\", argv[0]);\n"
+	"\t\t\t\treturn 1;\n"
+	"\t\t}\n"
+	"\t}\n"
+	"\ti = optind;\n"
+	"\tdo {\n"
+	"\t\tmemset(&cpu, 0, sizeof(cpu));\n"
+	"\t\tif (i < argc) {\n"
+	"\t\t\tfin = fopen(argv[i], \"rb\");\n"
+	"\t\t\tif ((fin == NULL) || (fread(cpu.ram, 1, sizeof(cpu.ram), fin) == 0)) {\n"
+	"\t\t\t\tfprintf(stderr, \"Error: Failed to read RAM image '%s'.\\n\", argv[i]);\n"
+	"\t\t\t\treturn 2;\n"
+	"\t\t\t}\n"
+	"\t\t\tfclose(fin);\n"
+	"\t\t\tif (argc - optind > 1) {\n"
+	"\t\t\t\tprintf(\"ram=%s\\n\", argv[i]);\n"
+	"\t\t\t}\n"
+	"\t\t}\n"
+	"\t\treason = run(&cpu, max_cycles);\n"
+	"\t\tprint_state(&cpu, reason, dump_ram);\n"
+	"\t\ti++;\n"
+	"\t} while (i < argc);\n"
+	"\treturn 0;\n"
+	"}\n";
+
+static int16_t cp_meet(int16_t a, int16_t b)
+{
+	if (a == CP_UNDEF) {
+		return b;
+	}
+	if ((b == CP_UNDEF) || (a == b)) {
+		return a;
+	}
+	return CP_NAC;
+}
+
+static int16_t cp_read(const struct cp_state *s, uint8_t reg, uint16_t addr)
+{
+	switch (reg) {
+		case REG_FLAGS:
+			return CP_NAC;
+		case REG_PCL:
+			return (addr + 1) & 0xFF;
+		case REG_PCH:
+			return ((addr + 1) >> 8) & 0xFF;
+		default:
+			return s->v[reg];
+	}
+}
+
+static int16_t cp_binop(uint8_t opcode, int16_t a, int16_t b)
+{
+	if ((a == CP_NAC) || (b == CP_NAC)) {
+		return CP_NAC;
+	}
+	switch (opcode) {
+		case OP_ANDI:
+		case OP_AND:
+			return a & b;
+		case OP_ORI:
+		case OP_OR:
+			return a | b;
+		default:
+			return a ^ b;
+	}
+}
+
+/* Merge a state into the entry state of addr and queue it if it changed. */
+static void cp_flow(struct aot *aot, uint32_t addr, const struct cp_state *s)
+{
+	struct cp_state *in;
+	int changed = 0;
+	int16_t v;
+	int i;
+
+	if (addr >= aot->size) {
+		/* Only NOPs up to the end of the address space, then address 0 */
+		aot->outside = 1;
+		addr = 0;
+	}
+	in = &aot->in[addr];
+	for (i = 0; i < CP_REGS; i++) {
+		v = cp_meet(in->v[i], s->v[i]);
+		if (v != in->v[i]) {
+			in->v[i] = v;
+			changed = 1;
+		}
+	}
+	if (!aot->reached[addr]) {
+		aot->reached[addr] = 1;
+		changed = 1;
+	}
+	if (changed) {
+		aot->work[aot->num_work++] = addr;
+	}
+}
+
+static void cp_nac(struct cp_state *s)
+{
+	int i;
+
+	for (i = 0; i < CP_REGS; i++) {
+		s->v[i] = CP_NAC;
+	}
+}
+
+/* Jump target of J or a write to PCL, -1 if not constant. */
+static int32_t cp_target(int16_t hi, int16_t lo)
+{
+	if ((hi == CP_NAC) || (lo == CP_NAC) || (hi == CP_UNDEF) || (lo == CP_UNDEF)) {
+		return -1;
+	}
+	return (hi << 8) | lo;
+}
+
+static void cp_jump(struct aot *aot, int32_t target, const struct cp_state *s)
+{
+	struct cp_state all;
+	uint32_t i;
+
+	if (target >= 0) {
+		aot->label[((uint32_t)target < aot->size) ? target : 0] = 1;
+		cp_flow(aot, target, s);
+		return;
+	}
+	if (aot->dynamic) {
+		return;
+	}
+	/* Any address may be the target, with any register contents. */
+	aot->dynamic = 1;
+	cp_nac(&all);
+	for (i = 0; i < aot->size; i++) {
+		aot->label[i] = 1;
+		cp_flow(aot, i, &all);
+	}
+}
+
+/* Propagate the state through the instruction at addr. */
+static void cp_insn(struct aot *aot, uint32_t addr)
+{
+	const struct cp_state *in = &aot->in[addr];
+	struct cp_state s = *in;
+	uint16_t insn;
+	uint8_t opcode;
+	uint8_t rd;
+	uint8_t cond;
+	uint32_t next;
+	int16_t v;
+	int fallthrough = 1;
+
+	insn = aot->rom->words[addr];
+	opcode = INSN_OPCODE(insn);
+	rd = INSN_RD(insn);
+	cond = INSN_COND(insn);
+	next = addr + 1;
+
+	if (aot->rom->ops[addr].uop == UOP_HALT) {
+		return;
+	}
+
+	switch (opcode) {
+		case OP_LI:
+		case OP_MOV:
+		case OP_ANDI:
+		case OP_ORI:
+		case OP_XORI:
+		case OP_AND:
+		case OP_OR:
+		case OP_XOR:
+		case OP_ADDI:
+		case OP_ADD:
+		case OP_SUBI:
+		case OP_SUB:
+		case OP_SHRI:
+		case OP_SHR:
+		case OP_SHLI:
+		case OP_SHL:
+		case OP_LDB:
+			if (opcode == OP_LI) {
+				v = INSN_IMM8(insn);
+			} else if (opcode == OP_MOV) {
+				v = cp_read(in, INSN_RS(insn), addr);
+			} else if ((opcode >= OP_ANDI) && (opcode <= OP_XORI)) {
+				v = cp_binop(opcode, cp_read(in, rd, addr), INSN_IMM8(insn));
+			} else if ((opcode >= OP_AND) && (opcode <= OP_XOR)) {
+				v = cp_binop(opcode, cp_read(in, rd, addr), cp_read(in, INSN_RS(insn), addr));
+			} else {
+				/* Depends on the carry flag or the RAM */
+				v = CP_NAC;
+			}
+			if (rd <= REG_R4) {
+				s.v[rd] = v;
+			} else if (rd == REG_PCH) {
+				s.v[CP_PCH] = v;
+			} else if (rd == REG_PCL) {
+				cp_jump(aot, cp_target(in->v[CP_PCH], v), &s);
+				fallthrough = 0;
+			}
+			break;
+
+		case OP_JUMP:
+			if (cond == COND_NV) {
+				break;
+			}
+			cp_jump(aot, cp_target(cp_read(in, INSN_RS(insn), addr),
+				cp_read(in, INSN_RT(insn), addr)), &s);
+			fallthrough = (cond != COND_AL);
+			break;
+
+		case OP_BRANCH:
+			if (cond == COND_NV) {
+				break;
+			}
+			cp_jump(aot, (uint16_t)(next + (int8_t)INSN_IMM8(insn)), &s);
+			fallthrough = (cond != COND_AL);
+			break;
+
+		default:
+			break;
+	}
+	if (fallthrough) {
+		if (next >= ROM_WORDS) {
+			aot->label[0] = 1;
+		}
+		cp_flow(aot, next & 0xFFFF, &s);
+	}
+}
+
+static int analyse(struct aot *aot)
+{
+	struct cp_state reset;
+	uint32_t addr;
+
+	aot->in = malloc(ROM_WORDS * sizeof(*aot->in));
+	aot->reached = calloc(ROM_WORDS, 1);
+	aot->label = calloc(ROM_WORDS, 1);
+	/* Every address is queued at most once per change of its state, which
+	 * happens at most three times per register.
+	 */
+	aot->work = malloc((CP_REGS * 3 + 2) * ROM_WORDS * sizeof(*aot->work));
+	if ((aot->in == NULL) || (aot->reached == NULL) || (aot->label == NULL) || (aot->work == NULL)) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		return 2;
+	}
+	memset(aot->in, 0xFF, ROM_WORDS * sizeof(*aot->in));
+
+	/* All registers are zero after reset. */
+	memset(&reset, 0, sizeof(reset));
+	aot->label[0] = 1;
+	aot->num_work = 0;
+	cp_flow(aot, 0, &reset);
+	while (aot->num_work > 0) {
+		addr = aot->work[--aot->num_work];
+		cp_insn(aot, addr);
+	}
+	return 0;
+}
+
+/* C expression reading a register, PCL and PCH are constants. */
+static const char *c_reg(uint8_t reg, uint16_t addr, char *buf)
+{
+	static const char *const names[] = { "r0", "r1", "r2", "r3", "r4", "flags" };
+	uint16_t next = addr + 1;
+
+	switch (reg) {
+		case REG_PCL:
+			sprintf(buf, "0x%02X", next & 0xFF);
+			return buf;
+		case REG_PCH:
+			sprintf(buf, "0x%02X", next >> 8);
+			return buf;
+		default:
+			return names[reg];
+	}
+}
+
+static void emit_goto(FILE *fout, struct aot *aot, uint32_t target)
+{
+	if (target >= aot->size) {
+		fprintf(fout, "\t\tt = 0x%04X;\n", target);
+		fprintf(fout, "\t\tgoto outside;\n");
+	} else {
+		fprintf(fout, "\t\tgoto L_%04X;\n", target);
+	}
+}
+
+/* Write value, a C expression, to register rd. */
+static void emit_write(FILE *fout, struct aot *aot, uint32_t addr, uint8_t rd, const char *value)
+{
+	int16_t pch;
+
+	switch (rd) {
+		case REG_FLAGS:
+			fprintf(fout, "\tflags = (%s) & FLAG_MASK;\n", value);
+			break;
+		case REG_PCH:
+			fprintf(fout, "\tpch = %s;\n", value);
+			break;
+		case REG_PCL:
+			fprintf(fout, "\t{\n");
+			fprintf(fout, "\t\tuint8_t v = %s;\n", value);
+			fprintf(fout, "\t\tTAKEN();\n");
+			pch = aot->in[addr].v[CP_PCH];
+			if ((pch != CP_NAC) && (pch != CP_UNDEF)) {
+				fprintf(fout, "\t\tt = 0x%02X00 | v;\n", pch);
+			} else {
+				fprintf(fout, "\t\tt = (pch << 8) | v;\n");
+			}
+			fprintf(fout, "\t\tgoto dispatch;\n");
+			fprintf(fout, "\t}\n");
+			break;
+		default:
+			fprintf(fout, "\tr%u = %s;\n", rd, value);
+			break;
+	}
+}
+
+/* Target of a write to PCL, -1 if it is not constant or the instruction
+ * also changes the flags. See cp_insn().
+ */
+static int32_t const_pcl(struct aot *aot, uint32_t addr, uint8_t opcode, uint16_t insn)
+{
+	const struct cp_state *in = &aot->in[addr];
+
+	if (opcode == OP_LI) {
+		return cp_target(in->v[CP_PCH], INSN_IMM8(insn));
+	}
+	if (opcode == OP_MOV) {
+		return cp_target(in->v[CP_PCH], cp_read(in, INSN_RS(insn), addr));
+	}
+	if ((opcode >= OP_ANDI) && (opcode <= OP_XORI)) {
+		return cp_target(in->v[CP_PCH], cp_binop(opcode, cp_read(in, REG_PCL, addr), INSN_IMM8(insn)));
+	}
+	if ((opcode >= OP_AND) && (opcode <= OP_XOR)) {
+		return cp_target(in->v[CP_PCH], cp_binop(opcode, cp_read(in, REG_PCL, addr),
+			cp_read(in, INSN_RS(insn), addr)));
+	}
+	return -1;
+}
+
+static void emit_insn(FILE *fout, struct aot *aot, uint32_t addr)
+{
+	uint16_t insn;
+	uint8_t opcode;
+	uint8_t rd;
+	uint8_t rs;
+	uint8_t rt;
+	uint8_t cond;
+	uint8_t imm8;
+	uint32_t next;
+	int32_t target;
+	int fallthrough = 1;
+	char a[8];
+	char b[8];
+	char c[8];
+	char value[64];
+
+	insn = aot->rom->words[addr];
+	opcode = INSN_OPCODE(insn);
+	rd = INSN_RD(insn);
+	rs = INSN_RS(insn);
+	rt = INSN_RT(insn);
+	cond = INSN_COND(insn);
+	imm8 = INSN_IMM8(insn);
+	next = addr + 1;
+
+	if (aot->label[addr]) {
+		fprintf(fout, "L_%04X:\n", addr);
+	}
+	fprintf(fout, "\t/* %04X: ", addr << 1);
+	print_insn(fout, addr << 1, insn);
+	fprintf(fout, " */\n");
+	fprintf(fout, "\tSTEP(0x%04X);\n", addr);
+
+	if (aot->rom->ops[addr].uop == UOP_HALT) {
+		fprintf(fout, "\tbudget++;\n");
+		fprintf(fout, "\tpc = 0x%04X;\n", addr);
+		fprintf(fout, "\treason = EXIT_HALT;\n");
+		fprintf(fout, "\tgoto out;\n");
+		return;
+	}
+
+	/* Writes to PCL with a constant target become a goto. */
+	if (rd == REG_PCL) {
+		target = const_pcl(aot, addr, opcode, insn);
+		if (target >= 0) {
+			fprintf(fout, "\tTAKEN();\n");
+			emit_goto(fout, aot, target);
+			return;
+		}
+	}
+
+	switch (opcode) {
+		case OP_LI:
+			sprintf(value, "0x%02X", imm8);
+			emit_write(fout, aot, addr, rd, value);
+			fallthrough = (rd != REG_PCL);
+			break;
+
+		case OP_ADDI:
+		case OP_SUBI:
+			sprintf(value, "alu_%s(%s, 0x%02X, &flags)", (opcode == OP_ADDI) ? "add" : "sub",
+				c_reg(rd, addr, a), imm8);
+			emit_write(fout, aot, addr, rd, value);
+			fallthrough = (rd != REG_PCL);
+			break;
+
+		case OP_ADD:
+		case OP_SUB:
+			sprintf(value, "%s %c %s %c (flags & FLAG_C)", c_reg(rd, addr, a),
+				(opcode == OP_ADD) ? '+' : '-', c_reg(rs, addr, b),
+				(opcode == OP_ADD) ? '+' : '-');
+			emit_write(fout, aot, addr, rd, value);
+			fallthrough = (rd != REG_PCL);
+			break;
+
+		case OP_ANDI:
+		case OP_ORI:
+		case OP_XORI:
+			sprintf(value, "%s %c 0x%02X", c_reg(rd, addr, a),
+				(opcode == OP_ANDI) ? '&' : ((opcode == OP_ORI) ? '|' : '^'), imm8);
+			emit_write(fout, aot, addr, rd, value);
+			fallthrough = (rd != REG_PCL);
+			break;
+
+		case OP_AND:
+		case OP_OR:
+		case OP_XOR:
+			sprintf(value, "%s %c %s", c_reg(rd, addr, a),
+				(opcode == OP_AND) ? '&' : ((opcode == OP_OR) ? '|' : '^'), c_reg(rs, addr, b));
+			emit_write(fout, aot, addr, rd, value);
+			fallthrough = (rd != REG_PCL);
+			break;
+
+		case OP_CMPI:
+			fprintf(fout, "\tflags = alu_cmp(%s, 0x%02X, flags);\n", c_reg(rd, addr, a), imm8);
+			break;
+
+		case OP_CMP:
+			fprintf(fout, "\tflags = alu_cmp(%s, %s, flags);\n", c_reg(rd, addr, a), c_reg(rs, addr, b));
+			break;
+
+		case OP_SHRI:
+		case OP_SHLI:
+			sprintf(value, "alu_%s(%s, %s, %u, &flags)", (opcode == OP_SHRI) ? "shr" : "shl",
+				c_reg(rd, addr, a), c_reg(rs, addr, b), INSN_IMM5(insn));
+			emit_write(fout, aot, addr, rd, value);
+			fallthrough = (rd != REG_PCL);
+			break;
+
+		case OP_SHR:
+		case OP_SHL:
+			sprintf(value, "alu_%s(%s, %s, %s & 0x1F, &flags)", (opcode == OP_SHR) ? "shr" : "shl",
+				c_reg(rd, addr, a), c_reg(rs, addr, b), c_reg(rt, addr, c));
+			emit_write(fout, aot, addr, rd, value);
+			fallthrough = (rd != REG_PCL);
+			break;
+
+		case OP_MOV:
+			emit_write(fout, aot, addr, rd, c_reg(rs, addr, a));
+			fallthrough = (rd != REG_PCL);
+			break;
+
+		case OP_LDB:
+			sprintf(value, "cpu->ram[0x%02X]", imm8);
+			emit_write(fout, aot, addr, rd, value);
+			fallthrough = (rd != REG_PCL);
+			break;
+
+		case OP_STB:
+			fprintf(fout, "\tcpu->ram[0x%02X] = %s;\n", imm8, c_reg(rd, addr, a));
+			break;
+
+		case OP_JUMP:
+			if (cond == COND_NV) {
+				break;
+			}
+			if (cond != COND_AL) {
+				fprintf(fout, "\tif (COND(%u)) {\n", cond);
+			} else {
+				fprintf(fout, "\t{\n");
+			}
+			fprintf(fout, "\t\tTAKEN();\n");
+			target = cp_target(cp_read(&aot->in[addr], rs, addr), cp_read(&aot->in[addr], rt, addr));
+			if (target >= 0) {
+				emit_goto(fout, aot, target);
+			} else {
+				fprintf(fout, "\t\tt = (%s << 8) | %s;\n", c_reg(rs, addr, a), c_reg(rt, addr, b));
+				fprintf(fout, "\t\tgoto dispatch;\n");
+			}
+			fprintf(fout, "\t}\n");
+			fallthrough = (cond != COND_AL);
+			break;
+
+		case OP_BRANCH:
+			if (cond == COND_NV) {
+				break;
+			}
+			if (cond != COND_AL) {
+				fprintf(fout, "\tif (COND(%u)) {\n", cond);
+			} else {
+				fprintf(fout, "\t{\n");
+			}
+			fprintf(fout, "\t\tTAKEN();\n");
+			emit_goto(fout, aot, (uint16_t)(next + (int8_t)imm8));
+			fprintf(fout, "\t}\n");
+			fallthrough = (cond != COND_AL);
+			break;
+
+		default:
+			/* NOP and not implemented instructions */
+			break;
+	}
+
+	if (fallthrough) {
+		if (next >= ROM_WORDS) {
+			fprintf(fout, "\tgoto L_0000;\n");
+		} else if (next >= aot->size) {
+			fprintf(fout, "\tt = 0x%04X;\n", next);
+			fprintf(fout, "\tgoto outside;\n");
+		}
+	}
+}
+
+static void emit_program(FILE *fout, struct aot *aot, const char *filename)
+{
+	uint32_t addr;
+	int i;
+
+	fprintf(fout, "/* Generated by lotec-aot from %s */\n", filename);
+	fputs(preamble, fout);
+
+	fprintf(fout, "#define ROM_SIZE 0x%X\n\n", aot->size);
+	fprintf(fout, "static int run(struct cpu *cpu, uint64_t max_cycles)\n");
+	fprintf(fout, "{\n");
+	if (aot->dynamic) {
+		fprintf(fout, "\tstatic const void *const table[ROM_SIZE] = {\n");
+		for (addr = 0; addr < aot->size; addr++) {
+			fprintf(fout, "\t\t&&L_%04X,\n", addr);
+		}
+		fprintf(fout, "\t};\n");
+	}
+	for (i = 0; i <= REG_R4; i++) {
+		fprintf(fout, "\tuint8_t r%d = 0;\n", i);
+	}
+	fprintf(fout, "\tuint8_t flags = 0;\n");
+	fprintf(fout, "\tuint8_t pch = 0;\n");
+	fprintf(fout, "\tuint16_t pc = 0;\n");
+	if (aot->outside || aot->dynamic) {
+		fprintf(fout, "\tuint32_t t;\n");
+	}
+	fprintf(fout, "\tint64_t slots;\n");
+	fprintf(fout, "\tint64_t budget;\n");
+	fprintf(fout, "\tuint64_t bubbles = 0;\n");
+	fprintf(fout, "\tint reason = EXIT_LIMIT;\n");
+	fprintf(fout, "\n");
+	fprintf(fout, "\tslots = (max_cycles + 1) / 2;\n");
+	fprintf(fout, "\tbudget = slots;\n");
+	fprintf(fout, "\tgoto L_0000;\n\n");
+
+	for (addr = 0; addr < aot->size; addr++) {
+		if (aot->reached[addr]) {
+			emit_insn(fout, aot, addr);
+		}
+	}
+	fprintf(fout, "\n");
+
+	if (aot->dynamic) {
+		fprintf(fout, "dispatch:\n");
+		fprintf(fout, "\tif (t < ROM_SIZE) {\n");
+		fprintf(fout, "\t\tgoto *table[t];\n");
+		fprintf(fout, "\t}\n");
+	}
+	if (aot->outside || aot->dynamic) {
+		fprintf(fout, "outside:\n");
+		fprintf(fout, "\t/* NOPs up to the end of the address space */\n");
+		fprintf(fout, "\tif (budget < (int64_t)(0x10000 - t)) {\n");
+		fprintf(fout, "\t\tpc = t + budget;\n");
+		fprintf(fout, "\t\tbudget = 0;\n");
+		fprintf(fout, "\t\tgoto out;\n");
+		fprintf(fout, "\t}\n");
+		fprintf(fout, "\tbudget -= 0x10000 - t;\n");
+		fprintf(fout, "\tgoto L_0000;\n");
+		fprintf(fout, "\n");
+	}
+	fprintf(fout, "out:\n");
+	fprintf(fout, "\tslots -= budget;\n");
+	for (i = 0; i <= REG_R4; i++) {
+		fprintf(fout, "\tcpu->r[%d] = r%d;\n", i, i);
+	}
+	fprintf(fout, "\tcpu->flags = flags;\n");
+	fprintf(fout, "\tcpu->pch = pch;\n");
+	fprintf(fout, "\tcpu->pc = pc;\n");
+	fprintf(fout, "\tcpu->insns = slots - bubbles;\n");
+	fprintf(fout, "\tcpu->cycles = slots * 2;\n");
+	fprintf(fout, "\treturn reason;\n");
+	fprintf(fout, "}\n\n");
+
+	fputs(postamble, fout);
+}
+
+static void usage(void)
+{
+	printf("lotec-aot [-o C file] [hex or bin file]\n");
+	printf("Translate a LoTec 8-Bit CPU ROM image to a C program\n");
+	printf(" -o file      Write the C program to file instead of stdout\n");
+	printf("Compile the program with the directory of lotec-alu.h in the include path\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *outfile = NULL;
+	struct lotec_rom *rom;
+	struct aot aot;
+	FILE *fout;
+	int rv;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "o:")) != -1) {
+		switch (opt) {
+			case 'o':
+				outfile = optarg;
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+	if (optind >= argc) {
+		usage();
+		return 1;
+	}
+
+	rom = lotec_rom_alloc();
+	if (rom == NULL) {
+		return 2;
+	}
+	if (lotec_rom_load(rom, argv[optind]) != 0) {
+		lotec_rom_free(rom);
+		return 2;
+	}
+
+	memset(&aot, 0, sizeof(aot));
+	aot.rom = rom;
+	aot.size = (rom->size > 0) ? rom->size : 1;
+	rv = analyse(&aot);
+	if (rv == 0) {
+		if (outfile != NULL) {
+			fout = fopen(outfile, "w");
+			if (fout == NULL) {
+				fprintf(stderr, "Error: Failed to open file '%s'.\n", outfile);
+				rv = 2;
+			}
+		} else {
+			fout = stdout;
+		}
+		if (rv == 0) {
+			emit_program(fout, &aot, argv[optind]);
+			if (fout != stdout) {
+				fclose(fout);
+			}
+		}
+	}
+
+	free(aot.in);
+	free(aot.reached);
+	free(aot.label);
+	free(aot.work);
+	lotec_rom_free(rom);
+	return rv;
+}
@@ -3,12 +3,25 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "lotec-opcodes.h"
+#include "lotec-isa.h"
 
 #define MAX_BUF_SIZE 256
 #define TOK_SIZE 20
-#define LABEL_SIZE 100
+
+/* Initial number of slots of the symbol table, a power of 2 */
+#define SYMTAB_MIN_SLOTS 1024
+/* Size of the blocks of the arena holding the label names */
+#define ARENA_BLOCK_SIZE 65536
+/* log2 of the size of the perfect hash table of the keywords */
+#define KEYWORD_BITS 8
+
+#define FNV_BASIS 0x811C9DC5
 
 #define PRINTOPCODE(st, ...) do { \
 		if (st->pass == 1) { \
@@ -16,88 +29,60 @@
 		} \
 	} while(0)
 
-typedef struct {
-	char label[MAX_BUF_SIZE];
+/* A label, its name is interned in the arena of the symbol table */
+struct label {
+	const char *name;	/* NULL for a free slot */
+	uint32_t hash;
 	uint16_t address;
-} label_t;
+};
+
+struct arena_block {
+	struct arena_block *next;
+	size_t used;
+	size_t size;
+	char data[];
+};
 
+/* Hash table of the labels with open addressing and linear probing, kept at
+ * most 3/4 full.
+ */
+struct symtab {
+	struct label *slots;
+	uint32_t mask;		/* number of slots - 1 */
+	uint32_t count;
+	struct arena_block *arena;
+};
+
+/* The tokens and labels are not copied, they point into the source and
+ * are not terminated.
+ */
 struct parse_state {
-	int pos;
+	const char *pos;	/* of the lexer */
+	const char *line_start;
 	int lineno;
-	int col;
 	uint16_t address;
 	int tok_pos;
-	int lineskip;
 	int pass;
 
-	char buffer[MAX_BUF_SIZE];
-	char label[MAX_BUF_SIZE];
+	const char *label;	/* of TOK_LABEL */
+	size_t label_len;
 	int tokens[TOK_SIZE];
-	int tokens_col[TOK_SIZE];
+	const char *tokens_pos[TOK_SIZE];
 	uint32_t values[TOK_SIZE];
 
-	int numlabels;
-	label_t labels[LABEL_SIZE];
+	struct symtab symbols;
+
+	FILE *listing;
+	char line[MAX_BUF_SIZE];
+	uint16_t line_address;
 };
 
 
 enum token {
-	TOK_NOP,
-	TOK_LI,
-	TOK_ADDI,
-	TOK_ANDI,
-	TOK_ORI,
-	TOK_XORI,
-	TOK_SUBI,
-	TOK_CMPI,
-	TOK_SHRI,
-	TOK_SHLI,
-	TOK_RORI,
-	TOK_ROLI,
-
-	TOK_MOV,
-	TOK_ADD,
-	TOK_AND,
-	TOK_OR,
-	TOK_XOR,
-	TOK_SUB,
-	TOK_CMP,
-	TOK_SHR,
-	TOK_SHL,
-	TOK_ROR,
-	TOK_ROL,
-
-	TOK_LDB,
-	TOK_STB,
-
-	TOK_JAL,
-	TOK_JEQ,
-	TOK_JGT,
-	TOK_JLT,
-	TOK_JNE,
-	TOK_JGE,
-	TOK_JLE,
-	TOK_JNV,
-
-	TOK_BAL,
-	TOK_BEQ,
-	TOK_BGT,
-	TOK_BLT,
-	TOK_BNE,
-	TOK_BGE,
-	TOK_BLE,
-	TOK_BNV,
-
+	TOK_INSN,		/* value is the index of the keyword */
+	TOK_REG,		/* value is the register */
 	TOK_ADD_LABEL,
 	TOK_LABEL,
-	TOK_R0,
-	TOK_R1,
-	TOK_R2,
-	TOK_R3,
-	TOK_R4,
-	TOK_FLAGS,
-	TOK_PCH,
-	TOK_PCL,
 	TOK_VAL,
 	TOK_ADDRESS,
 	TOK_COMMA,
@@ -110,62 +95,10 @@ enum token {
 static const char *get_token_name(enum token token)
 {
 	switch(token) {
-		TOK_STRING(TOK_NOP)
-		TOK_STRING(TOK_LI)
-		TOK_STRING(TOK_ADDI)
-		TOK_STRING(TOK_ANDI)
-		TOK_STRING(TOK_ORI)
-		TOK_STRING(TOK_XORI)
-		TOK_STRING(TOK_SUBI)
-		TOK_STRING(TOK_CMPI)
-		TOK_STRING(TOK_SHRI)
-		TOK_STRING(TOK_SHLI)
-		TOK_STRING(TOK_RORI)
-		TOK_STRING(TOK_ROLI)
-
-		TOK_STRING(TOK_MOV)
-		TOK_STRING(TOK_ADD)
-		TOK_STRING(TOK_AND)
-		TOK_STRING(TOK_OR)
-		TOK_STRING(TOK_XOR)
-		TOK_STRING(TOK_SUB)
-		TOK_STRING(TOK_CMP)
-		TOK_STRING(TOK_SHR)
-		TOK_STRING(TOK_SHL)
-		TOK_STRING(TOK_ROR)
-		TOK_STRING(TOK_ROL)
-
-		TOK_STRING(TOK_LDB)
-		TOK_STRING(TOK_STB)
-
-		TOK_STRING(TOK_JAL)
-		TOK_STRING(TOK_JEQ)
-		TOK_STRING(TOK_JGT)
-		TOK_STRING(TOK_JLT)
-		TOK_STRING(TOK_JNE)
-		TOK_STRING(TOK_JGE)
-		TOK_STRING(TOK_JLE)
-		TOK_STRING(TOK_JNV)
-
-		TOK_STRING(TOK_BAL)
-		TOK_STRING(TOK_BEQ)
-		TOK_STRING(TOK_BGT)
-		TOK_STRING(TOK_BLT)
-		TOK_STRING(TOK_BNE)
-		TOK_STRING(TOK_BGE)
-		TOK_STRING(TOK_BLE)
-		TOK_STRING(TOK_BNV)
-
+		TOK_STRING(TOK_INSN)
+		TOK_STRING(TOK_REG)
 		TOK_STRING(TOK_ADD_LABEL)
 		TOK_STRING(TOK_LABEL)
-		TOK_STRING(TOK_R0)
-		TOK_STRING(TOK_R1)
-		TOK_STRING(TOK_R2)
-		TOK_STRING(TOK_R3)
-		TOK_STRING(TOK_R4)
-		TOK_STRING(TOK_FLAGS)
-		TOK_STRING(TOK_PCH)
-		TOK_STRING(TOK_PCL)
 		TOK_STRING(TOK_VAL)
 		TOK_STRING(TOK_ADDRESS)
 		TOK_STRING(TOK_COMMA)
@@ -175,220 +108,314 @@ static const char *get_token_name(enum token token)
 	}
 }
 
-static uint32_t get_label_address(struct parse_state *st, const char *label)
+/* The mnemonics and registers of lotec-isa.h */
+struct keyword {
+	const char *name;
+	enum token token;
+	uint8_t value;		/* opcode or register */
+	uint8_t cond;
+	enum lotec_form form;
+};
+
+#define KEYWORD_INSN(name, opcode, form) { #name, TOK_INSN, opcode, COND_AL, form },
+#define KEYWORD_JUMP(suffix, cond) { "J" #suffix, TOK_INSN, OP_JUMP, cond, FORM_JUMP },
+#define KEYWORD_BRANCH(suffix, cond) { "B" #suffix, TOK_INSN, OP_BRANCH, cond, FORM_BRANCH },
+#define KEYWORD_REG(name, reg) { #name, TOK_REG, reg, COND_AL, FORM_NONE },
+
+static const struct keyword keywords[] = {
+	LOTEC_INSNS(KEYWORD_INSN)
+	LOTEC_ROTATES(KEYWORD_INSN)
+	LOTEC_CONDS(KEYWORD_JUMP)
+	LOTEC_CONDS(KEYWORD_BRANCH)
+	LOTEC_REGS(KEYWORD_REG)
+};
+
+#define NUM_KEYWORDS (sizeof(keywords) / sizeof(keywords[0]))
+
+/* Perfect hash table of the keywords, found by keywords_init(): index + 1
+ * of the keyword by the top KEYWORD_BITS of its hash with keyword_seed, 0
+ * for none.
+ */
+static uint8_t keyword_slots[1 << KEYWORD_BITS];
+static uint32_t keyword_seed;
+
+/* FNV-1a of the first n characters of name, starting with h */
+static uint32_t hash_name(uint32_t h, const char *name, size_t n)
 {
-	char l[MAX_BUF_SIZE];
-	const char *type = "";
-	int i;
+	size_t i;
 
-	strcpy(l, label);
-	for (i = 0; i < MAX_BUF_SIZE; i++) {
-		if (l[i] == 0) {
-			break;
-		}
-		if (l[i] == '@') {
-			l[i] = 0;
-			type = l + i + 1;
-			break;
-		}
+	for (i = 0; i < n; i++) {
+		h = (h ^ (uint8_t)name[i]) * 0x01000193;
 	}
+	return h;
+}
 
-	for (i = 0; i < st->numlabels; i++) {
-		if (strcmp(st->labels[i].label, l) == 0) {
-			if (strcmp(type, "ha") == 0) {
-				return (st->labels[i].address >> 9) & 0xFF;
-			} else if (strcmp(type, "la") == 0) {
-				return (st->labels[i].address >> 1) & 0xFF;
-			} else if (strcmp(type, "hi") == 0) {
-				return (st->labels[i].address >> 8) & 0xFF;
-			} else if (strcmp(type, "lo") == 0) {
-				return (st->labels[i].address >> 0) & 0xFF;
-			} else if (type[0] == 0) {
-				return st->labels[i].address;
-			} else {
-				fprintf(stderr, "Error: Label %s has invalid type %s at line %u col %u.\n",
-					label, type, st->lineno, st->tokens_col[st->tok_pos]);
-				return -1;
+/* Look for a seed of the hash for which no keywords collide */
+static int keywords_init(void)
+{
+	uint32_t seed;
+	uint32_t h;
+	unsigned int i;
+
+	for (seed = FNV_BASIS; seed != FNV_BASIS + 0x10000; seed++) {
+		memset(keyword_slots, 0, sizeof(keyword_slots));
+		for (i = 0; i < NUM_KEYWORDS; i++) {
+			h = hash_name(seed, keywords[i].name, strlen(keywords[i].name)) >> (32 - KEYWORD_BITS);
+			if (keyword_slots[h] != 0) {
+				break;
 			}
+			keyword_slots[h] = i + 1;
+		}
+		if (i == NUM_KEYWORDS) {
+			keyword_seed = seed;
+			return 0;
 		}
 	}
-	return -1;
+	return 1;
 }
 
-static int add_label(struct parse_state *st, const char *label)
+static const struct keyword *find_keyword(const char *text, size_t n)
 {
-	uint32_t u;
+	unsigned int i;
 
-#ifdef VERBOSE
-	printf("# Add label '%s' at 0x%04X\n", label, st->address);
-#endif
-
-	u = get_label_address(st, label);
-	if ((u != (uint32_t)-1) && (u != st->address)) {
-		fprintf(stderr, "Error: Label '%s' already added at 0x%04X (0x%04X) line %u col %u\n", label, u, st->address, st->lineno, st->tokens_col[st->tok_pos]);
-		return 2;
+	i = keyword_slots[hash_name(keyword_seed, text, n) >> (32 - KEYWORD_BITS)];
+	if ((i == 0) || (strncmp(keywords[i - 1].name, text, n) != 0) || (keywords[i - 1].name[n] != 0)) {
+		return NULL;
 	}
-	st->labels[st->numlabels].address = st->address;
-	strcpy(st->labels[st->numlabels].label, label);
+	return &keywords[i - 1];
+}
 
-	if (st->numlabels < LABEL_SIZE) {
-		st->numlabels++;
-		return 0;
-	}
-	fprintf(stderr, "Error: Label '%s' too many labels line %u col %u\n",
-		label, st->lineno, st->col);
-	return 1;
+static int symtab_init(struct symtab *tab)
+{
+	tab->slots = calloc(SYMTAB_MIN_SLOTS, sizeof(*tab->slots));
+	tab->mask = SYMTAB_MIN_SLOTS - 1;
+	tab->count = 0;
+	tab->arena = NULL;
+	return (tab->slots != NULL) ? 0 : 2;
 }
 
-static int parse_token(struct parse_state *st)
+static void symtab_free(struct symtab *tab)
 {
-	int n;
-	char *text = st->buffer;
+	struct arena_block *b;
 
-	if (strcmp(text, "NOP") == 0) {
-		return TOK_NOP;
-	}
-	if (strcmp(text, "LI") == 0) {
-		return TOK_LI;
-	}
-	if (strcmp(text, "ADDI") == 0) {
-		return TOK_ADDI;
-	}
-	if (strcmp(text, "ANDI") == 0) {
-		return TOK_ANDI;
-	}
-	if (strcmp(text, "ORI") == 0) {
-		return TOK_ORI;
-	}
-	if (strcmp(text, "XORI") == 0) {
-		return TOK_XORI;
-	}
-	if (strcmp(text, "SUBI") == 0) {
-		return TOK_SUBI;
-	}
-	if (strcmp(text, "CMPI") == 0) {
-		return TOK_CMPI;
-	}
-	if (strcmp(text, "SHRI") == 0) {
-		return TOK_SHRI;
-	}
-	if (strcmp(text, "SHLI") == 0) {
-		return TOK_SHLI;
-	}
-	if (strcmp(text, "RORI") == 0) {
-		return TOK_RORI;
-	}
-	if (strcmp(text, "ROLI") == 0) {
-		return TOK_ROLI;
-	}
-	if (strcmp(text, "ADD") == 0) {
-		return TOK_ADD;
-	}
-	if (strcmp(text, "AND") == 0) {
-		return TOK_AND;
-	}
-	if (strcmp(text, "OR") == 0) {
-		return TOK_OR;
-	}
-	if (strcmp(text, "XOR") == 0) {
-		return TOK_XOR;
-	}
-	if (strcmp(text, "SUB") == 0) {
-		return TOK_SUB;
-	}
-	if (strcmp(text, "CMP") == 0) {
-		return TOK_CMP;
-	}
-	if (strcmp(text, "SHR") == 0) {
-		return TOK_SHR;
-	}
-	if (strcmp(text, "SHL") == 0) {
-		return TOK_SHL;
-	}
-	if (strcmp(text, "ROR") == 0) {
-		return TOK_ROR;
-	}
-	if (strcmp(text, "ROL") == 0) {
-		return TOK_ROL;
-	}
-	if (strcmp(text, "LDB") == 0) {
-		return TOK_LDB;
-	}
-	if (strcmp(text, "STB") == 0) {
-		return TOK_STB;
-	}
-	if (strcmp(text, "MOV") == 0) {
-		return TOK_MOV;
+	while (tab->arena != NULL) {
+		b = tab->arena;
+		tab->arena = b->next;
+		free(b);
 	}
+	free(tab->slots);
+	tab->slots = NULL;
+}
 
-	if (strcmp(text, "J") == 0) {
-		return TOK_JAL;
-	}
-	if (strcmp(text, "JAL") == 0) {
-		return TOK_JAL;
-	}
-	if (strcmp(text, "JAL") == 0) {
-		return TOK_JAL;
-	}
-	if (strcmp(text, "JEQ") == 0) {
-		return TOK_JEQ;
-	}
-	if (strcmp(text, "JGT") == 0) {
-		return TOK_JGT;
-	}
-	if (strcmp(text, "JLT") == 0) {
-		return TOK_JLT;
-	}
-	if (strcmp(text, "JNE") == 0) {
-		return TOK_JNE;
-	}
-	if (strcmp(text, "JGE") == 0) {
-		return TOK_JGE;
-	}
-	if (strcmp(text, "JLE") == 0) {
-		return TOK_JLE;
-	}
+/* Copy the first n characters of name to the arena */
+static const char *symtab_intern(struct symtab *tab, const char *name, size_t n)
+{
+	struct arena_block *b = tab->arena;
+	size_t size;
+	char *p;
+
+	if ((b == NULL) || (b->size - b->used < n + 1)) {
+		size = (n + 1 > ARENA_BLOCK_SIZE) ? (n + 1) : ARENA_BLOCK_SIZE;
+		b = malloc(sizeof(*b) + size);
+		if (b == NULL) {
+			return NULL;
+		}
+		b->next = tab->arena;
+		b->used = 0;
+		b->size = size;
+		tab->arena = b;
+	}
+	p = b->data + b->used;
+	memcpy(p, name, n);
+	p[n] = 0;
+	b->used += n + 1;
+	return p;
+}
 
-	if (strcmp(text, "B") == 0) {
-		return TOK_BAL;
+/* Slot of the label with the first n characters of name or the free slot
+ * where it belongs
+ */
+static struct label *symtab_slot(const struct symtab *tab, const char *name, size_t n, uint32_t hash)
+{
+	struct label *l;
+	uint32_t i;
+
+	for (i = hash & tab->mask; ; i = (i + 1) & tab->mask) {
+		l = &tab->slots[i];
+		if ((l->name == NULL) ||
+			((l->hash == hash) && (strncmp(l->name, name, n) == 0) && (l->name[n] == 0))) {
+			return l;
+		}
 	}
-	if (strcmp(text, "BAL") == 0) {
-		return TOK_BAL;
+}
+
+static int symtab_grow(struct symtab *tab)
+{
+	struct label *old = tab->slots;
+	uint32_t size = tab->mask + 1;
+	uint32_t i;
+
+	tab->slots = calloc(2 * (size_t)size, sizeof(*tab->slots));
+	if (tab->slots == NULL) {
+		tab->slots = old;
+		return 2;
 	}
-	if (strcmp(text, "BAL") == 0) {
-		return TOK_BAL;
+	tab->mask = 2 * size - 1;
+	for (i = 0; i < size; i++) {
+		if (old[i].name != NULL) {
+			*symtab_slot(tab, old[i].name, strlen(old[i].name), old[i].hash) = old[i];
+		}
 	}
-	if (strcmp(text, "BEQ") == 0) {
-		return TOK_BEQ;
+	free(old);
+	return 0;
+}
+
+/* Column of p in the current line, a tab counts 8 */
+static unsigned int column(const struct parse_state *st, const char *p)
+{
+	const char *c;
+	unsigned int col = 1;
+
+	for (c = st->line_start; c < p; c++) {
+		if (*c == '\r') {
+			col = 1;
+		} else {
+			col += (*c == '\t') ? 8 : 1;
+		}
 	}
-	if (strcmp(text, "BGT") == 0) {
-		return TOK_BGT;
+	return col;
+}
+
+/* Whether the n characters at text are s */
+static int text_is(const char *text, size_t n, const char *s)
+{
+	return (strncmp(text, s, n) == 0) && (s[n] == 0);
+}
+
+static uint32_t get_label_address(struct parse_state *st, const char *label, size_t len)
+{
+	const struct label *l;
+	const char *type;
+	const char *at;
+	size_t type_len;
+	size_t n;
+
+	/* The suffix after '@' selects a byte of the address */
+	at = memchr(label, '@', len);
+	n = (at != NULL) ? (size_t)(at - label) : len;
+	type = (at != NULL) ? (at + 1) : (label + len);
+	type_len = len - (type - label);
+
+	l = symtab_slot(&st->symbols, label, n, hash_name(FNV_BASIS, label, n));
+	if (l->name == NULL) {
+		return -1;
+	}
+	if (text_is(type, type_len, "ha")) {
+		return (l->address >> 9) & 0xFF;
+	} else if (text_is(type, type_len, "la")) {
+		return (l->address >> 1) & 0xFF;
+	} else if (text_is(type, type_len, "hi")) {
+		return (l->address >> 8) & 0xFF;
+	} else if (text_is(type, type_len, "lo")) {
+		return (l->address >> 0) & 0xFF;
+	} else if (type_len == 0) {
+		return l->address;
+	}
+	fprintf(stderr, "Error: Label %.*s has invalid type %.*s at line %u col %u.\n",
+		(int)len, label, (int)type_len, type, st->lineno, column(st, st->tokens_pos[st->tok_pos]));
+	return -1;
+}
+
+static int add_label(struct parse_state *st, const char *label, size_t n)
+{
+	struct symtab *tab = &st->symbols;
+	struct label *l;
+	uint32_t hash;
+
+#ifdef VERBOSE
+	printf("# Add label '%.*s' at 0x%04X\n", (int)n, label, st->address);
+#endif
+
+	hash = hash_name(FNV_BASIS, label, n);
+	l = symtab_slot(tab, label, n, hash);
+	if (l->name != NULL) {
+		/* The second pass adds the labels again */
+		if (l->address != st->address) {
+			fprintf(stderr, "Error: Label '%.*s' already added at 0x%04X (0x%04X) line %u col %u\n", (int)n, label, l->address, st->address, st->lineno, column(st, st->tokens_pos[st->tok_pos]));
+			return 2;
+		}
+		return 0;
 	}
-	if (strcmp(text, "BLT") == 0) {
-		return TOK_BLT;
+	if (4 * (tab->count + 1) > 3 * (tab->mask + 1)) {
+		if (symtab_grow(tab) != 0) {
+			fprintf(stderr, "Error: Out of memory.\n");
+			return 2;
+		}
+		l = symtab_slot(tab, label, n, hash);
 	}
-	if (strcmp(text, "BNE") == 0) {
-		return TOK_BNE;
+	l->name = symtab_intern(tab, label, n);
+	if (l->name == NULL) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		return 2;
 	}
-	if (strcmp(text, "BGE") == 0) {
-		return TOK_BGE;
+	l->hash = hash;
+	l->address = st->address;
+	tab->count++;
+	return 0;
+}
+
+/* Value of the hex digits at text like strtoul() */
+static uint32_t parse_hex(const char *text, size_t n)
+{
+	const char *end = text + n;
+	uint32_t v = 0;
+	int negative = 0;
+	int digit;
+
+	if ((text < end) && ((*text == '+') || (*text == '-'))) {
+		negative = (*text++ == '-');
+	}
+	if ((end - text > 2) && (text[0] == '0') && ((text[1] == 'x') || (text[1] == 'X'))) {
+		text += 2;
+	}
+	for (; text < end; text++) {
+		if ((*text >= '0') && (*text <= '9')) {
+			digit = *text - '0';
+		} else if ((*text >= 'a') && (*text <= 'f')) {
+			digit = *text - 'a' + 10;
+		} else if ((*text >= 'A') && (*text <= 'F')) {
+			digit = *text - 'A' + 10;
+		} else {
+			break;
+		}
+		v = (v << 4) | digit;
 	}
-	if (strcmp(text, "BLE") == 0) {
-		return TOK_BLE;
+	return negative ? -v : v;
+}
+
+/* The token of the n characters at text */
+static int parse_token(struct parse_state *st, const char *text, size_t n)
+{
+	const struct keyword *kw;
+
+	kw = find_keyword(text, n);
+	if (kw != NULL) {
+		st->values[st->tok_pos] = (kw->token == TOK_INSN) ? (uint32_t)(kw - keywords) : kw->value;
+		return kw->token;
 	}
 	if (text[0] == '#') {
-		char *l = text + 1;
+		const char *l = text + 1;
 		uint32_t addr;
 
-		if (text[1] == '$') {
-			st->values[st->tok_pos] = strtoul(st->buffer + 2, NULL, 16);
+		if ((n > 1) && (text[1] == '$')) {
+			st->values[st->tok_pos] = parse_hex(text + 2, n - 2);
 			return TOK_VAL;
 		}
-		addr = get_label_address(st, l);
+		addr = get_label_address(st, l, n - 1);
 		if (addr == (uint32_t)-1) {
 			if (st->pass != 0) {
-				fprintf(stderr, "Error: Label %s is not defined at line %u col %u.\n",
-					l, st->lineno, st->tokens_col[st->tok_pos]);
+				fprintf(stderr, "Error: Label %.*s is not defined at line %u col %u.\n",
+					(int)(n - 1), l, st->lineno, column(st, st->tokens_pos[st->tok_pos]));
 				return TOK_INVAL;
 			}
 			addr = 0;
@@ -397,43 +424,18 @@ static int parse_token(struct parse_state *st)
 		return TOK_VAL;
 	}
 	if (text[0] == '$') {
-		st->values[st->tok_pos] = strtoul(st->buffer + 1, NULL, 16);
+		st->values[st->tok_pos] = parse_hex(text + 1, n - 1);
 		return TOK_ADDRESS;
 	}
-	if (strcmp(text, "R0") == 0) {
-		return TOK_R0;
-	}
-	if (strcmp(text, "R1") == 0) {
-		return TOK_R1;
-	}
-	if (strcmp(text, "R2") == 0) {
-		return TOK_R2;
-	}
-	if (strcmp(text, "R3") == 0) {
-		return TOK_R3;
-	}
-	if (strcmp(text, "R4") == 0) {
-		return TOK_R4;
-	}
-	if (strcmp(text, "FLAGS") == 0) {
-		return TOK_FLAGS;
-	}
-	if (strcmp(text, "PCH") == 0) {
-		return TOK_PCH;
-	}
-	if (strcmp(text, "PCL") == 0) {
-		return TOK_PCL;
-	}
 
-	n = strlen(text);
 	if (text[n - 1] == ':') {
-		text[n - 1] = 0;
-		if (add_label(st, text) != 0) {
+		if (add_label(st, text, n - 1) != 0) {
 			return TOK_INVAL;
 		}
 		return TOK_ADD_LABEL;
 	}
-	strcpy(st->label, st->buffer);
+	st->label = text;
+	st->label_len = n;
 	return TOK_LABEL;
 }
 
@@ -442,45 +444,29 @@ static void next_insn(struct parse_state *st)
 	st->address += 2;
 }
 
-static int parse_token_nop(struct parse_state *st)
+/* Register of token i */
+static int parse_token_reg(struct parse_state *st, int i)
+{
+	if (st->tokens[i] != TOK_REG) {
+		fprintf(stderr, "Error: Register expected.\n");
+		return -1;
+	}
+	return st->values[i];
+}
+
+static int parse_token_nop(const struct keyword *kw, struct parse_state *st)
 {
 	if (st->tok_pos != 1) {
 		return 1;
 	}
-	PRINTOPCODE(st, "%x\n", OP_NOP << 12);
+	PRINTOPCODE(st, "%x\n", kw->value << 11);
 
 	next_insn(st);
 	return 0;
 }
 
-static int parse_token_reg(int token)
-{
-	switch(token) {
-		case TOK_R0:
-			return REG_R0;
-		case TOK_R1:
-			return REG_R1;
-		case TOK_R2:
-			return REG_R2;
-		case TOK_R3:
-			return REG_R3;
-		case TOK_R4:
-			return REG_R4;
-
-		case TOK_FLAGS:
-			return REG_FLAGS;
-
-		case TOK_PCH:
-			return REG_PCH;
-		case TOK_PCL:
-			return REG_PCL;
-		default:
-			fprintf(stderr, "Error: Register expected.\n");
-			return -1;
-	}
-}
-
-static int parse_token_alu(uint8_t opcode, struct parse_state *st)
+/* rd and an 8 bit value or address (token) */
+static int parse_token_imm(const struct keyword *kw, struct parse_state *st, int token)
 {
 	int rd;
 
@@ -488,23 +474,23 @@ static int parse_token_alu(uint8_t opcode, struct parse_state *st)
 		return 1;
 	}
 
-	rd = parse_token_reg(st->tokens[1]);
+	rd = parse_token_reg(st, 1);
 	if (rd < 0) {
 		return 1;
 	}
-	if (st->tokens[2] != TOK_VAL) {
+	if (st->tokens[2] != token) {
 		return 1;
 	}
 	if (st->values[2] > 0xFF) {
 		return 1;
 	}
-	PRINTOPCODE(st, "%x\n", (opcode << 11) | (rd << 8) | st->values[2]);
+	PRINTOPCODE(st, "%x\n", (kw->value << 11) | (rd << 8) | st->values[2]);
 
 	next_insn(st);
 	return 0;
 }
 
-static int parse_token_shift(uint8_t opcode, struct parse_state *st)
+static int parse_token_shift(const struct keyword *kw, struct parse_state *st)
 {
 	int rd;
 	int rs;
@@ -514,7 +500,7 @@ static int parse_token_shift(uint8_t opcode, struct parse_state *st)
 		return 1;
 	}
 
-	if ((st->tokens[0] == TOK_RORI) || (st->tokens[0] == TOK_ROLI)) {
+	if (kw->form == FORM_ROT_IMM) {
 		if (st->tok_pos != 3) {
 			return 1;
 		}
@@ -522,11 +508,11 @@ static int parse_token_shift(uint8_t opcode, struct parse_state *st)
 
 	off = st->tok_pos - 2;
 
-	rd = parse_token_reg(st->tokens[1]);
+	rd = parse_token_reg(st, 1);
 	if (rd < 0) {
 		return 1;
 	}
-	rs = parse_token_reg(st->tokens[off]);
+	rs = parse_token_reg(st, off);
 	if (rs < 0) {
 		return 1;
 	}
@@ -534,7 +520,7 @@ static int parse_token_shift(uint8_t opcode, struct parse_state *st)
 		return 1;
 	}
 
-	if ((st->tok_pos == 4) || (st->tokens[0] == TOK_RORI) || (st->tokens[0] == TOK_ROLI)) {
+	if ((st->tok_pos == 4) || (kw->form == FORM_ROT_IMM)) {
 		if (st->values[off + 1] > 15) {
 			return 1;
 		}
@@ -544,162 +530,47 @@ static int parse_token_shift(uint8_t opcode, struct parse_state *st)
 		}
 		st->values[off + 1] += 8;
 	}
-	PRINTOPCODE(st, "%x\n", (opcode << 11) | (rd << 8) | (rs << 5) | st->values[off + 1]);
-
-	next_insn(st);
-	return 0;
-}
-
-static int parse_token_shiftreg(uint8_t opcode, struct parse_state *st)
-{
-	int rd;
-	int rs;
-	int rt;
-	int off;
-
-	if ((st->tokens[0] == TOK_ROR) || (st->tokens[0] == TOK_ROL)) {
-		if (st->tok_pos != 3) {
-			return 1;
-		}
-	} else {
-		if (st->tok_pos != 4) {
-			return 1;
-		}
-	}
-	off = st->tok_pos - 2;
-
-	rd = parse_token_reg(st->tokens[1]);
-	if (rd < 0) {
-		return 1;
-	}
-	rs = parse_token_reg(st->tokens[off]);
-	if (rs < 0) {
-		return 1;
-	}
-	rt = parse_token_reg(st->tokens[off + 1]);
-	if (rt < 0) {
-		return 1;
-	}
-	PRINTOPCODE(st, "%x\n", (opcode << 11) | (rd << 8) | (rs << 5) | (rt << 2));
-
-	next_insn(st);
-	return 0;
-}
-
-static int parse_token_addr(uint8_t opcode, struct parse_state *st)
-{
-	int rd;
-
-	if (st->tok_pos != 3) {
-		return 1;
-	}
-
-	rd = parse_token_reg(st->tokens[1]);
-	if (rd < 0) {
-		return 1;
-	}
-	if (st->tokens[2] != TOK_ADDRESS) {
-		return 1;
-	}
-	if (st->values[2] > 0xFF) {
-		return 1;
-	}
-	PRINTOPCODE(st, "%x\n", (opcode << 11) | (rd << 8) | st->values[2]);
+	PRINTOPCODE(st, "%x\n", (kw->value << 11) | (rd << 8) | (rs << 5) | st->values[off + 1]);
 
 	next_insn(st);
 	return 0;
 }
 
-static int parse_token_mov(uint8_t opcode, struct parse_state *st)
+/* rd, rs and for shifts rt */
+static int parse_token_regs(const struct keyword *kw, struct parse_state *st)
 {
 	int rd;
 	int rs;
+	int rt = 0;
+	int n;
 
-	if (st->tok_pos != 3) {
+	n = (kw->form == FORM_SHIFT_REG) ? 4 : 3;
+	if (st->tok_pos != n) {
 		return 1;
 	}
 
-	rd = parse_token_reg(st->tokens[1]);
+	rd = parse_token_reg(st, 1);
 	if (rd < 0) {
 		return 1;
 	}
-	rs = parse_token_reg(st->tokens[2]);
+	rs = (kw->form == FORM_ROT_REG) ? rd : parse_token_reg(st, 2);
 	if (rs < 0) {
 		return 1;
 	}
-	PRINTOPCODE(st, "%x\n", (opcode << 11) | (rd << 8) | (rs << 5));
-
-	next_insn(st);
-	return 0;
-}
-
-static int parse_token_alucode(uint8_t opcode, struct parse_state *st)
-{
-	int rd;
-	int rs;
-
-	if (st->tok_pos != 3) {
-		return 1;
-	}
-
-	rd = parse_token_reg(st->tokens[1]);
-	if (rd < 0) {
-		return 1;
-	}
-	rs = parse_token_reg(st->tokens[2]);
-	if (rs < 0) {
-		return 1;
+	if (kw->form != FORM_REG) {
+		rt = parse_token_reg(st, n - 1);
+		if (rt < 0) {
+			return 1;
+		}
 	}
-	PRINTOPCODE(st, "%x\n", (opcode << 11) | (rd << 8) | (rs << 5));
+	PRINTOPCODE(st, "%x\n", (kw->value << 11) | (rd << 8) | (rs << 5) | (rt << 2));
 
 	next_insn(st);
 	return 0;
 }
 
-static int parse_cond(int token)
+static int parse_token_jump(const struct keyword *kw, struct parse_state *st)
 {
-	switch(token) {
-		case TOK_JAL:
-			return COND_AL;
-		case TOK_JEQ:
-			return COND_EQ;
-		case TOK_JGT:
-			return COND_GT;
-		case TOK_JLT:
-			return COND_LT;
-		case TOK_JNE:
-			return COND_NE;
-		case TOK_JGE:
-			return COND_GE;
-		case TOK_JLE:
-			return COND_LE;
-		case TOK_JNV:
-			return COND_NV;
-
-		case TOK_BAL:
-			return COND_AL;
-		case TOK_BEQ:
-			return COND_EQ;
-		case TOK_BGT:
-			return COND_GT;
-		case TOK_BLT:
-			return COND_LT;
-		case TOK_BNE:
-			return COND_NE;
-		case TOK_BGE:
-			return COND_GE;
-		case TOK_BLE:
-			return COND_LE;
-		case TOK_BNV:
-			return COND_NV;
-		default:
-			return -1;
-	}
-}
-
-static int parse_token_jump(uint8_t opcode, struct parse_state *st)
-{
-	int cond;
 	int rs;
 	int rt;
 
@@ -708,30 +579,23 @@ static int parse_token_jump(uint8_t opcode, struct parse_state *st)
 		return 1;
 	}
 
-	cond = parse_cond(st->tokens[0]);
-	if (cond < 0) {
-		fprintf(stderr, "Error: Branch condition wrong.\n");
-		return 1;
-	}
-
-	rs = parse_token_reg(st->tokens[1]);
+	rs = parse_token_reg(st, 1);
 	if (rs < 0) {
 		return 1;
 	}
-	rt = parse_token_reg(st->tokens[2]);
+	rt = parse_token_reg(st, 2);
 	if (rt < 0) {
 		return 1;
 	}
 
-	PRINTOPCODE(st, "%x\n", (opcode << 11) | (cond << 8) | (rs << 5) | (rt << 2));
+	PRINTOPCODE(st, "%x\n", (kw->value << 11) | (kw->cond << 8) | (rs << 5) | (rt << 2));
 
 	next_insn(st);
 	return 0;
 }
 
-static int parse_token_branch(uint8_t opcode, struct parse_state *st)
+static int parse_token_branch(const struct keyword *kw, struct parse_state *st)
 {
-	int cond;
 	uint16_t offset;
 	uint32_t addr;
 
@@ -740,20 +604,15 @@ static int parse_token_branch(uint8_t opcode, struct parse_state *st)
 		return 1;
 	}
 
-	cond = parse_cond(st->tokens[0]);
-	if (cond < 0) {
-		fprintf(stderr, "Error: Branch condition wrong.\n");
-		return 1;
-	}
-
 	if (st->tokens[1] == TOK_LABEL) {
 
-		addr = get_label_address(st, st->label);
+		addr = get_label_address(st, st->label, st->label_len);
 		if (addr > 0xFFFF) {
 			if (st->pass == 0) {
 				addr = 0;
 			} else {
-				fprintf(stderr, "Error: Invalid label %s, line %u col %u\n", st->label, st->lineno, st->col);
+				fprintf(stderr, "Error: Invalid label %.*s, line %u col %u\n", (int)st->label_len, st->label,
+					st->lineno, column(st, st->pos));
 				return 1;
 			}
 		}
@@ -768,7 +627,7 @@ static int parse_token_branch(uint8_t opcode, struct parse_state *st)
 		fprintf(stderr, "Error: Branch offset larger than 8 bit (offset 0x%04x, pc 0x%04x, target 0x%04x)\n", offset, st->address, addr);
 		return 1;
 	}
-	PRINTOPCODE(st, "%x\n", (opcode << 11) | (cond << 8) | ((offset >> 1) & 0xFF));
+	PRINTOPCODE(st, "%x\n", (kw->value << 11) | (kw->cond << 8) | ((offset >> 1) & 0xFF));
 
 	next_insn(st);
 	return 0;
@@ -776,242 +635,338 @@ static int parse_token_branch(uint8_t opcode, struct parse_state *st)
 
 static int parse_token_list(struct parse_state *st)
 {
+	const struct keyword *kw;
+
 	if (st->tok_pos == 0) {
 		return 0;
 	}
-	switch(st->tokens[0]) {
-		case TOK_NOP:
-			return parse_token_nop(st);
-		case TOK_LI:
-			return parse_token_alu(OP_LI, st);
-		case TOK_ADDI:
-			return parse_token_alu(OP_ADDI, st);
-		case TOK_ANDI:
-			return parse_token_alu(OP_ANDI, st);
-		case TOK_ORI:
-			return parse_token_alu(OP_ORI, st);
-		case TOK_XORI:
-			return parse_token_alu(OP_XORI, st);
-		case TOK_SUBI:
-			return parse_token_alu(OP_SUBI, st);
-		case TOK_CMPI:
-			return parse_token_alu(OP_CMPI, st);
-		case TOK_SHRI:
-		case TOK_RORI:
-			return parse_token_shift(OP_SHRI, st);
-		case TOK_SHLI:
-		case TOK_ROLI:
-			return parse_token_shift(OP_SHLI, st);
-		case TOK_LDB:
-			return parse_token_addr(OP_LDB, st);
-		case TOK_STB:
-			return parse_token_addr(OP_STB, st);
-		case TOK_MOV:
-			return parse_token_mov(OP_MOV, st);
-		case TOK_ADD:
-			return parse_token_alucode(OP_ADD, st);
-		case TOK_AND:
-			return parse_token_alucode(OP_AND, st);
-		case TOK_OR:
-			return parse_token_alucode(OP_OR, st);
-		case TOK_XOR:
-			return parse_token_alucode(OP_XOR, st);
-		case TOK_SUB:
-			return parse_token_alucode(OP_SUB, st);
-		case TOK_CMP:
-			return parse_token_alucode(OP_CMP, st);
-		case TOK_SHR:
-		case TOK_ROR:
-			return parse_token_shiftreg(OP_SHR, st);
-		case TOK_SHL:
-		case TOK_ROL:
-			return parse_token_shiftreg(OP_SHL, st);
-
-		case TOK_JAL:
-			return parse_token_jump(OP_JUMP, st);
-		case TOK_JEQ:
-			return parse_token_jump(OP_JUMP, st);
-		case TOK_JGT:
-			return parse_token_jump(OP_JUMP, st);
-		case TOK_JLT:
-			return parse_token_jump(OP_JUMP, st);
-		case TOK_JNE:
-			return parse_token_jump(OP_JUMP, st);
-		case TOK_JGE:
-			return parse_token_jump(OP_JUMP, st);
-		case TOK_JLE:
-			return parse_token_jump(OP_JUMP, st);
-
-		case TOK_BAL:
-			return parse_token_branch(OP_BRANCH, st);
-		case TOK_BEQ:
-			return parse_token_branch(OP_BRANCH, st);
-		case TOK_BGT:
-			return parse_token_branch(OP_BRANCH, st);
-		case TOK_BLT:
-			return parse_token_branch(OP_BRANCH, st);
-		case TOK_BNE:
-			return parse_token_branch(OP_BRANCH, st);
-		case TOK_BGE:
-			return parse_token_branch(OP_BRANCH, st);
-		case TOK_BLE:
-			return parse_token_branch(OP_BRANCH, st);
+	if (st->tokens[0] != TOK_INSN) {
+		fprintf(stderr, "Error: Syntax error (%u) col %u\n", st->tokens[0], column(st, st->tokens_pos[0]));
+		return 1;
+	}
+	kw = &keywords[st->values[0]];
+	switch(kw->form) {
+		case FORM_NONE:
+			return parse_token_nop(kw, st);
+		case FORM_IMM:
+			return parse_token_imm(kw, st, TOK_VAL);
+		case FORM_ADDR:
+			return parse_token_imm(kw, st, TOK_ADDRESS);
+		case FORM_SHIFT_IMM:
+		case FORM_ROT_IMM:
+			return parse_token_shift(kw, st);
+		case FORM_REG:
+		case FORM_SHIFT_REG:
+		case FORM_ROT_REG:
+			return parse_token_regs(kw, st);
+		case FORM_JUMP:
+			return parse_token_jump(kw, st);
+		case FORM_BRANCH:
+			return parse_token_branch(kw, st);
 		default:
-			fprintf(stderr, "Error: Syntax error (%u) col %u\n", st->tokens[0], st->tokens_col[0]);
+			fprintf(stderr, "Error: Syntax error (%u) col %u\n", st->tokens[0], column(st, st->tokens_pos[0]));
 			return 1;
 	}
 	return 0;
 }
 
-static void parse_reset(struct parse_state *st)
+/* Write the line ending at eol to the listing, with its address if it is
+ * an instruction.
+ */
+static void list_line(struct parse_state *st, const char *eol)
 {
-	st->pos = 0;
+	const char *c;
+	int n = 0;
+
+	for (c = st->line_start; (c < eol) && (n < MAX_BUF_SIZE - 1); c++) {
+		if (*c != '\r') {
+			st->line[n++] = *c;
+		}
+	}
+	st->line[n] = 0;
+	if (st->address != st->line_address) {
+		fprintf(st->listing, "%04X %5u  %s\n", st->line_address, st->lineno, st->line);
+	} else {
+		fprintf(st->listing, "     %5u  %s\n", st->lineno, st->line);
+	}
+	st->line_address = st->address;
+}
+
+static void parse_reset(struct parse_state *st, const char *text)
+{
+	st->pos = text;
+	st->line_start = text;
 	st->lineno = 1;
-	st->col = 1;
 	st->address = 0;
 	st->tok_pos = 0;
-	st->lineskip = 0;
-	st->buffer[0] = 0;
-	st->label[0] = 0;
+	st->label = NULL;
+	st->label_len = 0;
+	st->tokens_pos[0] = text;
+	st->line_address = 0;
 }
 
-static int parse_char(struct parse_state *st, char c)
+static inline int is_token_char(char c)
 {
-	// printf("%c", c);
+	return (c > ' ') && (c <= '~') && (c != ',') && (c != ';');
+}
 
-	if (!st->lineskip) {
-		if ((c > ' ') && (c <= '~') && (c != ',') && (c != ';')) {
-			/* non white space */
-			st->buffer[st->pos] = c;
-			if (st->pos == 0) {
-				st->tokens_col[st->tok_pos] = st->col;
-			}
-			st->pos++;
+/* The lexer classifies 16 characters at once with the GCC vector
+ * extensions, a token is a run of the printable characters except ',' and
+ * ';'.
+ */
+#if defined(__GNUC__)
 
-			if (st->pos >= MAX_BUF_SIZE) {
-				fprintf(stderr, "Error: String too long at line %u col %u.\n", st->lineno, st->col);
-				return 1;
-			}
-		} else {
-			st->buffer[st->pos] = 0;
-			if (st->pos > 0) {
-				int token;
+typedef uint8_t v16 __attribute__((vector_size(16)));
+typedef uint64_t v2q __attribute__((vector_size(16)));
 
-#ifdef VERBOSE
-				printf("# line %u col %u token: '%s'\n", st->lineno, st->col, st->buffer);
+#define SPLAT16(c) ((v16){ c, c, c, c, c, c, c, c, c, c, c, c, c, c, c, c })
+
+/* 0xFF in the bytes of token characters */
+static inline v16 token_chars(v16 v)
+{
+	return (v16)((v > SPLAT16(' ')) & (v <= SPLAT16('~')) & (v != SPLAT16(',')) & (v != SPLAT16(';')));
+}
+
+/* Index of the first byte of a mask which is 0xFF, 8 if none */
+static inline unsigned int first_byte(uint64_t q)
+{
+	if (q == 0) {
+		return 8;
+	}
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	return __builtin_clzll(q) / 8;
+#else
+	return __builtin_ctzll(q) / 8;
 #endif
-				token = parse_token(st);
-				if (token == TOK_INVAL) {
-					fprintf(stderr, "Error: Invalid token at line %u col %u.\n", st->lineno, st->tokens_col[st->tok_pos]);
-					return 1;
-				}
-				if (token == TOK_ADD_LABEL) {
-					st->tok_pos = 0;
-					st->label[0] = 0;
-				} else {
-					if (st->tok_pos >= TOK_SIZE) {
-						fprintf(stderr, "Error: Too many tokens at line %u col %u.\n", st->lineno, st->col);
-						return 1;
-					}
-					st->tokens[st->tok_pos] = token;
-					st->tok_pos++;
-
-					if (st->tok_pos < TOK_SIZE) {
-						st->tokens_col[st->tok_pos] = st->col;
-					}
-				}
-			}
-			st->pos = 0;
+}
+
+#endif
+
+/* The first character from p before stop which is a token character if
+ * token is set or else is none, stop if there is none. 16 characters are
+ * read at once while they are before end, the end of the source.
+ */
+static inline const char *find_class(const char *p, const char *stop, const char *end, int token)
+{
+#if defined(__GNUC__)
+	v16 v;
+	v2q m;
+	unsigned int i;
+
+	while ((p < stop) && (end - p >= 16)) {
+		memcpy(&v, p, sizeof(v));
+		m = (v2q)token_chars(v);
+		if (!token) {
+			m = ~m;
+		}
+		i = first_byte(m[0]);
+		if (i == 8) {
+			i += first_byte(m[1]);
+		}
+		if (i < 16) {
+			p += i;
+			return (p < stop) ? p : stop;
 		}
+		p += 16;
 	}
-	if (c == ';') {
-		st->lineskip = 1;
+#endif
+	while ((p < stop) && (is_token_char(*p) != token)) {
+		p++;
 	}
+	return p;
+}
 
-	if (c == '\t') {
-		st->col += 8;
-	} else {
-		st->col++;
-	}
-	if (c == '\n') {
-		int rv;
+/* Assemble the size characters at text. A last line without newline ends
+ * at the end of the text.
+ */
+static int parse_text(struct parse_state *st, const char *text, size_t size)
+{
+	const char *end = text + size;
+	const char *eol;
+	const char *next;
+	const char *stop;
+	const char *p;
+	const char *q;
+	int token;
+	int i;
+
+	for (p = text; p < end; p = next) {
+		eol = memchr(p, '\n', end - p);
+		if (eol == NULL) {
+			eol = end;
+		}
+		next = (eol < end) ? (eol + 1) : end;
+		st->line_start = p;
+		st->tokens_pos[0] = p;
+		/* The rest of the line after ';' is a comment */
+		stop = memchr(p, ';', eol - p);
+		if (stop == NULL) {
+			stop = eol;
+		}
+		while ((p = find_class(p, stop, end, 1)) < stop) {
+			q = find_class(p, stop, end, 0);
+			st->pos = q;
 
-		st->lineskip = 0;
+#ifdef VERBOSE
+			printf("# line %u col %u token: '%.*s'\n", st->lineno, column(st, q), (int)(q - p), p);
+#endif
+			if (st->tok_pos >= TOK_SIZE) {
+				fprintf(stderr, "Error: Too many tokens at line %u col %u.\n", st->lineno, column(st, q));
+				return 1;
+			}
+			st->tokens_pos[st->tok_pos] = p;
+			token = parse_token(st, p, q - p);
+			if (token == TOK_INVAL) {
+				fprintf(stderr, "Error: Invalid token at line %u col %u.\n", st->lineno, column(st, p));
+				return 1;
+			}
+			if (token == TOK_ADD_LABEL) {
+				st->tok_pos = 0;
+				st->label = NULL;
+			} else {
+				st->tokens[st->tok_pos] = token;
+				st->tok_pos++;
 
-		rv = parse_token_list(st);
-		if (rv != 0) {
-			int i;
+				if (st->tok_pos < TOK_SIZE) {
+					st->tokens_pos[st->tok_pos] = q;
+				}
+			}
+			p = q;
+		}
+		st->pos = next;
 
-			fprintf(stderr, "Error: Failed to parse tokens at line %u col %u to %u.\n", st->lineno, st->tokens_col[0], st->col);
+		if (parse_token_list(st) != 0) {
+			fprintf(stderr, "Error: Failed to parse tokens at line %u col %u to %u.\n", st->lineno,
+				column(st, st->tokens_pos[0]), column(st, next));
 
 			for (i = 0; i < st->tok_pos; i++) {
 				fprintf(stderr, "Token %u: %u %s", i, st->tokens[i], get_token_name(st->tokens[i]));
-				if (st->tokens[i] == TOK_VAL) {
+				if (st->tokens[i] == TOK_INSN) {
+					fprintf(stderr, " %s", keywords[st->values[i]].name);
+				}
+				if ((st->tokens[i] == TOK_VAL) || (st->tokens[i] == TOK_REG)) {
 					fprintf(stderr, " 0x%04x", st->values[i]);
 				}
 				if (st->tokens[i] == TOK_LABEL) {
-					fprintf(stderr, " %s", st->label);
+					fprintf(stderr, " %.*s", (int)st->label_len, st->label);
 				}
 				fprintf(stderr, "\n");
 			}
 			return 1;
 		}
+		if ((st->pass == 1) && (st->listing != NULL)) {
+			list_line(st, eol);
+		}
 
 		st->tok_pos = 0;
 		st->lineno++;
-		st->col = 1;
-		st->label[0] = 0;
-		st->tokens_col[st->tok_pos] = st->col;
-	}
-
-	if (c == '\r') {
-		st->col = 1;
-		st->tokens_col[st->tok_pos] = st->col;
+		st->label = NULL;
 	}
 	return 0;
 }
 
+static void usage(void)
+{
+	printf("lotec-ass [-l listing] [asm file]\n");
+	printf("Assembler for LoTec 8-Bit CPU\n");
+	printf(" -l listing   Write the source lines with the addresses of the instructions\n");
+}
+
 int main(int argc, char *argv[])
 {
 	const char *filename;
-	FILE *fin;
-	char c;
+	const char *listfile = NULL;
+	const char *text = "";
 	struct parse_state st;
-
-	if (argc > 1) {
-		filename = argv[1];
-	} else {
-		printf("lotec-ass [asm file]\n");
-		printf("Assembler for LoTec 8-Bit CPU\n");
+	struct stat sb;
+	size_t size = 0;
+	int rv = 0;
+	int opt;
+	int fd;
+
+	while ((opt = getopt(argc, argv, "l:")) != -1) {
+		switch (opt) {
+			case 'l':
+				listfile = optarg;
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+	if (optind >= argc) {
+		usage();
 		return 1;
 	}
-	fin = fopen(filename, "r");
-	if (fin == NULL) {
+	filename = argv[optind];
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
 		fprintf(stderr, "Error: Failed to open file '%s'.\n", filename);
 		return 2;
 	}
+	/* Both passes read the source in place */
+	if (fstat(fd, &sb) != 0) {
+		fprintf(stderr, "Error: Failed to read file '%s'.\n", filename);
+		close(fd);
+		return 2;
+	}
+	if (sb.st_size > 0) {
+		size = sb.st_size;
+		text = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (text == MAP_FAILED) {
+			fprintf(stderr, "Error: Failed to map file '%s'.\n", filename);
+			close(fd);
+			return 2;
+		}
+	}
+	close(fd);
+	st.listing = NULL;
+	if (listfile != NULL) {
+		st.listing = fopen(listfile, "w");
+		if (st.listing == NULL) {
+			fprintf(stderr, "Error: Failed to open file '%s'.\n", listfile);
+			rv = 2;
+			goto out;
+		}
+		fprintf(st.listing, "; %s\n", filename);
+	}
 
 	printf("v2.0 raw\n");
 
-	parse_reset(&st);
+	if (keywords_init() != 0) {
+		fprintf(stderr, "Error: Mnemonics have no perfect hash.\n");
+		rv = 3;
+		goto out;
+	}
+	if (symtab_init(&st.symbols) != 0) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		rv = 2;
+		goto out;
+	}
+	parse_reset(&st, text);
 	st.pass = 0;
-	st.numlabels = 0;
-	while(fread(&c, sizeof(c), 1, fin) == 1) {
-		if (parse_char(&st, c) != 0) {
-			fprintf(stderr, "Error: Failed to parse file '%s'.\n", filename);
-			return 3;
-		}
+	if (parse_text(&st, text, size) != 0) {
+		fprintf(stderr, "Error: Failed to parse file '%s'.\n", filename);
+		rv = 3;
+		goto out_symbols;
 	}
 
-	rewind(fin);
-	parse_reset(&st);
+	parse_reset(&st, text);
 	st.pass = 1;
-	while(fread(&c, sizeof(c), 1, fin) == 1) {
-		if (parse_char(&st, c) != 0) {
-			fprintf(stderr, "Error: Failed to parse file '%s'.\n", filename);
-			return 3;
-		}
+	if (parse_text(&st, text, size) != 0) {
+		fprintf(stderr, "Error: Failed to parse file '%s'.\n", filename);
+		rv = 3;
 	}
-	fclose(fin);
-	return 0;
+
+out_symbols:
+	symtab_free(&st.symbols);
+out:
+	if (size > 0) {
+		munmap((void *)text, size);
+	}
+	if ((st.listing != NULL) && (fclose(st.listing) != 0)) {
+		fprintf(stderr, "Error: Failed to write file '%s'.\n", listfile);
+		return 2;
+	}
+	return rv;
 }
@@ -0,0 +1,490 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "lotec-cpu.h"
+
+/* Runs every ROM with every RAM image of a directory on all cores. Each
+ * worker owns a deque of jobs, it takes jobs from the bottom of its own deque
+ * and steals from the top of the others when it runs empty (Chase-Lev), so
+ * long running jobs don't leave cores idle.
+ */
+
+struct deque {
+	_Atomic int64_t top;
+	_Atomic int64_t bottom;
+	_Atomic uint32_t *jobs;
+	int64_t size;
+};
+
+struct batch {
+	const struct lotec_engine *engine;
+	struct lotec_rom **roms;
+	const char **rom_names;
+	unsigned int num_roms;
+	uint8_t (*seeds)[RAM_SIZE];
+	char **seed_names;
+	unsigned int num_seeds;
+	uint64_t max_cycles;
+	struct deque *deques;
+	unsigned int num_workers;
+	_Atomic uint32_t remaining;
+	_Atomic uint64_t insns;
+	_Atomic uint64_t steals;
+	pthread_mutex_t out_lock;
+};
+
+struct worker {
+	struct batch *b;
+	unsigned int id;
+	struct lotec_rom *rom;	/* private copy for the engine */
+	int rom_index;
+	pthread_t thread;
+	int started;
+};
+
+/* Only the owner pushes, before the workers start. */
+static void deque_push(struct deque *d, uint32_t job)
+{
+	int64_t b;
+
+	b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+	atomic_store_explicit(&d->jobs[b % d->size], job, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+}
+
+/* Take the newest job of the own deque. Returns 0 if it was empty. */
+static int deque_pop(struct deque *d, uint32_t *job)
+{
+	int64_t b;
+	int64_t t;
+	int rv = 1;
+
+	b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+	atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	t = atomic_load_explicit(&d->top, memory_order_relaxed);
+	if (t > b) {
+		atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+		return 0;
+	}
+	*job = atomic_load_explicit(&d->jobs[b % d->size], memory_order_relaxed);
+	if (t == b) {
+		/* Last job, race with the thieves for it */
+		if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+			memory_order_seq_cst, memory_order_relaxed)) {
+			rv = 0;
+		}
+		atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+	}
+	return rv;
+}
+
+/* Take the oldest job of another deque. Returns 0 if it was empty or
+ * another thread took the job first.
+ */
+static int deque_steal(struct deque *d, uint32_t *job)
+{
+	int64_t t;
+	int64_t b;
+
+	t = atomic_load_explicit(&d->top, memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+	if (t >= b) {
+		return 0;
+	}
+	*job = atomic_load_explicit(&d->jobs[t % d->size], memory_order_relaxed);
+	return atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+		memory_order_seq_cst, memory_order_relaxed);
+}
+
+/* FNV-1a of the RAM */
+static uint64_t ram_hash(const struct lotec_cpu *cpu)
+{
+	uint64_t h = 0xCBF29CE484222325ULL;
+	unsigned int i;
+
+	for (i = 0; i < RAM_SIZE; i++) {
+		h = (h ^ cpu->ram[i]) * 0x100000001B3ULL;
+	}
+	return h;
+}
+
+static struct lotec_rom *worker_rom(struct worker *w, unsigned int index)
+{
+	struct lotec_rom *rom = w->b->roms[index];
+
+	if (!w->b->engine->private_rom) {
+		return rom;
+	}
+	if (w->rom_index != (int)index) {
+		w->rom->size = rom->size;
+		memcpy(w->rom->words, rom->words, ROM_WORDS * sizeof(*rom->words));
+		lotec_rom_decode(w->rom);
+		w->rom_index = index;
+	}
+	return w->rom;
+}
+
+static void run_job(struct worker *w, uint32_t job)
+{
+	struct batch *b = w->b;
+	struct lotec_cpu cpu;
+	unsigned int rom;
+	unsigned int seed;
+	char line[256];
+	int reason;
+
+	rom = job / b->num_seeds;
+	seed = job % b->num_seeds;
+	lotec_reset(&cpu);
+	memcpy(cpu.ram, b->seeds[seed], RAM_SIZE);
+	reason = b->engine->run(&cpu, worker_rom(w, rom), b->max_cycles);
+
+	snprintf(line, sizeof(line), "%s %s %s %02X %02X %02X %02X %02X %02X %02X $%04X %llu %llu %016llX\n",
+		b->rom_names[rom], b->seed_names[seed], lotec_exit_name(reason),
+		cpu.r[0], cpu.r[1], cpu.r[2], cpu.r[3], cpu.r[4], cpu.flags, cpu.pch, cpu.pc << 1,
+		(unsigned long long)cpu.cycles, (unsigned long long)cpu.insns,
+		(unsigned long long)ram_hash(&cpu));
+	pthread_mutex_lock(&b->out_lock);
+	fputs(line, stdout);
+	pthread_mutex_unlock(&b->out_lock);
+	atomic_fetch_add_explicit(&b->insns, cpu.insns, memory_order_relaxed);
+}
+
+/* Take the oldest job of another deque, starting at a random one. Jobs are
+ * only pushed before the workers start, so when all deques are empty the
+ * remaining jobs are running and none will come.
+ */
+static int steal_job(struct worker *w, uint32_t *x, uint32_t *job)
+{
+	struct batch *b = w->b;
+	struct deque *d;
+	unsigned int victim;
+	unsigned int i;
+
+	if (b->num_workers == 1) {
+		return 0;
+	}
+	/* xorshift32 to pick the first victim */
+	*x ^= *x << 13;
+	*x ^= *x >> 17;
+	*x ^= *x << 5;
+	victim = *x % b->num_workers;
+	for (i = 0; i < b->num_workers; i++, victim = (victim + 1) % b->num_workers) {
+		if (victim == w->id) {
+			continue;
+		}
+		d = &b->deques[victim];
+		/* Again when another thief took the job first */
+		while (atomic_load_explicit(&d->top, memory_order_acquire) <
+			atomic_load_explicit(&d->bottom, memory_order_acquire)) {
+			if (deque_steal(d, job)) {
+				atomic_fetch_add_explicit(&b->steals, 1, memory_order_relaxed);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+/* Run jobs until there are none left to take, the last ones may still be
+ * running on other workers, main() waits for them in pthread_join().
+ */
+static void *worker_main(void *arg)
+{
+	struct worker *w = arg;
+	struct batch *b = w->b;
+	uint32_t job;
+	uint32_t x;
+
+	x = w->id * 0x9E3779B9 + 1;
+	while (atomic_load_explicit(&b->remaining, memory_order_acquire) > 0) {
+		if (!deque_pop(&b->deques[w->id], &job) && !steal_job(w, &x, &job)) {
+			break;
+		}
+		run_job(w, job);
+		atomic_fetch_sub_explicit(&b->remaining, 1, memory_order_release);
+	}
+	return NULL;
+}
+
+static int name_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* Load the files of dir not starting with a dot as RAM images, sorted by
+ * name.
+ */
+static int load_seeds(struct batch *b, const char *dir)
+{
+	struct lotec_cpu cpu;
+	struct dirent *de;
+	char **names;
+	char path[4096];
+	DIR *d;
+	unsigned int i;
+
+	d = opendir(dir);
+	if (d == NULL) {
+		fprintf(stderr, "Error: Failed to open directory '%s'.\n", dir);
+		return 2;
+	}
+	while ((de = readdir(d)) != NULL) {
+		if (de->d_name[0] == '.') {
+			continue;
+		}
+		names = realloc(b->seed_names, (b->num_seeds + 1) * sizeof(*names));
+		if (names == NULL) {
+			fprintf(stderr, "Error: Out of memory.\n");
+			closedir(d);
+			return 2;
+		}
+		b->seed_names = names;
+		b->seed_names[b->num_seeds] = strdup(de->d_name);
+		if (b->seed_names[b->num_seeds] == NULL) {
+			fprintf(stderr, "Error: Out of memory.\n");
+			closedir(d);
+			return 2;
+		}
+		b->num_seeds++;
+	}
+	closedir(d);
+	if (b->num_seeds == 0) {
+		fprintf(stderr, "Error: No RAM images in directory '%s'.\n", dir);
+		return 2;
+	}
+	qsort(b->seed_names, b->num_seeds, sizeof(*b->seed_names), name_cmp);
+
+	b->seeds = calloc(b->num_seeds, RAM_SIZE);
+	if (b->seeds == NULL) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		return 2;
+	}
+	for (i = 0; i < b->num_seeds; i++) {
+		snprintf(path, sizeof(path), "%s/%s", dir, b->seed_names[i]);
+		if (lotec_ram_load(&cpu, path) != 0) {
+			return 2;
+		}
+		memcpy(b->seeds[i], cpu.ram, RAM_SIZE);
+	}
+	return 0;
+}
+
+/* Distribute the jobs in contiguous blocks, so a worker runs the same ROM
+ * until it steals.
+ */
+static int start_workers(struct batch *b, struct worker *workers)
+{
+	uint32_t num_jobs;
+	uint32_t job;
+	unsigned int i;
+
+	num_jobs = b->num_roms * b->num_seeds;
+	atomic_store(&b->remaining, num_jobs);
+	for (i = 0; i < b->num_workers; i++) {
+		b->deques[i].size = num_jobs / b->num_workers + 1;
+		b->deques[i].jobs = calloc(b->deques[i].size, sizeof(*b->deques[i].jobs));
+		if (b->deques[i].jobs == NULL) {
+			fprintf(stderr, "Error: Out of memory.\n");
+			return 2;
+		}
+		atomic_store(&b->deques[i].top, 0);
+		atomic_store(&b->deques[i].bottom, 0);
+		/* Pushed in reverse, the owner pops the first job first. */
+		for (job = (uint64_t)num_jobs * (i + 1) / b->num_workers;
+			job > (uint64_t)num_jobs * i / b->num_workers; job--) {
+			deque_push(&b->deques[i], job - 1);
+		}
+	}
+
+	for (i = 0; i < b->num_workers; i++) {
+		workers[i].b = b;
+		workers[i].id = i;
+		workers[i].rom_index = -1;
+		if (b->engine->private_rom) {
+			workers[i].rom = lotec_rom_alloc();
+			if (workers[i].rom == NULL) {
+				return 2;
+			}
+		}
+	}
+	for (i = 0; i < b->num_workers; i++) {
+		if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0) {
+			fprintf(stderr, "Error: Failed to start worker %u.\n", i);
+			atomic_store(&b->remaining, 0);
+			return 2;
+		}
+		workers[i].started = 1;
+	}
+	return 0;
+}
+
+static void usage(void)
+{
+	unsigned int i;
+
+	printf("lotec-batch [-c cycles] [-e engine] [-j workers] [-t] [-N] ram-dir rom...\n");
+	printf("Runs every ROM with every RAM image in ram-dir on all cores\n");
+	printf(" -c cycles    Stop after cycles clock cycles (default %llu)\n", DEFAULT_MAX_CYCLES);
+	printf(" -e engine    Execution engine:");
+	for (i = 0; i < LOTEC_NUM_ENGINES; i++) {
+		printf(" %s", lotec_engines[i].name);
+	}
+	printf(" (default %s)\n", lotec_engines[0].name);
+	printf(" -j workers   Number of worker threads (default: online cores)\n");
+	printf(" -t           Print simulation speed\n");
+	printf(" -N           Load the ROM files themselves, not their pre-decoded images\n");
+	printf("              <file>.img, which are written when missing or older than the file\n");
+	printf("One line is printed per run as it finishes:\n");
+	printf("rom ram exit R0 R1 R2 R3 R4 FLAGS PCH PC cycles insns ram-hash\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct batch b;
+	struct worker *workers = NULL;
+	struct lotec_cpu cpu;
+	const char *dir;
+	double start;
+	double duration;
+	long cores;
+	unsigned int i;
+	int timing = 0;
+	int no_image = 0;
+	int rv = 0;
+	int opt;
+
+	memset(&b, 0, sizeof(b));
+	b.engine = &lotec_engines[0];
+	b.max_cycles = DEFAULT_MAX_CYCLES;
+	cores = sysconf(_SC_NPROCESSORS_ONLN);
+	b.num_workers = (cores > 0) ? cores : 1;
+
+	while ((opt = getopt(argc, argv, "c:e:j:tN")) != -1) {
+		switch (opt) {
+			case 'c':
+				b.max_cycles = strtoull(optarg, NULL, 0);
+				break;
+			case 'e':
+				b.engine = lotec_find_engine(optarg);
+				if (b.engine == NULL) {
+					fprintf(stderr, "Error: Unknown engine '%s'.\n", optarg);
+					return 1;
+				}
+				break;
+			case 'j':
+				b.num_workers = strtoul(optarg, NULL, 0);
+				if (b.num_workers == 0) {
+					usage();
+					return 1;
+				}
+				break;
+			case 't':
+				timing = 1;
+				break;
+			case 'N':
+				no_image = 1;
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+	if (optind + 2 > argc) {
+		usage();
+		return 1;
+	}
+	dir = argv[optind++];
+
+	b.num_roms = argc - optind;
+	b.rom_names = (const char **)&argv[optind];
+	b.roms = calloc(b.num_roms, sizeof(*b.roms));
+	b.deques = calloc(b.num_workers, sizeof(*b.deques));
+	workers = calloc(b.num_workers, sizeof(*workers));
+	if ((b.roms == NULL) || (b.deques == NULL) || (workers == NULL)) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		rv = 2;
+		goto out;
+	}
+	for (i = 0; i < b.num_roms; i++) {
+		b.roms[i] = lotec_rom_alloc();
+		if (b.roms[i] == NULL) {
+			rv = 2;
+			goto out;
+		}
+		rv = no_image ? lotec_rom_load(b.roms[i], b.rom_names[i]) :
+			lotec_rom_load_cached(b.roms[i], b.rom_names[i]);
+		if (rv != 0) {
+			rv = 2;
+			goto out;
+		}
+		/* Translate shared threaded code before the workers use it. */
+		if (b.engine->run == lotec_run_threaded) {
+			lotec_reset(&cpu);
+			lotec_run_threaded(&cpu, b.roms[i], 0);
+		}
+	}
+	rv = load_seeds(&b, dir);
+	if (rv != 0) {
+		goto out;
+	}
+	if ((uint64_t)b.num_roms * b.num_seeds > UINT32_MAX) {
+		fprintf(stderr, "Error: Too many runs.\n");
+		rv = 1;
+		goto out;
+	}
+	pthread_mutex_init(&b.out_lock, NULL);
+
+	start = lotec_get_time();
+	rv = start_workers(&b, workers);
+	for (i = 0; i < b.num_workers; i++) {
+		if (workers[i].started) {
+			pthread_join(workers[i].thread, NULL);
+		}
+	}
+	duration = lotec_get_time() - start;
+	pthread_mutex_destroy(&b.out_lock);
+
+	if (timing && (rv == 0)) {
+		fprintf(stderr, "%u runs on %u workers, %.3f s, %.1f M instructions/s, %llu steals\n",
+			b.num_roms * b.num_seeds, b.num_workers, duration,
+			(duration > 0) ? (atomic_load(&b.insns) / duration / 1e6) : 0.0,
+			(unsigned long long)atomic_load(&b.steals));
+	}
+
+out:
+	if (workers != NULL) {
+		for (i = 0; i < b.num_workers; i++) {
+			lotec_rom_free(workers[i].rom);
+		}
+	}
+	if (b.deques != NULL) {
+		for (i = 0; i < b.num_workers; i++) {
+			free(b.deques[i].jobs);
+		}
+	}
+	if (b.roms != NULL) {
+		for (i = 0; i < b.num_roms; i++) {
+			lotec_rom_free(b.roms[i]);
+		}
+	}
+	for (i = 0; i < b.num_seeds; i++) {
+		free(b.seed_names[i]);
+	}
+	free(b.seed_names);
+	free(b.seeds);
+	free(b.roms);
+	free(b.deques);
+	free(workers);
+	return rv;
+}
@@ -0,0 +1,280 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "lotec-cpu.h"
+#include "lotec-netcpu.h"
+#include "lotec-disasm.h"
+
+/* Runs a ROM on the instruction set model and on the netlist of
+ * dig/lotec.dig in lockstep and stops at the first instruction after which
+ * they differ. The model runs a batch of instructions ahead and keeps the
+ * registers, PC and cycles after each; the netlist then runs the batch and
+ * is compared with them after every instruction. The RAM is only compared
+ * at the end of a batch. On a difference both run again from the start
+ * with the RAM compared after every instruction, to find the first one
+ * writing a different value and print the state of the model at it.
+ */
+
+#define DEFAULT_BATCH 4096
+
+struct arch {
+	uint64_t cycles;
+	uint16_t pc;
+	uint8_t r[5];
+	uint8_t flags;
+	uint8_t pch;
+};
+
+struct cosim {
+	const struct lotec_rom *rom;
+	struct lotec_cpu init;
+	struct lotec_cpu cpu;		/* model */
+	struct lotec_netcpu nc;
+	struct arch *batch;
+	uint16_t *pcs;			/* of the instructions of the batch */
+	uint64_t max_cycles;
+};
+
+enum {
+	COSIM_MATCH = 0,
+	COSIM_REGS,		/* registers, PC or cycles differ */
+	COSIM_RAM,		/* RAM differs at the end of the batch */
+	COSIM_HALT,		/* one halted, the other didn't */
+	COSIM_ERROR,
+};
+
+static void model_arch(const struct lotec_cpu *cpu, struct arch *a)
+{
+	memset(a, 0, sizeof(*a));
+	memcpy(a->r, cpu->r, sizeof(a->r));
+	a->flags = cpu->flags;
+	a->pch = cpu->pch;
+	a->pc = cpu->pc;
+	a->cycles = cpu->cycles;
+}
+
+static void netlist_arch(const struct lotec_netcpu *nc, struct arch *a)
+{
+	unsigned int i;
+
+	memset(a, 0, sizeof(*a));
+	for (i = 0; i < 5; i++) {
+		a->r[i] = lotec_netlist_get(nc->nl, nc->net[NET_R0 + i]);
+	}
+	a->flags = (lotec_netlist_get(nc->nl, nc->net[NET_CARRY]) ? FLAG_C : 0) |
+		(lotec_netlist_get(nc->nl, nc->net[NET_GT]) ? FLAG_GT : 0) |
+		(lotec_netlist_get(nc->nl, nc->net[NET_EQ]) ? FLAG_EQ : 0) |
+		(lotec_netlist_get(nc->nl, nc->net[NET_LT]) ? FLAG_LT : 0);
+	a->pch = lotec_netlist_get(nc->nl, nc->net[NET_PCH]);
+	a->pc = lotec_netlist_get(nc->nl, nc->net[NET_PC]);
+	a->cycles = nc->cycles;
+}
+
+static int start(struct cosim *cs)
+{
+	cs->cpu = cs->init;
+	return lotec_netcpu_init(&cs->nc, cs->rom, &cs->init);
+}
+
+/* Run both in batches of size instructions until a halt, max_cycles or a
+ * difference. *pc is the address of the last instruction run.
+ */
+static int run(struct cosim *cs, unsigned int size, uint16_t *pc)
+{
+	struct lotec_cpu ncpu;
+	struct arch a;
+	unsigned int n;
+	unsigned int i;
+	int model_halt = 0;
+	int reason;
+
+	*pc = cs->cpu.pc;
+	while (!model_halt) {
+		for (n = 0; (n < size) && (cs->cpu.cycles < cs->max_cycles); n++) {
+			if (cs->rom->ops[cs->cpu.pc].uop == UOP_HALT) {
+				model_halt = 1;
+				break;
+			}
+			cs->pcs[n] = cs->cpu.pc;
+			lotec_step(&cs->cpu, cs->rom);
+			model_arch(&cs->cpu, &cs->batch[n]);
+		}
+		for (i = 0; i < n; i++) {
+			*pc = cs->pcs[i];
+			reason = lotec_netcpu_step(&cs->nc);
+			if (reason == EXIT_ERROR) {
+				return COSIM_ERROR;
+			}
+			if (reason == EXIT_HALT) {
+				return COSIM_HALT;
+			}
+			netlist_arch(&cs->nc, &a);
+			if (memcmp(&a, &cs->batch[i], sizeof(a)) != 0) {
+				return COSIM_REGS;
+			}
+		}
+		lotec_netcpu_state(&cs->nc, &ncpu);
+		if (memcmp(ncpu.ram, cs->cpu.ram, RAM_SIZE) != 0) {
+			return COSIM_RAM;
+		}
+		if (!model_halt && (n < size)) {
+			return COSIM_MATCH;
+		}
+	}
+	if (lotec_netcpu_step(&cs->nc) != EXIT_HALT) {
+		*pc = cs->cpu.pc;
+		return COSIM_HALT;
+	}
+	return COSIM_MATCH;
+}
+
+static void print_diff(FILE *fout, struct cosim *cs, int result, uint16_t pc)
+{
+	struct lotec_cpu ncpu;
+	unsigned int i;
+
+	lotec_netcpu_state(&cs->nc, &ncpu);
+	switch (result) {
+		case COSIM_REGS:
+			fprintf(fout, "Registers differ after instruction %llu:\n",
+				(unsigned long long)ncpu.insns);
+			break;
+		case COSIM_RAM:
+			fprintf(fout, "RAM differs after instruction %llu:\n", (unsigned long long)ncpu.insns);
+			break;
+		default:
+			fprintf(fout, "%s halts at instruction %llu, %s doesn't:\n",
+				(cs->rom->ops[ncpu.pc].uop == UOP_HALT) ? "Netlist" : "Model",
+				(unsigned long long)ncpu.insns + 1, (cs->rom->ops[ncpu.pc].uop == UOP_HALT) ?
+				"the model" : "the netlist");
+	}
+	decode_insn(fout, pc << 1, cs->rom->words[pc]);
+	fprintf(fout, "model:   ");
+	lotec_print_state(fout, &cs->cpu);
+	fprintf(fout, "netlist: ");
+	lotec_print_state(fout, &ncpu);
+	for (i = 0; i < RAM_SIZE; i++) {
+		if (ncpu.ram[i] != cs->cpu.ram[i]) {
+			fprintf(fout, "RAM $%02X: model %02X netlist %02X\n", i, cs->cpu.ram[i], ncpu.ram[i]);
+		}
+	}
+}
+
+static void usage(void)
+{
+	printf("lotec-cosim [-c cycles] [-r ram file] [-b batch] [-t] rom\n");
+	printf("Runs the instruction set model and the netlist of the LoTec CPU in lockstep\n");
+	printf(" -c cycles    Stop after cycles clock cycles (default %llu)\n", DEFAULT_MAX_CYCLES);
+	printf(" -r file      Load initial RAM content from binary file\n");
+	printf(" -b batch     Instructions run by the model ahead of the netlist and between\n");
+	printf("              comparisons of the RAM (default %u)\n", DEFAULT_BATCH);
+	printf(" -t           Print simulation speed\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct cosim cs;
+	struct lotec_rom *rom;
+	const char *ramfile = NULL;
+	unsigned int size = DEFAULT_BATCH;
+	double start_time;
+	double duration;
+	uint16_t pc;
+	int timing = 0;
+	int result;
+	int rv;
+	int opt;
+
+	memset(&cs, 0, sizeof(cs));
+	cs.max_cycles = DEFAULT_MAX_CYCLES;
+	while ((opt = getopt(argc, argv, "c:r:b:t")) != -1) {
+		switch (opt) {
+			case 'c':
+				cs.max_cycles = strtoull(optarg, NULL, 0);
+				break;
+			case 'r':
+				ramfile = optarg;
+				break;
+			case 'b':
+				size = strtoul(optarg, NULL, 0);
+				if (size == 0) {
+					usage();
+					return 1;
+				}
+				break;
+			case 't':
+				timing = 1;
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+	if (optind != argc - 1) {
+		usage();
+		return 1;
+	}
+
+	lotec_reset(&cs.init);
+	if ((ramfile != NULL) && (lotec_ram_load(&cs.init, ramfile) != 0)) {
+		return 2;
+	}
+	rom = lotec_rom_alloc();
+	cs.batch = calloc(size, sizeof(*cs.batch));
+	cs.pcs = calloc(size, sizeof(*cs.pcs));
+	if ((rom == NULL) || (cs.batch == NULL) || (cs.pcs == NULL)) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		rv = 2;
+		goto out;
+	}
+	rv = lotec_rom_load(rom, argv[optind]);
+	if (rv != 0) {
+		goto out;
+	}
+	cs.rom = rom;
+	rv = start(&cs);
+	if (rv != 0) {
+		goto out;
+	}
+
+	start_time = lotec_get_time();
+	result = run(&cs, size, &pc);
+	duration = lotec_get_time() - start_time;
+	if ((result != COSIM_MATCH) && (result != COSIM_ERROR) && (size > 1)) {
+		/* Again instruction by instruction, for the first one writing the
+		 * RAM differently and the state of the model at it
+		 */
+		lotec_netcpu_free(&cs.nc);
+		rv = start(&cs);
+		if (rv != 0) {
+			goto out;
+		}
+		result = run(&cs, 1, &pc);
+	}
+
+	if (result == COSIM_ERROR) {
+		rv = 3;
+	} else if (result != COSIM_MATCH) {
+		print_diff(stdout, &cs, result, pc);
+		rv = 3;
+	} else {
+		printf("exit=%s\n", lotec_exit_name((cs.rom->ops[cs.cpu.pc].uop == UOP_HALT) ? EXIT_HALT :
+			EXIT_LIMIT));
+		lotec_print_state(stdout, &cs.cpu);
+	}
+	if (timing) {
+		fprintf(stderr, "%.3f s, %.1f k instructions/s\n", duration,
+			(duration > 0) ? (cs.cpu.insns / duration / 1e3) : 0.0);
+	}
+	lotec_netcpu_free(&cs.nc);
+
+out:
+	lotec_rom_free(rom);
+	free(cs.batch);
+	free(cs.pcs);
+	return rv;
+}
@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "lotec-cpu.h"
+#include "lotec-coverage.h"
+
+static void usage(void)
+{
+	printf("lotec-cov [-o merged] [-L listing] [hex or bin file] [coverage]...\n");
+	printf("Merge coverage written by lotec-sim -v and report what wasn't covered\n");
+	printf(" -o merged    Write the merged coverage\n");
+	printf(" -L listing   Listing of lotec-ass -l, report source lines and labels\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct lotec_coverage *cov;
+	struct lotec_rom *rom;
+	const char *merged = NULL;
+	const char *listing = NULL;
+	int rv = 0;
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "o:L:")) != -1) {
+		switch (opt) {
+			case 'o':
+				merged = optarg;
+				break;
+			case 'L':
+				listing = optarg;
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+	if (optind + 1 >= argc) {
+		usage();
+		return 1;
+	}
+
+	rom = lotec_rom_alloc();
+	cov = calloc(1, sizeof(*cov));
+	if ((rom == NULL) || (cov == NULL)) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		lotec_rom_free(rom);
+		free(cov);
+		return 2;
+	}
+	if (lotec_rom_load(rom, argv[optind]) != 0) {
+		lotec_rom_free(rom);
+		free(cov);
+		return 2;
+	}
+	for (i = optind + 1; (i < argc) && (rv == 0); i++) {
+		rv = lotec_coverage_read(argv[i], cov, rom);
+	}
+	if ((rv == 0) && (merged != NULL)) {
+		rv = lotec_coverage_write(merged, cov, rom);
+	}
+	if (rv == 0) {
+		rv = lotec_coverage_report(stdout, cov, rom, listing);
+	}
+	lotec_rom_free(rom);
+	free(cov);
+	return rv;
+}
@@ -0,0 +1,402 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "lotec-cpu.h"
+#include "lotec-disasm.h"
+#include "lotec-coverage.h"
+
+/* Coverage files hold a header:
+ *
+ *	"LCOV", version and number of ROM words (32 bit each), FNV-1a hash of
+ *	the ROM words (64 bit)
+ *
+ * followed by the bitmaps of struct lotec_coverage. All numbers are little
+ * endian. The hash keeps coverage of different ROMs from being merged.
+ */
+
+#define COVERAGE_MAGIC "LCOV"
+#define COVERAGE_VERSION 1
+#define COVERAGE_HEADER_SIZE 20
+
+#define MAX_LINE_SIZE 512
+
+/* Source lines and labels by ROM word, read from a lotec-ass listing */
+struct listing {
+	char *asmfile;
+	unsigned int lineno[ROM_WORDS];
+	char *text[ROM_WORDS];
+	char *label[ROM_WORDS];
+};
+
+static void put_le(uint8_t *p, uint64_t v, unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		p[i] = v >> (8 * i);
+	}
+}
+
+static uint64_t get_le(const uint8_t *p, unsigned int n)
+{
+	uint64_t v = 0;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		v |= (uint64_t)p[i] << (8 * i);
+	}
+	return v;
+}
+
+static uint64_t rom_hash(const struct lotec_rom *rom)
+{
+	uint64_t h = 0xCBF29CE484222325ULL;
+	uint32_t i;
+
+	for (i = 0; i < rom->size; i++) {
+		h = (h ^ (rom->words[i] >> 8)) * 0x100000001B3ULL;
+		h = (h ^ (rom->words[i] & 0xFF)) * 0x100000001B3ULL;
+	}
+	return h;
+}
+
+int lotec_coverage_write(const char *filename, const struct lotec_coverage *cov,
+	const struct lotec_rom *rom)
+{
+	uint8_t header[COVERAGE_HEADER_SIZE];
+	FILE *fout;
+	int rv = 0;
+
+	fout = fopen(filename, "wb");
+	if (fout == NULL) {
+		fprintf(stderr, "Error: Failed to open file '%s'.\n", filename);
+		return 2;
+	}
+	memcpy(header, COVERAGE_MAGIC, 4);
+	put_le(&header[4], COVERAGE_VERSION, 4);
+	put_le(&header[8], rom->size, 4);
+	put_le(&header[12], rom_hash(rom), 8);
+	if ((fwrite(header, sizeof(header), 1, fout) != 1) ||
+		(fwrite(cov, sizeof(*cov), 1, fout) != 1)) {
+		rv = 2;
+	}
+	if (fclose(fout) != 0) {
+		rv = 2;
+	}
+	if (rv != 0) {
+		fprintf(stderr, "Error: Failed to write file '%s'.\n", filename);
+	}
+	return rv;
+}
+
+void lotec_coverage_merge(struct lotec_coverage *dst, const struct lotec_coverage *src)
+{
+	unsigned int i;
+
+	for (i = 0; i < COVERAGE_BYTES; i++) {
+		dst->insns[i] |= src->insns[i];
+		dst->taken[i] |= src->taken[i];
+		dst->not_taken[i] |= src->not_taken[i];
+	}
+}
+
+/* Merge the coverage file into cov. */
+int lotec_coverage_read(const char *filename, struct lotec_coverage *cov, const struct lotec_rom *rom)
+{
+	uint8_t header[COVERAGE_HEADER_SIZE];
+	struct lotec_coverage *in;
+	FILE *fin;
+	int rv = 0;
+
+	in = malloc(sizeof(*in));
+	if (in == NULL) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		return 2;
+	}
+	fin = fopen(filename, "rb");
+	if (fin == NULL) {
+		fprintf(stderr, "Error: Failed to open file '%s'.\n", filename);
+		free(in);
+		return 2;
+	}
+	if ((fread(header, sizeof(header), 1, fin) != 1) || (fread(in, sizeof(*in), 1, fin) != 1) ||
+		(memcmp(header, COVERAGE_MAGIC, 4) != 0) || (get_le(&header[4], 4) != COVERAGE_VERSION)) {
+		fprintf(stderr, "Error: '%s' is no coverage file.\n", filename);
+		rv = 3;
+	} else if ((get_le(&header[8], 4) != rom->size) || (get_le(&header[12], 8) != rom_hash(rom))) {
+		fprintf(stderr, "Error: Coverage '%s' is of another ROM.\n", filename);
+		rv = 3;
+	} else {
+		lotec_coverage_merge(cov, in);
+	}
+	fclose(fin);
+	free(in);
+	return rv;
+}
+
+static void free_listing(struct listing *l)
+{
+	unsigned int i;
+
+	if (l == NULL) {
+		return;
+	}
+	for (i = 0; i < ROM_WORDS; i++) {
+		free(l->text[i]);
+		free(l->label[i]);
+	}
+	free(l->asmfile);
+	free(l);
+}
+
+/* Label defined by a source line, the first token if it ends with ':' */
+static char *line_label(const char *text)
+{
+	const char *end;
+	char *label;
+
+	while (isspace((unsigned char)*text)) {
+		text++;
+	}
+	end = text;
+	while ((*end != 0) && (*end != ':') && (*end != ';') && !isspace((unsigned char)*end)) {
+		end++;
+	}
+	if ((*end != ':') || (end == text)) {
+		return NULL;
+	}
+	label = malloc(end - text + 1);
+	if (label != NULL) {
+		memcpy(label, text, end - text);
+		label[end - text] = 0;
+	}
+	return label;
+}
+
+/* Open a listing written by lotec-ass -l and read its header line into buf */
+static FILE *open_listing(const char *filename, char *buf)
+{
+	FILE *fin;
+
+	fin = fopen(filename, "r");
+	if (fin == NULL) {
+		fprintf(stderr, "Error: Failed to open file '%s'.\n", filename);
+		return NULL;
+	}
+	if ((fgets(buf, MAX_LINE_SIZE, fin) == NULL) || (strncmp(buf, "; ", 2) != 0)) {
+		fprintf(stderr, "Error: '%s' is no listing.\n", filename);
+		fclose(fin);
+		return NULL;
+	}
+	buf[strcspn(buf, "\r\n")] = 0;
+	return fin;
+}
+
+/* Split a line of a listing into the byte address, -1 if there is none,
+ * the line number and the source text. Returns 0 on success.
+ */
+static int parse_listing_line(char *buf, const char *filename, long *addr, unsigned long *lineno,
+	char **text)
+{
+	char *p;
+	int has_addr;
+
+	buf[strcspn(buf, "\r\n")] = 0;
+	has_addr = isxdigit((unsigned char)buf[0]);
+	*addr = has_addr ? (long)strtoul(buf, &p, 16) : -1;
+	*lineno = strtoul(has_addr ? p : buf, &p, 10);
+	*text = (strncmp(p, "  ", 2) == 0) ? (p + 2) : p;
+	if ((*lineno == 0) || (*addr >= 2 * ROM_WORDS)) {
+		fprintf(stderr, "Error: Invalid line '%s' in listing '%s'.\n", buf, filename);
+		return 1;
+	}
+	return 0;
+}
+
+/* Read a listing written by lotec-ass -l. Labels on lines without an
+ * instruction belong to the next instruction.
+ */
+static struct listing *read_listing(const char *filename)
+{
+	char buf[MAX_LINE_SIZE];
+	struct listing *l;
+	char *pending = NULL;
+	char *label;
+	char *text;
+	long addr;
+	unsigned long lineno;
+	FILE *fin;
+
+	fin = open_listing(filename, buf);
+	if (fin == NULL) {
+		return NULL;
+	}
+	l = calloc(1, sizeof(*l));
+	if (l == NULL) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		fclose(fin);
+		return NULL;
+	}
+	l->asmfile = strdup(&buf[2]);
+
+	while (fgets(buf, sizeof(buf), fin) != NULL) {
+		if (parse_listing_line(buf, filename, &addr, &lineno, &text) != 0) {
+			free(pending);
+			fclose(fin);
+			free_listing(l);
+			return NULL;
+		}
+
+		label = line_label(text);
+		if ((label != NULL) && (pending == NULL)) {
+			pending = label;
+		} else {
+			free(label);
+		}
+		if (addr < 0) {
+			continue;
+		}
+		addr >>= 1;
+		while (isspace((unsigned char)*text)) {
+			text++;
+		}
+		free(l->text[addr]);
+		l->text[addr] = strdup(text);
+		l->lineno[addr] = lineno;
+		if ((pending != NULL) && (l->label[addr] == NULL)) {
+			l->label[addr] = pending;
+		} else {
+			free(pending);
+		}
+		pending = NULL;
+	}
+	free(pending);
+	fclose(fin);
+	return l;
+}
+
+/* Word address of a label in a listing written by lotec-ass -l, -1 if it
+ * is not defined and -2 on errors.
+ */
+int32_t lotec_listing_label(const char *filename, const char *name)
+{
+	char buf[MAX_LINE_SIZE];
+	char *label;
+	char *text;
+	long addr;
+	unsigned long lineno;
+	int32_t pc = -1;
+	int found = 0;
+	FILE *fin;
+
+	fin = open_listing(filename, buf);
+	if (fin == NULL) {
+		return -2;
+	}
+	while (fgets(buf, sizeof(buf), fin) != NULL) {
+		if (parse_listing_line(buf, filename, &addr, &lineno, &text) != 0) {
+			pc = -2;
+			break;
+		}
+		/* The next instruction from the line of the label on */
+		label = line_label(text);
+		if ((label != NULL) && (strcmp(label, name) == 0)) {
+			found = 1;
+		}
+		free(label);
+		if (found && (addr >= 0)) {
+			pc = addr >> 1;
+			break;
+		}
+	}
+	fclose(fin);
+	return pc;
+}
+
+/* Print an instruction not covered completely, with its source line and
+ * the label before it if there is a listing.
+ */
+static void print_uncovered(FILE *fout, const struct listing *l, const struct lotec_rom *rom,
+	uint32_t pc, const char *what, int32_t label)
+{
+	if ((l == NULL) || (l->text[pc] == NULL)) {
+		fprintf(fout, "$%04X %s: ", pc << 1, what);
+		print_insn(fout, pc << 1, rom->words[pc]);
+		fprintf(fout, "\n");
+		return;
+	}
+	fprintf(fout, "%s:%u: $%04X ", l->asmfile, l->lineno[pc], pc << 1);
+	if (label == (int32_t)pc) {
+		fprintf(fout, "(%s) ", l->label[label]);
+	} else if (label >= 0) {
+		fprintf(fout, "(%s+$%X) ", l->label[label], (pc - label) << 1);
+	}
+	fprintf(fout, "%s: %s\n", what, l->text[pc]);
+}
+
+/* Print the instructions and branch directions covered and list the
+ * instructions never executed and the branches and jumps which went only
+ * one way. With a listing only its instructions are counted, else all
+ * words of the ROM.
+ */
+int lotec_coverage_report(FILE *fout, const struct lotec_coverage *cov, const struct lotec_rom *rom,
+	const char *listing)
+{
+	struct listing *l = NULL;
+	uint32_t insns = 0;
+	uint32_t insns_hit = 0;
+	uint32_t dirs = 0;
+	uint32_t dirs_hit = 0;
+	int32_t label = -1;
+	uint32_t pc;
+	uint16_t insn;
+	uint8_t cond;
+	int jump;
+
+	if (listing != NULL) {
+		l = read_listing(listing);
+		if (l == NULL) {
+			return 2;
+		}
+	}
+
+	for (pc = 0; pc < ROM_WORDS; pc++) {
+		if ((l != NULL) ? (l->text[pc] == NULL) : (pc >= rom->size)) {
+			continue;
+		}
+		if ((l != NULL) && (l->label[pc] != NULL)) {
+			label = pc;
+		}
+		insn = rom->words[pc];
+		cond = INSN_COND(insn);
+		jump = (INSN_OPCODE(insn) == OP_BRANCH) || (INSN_OPCODE(insn) == OP_JUMP);
+		insns++;
+		if (jump) {
+			dirs += ((cond == COND_AL) || (cond == COND_NV)) ? 1 : 2;
+			dirs_hit += COVERAGE_GET(cov->taken, pc) + COVERAGE_GET(cov->not_taken, pc);
+		}
+		if (!COVERAGE_GET(cov->insns, pc)) {
+			print_uncovered(fout, l, rom, pc, "not executed", label);
+			continue;
+		}
+		insns_hit++;
+		if (!jump || (cond == COND_AL) || (cond == COND_NV)) {
+			continue;
+		}
+		if (!COVERAGE_GET(cov->taken, pc)) {
+			print_uncovered(fout, l, rom, pc, "never taken", label);
+		} else if (!COVERAGE_GET(cov->not_taken, pc)) {
+			print_uncovered(fout, l, rom, pc, "always taken", label);
+		}
+	}
+	fprintf(fout, "instructions %u/%u %.1f%%\n", insns_hit, insns,
+		(insns > 0) ? (100.0 * insns_hit / insns) : 100.0);
+	fprintf(fout, "branch directions %u/%u %.1f%%\n", dirs_hit, dirs,
+		(dirs > 0) ? (100.0 * dirs_hit / dirs) : 100.0);
+	free_listing(l);
+	return 0;
+}
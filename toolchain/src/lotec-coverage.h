@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef LOTECCOVERAGE_H
+#define LOTECCOVERAGE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "lotec-cpu.h"
+
+int lotec_coverage_write(const char *filename, const struct lotec_coverage *cov,
+	const struct lotec_rom *rom);
+int lotec_coverage_read(const char *filename, struct lotec_coverage *cov, const struct lotec_rom *rom);
+void lotec_coverage_merge(struct lotec_coverage *dst, const struct lotec_coverage *src);
+int lotec_coverage_report(FILE *fout, const struct lotec_coverage *cov, const struct lotec_rom *rom,
+	const char *listing);
+int32_t lotec_listing_label(const char *filename, const char *name);
+
+#endif
@@ -0,0 +1,871 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "lotec-cpu.h"
+#include "lotec-alu.h"
+
+#define MAX_TOKEN_SIZE 64
+
+const uint16_t lotec_cond_mask[8] = {
+	[COND_AL] = 0xFFFF,
+	[COND_EQ] = 0xF0F0,
+	[COND_GT] = 0xCCCC,
+	[COND_LT] = 0xFF00,
+	[COND_NE] = 0x0F0F,
+	[COND_GE] = 0xFCFC,
+	[COND_LE] = 0xFFF0,
+	[COND_NV] = 0x0000,
+};
+
+/* Use mem for the words, operations and block starts, mapped is the size of
+ * its mapping or 0 if it was allocated with malloc(). The previous memory is
+ * released.
+ */
+void lotec_rom_set_mem(struct lotec_rom *rom, void *mem, size_t mapped)
+{
+	if (rom->mapped) {
+		munmap(rom->mem, rom->mapped);
+	} else {
+		free(rom->mem);
+	}
+	rom->mem = mem;
+	rom->mapped = mapped;
+	rom->words = mem;
+	rom->ops = (struct lotec_op *)(rom->words + ROM_WORDS);
+	rom->leaders = (uint8_t *)(rom->ops + ROM_WORDS);
+}
+
+/* Switch a ROM mapped from an image to writable memory. */
+static int rom_own(struct lotec_rom *rom)
+{
+	void *mem;
+
+	if (!rom->mapped) {
+		return 0;
+	}
+	mem = malloc(ROM_MEM_SIZE);
+	if (mem == NULL) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		return 2;
+	}
+	memcpy(mem, rom->mem, ROM_MEM_SIZE);
+	lotec_rom_set_mem(rom, mem, 0);
+	return 0;
+}
+
+struct lotec_rom *lotec_rom_alloc(void)
+{
+	struct lotec_rom *rom;
+	void *mem;
+
+	rom = calloc(1, sizeof(*rom));
+	mem = calloc(1, ROM_MEM_SIZE);
+	if ((rom == NULL) || (mem == NULL)) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		free(rom);
+		free(mem);
+		return NULL;
+	}
+	lotec_rom_set_mem(rom, mem, 0);
+	return rom;
+}
+
+void lotec_rom_free(struct lotec_rom *rom)
+{
+	if (rom != NULL) {
+		free(rom->code);
+		lotec_jit_free(rom->jit);
+		lotec_memo_free(rom->memo);
+		lotec_rom_set_mem(rom, NULL, 0);
+	}
+	free(rom);
+}
+
+static int load_hex(struct lotec_rom *rom, FILE *fin, const char *filename)
+{
+	char tok[MAX_TOKEN_SIZE];
+	char *end;
+	unsigned long count;
+	unsigned long value;
+
+	while (fscanf(fin, "%63s", tok) == 1) {
+		count = 1;
+		end = strchr(tok, '*');
+		if (end != NULL) {
+			/* Digital run length encoding */
+			count = strtoul(tok, &end, 10);
+			end++;
+		} else {
+			end = tok;
+		}
+		value = strtoul(end, &end, 16);
+		if ((*end != 0) || (value > 0xFFFF)) {
+			fprintf(stderr, "Error: Invalid word '%s' in file '%s'.\n", tok, filename);
+			return 3;
+		}
+		if (count > ROM_WORDS - rom->size) {
+			fprintf(stderr, "Error: File '%s' is larger than the ROM.\n", filename);
+			return 3;
+		}
+		while (count-- > 0) {
+			rom->words[rom->size++] = value;
+		}
+	}
+	return 0;
+}
+
+static int load_bin(struct lotec_rom *rom, FILE *fin, const char *filename)
+{
+	uint8_t buf[2];
+
+	while (fread(&buf, sizeof(buf), 1, fin) == 1) {
+		if (rom->size >= ROM_WORDS) {
+			fprintf(stderr, "Error: File '%s' is larger than the ROM.\n", filename);
+			return 3;
+		}
+		rom->words[rom->size++] = (buf[0] << 8) | (buf[1] << 0);
+	}
+	return 0;
+}
+
+/* Load a ROM image, either the "v2.0 raw" hex file printed by lotec-ass or
+ * the binary file created by hex2bin.py.
+ */
+int lotec_rom_load(struct lotec_rom *rom, const char *filename)
+{
+	FILE *fin;
+	char header[16];
+	int rv;
+
+	fin = fopen(filename, "rb");
+	if (fin == NULL) {
+		fprintf(stderr, "Error: Failed to open file '%s'.\n", filename);
+		return 2;
+	}
+	if (rom_own(rom) != 0) {
+		fclose(fin);
+		return 2;
+	}
+	memset(rom->words, 0, ROM_WORDS * sizeof(*rom->words));
+	rom->size = 0;
+
+	if ((fgets(header, sizeof(header), fin) != NULL) && (strncmp(header, "v2.0 raw", 8) == 0)) {
+		rv = load_hex(rom, fin, filename);
+	} else {
+		rewind(fin);
+		rv = load_bin(rom, fin, filename);
+	}
+	fclose(fin);
+	if (rv == 0) {
+		lotec_rom_decode(rom);
+	}
+	return rv;
+}
+
+static void decode_op(struct lotec_op *op, uint16_t insn, uint16_t address)
+{
+	uint8_t opcode;
+
+	opcode = INSN_OPCODE(insn);
+
+	op->rd = INSN_RD(insn);
+	op->rs = INSN_RS(insn);
+	op->rt = INSN_RT(insn);
+	op->cond = INSN_COND(insn);
+	op->imm = INSN_IMM8(insn);
+	op->target = 0;
+	op->uop = UOP_GENERIC;
+
+	switch (opcode) {
+		case OP_LI:
+			if (op->rd <= REG_R4) {
+				op->uop = UOP_LI;
+			} else if (op->rd == REG_FLAGS) {
+				op->imm &= FLAG_MASK;
+				op->uop = UOP_LIF;
+			} else if (op->rd == REG_PCH) {
+				op->uop = UOP_LIH;
+			} else {
+				op->uop = UOP_LJ;
+			}
+			break;
+
+		case OP_ADDI:
+		case OP_ANDI:
+		case OP_ORI:
+		case OP_XORI:
+		case OP_SUBI:
+		case OP_CMPI:
+			if (op->rd <= REG_R4) {
+				op->uop = UOP_ADDI + (opcode - OP_ADDI);
+			}
+			break;
+
+		case OP_SHRI:
+		case OP_SHLI:
+			op->imm = INSN_IMM5(insn);
+			if ((op->rd <= REG_R4) && (op->rs <= REG_R4)) {
+				op->uop = (opcode == OP_SHRI) ? UOP_SHRI : UOP_SHLI;
+			}
+			break;
+
+		case OP_MOV:
+			if ((op->rd <= REG_R4) && (op->rs <= REG_R4)) {
+				op->uop = UOP_MOV;
+			} else if ((op->rd <= REG_R4) && (op->rs == REG_FLAGS)) {
+				op->uop = UOP_MOVF;
+			}
+			break;
+
+		case OP_ADD:
+		case OP_AND:
+		case OP_OR:
+		case OP_XOR:
+		case OP_SUB:
+		case OP_CMP:
+			if ((op->rd <= REG_R4) && (op->rs <= REG_R4)) {
+				op->uop = UOP_ADD + (opcode - OP_ADD);
+			}
+			break;
+
+		case OP_SHR:
+		case OP_SHL:
+			if ((op->rd <= REG_R4) && (op->rs <= REG_R4) && (op->rt <= REG_R4)) {
+				op->uop = (opcode == OP_SHR) ? UOP_SHR : UOP_SHL;
+			}
+			break;
+
+		case OP_LDB:
+			if (op->rd <= REG_R4) {
+				op->uop = UOP_LDB;
+			}
+			break;
+
+		case OP_STB:
+			if (op->rd <= REG_R4) {
+				op->uop = UOP_STB;
+			}
+			break;
+
+		case OP_JUMP:
+			if (op->cond == COND_NV) {
+				op->uop = UOP_NOP;
+			} else if ((op->rs <= REG_R4) && (op->rt <= REG_R4)) {
+				op->uop = UOP_J;
+			}
+			break;
+
+		case OP_BRANCH:
+			op->target = address + 1 + (int8_t)op->imm;
+			if (op->cond == COND_NV) {
+				op->uop = UOP_NOP;
+			} else if ((op->cond == COND_AL) && (op->target == address)) {
+				op->uop = UOP_HALT;
+			} else {
+				op->uop = UOP_B;
+			}
+			break;
+
+		default:
+			/* Not implemented instructions are executed as NOP. */
+			op->uop = UOP_NOP;
+			break;
+	}
+}
+
+/* Whether an instruction may change the program counter */
+static int insn_branches(uint16_t insn)
+{
+	switch (INSN_OPCODE(insn)) {
+		case OP_JUMP:
+		case OP_BRANCH:
+			return INSN_COND(insn) != COND_NV;
+		case OP_LI:
+		case OP_ADDI:
+		case OP_ANDI:
+		case OP_ORI:
+		case OP_XORI:
+		case OP_SUBI:
+		case OP_SHRI:
+		case OP_SHLI:
+		case OP_MOV:
+		case OP_ADD:
+		case OP_AND:
+		case OP_OR:
+		case OP_XOR:
+		case OP_SUB:
+		case OP_SHR:
+		case OP_SHL:
+		case OP_LDB:
+			return INSN_RD(insn) == REG_PCL;
+		default:
+			return 0;
+	}
+}
+
+#define SET_LEADER(rom, pc) ((rom)->leaders[(pc) >> 3] |= 1 << ((pc) & 7))
+
+/* Decode the operations and find the basic block starts: address 0, the
+ * targets of B and the instructions after B, J and writes to PCL. The ROM
+ * must not be mapped from an image.
+ */
+void lotec_rom_decode(struct lotec_rom *rom)
+{
+	uint32_t i;
+
+	memset(rom->leaders, 0, ROM_LEADER_BYTES);
+	SET_LEADER(rom, 0);
+	for (i = 0; i < ROM_WORDS; i++) {
+		decode_op(&rom->ops[i], rom->words[i], i);
+		if (insn_branches(rom->words[i])) {
+			SET_LEADER(rom, (i + 1) & 0xFFFF);
+		}
+		if (INSN_OPCODE(rom->words[i]) == OP_BRANCH) {
+			SET_LEADER(rom, rom->ops[i].target);
+		}
+	}
+	rom->code_valid = 0;
+	rom->jit_valid = 0;
+	rom->memo_valid = 0;
+}
+
+void lotec_reset(struct lotec_cpu *cpu)
+{
+	memset(cpu, 0, sizeof(*cpu));
+}
+
+/* Load the initial RAM content, byte n is addressed by LDB/STB $n. */
+int lotec_ram_load(struct lotec_cpu *cpu, const char *filename)
+{
+	FILE *fin;
+
+	fin = fopen(filename, "rb");
+	if (fin == NULL) {
+		fprintf(stderr, "Error: Failed to open file '%s'.\n", filename);
+		return 2;
+	}
+	memset(cpu->ram, 0, sizeof(cpu->ram));
+	if (fread(cpu->ram, 1, sizeof(cpu->ram), fin) == 0) {
+		fprintf(stderr, "Error: Failed to read RAM image '%s'.\n", filename);
+		fclose(fin);
+		return 3;
+	}
+	fclose(fin);
+	return 0;
+}
+
+/* PCH and PCL read the program counter, which already points to the next
+ * instruction while executing.
+ */
+static uint8_t read_reg(const struct lotec_cpu *cpu, uint8_t reg)
+{
+	switch (reg) {
+		case REG_FLAGS:
+			return cpu->flags;
+		case REG_PCL:
+			return (cpu->pc + 1) & 0xFF;
+		case REG_PCH:
+			return ((cpu->pc + 1) >> 8) & 0xFF;
+		default:
+			return cpu->r[reg];
+	}
+}
+
+/* Writing PCH only sets the latch, writing PCL jumps to PCH:PCL. */
+static int write_reg(struct lotec_cpu *cpu, uint8_t reg, uint8_t value)
+{
+	switch (reg) {
+		case REG_FLAGS:
+			cpu->flags = value & FLAG_MASK;
+			return 0;
+		case REG_PCL:
+			cpu->pc = (cpu->pch << 8) | value;
+			return 1;
+		case REG_PCH:
+			cpu->pch = value;
+			return 0;
+		default:
+			cpu->r[reg] = value;
+			return 0;
+	}
+}
+
+/* Reference implementation of a single instruction, working on the raw
+ * instruction word at cpu->pc. Returns 1 if the program counter was changed.
+ * Doesn't count cycles.
+ */
+int lotec_exec(struct lotec_cpu *cpu, uint16_t insn)
+{
+	uint8_t opcode;
+	uint8_t rd;
+	uint8_t rs;
+	uint8_t rt;
+	uint8_t imm8;
+	uint8_t a;
+	uint8_t b;
+	uint8_t v;
+	uint8_t c;
+	int branch;
+
+	opcode = INSN_OPCODE(insn);
+	rd = INSN_RD(insn);
+	rs = INSN_RS(insn);
+	rt = INSN_RT(insn);
+	imm8 = INSN_IMM8(insn);
+	branch = 0;
+
+	switch (opcode) {
+		case OP_LI:
+			branch = write_reg(cpu, rd, imm8);
+			break;
+
+		case OP_ADDI:
+		case OP_ADD:
+			a = read_reg(cpu, rd);
+			b = (opcode == OP_ADDI) ? imm8 : read_reg(cpu, rs);
+			c = cpu->flags;
+			v = alu_add(a, b, &c);
+			if (opcode == OP_ADDI) {
+				cpu->flags = c;
+			}
+			branch = write_reg(cpu, rd, v);
+			break;
+
+		case OP_SUBI:
+		case OP_SUB:
+			a = read_reg(cpu, rd);
+			b = (opcode == OP_SUBI) ? imm8 : read_reg(cpu, rs);
+			c = cpu->flags;
+			v = alu_sub(a, b, &c);
+			if (opcode == OP_SUBI) {
+				cpu->flags = c;
+			}
+			branch = write_reg(cpu, rd, v);
+			break;
+
+		case OP_ANDI:
+		case OP_AND:
+			b = (opcode == OP_ANDI) ? imm8 : read_reg(cpu, rs);
+			branch = write_reg(cpu, rd, read_reg(cpu, rd) & b);
+			break;
+
+		case OP_ORI:
+		case OP_OR:
+			b = (opcode == OP_ORI) ? imm8 : read_reg(cpu, rs);
+			branch = write_reg(cpu, rd, read_reg(cpu, rd) | b);
+			break;
+
+		case OP_XORI:
+		case OP_XOR:
+			b = (opcode == OP_XORI) ? imm8 : read_reg(cpu, rs);
+			branch = write_reg(cpu, rd, read_reg(cpu, rd) ^ b);
+			break;
+
+		case OP_CMPI:
+		case OP_CMP:
+			b = (opcode == OP_CMPI) ? imm8 : read_reg(cpu, rs);
+			cpu->flags = alu_cmp(read_reg(cpu, rd), b, cpu->flags);
+			break;
+
+		case OP_SHRI:
+		case OP_SHR:
+			b = (opcode == OP_SHRI) ? INSN_IMM5(insn) : (read_reg(cpu, rt) & 0x1F);
+			v = alu_shr(read_reg(cpu, rd), read_reg(cpu, rs), b, &cpu->flags);
+			branch = write_reg(cpu, rd, v);
+			break;
+
+		case OP_SHLI:
+		case OP_SHL:
+			b = (opcode == OP_SHLI) ? INSN_IMM5(insn) : (read_reg(cpu, rt) & 0x1F);
+			v = alu_shl(read_reg(cpu, rd), read_reg(cpu, rs), b, &cpu->flags);
+			branch = write_reg(cpu, rd, v);
+			break;
+
+		case OP_MOV:
+			branch = write_reg(cpu, rd, read_reg(cpu, rs));
+			break;
+
+		case OP_LDB:
+			branch = write_reg(cpu, rd, cpu->ram[imm8]);
+			break;
+
+		case OP_STB:
+			cpu->ram[imm8] = read_reg(cpu, rd);
+			break;
+
+		case OP_JUMP:
+			if (COND_TRUE(INSN_COND(insn), cpu->flags)) {
+				cpu->pc = (read_reg(cpu, rs) << 8) | read_reg(cpu, rt);
+				branch = 1;
+			}
+			break;
+
+		case OP_BRANCH:
+			if (COND_TRUE(INSN_COND(insn), cpu->flags)) {
+				cpu->pc = cpu->pc + 1 + (int8_t)imm8;
+				branch = 1;
+			}
+			break;
+
+		default:
+			/* Not implemented instructions are executed as NOP. */
+			break;
+	}
+	if (!branch) {
+		cpu->pc++;
+	}
+	return branch;
+}
+
+/* Execute a single instruction with cycle counting. */
+int lotec_step(struct lotec_cpu *cpu, const struct lotec_rom *rom)
+{
+	int branch;
+
+	branch = lotec_exec(cpu, rom->words[cpu->pc]);
+	cpu->insns++;
+	cpu->cycles += CYCLES_INSN;
+	if (branch) {
+		cpu->cycles += CYCLES_BRANCH;
+	}
+	return branch;
+}
+
+/* Switch interpreter of lotec_run() and lotec_run_profile(), which counts
+ * the instructions and taken branches by address if prof isn't NULL. Always
+ * inlined, so the counting is compiled out of lotec_run().
+ */
+static inline __attribute__((always_inline)) int run_switch(struct lotec_cpu *cpu,
+	const struct lotec_rom *rom, uint64_t max_cycles, struct lotec_profile *prof)
+{
+	const struct lotec_op *ops = rom->ops;
+	const struct lotec_op *op;
+	struct lotec_cpu c;
+	int64_t budget;
+	int64_t slots;
+	uint64_t bubbles;
+	uint16_t pc;
+	uint8_t flags;
+	int reason;
+
+	if (cpu->cycles >= max_cycles) {
+		return EXIT_LIMIT;
+	}
+	/* Count in instruction slots of CYCLES_INSN cycles each. */
+	slots = (max_cycles - cpu->cycles + CYCLES_INSN - 1) / CYCLES_INSN;
+	budget = slots;
+	bubbles = 0;
+	reason = EXIT_LIMIT;
+
+	c = *cpu;
+	pc = c.pc;
+	flags = c.flags;
+
+	while (budget > 0) {
+		op = &ops[pc];
+		budget--;
+		if (prof != NULL) {
+			prof->hits[pc]++;
+		}
+
+		switch (op->uop) {
+			case UOP_NOP:
+				pc++;
+				break;
+
+			case UOP_LI:
+				c.r[op->rd] = op->imm;
+				pc++;
+				break;
+
+			case UOP_ADDI:
+				c.r[op->rd] = alu_add(c.r[op->rd], op->imm, &flags);
+				pc++;
+				break;
+
+			case UOP_ANDI:
+				c.r[op->rd] &= op->imm;
+				pc++;
+				break;
+
+			case UOP_ORI:
+				c.r[op->rd] |= op->imm;
+				pc++;
+				break;
+
+			case UOP_XORI:
+				c.r[op->rd] ^= op->imm;
+				pc++;
+				break;
+
+			case UOP_SUBI:
+				c.r[op->rd] = alu_sub(c.r[op->rd], op->imm, &flags);
+				pc++;
+				break;
+
+			case UOP_CMPI:
+				flags = alu_cmp(c.r[op->rd], op->imm, flags);
+				pc++;
+				break;
+
+			case UOP_SHRI:
+				c.r[op->rd] = alu_shr(c.r[op->rd], c.r[op->rs], op->imm, &flags);
+				pc++;
+				break;
+
+			case UOP_SHLI:
+				c.r[op->rd] = alu_shl(c.r[op->rd], c.r[op->rs], op->imm, &flags);
+				pc++;
+				break;
+
+			case UOP_MOV:
+				c.r[op->rd] = c.r[op->rs];
+				pc++;
+				break;
+
+			case UOP_ADD:
+				c.r[op->rd] += c.r[op->rs] + (flags & FLAG_C);
+				pc++;
+				break;
+
+			case UOP_AND:
+				c.r[op->rd] &= c.r[op->rs];
+				pc++;
+				break;
+
+			case UOP_OR:
+				c.r[op->rd] |= c.r[op->rs];
+				pc++;
+				break;
+
+			case UOP_XOR:
+				c.r[op->rd] ^= c.r[op->rs];
+				pc++;
+				break;
+
+			case UOP_SUB:
+				c.r[op->rd] -= c.r[op->rs] + (flags & FLAG_C);
+				pc++;
+				break;
+
+			case UOP_CMP:
+				flags = alu_cmp(c.r[op->rd], c.r[op->rs], flags);
+				pc++;
+				break;
+
+			case UOP_SHR:
+				c.r[op->rd] = alu_shr(c.r[op->rd], c.r[op->rs], c.r[op->rt] & 0x1F, &flags);
+				pc++;
+				break;
+
+			case UOP_SHL:
+				c.r[op->rd] = alu_shl(c.r[op->rd], c.r[op->rs], c.r[op->rt] & 0x1F, &flags);
+				pc++;
+				break;
+
+			case UOP_LDB:
+				c.r[op->rd] = c.ram[op->imm];
+				pc++;
+				break;
+
+			case UOP_STB:
+				c.ram[op->imm] = c.r[op->rd];
+				pc++;
+				break;
+
+			case UOP_J:
+				if (COND_TRUE(op->cond, flags)) {
+					if (prof != NULL) {
+						prof->taken[pc]++;
+					}
+					pc = (c.r[op->rs] << 8) | c.r[op->rt];
+					budget--;
+					bubbles++;
+				} else {
+					pc++;
+				}
+				break;
+
+			case UOP_B:
+				if (COND_TRUE(op->cond, flags)) {
+					if (prof != NULL) {
+						prof->taken[pc]++;
+					}
+					pc = op->target;
+					budget--;
+					bubbles++;
+				} else {
+					pc++;
+				}
+				break;
+
+			case UOP_LIF:
+				flags = op->imm;
+				pc++;
+				break;
+
+			case UOP_MOVF:
+				c.r[op->rd] = flags;
+				pc++;
+				break;
+
+			case UOP_LIH:
+				c.pch = op->imm;
+				pc++;
+				break;
+
+			case UOP_LJ:
+				if (prof != NULL) {
+					prof->taken[pc]++;
+				}
+				pc = (c.pch << 8) | op->imm;
+				budget--;
+				bubbles++;
+				break;
+
+			case UOP_HALT:
+				budget++;
+				/* Not executed */
+				if (prof != NULL) {
+					prof->hits[pc]--;
+				}
+				reason = EXIT_HALT;
+				goto out;
+
+			default:
+				c.pc = pc;
+				c.flags = flags;
+				if (lotec_exec(&c, rom->words[pc])) {
+					if (prof != NULL) {
+						prof->taken[pc]++;
+					}
+					budget--;
+					bubbles++;
+				}
+				pc = c.pc;
+				flags = c.flags;
+				break;
+		}
+	}
+out:
+	slots -= budget;
+	c.pc = pc;
+	c.flags = flags;
+	c.insns += slots - bubbles;
+	c.cycles += slots * CYCLES_INSN;
+	*cpu = c;
+	return reason;
+}
+
+/* Run the pre-decoded ROM until the CPU halts in a branch to itself or at
+ * least max_cycles have passed.
+ */
+int lotec_run(struct lotec_cpu *cpu, const struct lotec_rom *rom, uint64_t max_cycles)
+{
+	return run_switch(cpu, rom, max_cycles, NULL);
+}
+
+/* Same as lotec_run(), but add the executed instructions and taken branches
+ * to prof. The counting is compiled out with LOTEC_FAST.
+ */
+int lotec_run_profile(struct lotec_cpu *cpu, const struct lotec_rom *rom, uint64_t max_cycles,
+	struct lotec_profile *prof)
+{
+#ifdef LOTEC_FAST
+	(void)prof;
+	return run_switch(cpu, rom, max_cycles, NULL);
+#else
+	return run_switch(cpu, rom, max_cycles, prof);
+#endif
+}
+
+static int run_engine_switch(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles)
+{
+	return lotec_run(cpu, rom, max_cycles);
+}
+
+const struct lotec_engine lotec_engines[LOTEC_NUM_ENGINES] = {
+	{ "jit", lotec_run_jit, 0, 1 },
+	{ "threaded", lotec_run_threaded, 0, 0 },
+	{ "switch", run_engine_switch, 0, 0 },
+	{ "lazy", lotec_run_lazy, 0, 0 },
+	{ "memo", lotec_run_memo, 0, 1 },
+	{ "jit-check", lotec_run_jit_check, 1, 1 },
+	{ "lazy-check", lotec_run_lazy_check, 1, 0 },
+	{ "memo-check", lotec_run_memo_check, 1, 1 },
+};
+
+/* The engine called name, NULL if there is none */
+const struct lotec_engine *lotec_find_engine(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < LOTEC_NUM_ENGINES; i++) {
+		if (strcmp(lotec_engines[i].name, name) == 0) {
+			return &lotec_engines[i];
+		}
+	}
+	return NULL;
+}
+
+/* Seconds of the monotonic clock, for the run times printed by the tools */
+double lotec_get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Whether two states are the same, field by field as the padding of
+ * struct lotec_cpu may differ
+ */
+int lotec_state_equal(const struct lotec_cpu *a, const struct lotec_cpu *b)
+{
+	return (memcmp(a->r, b->r, sizeof(a->r)) == 0) && (a->flags == b->flags) && (a->pch == b->pch) &&
+		(a->pc == b->pc) && (a->cycles == b->cycles) && (a->insns == b->insns) &&
+		(memcmp(a->ram, b->ram, RAM_SIZE) == 0);
+}
+
+const char *lotec_exit_name(int reason)
+{
+	switch (reason) {
+		case EXIT_LIMIT:
+			return "limit";
+		case EXIT_HALT:
+			return "halt";
+		case EXIT_ERROR:
+			return "error";
+		default:
+			return "unknown";
+	}
+}
+
+void lotec_print_state(FILE *fout, const struct lotec_cpu *cpu)
+{
+	fprintf(fout, "R0=%02X R1=%02X R2=%02X R3=%02X R4=%02X FLAGS=%02X PCH=%02X PC=$%04X\n",
+		cpu->r[REG_R0], cpu->r[REG_R1], cpu->r[REG_R2], cpu->r[REG_R3], cpu->r[REG_R4],
+		cpu->flags, cpu->pch, cpu->pc << 1);
+	fprintf(fout, "cycles=%llu insns=%llu\n",
+		(unsigned long long)cpu->cycles, (unsigned long long)cpu->insns);
+}
+
+void lotec_print_ram(FILE *fout, const struct lotec_cpu *cpu)
+{
+	int i;
+
+	for (i = 0; i < RAM_SIZE; i++) {
+		if ((i % 16) == 0) {
+			fprintf(fout, "%02X:", i);
+		}
+		fprintf(fout, " %02X", cpu->ram[i]);
+		if ((i % 16) == 15) {
+			fprintf(fout, "\n");
+		}
+	}
+}
@@ -0,0 +1,301 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef LOTECCPU_H
+#define LOTECCPU_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "lotec-opcodes.h"
+
+/* The program counter addresses 16 bit words. */
+#define ROM_WORDS 0x10000
+
+/* LDB and STB address the RAM with a sign extended 8 bit immediate, so only
+ * $0000 - $007F and $FF80 - $FFFF are reachable. The simulator indexes the RAM
+ * with the 8 bit immediate.
+ */
+#define RAM_SIZE 0x100
+
+/* Bits of the FLAGS register */
+#define FLAG_C 0x01
+#define FLAG_GT 0x02
+#define FLAG_EQ 0x04
+#define FLAG_LT 0x08
+#define FLAG_MASK 0x0F
+
+/* Each instruction takes 2 clock cycles (fetch and execute). When the program
+ * counter is changed, the following fetch is replaced by a NOP, which costs
+ * another 2 clock cycles.
+ */
+#define CYCLES_INSN 2
+#define CYCLES_BRANCH 2
+
+#define DEFAULT_MAX_CYCLES 100000000ULL
+
+/* Pre-decoded operations, only used by the simulator. Instructions using
+ * FLAGS, PCH or PCL in an unusual way are executed by UOP_GENERIC.
+ */
+enum lotec_uop {
+	UOP_NOP = 0,
+	UOP_LI,
+	UOP_ADDI,
+	UOP_ANDI,
+	UOP_ORI,
+	UOP_XORI,
+	UOP_SUBI,
+	UOP_CMPI,
+	UOP_SHRI,
+	UOP_SHLI,
+
+	UOP_MOV,
+	UOP_ADD,
+	UOP_AND,
+	UOP_OR,
+	UOP_XOR,
+	UOP_SUB,
+	UOP_CMP,
+	UOP_SHR,
+	UOP_SHL,
+
+	UOP_LDB,
+	UOP_STB,
+	UOP_J,
+	UOP_B,
+
+	UOP_LIF,	/* LI FLAGS, #imm */
+	UOP_MOVF,	/* MOV Rd, FLAGS */
+	UOP_LIH,	/* LI PCH, #imm */
+	UOP_LJ,		/* LI PCL, #imm */
+	UOP_HALT,	/* B to itself */
+	UOP_GENERIC,
+
+	/* Superinstructions, only used by the threaded code */
+	UOP_LIF_ADDI,	/* LI FLAGS, #imm2; ADDI Rd, #imm */
+	UOP_LIF_SUBI,	/* LI FLAGS, #imm2; SUBI Rd, #imm */
+	UOP_LIF_ADD,	/* LI FLAGS, #imm2; ADD Rd, Rs */
+	UOP_LIF_SUB,	/* LI FLAGS, #imm2; SUB Rd, Rs */
+	UOP_CMPI_B,	/* CMPI Rd, #imm; Bcc target */
+	UOP_CMP_B,	/* CMP Rd, Rs; Bcc target */
+	UOP_LIH_LJ,	/* LI PCH, #imm2; LI PCL, #imm */
+
+	UOP_COUNT
+};
+
+struct lotec_op {
+	uint8_t uop;
+	uint8_t rd;
+	uint8_t rs;
+	uint8_t rt;
+	uint8_t imm;
+	uint8_t cond;
+	uint16_t target;
+};
+
+/* Direct threaded code, handler is the address of the label executing it. */
+struct lotec_top {
+	const void *handler;
+	uint8_t rd;
+	uint8_t rs;
+	uint8_t imm;
+	uint8_t imm2;
+	uint8_t rt;
+	uint8_t cond;
+	uint16_t target;
+};
+
+/* Translated code of the JIT, see lotec-jit.c */
+struct lotec_jit;
+
+/* Block summaries of lotec_run_memo(), see lotec-memo.c */
+struct lotec_memo;
+
+/* The words, decoded operations and block starts of a ROM are kept in this
+ * order in one block of memory, which may be mapped from an image file, see
+ * lotec-image.c
+ */
+#define ROM_LEADER_BYTES (ROM_WORDS / 8)
+#define ROM_MEM_SIZE (ROM_WORDS * sizeof(uint16_t) + ROM_WORDS * sizeof(struct lotec_op) + \
+	ROM_LEADER_BYTES)
+
+#define ROM_LEADER(rom, pc) (((rom)->leaders[(pc) >> 3] >> ((pc) & 7)) & 1)
+
+struct lotec_rom {
+	uint32_t size;
+	uint16_t *words;
+	struct lotec_op *ops;
+	uint8_t *leaders;	/* bitmap of the basic block starts */
+	void *mem;
+	size_t mapped;		/* size of the mapping of mem, 0 if allocated */
+	struct lotec_top *code;
+	int code_valid;
+	struct lotec_jit *jit;
+	int jit_valid;
+	struct lotec_memo *memo;
+	int memo_valid;
+};
+
+struct lotec_cpu {
+	uint8_t r[5];
+	uint8_t flags;
+	uint8_t pch;
+	uint16_t pc;
+	uint64_t cycles;
+	uint64_t insns;
+	uint8_t ram[RAM_SIZE];
+};
+
+enum lotec_exit {
+	EXIT_LIMIT = 0,
+	EXIT_HALT,
+	EXIT_ERROR,
+};
+
+/* Write of an external device to the RAM at a given cycle */
+struct lotec_event {
+	uint64_t cycle;
+	uint8_t addr;
+	uint8_t value;
+};
+
+typedef int (*lotec_run_fn)(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles);
+
+/* The engines running a ROM, the first one is the default */
+struct lotec_engine {
+	const char *name;
+	lotec_run_fn run;
+	int check;		/* compares against the reference, not benchmarked */
+	int private_rom;	/* changes the ROM while running, needs a copy per thread */
+};
+
+#define LOTEC_NUM_ENGINES 8
+
+extern const struct lotec_engine lotec_engines[LOTEC_NUM_ENGINES];
+
+/* The CPU with the devices around it, see lotec_run_system() */
+struct lotec_system {
+	lotec_run_fn run;
+	const struct lotec_event *events;	/* sorted by cycle */
+	unsigned int num_events;
+	unsigned int next_event;
+	int idle;		/* skip idle loops instead of halting */
+	uint64_t idle_cycles;	/* cycles skipped */
+};
+
+/* Registers and the RAM bytes written since the previous snapshot, as
+ * address and old value pairs, see lotec-snap.c
+ */
+struct lotec_snap {
+	uint8_t r[5];
+	uint8_t flags;
+	uint8_t pch;
+	uint16_t pc;
+	uint64_t cycles;
+	uint64_t insns;
+	unsigned int next_event;
+	unsigned int num_undo;
+	uint8_t *undo;
+};
+
+struct lotec_history {
+	struct lotec_snap *snaps;	/* sorted by time */
+	unsigned int num;
+	unsigned int size;
+	uint64_t interval;	/* cycles between snapshots */
+	size_t bytes;		/* memory used by the snapshots */
+	size_t max_bytes;
+	uint8_t ram[RAM_SIZE];	/* RAM at the last snapshot */
+};
+
+/* Executed instructions and taken branches by address, see
+ * lotec_run_profile()
+ */
+struct lotec_profile {
+	uint64_t hits[ROM_WORDS];
+	uint64_t taken[ROM_WORDS];
+};
+
+/* Executed instructions and the directions taken by B and J, one bit per
+ * ROM word each, see lotec_run_coverage()
+ */
+#define COVERAGE_BYTES (ROM_WORDS / 8)
+
+struct lotec_coverage {
+	uint8_t insns[COVERAGE_BYTES];
+	uint8_t taken[COVERAGE_BYTES];
+	uint8_t not_taken[COVERAGE_BYTES];
+};
+
+#define COVERAGE_SET(map, pc) ((map)[(pc) >> 3] |= 1 << ((pc) & 7))
+#define COVERAGE_GET(map, pc) (((map)[(pc) >> 3] >> ((pc) & 7)) & 1)
+
+/* Counters of lotec_run_memo() since the ROM was decoded */
+struct lotec_memo_stats {
+	uint64_t lookups;	/* blocks looked up */
+	uint64_t hits;		/* blocks skipped */
+	uint64_t insns;		/* instructions skipped */
+	uint64_t evictions;	/* summaries replaced by another one */
+	uint64_t uncached;	/* blocks executed without looking them up */
+};
+
+/* Counters of lotec_run_lanes() */
+struct lotec_lanes_stats {
+	uint64_t insns;		/* instructions executed by all lanes */
+	uint64_t slots;		/* lane slots of the warp steps run */
+	unsigned int regroups;
+};
+
+/* Set of flags for which a condition is true, indexed by enum lotec_cond */
+extern const uint16_t lotec_cond_mask[8];
+
+#define COND_TRUE(cond, flags) ((lotec_cond_mask[(cond)] >> (flags)) & 1)
+
+struct lotec_rom *lotec_rom_alloc(void);
+void lotec_rom_free(struct lotec_rom *rom);
+int lotec_rom_load(struct lotec_rom *rom, const char *filename);
+void lotec_rom_decode(struct lotec_rom *rom);
+void lotec_rom_set_mem(struct lotec_rom *rom, void *mem, size_t mapped);
+int lotec_rom_load_cached(struct lotec_rom *rom, const char *filename);
+
+void lotec_reset(struct lotec_cpu *cpu);
+int lotec_ram_load(struct lotec_cpu *cpu, const char *filename);
+
+int lotec_exec(struct lotec_cpu *cpu, uint16_t insn);
+int lotec_step(struct lotec_cpu *cpu, const struct lotec_rom *rom);
+int lotec_run(struct lotec_cpu *cpu, const struct lotec_rom *rom, uint64_t max_cycles);
+int lotec_run_profile(struct lotec_cpu *cpu, const struct lotec_rom *rom, uint64_t max_cycles,
+	struct lotec_profile *prof);
+int lotec_run_threaded(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles);
+int lotec_run_lazy(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles);
+int lotec_run_lazy_check(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles);
+int lotec_run_jit(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles);
+int lotec_run_jit_check(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles);
+int lotec_run_coverage(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles,
+	struct lotec_coverage *cov);
+void lotec_jit_free(struct lotec_jit *jit);
+int lotec_run_memo(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles);
+int lotec_run_memo_check(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles);
+void lotec_memo_stats(const struct lotec_rom *rom, struct lotec_memo_stats *stats);
+void lotec_memo_free(struct lotec_memo *memo);
+int lotec_run_lanes(const struct lotec_rom *rom, unsigned int n, const uint8_t (*ram)[RAM_SIZE],
+	uint64_t max_cycles, struct lotec_cpu *out, int *reasons, struct lotec_lanes_stats *stats);
+int lotec_run_system(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles,
+	struct lotec_system *sys);
+int lotec_step_system(struct lotec_cpu *cpu, const struct lotec_rom *rom, struct lotec_system *sys);
+
+int lotec_history_init(struct lotec_history *h, const struct lotec_cpu *cpu, unsigned int next_event,
+	uint64_t interval, size_t max_bytes);
+void lotec_history_free(struct lotec_history *h);
+int lotec_history_update(struct lotec_history *h, const struct lotec_cpu *cpu, unsigned int next_event);
+uint64_t lotec_history_next(const struct lotec_history *h);
+unsigned int lotec_history_find(const struct lotec_history *h, uint64_t insns);
+unsigned int lotec_history_restore(struct lotec_history *h, struct lotec_cpu *cpu, unsigned int index);
+
+const struct lotec_engine *lotec_find_engine(const char *name);
+double lotec_get_time(void);
+int lotec_state_equal(const struct lotec_cpu *a, const struct lotec_cpu *b);
+const char *lotec_exit_name(int reason);
+void lotec_print_state(FILE *fout, const struct lotec_cpu *cpu);
+void lotec_print_ram(FILE *fout, const struct lotec_cpu *cpu);
+
+#endif
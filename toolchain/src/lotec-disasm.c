@@ -0,0 +1,142 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+
+#include "lotec-opcodes.h"
+#include "lotec-isa.h"
+#include "lotec-disasm.h"
+
+/* Mnemonic and operands of the instructions by opcode, NULL if illegal */
+struct insn_desc {
+	const char *name;
+	const char *rotate;	/* for rd == rs */
+	enum lotec_form form;
+};
+
+#define INSN_DESC(name, opcode, form) [opcode] = { #name, NULL, form },
+#define ROTATE_DESC(name, opcode, form) [opcode] = #name,
+#define REG_NAME(name, reg) [reg] = #name,
+#define COND_NAME(suffix, cond) [cond] = #suffix,
+
+static const struct insn_desc insns[32] = {
+	LOTEC_INSNS(INSN_DESC)
+};
+
+static const char *const rotates[32] = {
+	LOTEC_ROTATES(ROTATE_DESC)
+};
+
+static const char *const regs[8] = {
+	LOTEC_REGS(REG_NAME)
+};
+
+static const char *const conds[8] = {
+	LOTEC_CONDS(COND_NAME)
+};
+
+const char *decode_reg(uint8_t reg)
+{
+	if ((reg >= 8) || (regs[reg] == NULL)) {
+		return "R?";
+	}
+	return regs[reg];
+}
+
+const char *decode_cond(uint8_t lotec_cond)
+{
+	if ((lotec_cond >= 8) || (conds[lotec_cond] == NULL)) {
+		return "??";
+	}
+	/* J and B are printed without AL */
+	return (lotec_cond == COND_AL) ? "" : conds[lotec_cond];
+}
+
+/* Print the mnemonic of the instruction at byte address without a newline. */
+void print_insn(FILE *fout, uint16_t address, uint16_t insn)
+{
+	const struct insn_desc *d;
+	uint8_t opcode;
+	uint8_t imm8;
+	uint8_t imm5;
+	uint8_t rd;
+	uint8_t rs;
+	uint8_t rt;
+	uint8_t cond;
+	static uint32_t last_pch;
+
+	opcode = INSN_OPCODE(insn);
+
+	rd = INSN_RD(insn);
+	rs = INSN_RS(insn);
+	rt = INSN_RT(insn);
+	imm5 = INSN_IMM5(insn);
+
+	cond = INSN_COND(insn);
+	imm8 = INSN_IMM8(insn);
+
+	d = &insns[opcode];
+	if (d->name == NULL) {
+		fprintf(fout, "illegal opcode %u", opcode);
+		return;
+	}
+	switch (d->form) {
+		case FORM_NONE:
+			fprintf(fout, "%s", d->name);
+			break;
+
+		case FORM_IMM:
+			fprintf(fout, "%s %s, #$%02X", d->name, decode_reg(rd), imm8);
+			if ((opcode == OP_LI) && (rd == REG_PCH)) {
+				last_pch = imm8 << 9;
+				fprintf(fout, "; PC=$%04x", last_pch);
+			}
+			if ((opcode == OP_LI) && (rd == REG_PCL)) {
+				fprintf(fout, "; PC=$%04x", last_pch | (imm8 << 1));
+			}
+			break;
+
+		case FORM_ADDR:
+			fprintf(fout, "%s %s, $%04X", d->name, decode_reg(rd), imm8);
+			break;
+
+		case FORM_SHIFT_IMM:
+			if (rd != rs) {
+				fprintf(fout, "%s %s, %s, #$%02X", d->name, decode_reg(rd), decode_reg(rs), imm5);
+			} else if (imm5 >= 8) {
+				fprintf(fout, "%s %s, #$%02X", d->name, decode_reg(rd), imm5 - 8);
+			} else {
+				fprintf(fout, "%s %s, #$%02X", rotates[opcode], decode_reg(rd), imm5);
+			}
+			break;
+
+		case FORM_REG:
+			fprintf(fout, "%s %s, %s", d->name, decode_reg(rd), decode_reg(rs));
+			break;
+
+		case FORM_SHIFT_REG:
+			if (rd != rs) {
+				fprintf(fout, "%s %s, %s, %s", d->name, decode_reg(rd), decode_reg(rs), decode_reg(rt));
+			} else {
+				fprintf(fout, "%s %s, %s", rotates[opcode], decode_reg(rd), decode_reg(rt));
+			}
+			break;
+
+		case FORM_JUMP:
+			fprintf(fout, "%s%s %s, %s", d->name, decode_cond(cond), decode_reg(rs), decode_reg(rt));
+			break;
+
+		case FORM_BRANCH:
+			fprintf(fout, "%s%s $%04X", d->name, decode_cond(cond), address + ((((int8_t)imm8) + 1) * 2));
+			break;
+
+		default:
+			fprintf(fout, "illegal opcode %u", opcode);
+	}
+}
+
+void decode_insn(FILE *fout, uint16_t address, uint16_t insn)
+{
+	fprintf(fout, "%04X: %02X %02X ", address, (insn >> 8) & 0xFF, (insn >> 0) & 0xFF);
+	print_insn(fout, address, insn);
+	fprintf(fout, "\n");
+}
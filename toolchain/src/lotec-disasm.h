@@ -0,0 +1,13 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef LOTECDISASM_H
+#define LOTECDISASM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+const char *decode_reg(uint8_t reg);
+const char *decode_cond(uint8_t lotec_cond);
+void print_insn(FILE *fout, uint16_t address, uint16_t insn);
+void decode_insn(FILE *fout, uint16_t address, uint16_t insn);
+
+#endif
@@ -0,0 +1,954 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "lotec-cpu.h"
+#include "lotec-coverage.h"
+
+/* Exhaustive exploration of the states reachable from a set of initial
+ * states. The inputs are RAM bytes enumerated in the initial states and
+ * volatile RAM bytes, for which every LDB may read any value of a range. A
+ * state is the CPU without its counters: registers, FLAGS, PCH, PC and RAM.
+ *
+ * The workers share one open addressing table of the visited states, kept
+ * as 64 bit fingerprints, so a hash collision may hide a state. Each worker
+ * expands the states it found depth first and hands the older half of them
+ * to a pool when other workers are idle, these take the initial states and
+ * then the states of the pool. So a single initial state with volatile
+ * inputs is explored by all workers and no state twice. The successors of
+ * every state are kept with it.
+ *
+ * Then the strongly connected components of the state graph are found
+ * (Tarjan). A component with more than one state or an edge to itself is a
+ * loop, an infinite loop if no edge leaves it. For the worst case cycles to
+ * the label this is done again with the paths ending at the label.
+ */
+
+#define MAX_INPUTS 8
+#define MAX_LOOPS 64
+#define MAX_WORKERS 256
+
+/* Default memory of the state table in MiB */
+#define DEFAULT_MEMORY 256
+
+#define WC_NONE UINT64_MAX	/* label not reachable */
+#define WC_INF (UINT64_MAX - 1)	/* unbounded */
+
+#define ENTRY_STACK 0x01	/* on the component stack */
+#define ENTRY_CYCLIC 0x02	/* edge into the own component */
+#define ENTRY_EXIT 0x04		/* edge out of the own component */
+
+struct input {
+	uint8_t addr;
+	uint8_t lo;
+	uint8_t hi;
+};
+
+struct entry {
+	_Atomic uint64_t fp;	/* 0 if unused */
+	uint64_t wc;		/* worst case cycles to the label */
+	uint32_t index;		/* 0 if not visited by the component search */
+	uint32_t low;
+	uint32_t edge;		/* first successor in the edges of the worker */
+	uint16_t worker;	/* worker which expanded the state */
+	uint16_t count;		/* number of successors */
+	uint16_t pc;
+	uint8_t cost;		/* cycles to the successors */
+	uint8_t flags;
+};
+
+/* A state found but not expanded yet */
+struct pending {
+	struct lotec_cpu cpu;
+	uint32_t slot;
+};
+
+struct frame {
+	uint32_t slot;
+	uint32_t next;		/* successor to visit next */
+};
+
+struct loop {
+	uint16_t first;
+	uint16_t last;
+	int exit;
+	uint64_t states;
+};
+
+struct explore {
+	const struct lotec_rom *rom;
+	struct lotec_cpu init;
+	struct input inputs[MAX_INPUTS];
+	unsigned int num_inputs;
+	struct input volatiles[RAM_SIZE];
+	int is_volatile[RAM_SIZE];
+	uint64_t num_initial;
+	int32_t label;
+	struct entry *table;
+	uint32_t table_size;	/* power of 2 */
+	_Atomic uint64_t states;
+	_Atomic uint64_t next_initial;
+	_Atomic int error;
+
+	/* States handed to idle workers */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct pending *pool;
+	uint32_t num_pool;
+	uint32_t pool_size;
+	unsigned int num_workers;
+	_Atomic unsigned int idle;
+	int done;
+
+	/* Component search */
+	struct frame *frames;
+	uint32_t *scc;
+	uint32_t scc_top;
+	uint32_t counter;
+	struct loop loops[MAX_LOOPS];
+	unsigned int num_loops;
+	uint64_t more_loops;
+};
+
+struct worker {
+	struct explore *e;
+	unsigned int id;
+	pthread_t thread;
+	int started;
+	struct pending *stack;
+	uint32_t top;
+	uint32_t stack_size;
+	uint32_t *edges;
+	uint32_t num_edges;
+	uint32_t edges_size;
+	uint32_t *slots;	/* of the states expanded */
+	uint32_t num_slots;
+	uint32_t slots_size;
+	uint64_t halts;
+	uint8_t reached[ROM_WORDS / 8];
+};
+
+static uint64_t mix(uint64_t h, uint64_t v)
+{
+	h ^= v;
+	h *= 0x9E3779B97F4A7C15ULL;
+	return h ^ (h >> 29);
+}
+
+static uint64_t fingerprint(const struct lotec_cpu *cpu)
+{
+	uint64_t h;
+	uint64_t v;
+	unsigned int i;
+
+	v = (uint64_t)cpu->r[0] | ((uint64_t)cpu->r[1] << 8) | ((uint64_t)cpu->r[2] << 16) |
+		((uint64_t)cpu->r[3] << 24) | ((uint64_t)cpu->r[4] << 32) |
+		((uint64_t)cpu->flags << 40) | ((uint64_t)cpu->pch << 48);
+	h = mix(0x243F6A8885A308D3ULL, v);
+	h = mix(h, cpu->pc);
+	for (i = 0; i < RAM_SIZE; i += sizeof(v)) {
+		memcpy(&v, &cpu->ram[i], sizeof(v));
+		h = mix(h, v);
+	}
+	h ^= h >> 32;
+	return (h != 0) ? h : 1;
+}
+
+/* Find the entry of a fingerprint, claiming a free slot for it if it is
+ * new. The table is never filled beyond 3/4 and a few more states of the
+ * other workers, so there is always a free slot.
+ */
+static uint32_t lookup(struct explore *e, uint64_t fp, int *added)
+{
+	uint32_t mask = e->table_size - 1;
+	uint64_t cur;
+	uint32_t i;
+
+	*added = 0;
+	for (i = (fp >> 7) & mask; ; i = (i + 1) & mask) {
+		cur = atomic_load_explicit(&e->table[i].fp, memory_order_relaxed);
+		if ((cur == 0) && atomic_compare_exchange_strong_explicit(&e->table[i].fp, &cur, fp,
+			memory_order_relaxed, memory_order_relaxed)) {
+			*added = 1;
+			return i;
+		}
+		/* cur is the fingerprint of the slot, also if another worker
+		 * claimed it first
+		 */
+		if (cur == fp) {
+			return i;
+		}
+	}
+}
+
+/* Cycles of an edge plus the worst case of the state it leads to */
+static uint64_t wc_add(uint64_t cost, uint64_t wc)
+{
+	if ((wc == WC_NONE) || (wc == WC_INF)) {
+		return wc;
+	}
+	return cost + wc;
+}
+
+static uint64_t wc_max(uint64_t a, uint64_t b)
+{
+	if (a == WC_NONE) {
+		return b;
+	}
+	if (b == WC_NONE) {
+		return a;
+	}
+	return (a > b) ? a : b;
+}
+
+static void add_loop(struct explore *e, uint16_t first, uint16_t last, int exit, uint64_t states)
+{
+	unsigned int i;
+
+	for (i = 0; i < e->num_loops; i++) {
+		if ((e->loops[i].first == first) && (e->loops[i].last == last) && (e->loops[i].exit == exit)) {
+			e->loops[i].states += states;
+			return;
+		}
+	}
+	if (e->num_loops == MAX_LOOPS) {
+		e->more_loops++;
+		return;
+	}
+	e->loops[e->num_loops].first = first;
+	e->loops[e->num_loops].last = last;
+	e->loops[e->num_loops].exit = exit;
+	e->loops[e->num_loops].states = states;
+	e->num_loops++;
+}
+
+/* Initial state number k, counting through the values of the inputs */
+static void initial_state(const struct explore *e, uint64_t k, struct lotec_cpu *cpu)
+{
+	uint64_t n;
+	unsigned int i;
+
+	*cpu = e->init;
+	for (i = 0; i < e->num_inputs; i++) {
+		n = e->inputs[i].hi - e->inputs[i].lo + 1;
+		cpu->ram[e->inputs[i].addr] = e->inputs[i].lo + k % n;
+		k /= n;
+	}
+}
+
+/* Stop all workers after an error */
+static void stop(struct explore *e)
+{
+	pthread_mutex_lock(&e->lock);
+	atomic_store(&e->error, 1);
+	e->done = 1;
+	pthread_cond_broadcast(&e->cond);
+	pthread_mutex_unlock(&e->lock);
+}
+
+/* Add a state to the table. Returns 1 if it is new and needs to be expanded
+ * by the caller, 0 if it was known and -1 on errors.
+ */
+static int add_state(struct worker *w, const struct lotec_cpu *cpu, uint32_t *slot)
+{
+	struct explore *e = w->e;
+	int added;
+
+	*slot = lookup(e, fingerprint(cpu), &added);
+	if (!added) {
+		return 0;
+	}
+	if ((atomic_fetch_add_explicit(&e->states, 1, memory_order_relaxed) + 1) * 4 >
+		(uint64_t)e->table_size * 3) {
+		fprintf(stderr, "Error: State table full, use a larger -m.\n");
+		return -1;
+	}
+	e->table[*slot].pc = cpu->pc;
+	w->reached[cpu->pc / 8] |= 1 << (cpu->pc % 8);
+	return 1;
+}
+
+static int push(struct worker *w, const struct lotec_cpu *cpu, uint32_t slot)
+{
+	uint32_t size;
+	void *p;
+
+	if (w->top == w->stack_size) {
+		size = w->stack_size * 2 + 1024;
+		p = realloc(w->stack, size * sizeof(*w->stack));
+		if (p == NULL) {
+			fprintf(stderr, "Error: Out of memory.\n");
+			return 1;
+		}
+		w->stack = p;
+		w->stack_size = size;
+	}
+	w->stack[w->top].cpu = *cpu;
+	w->stack[w->top].slot = slot;
+	w->top++;
+	return 0;
+}
+
+/* Run the instruction of a state for all values of a volatile LDB, store
+ * the successors and push the new ones. Returns 0 on success.
+ */
+static int expand(struct worker *w, const struct pending *p)
+{
+	struct explore *e = w->e;
+	struct entry *en = &e->table[p->slot];
+	struct lotec_cpu next;
+	uint32_t count = 1;
+	uint32_t slot;
+	uint32_t size;
+	uint32_t i;
+	uint16_t insn;
+	int addr = -1;
+	int rv;
+	void *q;
+
+	if (w->num_slots == w->slots_size) {
+		size = w->slots_size * 2 + 1024;
+		q = realloc(w->slots, size * sizeof(*w->slots));
+		if (q == NULL) {
+			fprintf(stderr, "Error: Out of memory.\n");
+			return 1;
+		}
+		w->slots = q;
+		w->slots_size = size;
+	}
+	w->slots[w->num_slots++] = p->slot;
+
+	en->worker = w->id;
+	en->edge = w->num_edges;
+	en->count = 0;
+	if (e->rom->ops[p->cpu.pc].uop == UOP_HALT) {
+		w->halts++;
+		return 0;
+	}
+	insn = e->rom->words[p->cpu.pc];
+	if ((INSN_OPCODE(insn) == OP_LDB) && e->is_volatile[INSN_IMM8(insn)]) {
+		addr = INSN_IMM8(insn);
+		count = e->volatiles[addr].hi - e->volatiles[addr].lo + 1;
+	}
+	if (w->num_edges + count > w->edges_size) {
+		if (w->edges_size > UINT32_MAX / 2 - count) {
+			fprintf(stderr, "Error: Too many states.\n");
+			return 1;
+		}
+		size = w->edges_size * 2 + count + 1024;
+		q = realloc(w->edges, size * sizeof(*w->edges));
+		if (q == NULL) {
+			fprintf(stderr, "Error: Out of memory.\n");
+			return 1;
+		}
+		w->edges = q;
+		w->edges_size = size;
+	}
+
+	for (i = 0; i < count; i++) {
+		next = p->cpu;
+		if (addr >= 0) {
+			next.ram[addr] = e->volatiles[addr].lo + i;
+		}
+		lotec_step(&next, e->rom);
+		en->cost = next.cycles;
+		next.cycles = 0;
+		next.insns = 0;
+
+		rv = add_state(w, &next, &slot);
+		if (rv < 0) {
+			return 1;
+		}
+		w->edges[w->num_edges++] = slot;
+		if ((rv > 0) && (push(w, &next, slot) != 0)) {
+			return 1;
+		}
+	}
+	en->count = count;
+	return 0;
+}
+
+/* Hand the older half of the own states to the pool while workers are
+ * idle. Returns 0 on success.
+ */
+static int share(struct worker *w)
+{
+	struct explore *e = w->e;
+	uint32_t n;
+	uint32_t size;
+	void *p;
+
+	if ((w->top < 2) || (atomic_load_explicit(&e->idle, memory_order_relaxed) == 0)) {
+		return 0;
+	}
+	n = w->top / 2;
+	pthread_mutex_lock(&e->lock);
+	if (e->num_pool + n > e->pool_size) {
+		size = e->pool_size * 2 + n;
+		p = realloc(e->pool, size * sizeof(*e->pool));
+		if (p == NULL) {
+			pthread_mutex_unlock(&e->lock);
+			fprintf(stderr, "Error: Out of memory.\n");
+			return 1;
+		}
+		e->pool = p;
+		e->pool_size = size;
+	}
+	memcpy(&e->pool[e->num_pool], w->stack, n * sizeof(*w->stack));
+	e->num_pool += n;
+	pthread_cond_broadcast(&e->cond);
+	pthread_mutex_unlock(&e->lock);
+	memmove(w->stack, &w->stack[n], (w->top - n) * sizeof(*w->stack));
+	w->top -= n;
+	return 0;
+}
+
+/* Take the next state to expand: the newest one of the worker, else the
+ * next new initial state, else half of the pool, waiting while other
+ * workers may still add to it. Returns 0 when all states are expanded or
+ * on errors.
+ */
+static int next_pending(struct worker *w, struct pending *p)
+{
+	struct explore *e = w->e;
+	uint64_t k;
+	uint32_t n;
+	int rv;
+
+	if (atomic_load_explicit(&e->error, memory_order_relaxed)) {
+		return 0;
+	}
+	if (w->top > 0) {
+		*p = w->stack[--w->top];
+		return 1;
+	}
+	while ((k = atomic_fetch_add_explicit(&e->next_initial, 1, memory_order_relaxed)) < e->num_initial) {
+		initial_state(e, k, &p->cpu);
+		rv = add_state(w, &p->cpu, &p->slot);
+		if (rv < 0) {
+			stop(e);
+			return 0;
+		}
+		if (rv > 0) {
+			return 1;
+		}
+	}
+
+	pthread_mutex_lock(&e->lock);
+	atomic_fetch_add_explicit(&e->idle, 1, memory_order_relaxed);
+	while ((e->num_pool == 0) && !e->done) {
+		if (atomic_load_explicit(&e->idle, memory_order_relaxed) == e->num_workers) {
+			e->done = 1;
+			pthread_cond_broadcast(&e->cond);
+			break;
+		}
+		pthread_cond_wait(&e->cond, &e->lock);
+	}
+	if (e->done) {
+		pthread_mutex_unlock(&e->lock);
+		return 0;
+	}
+	atomic_fetch_sub_explicit(&e->idle, 1, memory_order_relaxed);
+	n = (e->num_pool + 1) / 2;
+	e->num_pool -= n;
+	*p = e->pool[e->num_pool];
+	for (n--; n > 0; n--) {
+		if (push(w, &e->pool[e->num_pool + n].cpu, e->pool[e->num_pool + n].slot) != 0) {
+			pthread_mutex_unlock(&e->lock);
+			stop(e);
+			return 0;
+		}
+	}
+	pthread_mutex_unlock(&e->lock);
+	return 1;
+}
+
+static void *worker_main(void *arg)
+{
+	struct worker *w = arg;
+	struct pending p;
+
+	while (next_pending(w, &p)) {
+		if ((expand(w, &p) != 0) || (share(w) != 0)) {
+			stop(w->e);
+			break;
+		}
+	}
+	return NULL;
+}
+
+/* Successors of a state in the component search, none at the label if the
+ * paths end there.
+ */
+static uint32_t successors(const struct explore *e, const struct entry *en, int at_label)
+{
+	return (at_label && (en->pc == e->label)) ? 0 : en->count;
+}
+
+static void visit(struct explore *e, uint32_t slot, uint32_t top, int at_label)
+{
+	struct entry *en = &e->table[slot];
+
+	e->counter++;
+	en->index = e->counter;
+	en->low = e->counter;
+	en->flags = ENTRY_STACK;
+	en->wc = (at_label && (en->pc == e->label)) ? 0 : WC_NONE;
+	e->scc[e->scc_top++] = slot;
+	e->frames[top].slot = slot;
+	e->frames[top].next = 0;
+}
+
+/* Pop the component of a root from the component stack. Its states are in
+ * a loop if it has more than one state or an edge to itself, then the label
+ * is either not reachable or after any number of iterations.
+ */
+static void pop_component(struct explore *e, uint32_t root, int at_label)
+{
+	struct entry *en;
+	uint32_t first;
+	uint32_t i;
+	uint16_t lo = 0xFFFF;
+	uint16_t hi = 0;
+	uint64_t wc = WC_NONE;
+	int exit = 0;
+
+	for (first = e->scc_top; e->scc[first - 1] != root; first--) {
+	}
+	first--;
+	if ((first + 1 == e->scc_top) && !(e->table[root].flags & ENTRY_CYCLIC)) {
+		e->table[root].flags &= ~ENTRY_STACK;
+		e->scc_top = first;
+		return;
+	}
+
+	for (i = first; i < e->scc_top; i++) {
+		en = &e->table[e->scc[i]];
+		wc = wc_max(wc, en->wc);
+		exit |= (en->flags & ENTRY_EXIT) != 0;
+		lo = (en->pc < lo) ? en->pc : lo;
+		hi = (en->pc > hi) ? en->pc : hi;
+	}
+	for (i = first; i < e->scc_top; i++) {
+		en = &e->table[e->scc[i]];
+		en->wc = (wc == WC_NONE) ? WC_NONE : WC_INF;
+		en->flags &= ~ENTRY_STACK;
+	}
+	if (!at_label) {
+		add_loop(e, lo, hi, exit, e->scc_top - first);
+	}
+	e->scc_top = first;
+}
+
+/* Depth first search for the components from a state not visited yet */
+static void search(struct explore *e, const struct worker *workers, uint32_t root, int at_label)
+{
+	struct frame *f;
+	struct entry *en;
+	struct entry *child;
+	uint32_t slot;
+	uint32_t top = 0;
+
+	visit(e, root, top++, at_label);
+	while (top > 0) {
+		f = &e->frames[top - 1];
+		en = &e->table[f->slot];
+
+		if (f->next < successors(e, en, at_label)) {
+			slot = workers[en->worker].edges[en->edge + f->next];
+			f->next++;
+			child = &e->table[slot];
+			if (child->index == 0) {
+				visit(e, slot, top++, at_label);
+			} else if (child->flags & ENTRY_STACK) {
+				en->low = (child->index < en->low) ? child->index : en->low;
+				en->flags |= ENTRY_CYCLIC;
+			} else {
+				en->flags |= ENTRY_EXIT;
+				en->wc = wc_max(en->wc, wc_add(en->cost, child->wc));
+			}
+			continue;
+		}
+
+		/* All successors visited */
+		if (en->low == en->index) {
+			pop_component(e, f->slot, at_label);
+		}
+		top--;
+		if (top == 0) {
+			break;
+		}
+		child = en;
+		en = &e->table[e->frames[top - 1].slot];
+		if (child->flags & ENTRY_STACK) {
+			en->low = (child->low < en->low) ? child->low : en->low;
+			en->flags |= ENTRY_CYCLIC;
+		} else {
+			en->flags |= ENTRY_EXIT;
+			en->wc = wc_max(en->wc, wc_add(en->cost, child->wc));
+		}
+	}
+}
+
+/* Find the components of the whole state graph. With at_label the paths
+ * end at the label and the worst case cycles to it are computed, else the
+ * loops are collected.
+ */
+static void components(struct explore *e, const struct worker *workers, unsigned int num_workers,
+	int at_label)
+{
+	uint32_t slot;
+	uint32_t i;
+	unsigned int j;
+
+	for (j = 0; j < num_workers; j++) {
+		for (i = 0; i < workers[j].num_slots; i++) {
+			e->table[workers[j].slots[i]].index = 0;
+		}
+	}
+	e->counter = 0;
+	e->scc_top = 0;
+	for (j = 0; j < num_workers; j++) {
+		for (i = 0; i < workers[j].num_slots; i++) {
+			slot = workers[j].slots[i];
+			if (e->table[slot].index == 0) {
+				search(e, workers, slot, at_label);
+			}
+		}
+	}
+}
+
+/* Worst case cycles to the label over all initial states */
+static uint64_t wcet(struct explore *e)
+{
+	struct lotec_cpu cpu;
+	uint64_t wc = WC_NONE;
+	uint64_t k;
+	int added;
+
+	for (k = 0; k < e->num_initial; k++) {
+		initial_state(e, k, &cpu);
+		wc = wc_max(wc, e->table[lookup(e, fingerprint(&cpu), &added)].wc);
+	}
+	return wc;
+}
+
+/* Parse addr or addr=lo-hi, the range defaults to all values. */
+static int parse_input(const char *s, struct input *in)
+{
+	unsigned long addr;
+	unsigned long lo = 0;
+	unsigned long hi = 0xFF;
+	char *end;
+
+	addr = strtoul(s, &end, 0);
+	if (*end == '=') {
+		lo = strtoul(end + 1, &end, 0);
+		hi = lo;
+		if (*end == '-') {
+			hi = strtoul(end + 1, &end, 0);
+		}
+	}
+	if ((end == s) || (*end != '\0') || (addr >= RAM_SIZE) || (lo > hi) || (hi > 0xFF)) {
+		fprintf(stderr, "Error: Invalid input '%s'.\n", s);
+		return 1;
+	}
+	in->addr = addr;
+	in->lo = lo;
+	in->hi = hi;
+	return 0;
+}
+
+/* Address of -l, a number or a label of the listing. Returns -1 on invalid
+ * addresses and labels, -2 if the listing can't be read.
+ */
+static int32_t parse_label(const char *s, const char *listing)
+{
+	unsigned long addr;
+	char *end;
+	int32_t pc;
+
+	addr = strtoul(s, &end, 0);
+	if ((end != s) && (*end == '\0')) {
+		if (addr >= 2 * ROM_WORDS) {
+			fprintf(stderr, "Error: Invalid address '%s'.\n", s);
+			return -1;
+		}
+		if (addr & 1) {
+			fprintf(stderr, "Error: Odd address '%s', instructions are at even addresses.\n", s);
+			return -1;
+		}
+		return addr >> 1;
+	}
+	if (listing == NULL) {
+		fprintf(stderr, "Error: Label '%s' needs a listing (-L).\n", s);
+		return -1;
+	}
+	pc = lotec_listing_label(listing, s);
+	if (pc == -1) {
+		fprintf(stderr, "Error: Label '%s' not found in listing '%s'.\n", s, listing);
+	}
+	return pc;
+}
+
+static void print_wc(uint64_t wc)
+{
+	if (wc == WC_NONE) {
+		printf("unreachable\n");
+	} else if (wc == WC_INF) {
+		printf("unbounded\n");
+	} else {
+		printf("%llu\n", (unsigned long long)wc);
+	}
+}
+
+/* Merge the results of the workers, find the components and print them. */
+static void report(struct explore *e, const struct worker *workers, unsigned int num_workers)
+{
+	uint8_t reached[ROM_WORDS / 8];
+	uint64_t halts = 0;
+	uint32_t addr;
+	uint32_t start;
+	unsigned int i;
+	unsigned int j;
+
+	memset(reached, 0, sizeof(reached));
+	for (i = 0; i < num_workers; i++) {
+		halts += workers[i].halts;
+		for (j = 0; j < ROM_WORDS / 8; j++) {
+			reached[j] |= workers[i].reached[j];
+		}
+	}
+	components(e, workers, num_workers, 0);
+
+	printf("initial=%llu states=%llu halts=%llu\n", (unsigned long long)e->num_initial,
+		(unsigned long long)atomic_load(&e->states), (unsigned long long)halts);
+	for (addr = 0; addr < e->rom->size; addr++) {
+		if (reached[addr / 8] & (1 << (addr % 8))) {
+			continue;
+		}
+		for (start = addr; (addr + 1 < e->rom->size) && !(reached[(addr + 1) / 8] & (1 << ((addr + 1) % 8))); addr++) {
+		}
+		printf("unreachable $%04X-$%04X\n", start << 1, addr << 1);
+	}
+	for (i = 0; i < e->num_loops; i++) {
+		printf("loop $%04X-$%04X states=%llu %s\n", e->loops[i].first << 1, e->loops[i].last << 1,
+			(unsigned long long)e->loops[i].states, e->loops[i].exit ? "exit" : "infinite");
+	}
+	if (e->more_loops > 0) {
+		printf("%llu more loops\n", (unsigned long long)e->more_loops);
+	}
+	if (e->label >= 0) {
+		components(e, workers, num_workers, 1);
+		printf("wcet $%04X ", e->label << 1);
+		print_wc(wcet(e));
+	}
+}
+
+static void usage(void)
+{
+	printf("lotec-explore [-i addr[=lo-hi]] [-v addr[=lo-hi]] [-l addr] [-L listing] [-r ram] [-j workers]\n");
+	printf("              [-m MiB] [-t] rom\n");
+	printf("Explores all states reachable from reset\n");
+	printf(" -i addr      Start with every value lo-hi (default 0-255) of the RAM byte at addr\n");
+	printf(" -v addr      Every LDB of the RAM byte at addr may read any value lo-hi\n");
+	printf(" -l addr      Print the worst case cycles to address addr, or to a label of\n");
+	printf("              the listing\n");
+	printf(" -L listing   Listing of lotec-ass -l for the labels of -l\n");
+	printf(" -r ram       Load RAM from file\n");
+	printf(" -j workers   Number of worker threads (default: online cores)\n");
+	printf(" -m MiB       Memory of the state table (default %u)\n", DEFAULT_MEMORY);
+	printf(" -t           Print exploration speed\n");
+	printf("Prints the code never executed, the loops, which are infinite if no\n");
+	printf("state leaves them, and with -l the worst case number of cycles.\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct explore e;
+	struct worker *workers = NULL;
+	struct lotec_rom *rom;
+	struct input in;
+	const char *label = NULL;
+	const char *listing = NULL;
+	unsigned long long memory = DEFAULT_MEMORY;
+	unsigned long long entries;
+	unsigned int num_workers;
+	double start;
+	double duration;
+	uint64_t states;
+	long cores;
+	unsigned int i;
+	int timing = 0;
+	int rv = 0;
+	int opt;
+
+	memset(&e, 0, sizeof(e));
+	lotec_reset(&e.init);
+	e.label = -1;
+	e.num_initial = 1;
+	pthread_mutex_init(&e.lock, NULL);
+	pthread_cond_init(&e.cond, NULL);
+	cores = sysconf(_SC_NPROCESSORS_ONLN);
+	num_workers = (cores > 0) ? cores : 1;
+
+	rom = lotec_rom_alloc();
+	if (rom == NULL) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		return 2;
+	}
+	e.rom = rom;
+
+	while ((opt = getopt(argc, argv, "i:v:l:L:r:j:m:t")) != -1) {
+		switch (opt) {
+			case 'i':
+				if (e.num_inputs == MAX_INPUTS) {
+					fprintf(stderr, "Error: Too many inputs.\n");
+					rv = 1;
+					goto out;
+				}
+				if (parse_input(optarg, &e.inputs[e.num_inputs]) != 0) {
+					rv = 1;
+					goto out;
+				}
+				e.num_initial *= e.inputs[e.num_inputs].hi - e.inputs[e.num_inputs].lo + 1;
+				if (e.num_initial > UINT32_MAX) {
+					fprintf(stderr, "Error: Too many initial states.\n");
+					rv = 1;
+					goto out;
+				}
+				e.num_inputs++;
+				break;
+			case 'v':
+				if (parse_input(optarg, &in) != 0) {
+					rv = 1;
+					goto out;
+				}
+				e.volatiles[in.addr] = in;
+				e.is_volatile[in.addr] = 1;
+				break;
+			case 'l':
+				label = optarg;
+				break;
+			case 'L':
+				listing = optarg;
+				break;
+			case 'r':
+				if (lotec_ram_load(&e.init, optarg) != 0) {
+					rv = 2;
+					goto out;
+				}
+				break;
+			case 'j':
+				num_workers = strtoul(optarg, NULL, 0);
+				if (num_workers == 0) {
+					usage();
+					rv = 1;
+					goto out;
+				}
+				break;
+			case 'm':
+				memory = strtoull(optarg, NULL, 0);
+				break;
+			case 't':
+				timing = 1;
+				break;
+			default:
+				usage();
+				rv = 1;
+				goto out;
+		}
+	}
+	if (optind + 1 != argc) {
+		usage();
+		rv = 1;
+		goto out;
+	}
+	if (label != NULL) {
+		e.label = parse_label(label, listing);
+		if (e.label < 0) {
+			rv = (e.label == -2) ? 2 : 1;
+			goto out;
+		}
+	}
+	if (lotec_rom_load(rom, argv[optind]) != 0) {
+		rv = 2;
+		goto out;
+	}
+
+	if (num_workers > MAX_WORKERS) {
+		num_workers = MAX_WORKERS;
+	}
+	e.num_workers = num_workers;
+	entries = (memory << 20) / sizeof(struct entry);
+	for (e.table_size = 1024; (e.table_size < (1U << 31)) && (e.table_size * 2ULL <= entries); e.table_size *= 2) {
+	}
+	e.table = calloc(e.table_size, sizeof(*e.table));
+	workers = calloc(num_workers, sizeof(*workers));
+	if ((e.table == NULL) || (workers == NULL)) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		rv = 2;
+		goto out;
+	}
+
+	start = lotec_get_time();
+	for (i = 0; i < num_workers; i++) {
+		workers[i].e = &e;
+		workers[i].id = i;
+		if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0) {
+			fprintf(stderr, "Error: Failed to start worker thread.\n");
+			stop(&e);
+			rv = 2;
+			break;
+		}
+		workers[i].started = 1;
+	}
+	for (i = 0; i < num_workers; i++) {
+		if (workers[i].started) {
+			pthread_join(workers[i].thread, NULL);
+		}
+	}
+	if ((rv == 0) && atomic_load(&e.error)) {
+		rv = 3;
+	}
+
+	if (rv == 0) {
+		states = atomic_load(&e.states);
+		e.frames = malloc(states * sizeof(*e.frames));
+		e.scc = malloc(states * sizeof(*e.scc));
+		if ((e.frames == NULL) || (e.scc == NULL)) {
+			fprintf(stderr, "Error: Out of memory.\n");
+			rv = 2;
+			goto out;
+		}
+		report(&e, workers, num_workers);
+		duration = lotec_get_time() - start;
+		if (timing) {
+			fprintf(stderr, "%u workers, %.3f s, %.1f M states/s\n", num_workers, duration,
+				(duration > 0) ? (states / duration / 1e6) : 0.0);
+		}
+	}
+
+out:
+	if (workers != NULL) {
+		for (i = 0; i < num_workers; i++) {
+			free(workers[i].stack);
+			free(workers[i].edges);
+			free(workers[i].slots);
+		}
+	}
+	free(workers);
+	free(e.table);
+	free(e.pool);
+	free(e.frames);
+	free(e.scc);
+	pthread_cond_destroy(&e.cond);
+	pthread_mutex_destroy(&e.lock);
+	lotec_rom_free(rom);
+	return rv;
+}
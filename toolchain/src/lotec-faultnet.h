@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef LOTECFAULTNET_H
+#define LOTECFAULTNET_H
+
+#include <stdint.h>
+
+/* Netlist of a circuit compiled to C by dig2c.py -f, the Makefile generates
+ * bin/lotec-faultnet.c from dig/lotec.dig. It runs 64 machines at once: bit
+ * i of the nets, numbered as in lotec-netlist.c, is the 64 bit slice
+ * offset + i, bit k of which is the value in machine k.
+ */
+struct lotec_faultnet;
+
+struct lotec_faultnet_net {
+	const char *name;	/* tunnel or label of the driver, else n<number> */
+	unsigned int offset;	/* first slice */
+	unsigned int width;
+	int faults;		/* may have stuck-at faults */
+};
+
+struct lotec_faultnet *lotec_faultnet_alloc(void);
+void lotec_faultnet_free(struct lotec_faultnet *f);
+const struct lotec_faultnet_net *lotec_faultnet_nets(unsigned int *num, unsigned int *bits);
+void lotec_faultnet_reset(struct lotec_faultnet *f, const uint64_t *sa0, const uint64_t *sa1);
+void lotec_faultnet_clock(struct lotec_faultnet *f);
+const uint64_t *lotec_faultnet_slices(const struct lotec_faultnet *f);
+void lotec_faultnet_set_rom(struct lotec_faultnet *f, const uint16_t *words, uint32_t size);
+void lotec_faultnet_set_ram(struct lotec_faultnet *f, const uint8_t *ram, uint32_t size);
+uint64_t lotec_faultnet_ram_differs(const struct lotec_faultnet *f, const uint8_t *ram, uint32_t size);
+
+#endif
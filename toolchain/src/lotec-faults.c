@@ -0,0 +1,422 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "lotec-cpu.h"
+#include "lotec-netcpu.h"
+#include "lotec-faultnet.h"
+
+/* Stuck-at fault simulation of dig/lotec.dig. Every bit of every net may be
+ * stuck at 0 or 1. The fault free netlist runs a test ROM first and records
+ * the registers after every instruction. Then the faults not yet detected
+ * are packed into groups of 64, one machine per fault, and the groups run
+ * on worker threads in the bit-parallel netlist of dig2c.py -f, which is
+ * compared with the record at the same master clocks and with the final RAM.
+ * A fault is detected by the first difference; a group stops when all its
+ * faults are, and a detected fault is dropped from the following ROMs.
+ */
+
+#define DEFAULT_FAULT_CYCLES 100000ULL
+
+/* Registers compared after every instruction, NET_R0 to NET_PC */
+#define NUM_OBSERVED (NET_PC + 1)
+
+#define UNDETECTED -1
+
+struct fault {
+	unsigned int net;
+	unsigned int bit;
+	int value;
+	int rom;		/* index of the ROM detecting it or UNDETECTED */
+};
+
+struct strobe {
+	uint64_t clock;
+	uint32_t value[NUM_OBSERVED];
+};
+
+struct faultsim {
+	const struct lotec_faultnet_net *nets;
+	unsigned int num_nets;
+	unsigned int num_bits;
+	struct fault *faults;
+	unsigned int num_faults;
+	unsigned int *pending;		/* faults run with the current ROM */
+	unsigned int num_pending;
+	unsigned int observed[NUM_OBSERVED];	/* nets */
+	const struct lotec_rom *rom;
+	int rom_index;
+	struct strobe *strobes;
+	size_t num_strobes;
+	uint8_t *ram_start;
+	uint8_t *ram_end;
+	uint32_t ram_size;
+	unsigned int num_workers;
+	atomic_uint next_group;
+	atomic_uint_fast64_t clocks;
+};
+
+struct worker {
+	struct faultsim *fs;
+	struct lotec_faultnet *f;
+	uint64_t *sa0;
+	uint64_t *sa1;
+	pthread_t thread;
+};
+
+/* Run the fault free netlist and record the registers after every
+ * instruction and the RAM at the start and at the end.
+ */
+static int run_good(struct faultsim *fs, const struct lotec_cpu *init, uint64_t max_cycles, uint64_t *cycles)
+{
+	struct lotec_netcpu nc;
+	struct strobe *st;
+	size_t size = 0;
+	unsigned int i;
+	int reason = EXIT_LIMIT;
+	int rv;
+
+	rv = lotec_netcpu_init(&nc, fs->rom, init);
+	if (rv != 0) {
+		return rv;
+	}
+	fs->ram_size = nc.ram_size;
+	fs->ram_start = malloc(nc.ram_size);
+	fs->ram_end = malloc(nc.ram_size);
+	if ((fs->ram_start == NULL) || (fs->ram_end == NULL)) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		lotec_netcpu_free(&nc);
+		return 2;
+	}
+	memcpy(fs->ram_start, nc.ram, nc.ram_size);
+	for (i = 0; i < NUM_OBSERVED; i++) {
+		fs->observed[i] = nc.net[i];
+	}
+
+	fs->num_strobes = 0;
+	while ((nc.cycles < max_cycles) && (reason == EXIT_LIMIT)) {
+		reason = lotec_netcpu_step(&nc);
+		if (reason != EXIT_LIMIT) {
+			break;
+		}
+		if (fs->num_strobes == size) {
+			size = size ? (size * 2) : 1024;
+			st = realloc(fs->strobes, size * sizeof(*st));
+			if (st == NULL) {
+				fprintf(stderr, "Error: Out of memory.\n");
+				lotec_netcpu_free(&nc);
+				return 2;
+			}
+			fs->strobes = st;
+		}
+		st = &fs->strobes[fs->num_strobes++];
+		st->clock = nc.clocks;
+		for (i = 0; i < NUM_OBSERVED; i++) {
+			st->value[i] = lotec_netlist_get(nc.nl, nc.net[i]);
+		}
+	}
+	memcpy(fs->ram_end, nc.ram, nc.ram_size);
+	*cycles = nc.cycles;
+	lotec_netcpu_free(&nc);
+	return (reason == EXIT_ERROR) ? 3 : 0;
+}
+
+/* Run a group of up to 64 faults, returns the machines detecting theirs */
+static uint64_t run_group(struct faultsim *fs, struct worker *w, const unsigned int *group, unsigned int n)
+{
+	const struct lotec_faultnet_net *net;
+	const struct fault *fault;
+	const uint64_t *s;
+	uint64_t active;
+	uint64_t detected = 0;
+	uint64_t clock = 0;
+	size_t k;
+	unsigned int i;
+	unsigned int j;
+
+	memset(w->sa0, 0, fs->num_bits * sizeof(*w->sa0));
+	memset(w->sa1, 0, fs->num_bits * sizeof(*w->sa1));
+	for (i = 0; i < n; i++) {
+		fault = &fs->faults[group[i]];
+		j = fs->nets[fault->net].offset + fault->bit;
+		if (fault->value) {
+			w->sa1[j] |= 1ULL << i;
+		} else {
+			w->sa0[j] |= 1ULL << i;
+		}
+	}
+	active = (n == 64) ? ~0ULL : ((1ULL << n) - 1);
+
+	lotec_faultnet_set_rom(w->f, fs->rom->words, ROM_WORDS);
+	lotec_faultnet_set_ram(w->f, fs->ram_start, fs->ram_size);
+	lotec_faultnet_reset(w->f, w->sa0, w->sa1);
+	s = lotec_faultnet_slices(w->f);
+
+	for (k = 0; (k < fs->num_strobes) && ((detected & active) != active); k++) {
+		for (; clock < fs->strobes[k].clock; clock++) {
+			lotec_faultnet_clock(w->f);
+		}
+		for (i = 0; i < NUM_OBSERVED; i++) {
+			net = &fs->nets[fs->observed[i]];
+			for (j = 0; j < net->width; j++) {
+				detected |= s[net->offset + j] ^ -(uint64_t)((fs->strobes[k].value[i] >> j) & 1);
+			}
+		}
+	}
+	if ((detected & active) != active) {
+		detected |= lotec_faultnet_ram_differs(w->f, fs->ram_end, fs->ram_size);
+	}
+	atomic_fetch_add_explicit(&fs->clocks, clock * n, memory_order_relaxed);
+	return detected & active;
+}
+
+static void *worker_main(void *arg)
+{
+	struct worker *w = arg;
+	struct faultsim *fs = w->fs;
+	const unsigned int *group;
+	uint64_t detected;
+	unsigned int first;
+	unsigned int n;
+	unsigned int i;
+
+	for (;;) {
+		first = atomic_fetch_add_explicit(&fs->next_group, 1, memory_order_relaxed) * 64;
+		if (first >= fs->num_pending) {
+			break;
+		}
+		group = &fs->pending[first];
+		n = (fs->num_pending - first < 64) ? (fs->num_pending - first) : 64;
+		detected = run_group(fs, w, group, n);
+		for (i = 0; i < n; i++) {
+			if ((detected >> i) & 1) {
+				fs->faults[group[i]].rom = fs->rom_index;
+			}
+		}
+	}
+	return NULL;
+}
+
+static int run_workers(struct faultsim *fs, struct worker *workers)
+{
+	unsigned int started;
+	unsigned int i;
+	int rv = 0;
+
+	atomic_store(&fs->next_group, 0);
+	for (started = 0; started < fs->num_workers; started++) {
+		if (pthread_create(&workers[started].thread, NULL, worker_main, &workers[started]) != 0) {
+			/* The started workers take all groups. */
+			fprintf(stderr, "Error: Failed to start worker %u.\n", started);
+			rv = 2;
+			break;
+		}
+	}
+	for (i = 0; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+	return rv;
+}
+
+static void usage(void)
+{
+	printf("lotec-faults [-c cycles] [-j workers] [-r ram file] [-s] [-u] [-t] rom...\n");
+	printf("Grades test ROMs by the stuck-at faults of the LoTec netlist they detect\n");
+	printf(" -c cycles    Stop every ROM after cycles clock cycles (default %llu)\n",
+		DEFAULT_FAULT_CYCLES);
+	printf(" -j workers   Number of worker threads (default: online cores)\n");
+	printf(" -r file      Load initial RAM content from binary file\n");
+	printf(" -s           Run every ROM on all faults, don't drop the detected ones\n");
+	printf(" -u           Print the undetected faults\n");
+	printf(" -t           Print simulation speed\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct faultsim fs;
+	struct worker *workers = NULL;
+	struct lotec_cpu cpu;
+	struct lotec_rom *rom = NULL;
+	const char *ramfile = NULL;
+	uint64_t max_cycles = DEFAULT_FAULT_CYCLES;
+	uint64_t cycles;
+	double start;
+	double duration;
+	unsigned int detected;
+	unsigned int total;
+	unsigned int i;
+	unsigned int j;
+	long cores;
+	int separate = 0;
+	int undetected = 0;
+	int timing = 0;
+	int rv = 0;
+	int opt;
+
+	memset(&fs, 0, sizeof(fs));
+	cores = sysconf(_SC_NPROCESSORS_ONLN);
+	fs.num_workers = (cores > 0) ? cores : 1;
+
+	while ((opt = getopt(argc, argv, "c:j:r:sut")) != -1) {
+		switch (opt) {
+			case 'c':
+				max_cycles = strtoull(optarg, NULL, 0);
+				break;
+			case 'j':
+				fs.num_workers = strtoul(optarg, NULL, 0);
+				if (fs.num_workers == 0) {
+					usage();
+					return 1;
+				}
+				break;
+			case 'r':
+				ramfile = optarg;
+				break;
+			case 's':
+				separate = 1;
+				break;
+			case 'u':
+				undetected = 1;
+				break;
+			case 't':
+				timing = 1;
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+	if (optind >= argc) {
+		usage();
+		return 1;
+	}
+
+	lotec_reset(&cpu);
+	if ((ramfile != NULL) && (lotec_ram_load(&cpu, ramfile) != 0)) {
+		return 2;
+	}
+
+	/* Both stuck-at faults of every bit of the nets */
+	fs.nets = lotec_faultnet_nets(&fs.num_nets, &fs.num_bits);
+	for (i = 0; i < fs.num_nets; i++) {
+		if (fs.nets[i].faults) {
+			fs.num_faults += 2 * fs.nets[i].width;
+		}
+	}
+	fs.faults = calloc(fs.num_faults, sizeof(*fs.faults));
+	fs.pending = calloc(fs.num_faults, sizeof(*fs.pending));
+	workers = calloc(fs.num_workers, sizeof(*workers));
+	rom = lotec_rom_alloc();
+	if ((fs.faults == NULL) || (fs.pending == NULL) || (workers == NULL) || (rom == NULL)) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		rv = 2;
+		goto out;
+	}
+	total = 0;
+	for (i = 0; i < fs.num_nets; i++) {
+		for (j = 0; fs.nets[i].faults && (j < 2 * fs.nets[i].width); j++) {
+			fs.faults[total].net = i;
+			fs.faults[total].bit = j / 2;
+			fs.faults[total].value = j % 2;
+			fs.faults[total].rom = UNDETECTED;
+			total++;
+		}
+	}
+	for (i = 0; i < fs.num_workers; i++) {
+		workers[i].fs = &fs;
+		workers[i].f = lotec_faultnet_alloc();
+		workers[i].sa0 = calloc(fs.num_bits, sizeof(*workers[i].sa0));
+		workers[i].sa1 = calloc(fs.num_bits, sizeof(*workers[i].sa1));
+		if ((workers[i].f == NULL) || (workers[i].sa0 == NULL) || (workers[i].sa1 == NULL)) {
+			fprintf(stderr, "Error: Out of memory.\n");
+			rv = 2;
+			goto out;
+		}
+	}
+
+	start = lotec_get_time();
+	for (fs.rom_index = 0; optind + fs.rom_index < argc; fs.rom_index++) {
+		rv = lotec_rom_load(rom, argv[optind + fs.rom_index]);
+		if (rv != 0) {
+			goto out;
+		}
+		fs.rom = rom;
+		free(fs.ram_start);
+		free(fs.ram_end);
+		fs.ram_start = NULL;
+		fs.ram_end = NULL;
+		rv = run_good(&fs, &cpu, max_cycles, &cycles);
+		if (rv != 0) {
+			goto out;
+		}
+
+		fs.num_pending = 0;
+		for (i = 0; i < fs.num_faults; i++) {
+			if (separate || (fs.faults[i].rom == UNDETECTED)) {
+				fs.faults[i].rom = UNDETECTED;
+				fs.pending[fs.num_pending++] = i;
+			}
+		}
+		rv = run_workers(&fs, workers);
+		if (rv != 0) {
+			goto out;
+		}
+
+		detected = 0;
+		total = 0;
+		for (i = 0; i < fs.num_pending; i++) {
+			detected += (fs.faults[fs.pending[i]].rom == fs.rom_index);
+		}
+		for (i = 0; i < fs.num_faults; i++) {
+			total += (fs.faults[i].rom != UNDETECTED);
+		}
+		/* The coverage of all faults this ROM adds, and when dropping the
+		 * coverage of the ROMs so far
+		 */
+		printf("rom=%s cycles=%llu faults=%u detected=%u coverage=%.1f%%", argv[optind + fs.rom_index],
+			(unsigned long long)cycles, fs.num_pending, detected, 100.0 * detected / fs.num_faults);
+		if (!separate) {
+			printf(" total=%.1f%%", 100.0 * total / fs.num_faults);
+		}
+		printf("\n");
+	}
+	duration = lotec_get_time() - start;
+
+	if (!separate) {
+		printf("faults=%u detected=%u coverage=%.1f%%\n", fs.num_faults, total,
+			100.0 * total / fs.num_faults);
+	}
+	if (undetected) {
+		for (i = 0; i < fs.num_faults; i++) {
+			if (fs.faults[i].rom == UNDETECTED) {
+				printf("undetected %s[%u] stuck-at-%d\n", fs.nets[fs.faults[i].net].name,
+					fs.faults[i].bit, fs.faults[i].value);
+			}
+		}
+	}
+	if (timing) {
+		fprintf(stderr, "%u workers, %.3f s, %.1f M faulty master clocks/s\n", fs.num_workers, duration,
+			(duration > 0) ? (atomic_load(&fs.clocks) / duration / 1e6) : 0.0);
+	}
+
+out:
+	for (i = 0; (workers != NULL) && (i < fs.num_workers); i++) {
+		lotec_faultnet_free(workers[i].f);
+		free(workers[i].sa0);
+		free(workers[i].sa1);
+	}
+	free(workers);
+	lotec_rom_free(rom);
+	free(fs.faults);
+	free(fs.pending);
+	free(fs.strobes);
+	free(fs.ram_start);
+	free(fs.ram_end);
+	return rv;
+}
@@ -0,0 +1,101 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "lotec-cpu.h"
+#include "lotec-netcpu.h"
+
+/* Runs a ROM on the gate level netlist of dig/lotec.dig, compiled to C by
+ * dig2c.py. The output is the one of lotec-sim, so both can be compared.
+ */
+
+static void usage(void)
+{
+	printf("lotec-gates [-c cycles] [-r ram file] [-m] [-t] rom\n");
+	printf("Runs the gate level netlist of the LoTec CPU\n");
+	printf(" -c cycles    Stop after cycles clock cycles (default %llu)\n", DEFAULT_MAX_CYCLES);
+	printf(" -r file      Load initial RAM content from binary file\n");
+	printf(" -m           Print RAM content at exit\n");
+	printf(" -t           Print simulation speed\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct lotec_netcpu nc;
+	struct lotec_cpu cpu;
+	struct lotec_rom *rom;
+	const char *ramfile = NULL;
+	uint64_t max_cycles = DEFAULT_MAX_CYCLES;
+	double start;
+	double duration;
+	int dump_ram = 0;
+	int timing = 0;
+	int reason;
+	int rv;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "c:r:mt")) != -1) {
+		switch (opt) {
+			case 'c':
+				max_cycles = strtoull(optarg, NULL, 0);
+				break;
+			case 'r':
+				ramfile = optarg;
+				break;
+			case 'm':
+				dump_ram = 1;
+				break;
+			case 't':
+				timing = 1;
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+	if (optind != argc - 1) {
+		usage();
+		return 1;
+	}
+
+	lotec_reset(&cpu);
+	if ((ramfile != NULL) && (lotec_ram_load(&cpu, ramfile) != 0)) {
+		return 2;
+	}
+	rom = lotec_rom_alloc();
+	if (rom == NULL) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		return 2;
+	}
+	rv = lotec_rom_load(rom, argv[optind]);
+	if (rv == 0) {
+		rv = lotec_netcpu_init(&nc, rom, &cpu);
+	}
+	if (rv != 0) {
+		lotec_rom_free(rom);
+		return rv;
+	}
+
+	start = lotec_get_time();
+	reason = lotec_netcpu_run(&nc, max_cycles);
+	duration = lotec_get_time() - start;
+
+	lotec_netcpu_state(&nc, &cpu);
+	printf("exit=%s\n", lotec_exit_name(reason));
+	lotec_print_state(stdout, &cpu);
+	if (dump_ram) {
+		lotec_print_ram(stdout, &cpu);
+	}
+	if (timing) {
+		fprintf(stderr, "%.3f s, %.1f k master clocks/s, %.1f k instructions/s\n", duration,
+			(duration > 0) ? (nc.clocks / duration / 1e3) : 0.0,
+			(duration > 0) ? (cpu.insns / duration / 1e3) : 0.0);
+	}
+
+	lotec_netcpu_free(&nc);
+	lotec_rom_free(rom);
+	return (reason == EXIT_ERROR) ? 3 : 0;
+}
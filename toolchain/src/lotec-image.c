@@ -0,0 +1,198 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lotec-cpu.h"
+
+/* Pre-decoded ROM images. An image holds the memory of struct lotec_rom as
+ * it is after lotec_rom_decode(): the words, the operations and the bitmap of
+ * the basic block starts, followed by a footer:
+ *
+ *	"LIMG", version, byte order marker, ROM_WORDS, sizeof(struct
+ *	lotec_op) and ROM size (32 bit each), size, modification time
+ *	(seconds and nanoseconds) of the source file and FNV-1a hash of the
+ *	ROM words (64 bit each)
+ *
+ * The body is in host byte order and starts at offset 0, so it is mapped
+ * directly and processes running the same ROM share it in the page cache.
+ * The footer is in host byte order, too; an image of another host is
+ * rebuilt like a stale one. IMAGE_VERSION must change with decode_op().
+ */
+
+#define IMAGE_MAGIC "LIMG"
+#define IMAGE_VERSION 1
+#define IMAGE_BYTE_ORDER 0x01020304
+#define IMAGE_SUFFIX ".img"
+
+struct image_footer {
+	char magic[4];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t rom_words;
+	uint32_t op_size;
+	uint32_t rom_size;
+	uint64_t source_size;
+	uint64_t source_sec;
+	uint64_t source_nsec;
+	uint64_t hash;
+};
+
+static uint64_t words_hash(const uint16_t *words, uint32_t size)
+{
+	uint64_t h = 0xCBF29CE484222325ULL;
+	uint32_t i;
+
+	for (i = 0; i < size; i++) {
+		h = (h ^ (words[i] >> 8)) * 0x100000001B3ULL;
+		h = (h ^ (words[i] & 0xFF)) * 0x100000001B3ULL;
+	}
+	return h;
+}
+
+static void init_footer(struct image_footer *f, const struct stat *st)
+{
+	memset(f, 0, sizeof(*f));
+	memcpy(f->magic, IMAGE_MAGIC, 4);
+	f->version = IMAGE_VERSION;
+	f->byte_order = IMAGE_BYTE_ORDER;
+	f->rom_words = ROM_WORDS;
+	f->op_size = sizeof(struct lotec_op);
+	f->source_size = st->st_size;
+	f->source_sec = st->st_mtim.tv_sec;
+	f->source_nsec = st->st_mtim.tv_nsec;
+}
+
+/* Map the image if it is up to date with the source. Returns 0 if it was
+ * mapped, else 1.
+ */
+static int map_image(struct lotec_rom *rom, const char *imgfile, const struct stat *source)
+{
+	struct image_footer expect;
+	struct image_footer f;
+	struct stat st;
+	void *p;
+	int fd;
+
+	fd = open(imgfile, O_RDONLY);
+	if (fd < 0) {
+		return 1;
+	}
+	if ((fstat(fd, &st) != 0) || (st.st_size != (off_t)(ROM_MEM_SIZE + sizeof(f))) ||
+		(pread(fd, &f, sizeof(f), ROM_MEM_SIZE) != sizeof(f))) {
+		close(fd);
+		return 1;
+	}
+	init_footer(&expect, source);
+	expect.rom_size = f.rom_size;
+	expect.hash = f.hash;
+	if ((memcmp(&f, &expect, sizeof(f)) != 0) || (f.rom_size > ROM_WORDS)) {
+		close(fd);
+		return 1;
+	}
+	p = mmap(NULL, ROM_MEM_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		return 1;
+	}
+	if (words_hash(p, f.rom_size) != f.hash) {
+		munmap(p, ROM_MEM_SIZE);
+		return 1;
+	}
+
+	lotec_rom_set_mem(rom, p, ROM_MEM_SIZE);
+	rom->size = f.rom_size;
+	rom->code_valid = 0;
+	rom->jit_valid = 0;
+	rom->memo_valid = 0;
+	return 0;
+}
+
+/* Write the image of the decoded ROM to a temporary file and rename it, so
+ * that other processes never map a partial image.
+ */
+static int write_image(const struct lotec_rom *rom, const char *imgfile, const struct stat *source)
+{
+	struct image_footer f;
+	char *tmpfile;
+	FILE *fout;
+	int rv = 0;
+	int fd;
+
+	tmpfile = malloc(strlen(imgfile) + 8);
+	if (tmpfile == NULL) {
+		return 2;
+	}
+	sprintf(tmpfile, "%s.XXXXXX", imgfile);
+	fd = mkstemp(tmpfile);
+	if (fd < 0) {
+		free(tmpfile);
+		return 2;
+	}
+	fchmod(fd, 0644);
+	fout = fdopen(fd, "wb");
+	if (fout == NULL) {
+		close(fd);
+		unlink(tmpfile);
+		free(tmpfile);
+		return 2;
+	}
+
+	init_footer(&f, source);
+	f.rom_size = rom->size;
+	f.hash = words_hash(rom->words, rom->size);
+	if ((fwrite(rom->mem, ROM_MEM_SIZE, 1, fout) != 1) || (fwrite(&f, sizeof(f), 1, fout) != 1)) {
+		rv = 2;
+	}
+	if (fclose(fout) != 0) {
+		rv = 2;
+	}
+	if ((rv == 0) && (rename(tmpfile, imgfile) != 0)) {
+		rv = 2;
+	}
+	if (rv != 0) {
+		unlink(tmpfile);
+	}
+	free(tmpfile);
+	return rv;
+}
+
+/* Load a ROM through its pre-decoded image, filename with ".img" appended.
+ * The image is mapped if its footer matches the size and modification time
+ * of filename and the hash of its words. Otherwise filename is loaded by
+ * lotec_rom_load() and the image is written again; failing to write it only
+ * prints a warning.
+ */
+int lotec_rom_load_cached(struct lotec_rom *rom, const char *filename)
+{
+	struct stat st;
+	char *imgfile;
+	int rv;
+
+	if (stat(filename, &st) != 0) {
+		fprintf(stderr, "Error: Failed to open file '%s'.\n", filename);
+		return 2;
+	}
+	imgfile = malloc(strlen(filename) + sizeof(IMAGE_SUFFIX));
+	if (imgfile == NULL) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		return 2;
+	}
+	sprintf(imgfile, "%s%s", filename, IMAGE_SUFFIX);
+
+	if (map_image(rom, imgfile, &st) == 0) {
+		free(imgfile);
+		return 0;
+	}
+	rv = lotec_rom_load(rom, filename);
+	if ((rv == 0) && (write_image(rom, imgfile, &st) != 0)) {
+		fprintf(stderr, "Warning: Failed to write image '%s'.\n", imgfile);
+	}
+	free(imgfile);
+	return rv;
+}
@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef LOTECISA_H
+#define LOTECISA_H
+
+#include "lotec-opcodes.h"
+
+/* Operands of an instruction and the fields they are encoded in */
+enum lotec_form {
+	FORM_NONE = 0,		/* no operands */
+	FORM_IMM,		/* rd, #imm8 */
+	FORM_ADDR,		/* rd, $imm8 */
+	FORM_SHIFT_IMM,		/* rd, rs, #imm5 or rd, #n for rd, rd, #n + 8 */
+	FORM_ROT_IMM,		/* rd, #imm5 for rd, rd, #imm5 */
+	FORM_REG,		/* rd, rs */
+	FORM_SHIFT_REG,		/* rd, rs, rt */
+	FORM_ROT_REG,		/* rd, rt for rd, rd, rt */
+	FORM_JUMP,		/* cond, rs, rt: PCH = rs, PCL = rt */
+	FORM_BRANCH,		/* cond, $target as imm8 word offset to the next address */
+};
+
+/* The instructions, X(mnemonic, opcode, form). The assembler accepts the
+ * mnemonics, the disassembler prints them. J and B take the conditions of
+ * LOTEC_CONDS as suffix.
+ */
+#define LOTEC_INSNS(X) \
+	X(NOP, OP_NOP, FORM_NONE) \
+	X(LI, OP_LI, FORM_IMM) \
+	X(ADDI, OP_ADDI, FORM_IMM) \
+	X(ANDI, OP_ANDI, FORM_IMM) \
+	X(ORI, OP_ORI, FORM_IMM) \
+	X(XORI, OP_XORI, FORM_IMM) \
+	X(SUBI, OP_SUBI, FORM_IMM) \
+	X(CMPI, OP_CMPI, FORM_IMM) \
+	X(SHRI, OP_SHRI, FORM_SHIFT_IMM) \
+	X(SHLI, OP_SHLI, FORM_SHIFT_IMM) \
+	X(MOV, OP_MOV, FORM_REG) \
+	X(ADD, OP_ADD, FORM_REG) \
+	X(AND, OP_AND, FORM_REG) \
+	X(OR, OP_OR, FORM_REG) \
+	X(XOR, OP_XOR, FORM_REG) \
+	X(SUB, OP_SUB, FORM_REG) \
+	X(CMP, OP_CMP, FORM_REG) \
+	X(SHR, OP_SHR, FORM_SHIFT_REG) \
+	X(SHL, OP_SHL, FORM_SHIFT_REG) \
+	X(LDB, OP_LDB, FORM_ADDR) \
+	X(STB, OP_STB, FORM_ADDR) \
+	X(J, OP_JUMP, FORM_JUMP) \
+	X(B, OP_BRANCH, FORM_BRANCH)
+
+/* Rotates, shifts with rd == rs, X(mnemonic, opcode, form). The
+ * disassembler prints them for a shift with rd == rs and imm5 < 8 or a
+ * register shift with rd == rs.
+ */
+#define LOTEC_ROTATES(X) \
+	X(RORI, OP_SHRI, FORM_ROT_IMM) \
+	X(ROLI, OP_SHLI, FORM_ROT_IMM) \
+	X(ROR, OP_SHR, FORM_ROT_REG) \
+	X(ROL, OP_SHL, FORM_ROT_REG)
+
+/* Conditions of J and B, X(suffix, cond). AL is also written without suffix. */
+#define LOTEC_CONDS(X) \
+	X(AL, COND_AL) \
+	X(EQ, COND_EQ) \
+	X(GT, COND_GT) \
+	X(LT, COND_LT) \
+	X(NE, COND_NE) \
+	X(GE, COND_GE) \
+	X(LE, COND_LE) \
+	X(NV, COND_NV)
+
+/* Registers, X(name, reg) */
+#define LOTEC_REGS(X) \
+	X(R0, REG_R0) \
+	X(R1, REG_R1) \
+	X(R2, REG_R2) \
+	X(R3, REG_R3) \
+	X(R4, REG_R4) \
+	X(FLAGS, REG_FLAGS) \
+	X(PCL, REG_PCL) \
+	X(PCH, REG_PCH)
+
+#endif
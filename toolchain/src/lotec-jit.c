@@ -0,0 +1,953 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "lotec-cpu.h"
+
+/* Mark the instruction at pc as executed, and the direction it took if it is
+ * a branch or jump.
+ */
+static inline void cover_insn(struct lotec_coverage *cov, uint16_t insn, uint16_t pc, int branch)
+{
+	COVERAGE_SET(cov->insns, pc);
+	if ((INSN_OPCODE(insn) == OP_BRANCH) || (INSN_OPCODE(insn) == OP_JUMP)) {
+		if (branch) {
+			COVERAGE_SET(cov->taken, pc);
+		} else {
+			COVERAGE_SET(cov->not_taken, pc);
+		}
+	}
+}
+
+#if defined(__x86_64__) && defined(__unix__)
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* Dynamic binary translation of LoTec basic blocks to x86-64.
+ *
+ * A block starts at any program counter and ends with B, J, a write to PCL
+ * or after MAX_BLOCK_INSNS instructions. The guest registers stay in
+ * struct lotec_cpu, rbx points to it. r12 holds the number of instruction
+ * slots left and r13 counts the NOPs fetched after taken branches, r14
+ * points to struct jit_regs while executing.
+ *
+ * Every block checks at its entry that enough slots are left to execute it
+ * completely, else it returns to lotec_run_jit() which single steps with
+ * lotec_exec(). Exits to a fixed program counter are chained to the target
+ * block when it has been translated. Exits with a computed target (J, writes
+ * to PCL) compare against the last target and chain to it, on a miss they
+ * return and the cache is replaced by the new target. When the code cache
+ * is full it is flushed, with all blocks and exits.
+ *
+ * lotec_run_coverage() gets the coverage from the transitions which
+ * lotec_run_jit() sees anyway: the instructions of a block are marked when
+ * it is entered from there, and every exit of a branch or jump returns there
+ * the first time it is taken before it is chained. The translated code is
+ * the same, so coverage costs next to nothing once the blocks are chained.
+ */
+
+#define CODE_CACHE_SIZE (16 * 1024 * 1024)
+#define MAX_BLOCK_INSNS 64
+/* Worst case size of a translated block */
+#define MAX_BLOCK_SIZE (MAX_BLOCK_INSNS * 96 + 256)
+
+#define NO_EXIT 0xFFFFFFFFu
+
+/* Direction of the branch or jump leaving a block through an exit */
+#define EDGE_NONE 0
+#define EDGE_TAKEN 1
+#define EDGE_NOT_TAKEN 2
+#define NO_TARGET 0xFFFFFFFFu
+
+/* x86-64 registers used */
+#define EAX 0
+#define ECX 1
+#define EDX 2
+
+#define OFF_R(n) (offsetof(struct lotec_cpu, r) + (n))
+#define OFF_FLAGS offsetof(struct lotec_cpu, flags)
+#define OFF_PCH offsetof(struct lotec_cpu, pch)
+#define OFF_PC offsetof(struct lotec_cpu, pc)
+#define OFF_RAM(n) (offsetof(struct lotec_cpu, ram) + (n))
+
+struct jit_regs {
+	int64_t budget;
+	uint64_t bubbles;
+};
+
+struct jit_exit {
+	uint8_t *jmp;		/* rel32 of the jump to patch */
+	uint8_t *cmp;		/* imm32 of the target compare, NULL for fixed targets */
+	uint16_t pc;		/* instruction leaving the block */
+	uint8_t edge;
+};
+
+typedef uint32_t (*jit_enter_t)(struct lotec_cpu *cpu, struct jit_regs *regs, const void *code);
+
+struct lotec_jit {
+	uint8_t *mem;
+	uint8_t *cur;
+	uint8_t *end;
+	uint8_t *code;
+	uint8_t *exit_stub;
+	jit_enter_t enter;
+
+	uint8_t *entry[ROM_WORDS];
+	uint8_t slots[ROM_WORDS];
+	uint8_t length[ROM_WORDS];	/* instructions of the block */
+	uint16_t pc;			/* instruction being translated */
+
+	struct jit_exit *exits;
+	uint32_t num_exits;
+	uint32_t max_exits;
+	uint32_t generation;		/* counts the flushes */
+
+	/* Pages made writable since the code was last executed */
+	uintptr_t page_size;
+	uint8_t *write_start;
+	uint8_t *write_end;
+};
+
+#define EMIT(j, ...) do { \
+		static const uint8_t b_[] = { __VA_ARGS__ }; \
+		memcpy((j)->cur, b_, sizeof(b_)); \
+		(j)->cur += sizeof(b_); \
+	} while (0)
+
+static void emit8(struct lotec_jit *j, uint8_t v)
+{
+	*j->cur++ = v;
+}
+
+static void emit32(struct lotec_jit *j, uint32_t v)
+{
+	memcpy(j->cur, &v, sizeof(v));
+	j->cur += sizeof(v);
+}
+
+static void patch_rel32(uint8_t *at, const uint8_t *target)
+{
+	int32_t rel;
+
+	rel = target - (at + 4);
+	memcpy(at, &rel, sizeof(rel));
+}
+
+/* op r32, byte [rbx + disp32] style instructions */
+static void emit_modrm_rbx(struct lotec_jit *j, uint8_t reg, uint32_t disp)
+{
+	emit8(j, 0x80 | (reg << 3) | 3);
+	emit32(j, disp);
+}
+
+/* movzx r32, byte [rbx + disp32] */
+static void emit_movzx_mem(struct lotec_jit *j, uint8_t reg, uint32_t disp)
+{
+	EMIT(j, 0x0F, 0xB6);
+	emit_modrm_rbx(j, reg, disp);
+}
+
+/* mov byte [rbx + disp32], r8 */
+static void emit_store_mem(struct lotec_jit *j, uint8_t reg, uint32_t disp)
+{
+	emit8(j, 0x88);
+	emit_modrm_rbx(j, reg, disp);
+}
+
+/* mov r32, imm32 */
+static void emit_mov_imm(struct lotec_jit *j, uint8_t reg, uint32_t imm)
+{
+	emit8(j, 0xB8 + reg);
+	emit32(j, imm);
+}
+
+/* Load a guest register into a host register, PCH and PCL read the address
+ * of the next instruction, which is known at translation time.
+ */
+static void emit_load_reg(struct lotec_jit *j, uint8_t host, uint8_t reg, uint16_t next)
+{
+	switch (reg) {
+		case REG_FLAGS:
+			emit_movzx_mem(j, host, OFF_FLAGS);
+			break;
+		case REG_PCL:
+			emit_mov_imm(j, host, next & 0xFF);
+			break;
+		case REG_PCH:
+			emit_mov_imm(j, host, next >> 8);
+			break;
+		default:
+			emit_movzx_mem(j, host, OFF_R(reg));
+			break;
+	}
+}
+
+static uint32_t new_exit(struct lotec_jit *j, uint8_t *jmp, uint8_t *cmp, uint8_t edge)
+{
+	struct jit_exit *exits;
+
+	if (j->num_exits >= j->max_exits) {
+		j->max_exits = j->max_exits ? (j->max_exits * 2) : 1024;
+		exits = realloc(j->exits, j->max_exits * sizeof(*exits));
+		if (exits == NULL) {
+			fprintf(stderr, "Error: Out of memory.\n");
+			exit(2);
+		}
+		j->exits = exits;
+	}
+	j->exits[j->num_exits].jmp = jmp;
+	j->exits[j->num_exits].cmp = cmp;
+	j->exits[j->num_exits].pc = j->pc;
+	j->exits[j->num_exits].edge = edge;
+	return j->num_exits++;
+}
+
+/* Account the slots used by the block, one more for a taken branch. */
+static void emit_account(struct lotec_jit *j, unsigned int slots, int taken)
+{
+	/* sub r12, imm32 */
+	EMIT(j, 0x49, 0x81, 0xEC);
+	emit32(j, slots + (taken ? 1 : 0));
+	if (taken) {
+		/* inc r13 */
+		EMIT(j, 0x49, 0xFF, 0xC5);
+	}
+}
+
+/* Leave the block to a fixed program counter. */
+static void emit_exit_direct(struct lotec_jit *j, uint16_t target, uint8_t edge)
+{
+	uint8_t *jmp;
+
+	/* mov word [rbx + pc], imm16 */
+	EMIT(j, 0x66, 0xC7, 0x83);
+	emit32(j, OFF_PC);
+	emit8(j, target & 0xFF);
+	emit8(j, target >> 8);
+	/* mov eax, exit; jmp exit_stub */
+	emit8(j, 0xB8);
+	emit32(j, j->num_exits);
+	emit8(j, 0xE9);
+	jmp = j->cur;
+	j->cur += 4;
+	patch_rel32(jmp, j->exit_stub);
+	new_exit(j, jmp, NULL, edge);
+}
+
+/* Leave the block to the program counter in ecx. */
+static void emit_exit_indirect(struct lotec_jit *j, uint8_t edge)
+{
+	uint8_t *cmp;
+	uint8_t *jne;
+	uint8_t *jmp;
+
+	/* and ecx, 0xFFFF; mov word [rbx + pc], cx */
+	EMIT(j, 0x81, 0xE1, 0xFF, 0xFF, 0x00, 0x00);
+	EMIT(j, 0x66, 0x89, 0x8B);
+	emit32(j, OFF_PC);
+	/* cmp ecx, last target; jne miss; jmp last block */
+	EMIT(j, 0x81, 0xF9);
+	cmp = j->cur;
+	emit32(j, NO_TARGET);
+	EMIT(j, 0x0F, 0x85);
+	jne = j->cur;
+	j->cur += 4;
+	emit8(j, 0xE9);
+	jmp = j->cur;
+	j->cur += 4;
+	patch_rel32(jne, j->cur);
+	patch_rel32(jmp, j->cur);
+	/* miss: mov eax, exit; jmp exit_stub */
+	emit8(j, 0xB8);
+	emit32(j, j->num_exits);
+	emit8(j, 0xE9);
+	j->cur += 4;
+	patch_rel32(j->cur - 4, j->exit_stub);
+	new_exit(j, jmp, cmp, edge);
+}
+
+/* Evaluate a condition, leaves the x86 carry flag set if it is true. */
+static void emit_cond(struct lotec_jit *j, uint8_t cond)
+{
+	/* movzx ecx, byte [rbx + flags]; mov eax, mask; bt eax, ecx */
+	emit_movzx_mem(j, ECX, OFF_FLAGS);
+	emit_mov_imm(j, EAX, lotec_cond_mask[cond]);
+	EMIT(j, 0x0F, 0xA3, 0xC8);
+}
+
+/* Write al to a guest register. Returns 1 if this is a write to PCL, which
+ * ends the block.
+ */
+static int emit_store_reg(struct lotec_jit *j, uint8_t reg, unsigned int slots)
+{
+	switch (reg) {
+		case REG_FLAGS:
+			/* and al, 0x0F */
+			EMIT(j, 0x24, FLAG_MASK);
+			emit_store_mem(j, EAX, OFF_FLAGS);
+			return 0;
+		case REG_PCH:
+			emit_store_mem(j, EAX, OFF_PCH);
+			return 0;
+		case REG_PCL:
+			/* movzx eax, al; movzx ecx, byte [rbx + pch]; shl ecx, 8; or ecx, eax */
+			EMIT(j, 0x0F, 0xB6, 0xC0);
+			emit_movzx_mem(j, ECX, OFF_PCH);
+			EMIT(j, 0xC1, 0xE1, 0x08);
+			EMIT(j, 0x09, 0xC1);
+			emit_account(j, slots, 1);
+			emit_exit_indirect(j, EDGE_NONE);
+			return 1;
+		default:
+			emit_store_mem(j, EAX, OFF_R(reg));
+			return 0;
+	}
+}
+
+/* Merge the x86 carry flag into the guest carry flag, edx holds the old
+ * guest flags.
+ */
+static void emit_update_carry(struct lotec_jit *j)
+{
+	/* setc cl; and dl, 0xFE; or dl, cl; mov [rbx + flags], dl */
+	EMIT(j, 0x0F, 0x92, 0xC1);
+	EMIT(j, 0x80, 0xE2, 0xFE);
+	EMIT(j, 0x08, 0xCA);
+	emit_store_mem(j, EDX, OFF_FLAGS);
+}
+
+/* Translate one instruction. Returns 1 if it ended the block. */
+static int translate_insn(struct lotec_jit *j, uint16_t insn, uint16_t pc, unsigned int slots)
+{
+	uint8_t opcode;
+	uint8_t rd;
+	uint8_t rs;
+	uint8_t rt;
+	uint8_t cond;
+	uint8_t imm8;
+	uint8_t imm5;
+	uint16_t next;
+	uint8_t *jc;
+
+	opcode = INSN_OPCODE(insn);
+	rd = INSN_RD(insn);
+	rs = INSN_RS(insn);
+	rt = INSN_RT(insn);
+	cond = INSN_COND(insn);
+	imm8 = INSN_IMM8(insn);
+	imm5 = INSN_IMM5(insn);
+	next = pc + 1;
+	j->pc = pc;
+
+	switch (opcode) {
+		case OP_LI:
+			if (rd <= REG_R4) {
+				/* mov byte [rbx + r], imm8 */
+				emit8(j, 0xC6);
+				emit_modrm_rbx(j, 0, OFF_R(rd));
+				emit8(j, imm8);
+				return 0;
+			}
+			emit_mov_imm(j, EAX, imm8);
+			return emit_store_reg(j, rd, slots);
+
+		case OP_ADDI:
+		case OP_ADD:
+		case OP_SUBI:
+		case OP_SUB:
+			emit_load_reg(j, EAX, rd, next);
+			if ((opcode == OP_ADDI) || (opcode == OP_SUBI)) {
+				emit_mov_imm(j, ECX, imm8);
+			} else {
+				emit_load_reg(j, ECX, rs, next);
+			}
+			/* movzx edx, byte [rbx + flags]; bt edx, 0 */
+			emit_movzx_mem(j, EDX, OFF_FLAGS);
+			EMIT(j, 0x0F, 0xBA, 0xE2, 0x00);
+			if ((opcode == OP_ADDI) || (opcode == OP_ADD)) {
+				/* adc al, cl */
+				EMIT(j, 0x10, 0xC8);
+			} else {
+				/* sbb al, cl */
+				EMIT(j, 0x18, 0xC8);
+			}
+			if ((opcode == OP_ADDI) || (opcode == OP_SUBI)) {
+				emit_update_carry(j);
+			}
+			return emit_store_reg(j, rd, slots);
+
+		case OP_ANDI:
+		case OP_AND:
+		case OP_ORI:
+		case OP_OR:
+		case OP_XORI:
+		case OP_XOR:
+			emit_load_reg(j, EAX, rd, next);
+			if (opcode < OP_MOV) {
+				emit_mov_imm(j, ECX, imm8);
+			} else {
+				emit_load_reg(j, ECX, rs, next);
+			}
+			if ((opcode == OP_ANDI) || (opcode == OP_AND)) {
+				EMIT(j, 0x20, 0xC8);
+			} else if ((opcode == OP_ORI) || (opcode == OP_OR)) {
+				EMIT(j, 0x08, 0xC8);
+			} else {
+				EMIT(j, 0x30, 0xC8);
+			}
+			return emit_store_reg(j, rd, slots);
+
+		case OP_CMPI:
+		case OP_CMP:
+			emit_load_reg(j, EAX, rd, next);
+			if (opcode == OP_CMPI) {
+				emit_mov_imm(j, ECX, imm8);
+			} else {
+				emit_load_reg(j, ECX, rs, next);
+			}
+			/* cmp al, cl; seta al; sete cl; setb dl */
+			EMIT(j, 0x38, 0xC8);
+			EMIT(j, 0x0F, 0x97, 0xC0);
+			EMIT(j, 0x0F, 0x94, 0xC1);
+			EMIT(j, 0x0F, 0x92, 0xC2);
+			/* add al, al; shl cl, 2; shl dl, 3; or al, cl; or al, dl */
+			EMIT(j, 0x00, 0xC0);
+			EMIT(j, 0xC0, 0xE1, 0x02);
+			EMIT(j, 0xC0, 0xE2, 0x03);
+			EMIT(j, 0x08, 0xC8);
+			EMIT(j, 0x08, 0xD0);
+			/* movzx ecx, byte [rbx + flags]; and cl, FLAG_C; or al, cl */
+			emit_movzx_mem(j, ECX, OFF_FLAGS);
+			EMIT(j, 0x80, 0xE1, FLAG_C);
+			EMIT(j, 0x08, 0xC8);
+			emit_store_mem(j, EAX, OFF_FLAGS);
+			return 0;
+
+		case OP_SHLI:
+		case OP_SHL:
+			emit_load_reg(j, EAX, rd, next);
+			emit_load_reg(j, ECX, rs, next);
+			emit_movzx_mem(j, EDX, OFF_FLAGS);
+			/* eax = (rd << 9) | (rs << 1) | C */
+			EMIT(j, 0xC1, 0xE0, 0x09);
+			EMIT(j, 0x01, 0xC9);
+			EMIT(j, 0x09, 0xC8);
+			EMIT(j, 0x89, 0xD1);
+			EMIT(j, 0x83, 0xE1, FLAG_C);
+			EMIT(j, 0x09, 0xC8);
+			if (opcode == OP_SHLI) {
+				/* shl eax, imm5 */
+				EMIT(j, 0xC1, 0xE0);
+				emit8(j, imm5);
+			} else {
+				/* and ecx, 0x1F; shl eax, cl */
+				emit_load_reg(j, ECX, rt, next);
+				EMIT(j, 0x83, 0xE1, 0x1F);
+				EMIT(j, 0xD3, 0xE0);
+			}
+			/* bt eax, 17 */
+			EMIT(j, 0x0F, 0xBA, 0xE0, 0x11);
+			emit_update_carry(j);
+			/* shr eax, 9 */
+			EMIT(j, 0xC1, 0xE8, 0x09);
+			return emit_store_reg(j, rd, slots);
+
+		case OP_SHRI:
+		case OP_SHR:
+			emit_load_reg(j, EAX, rd, next);
+			emit_load_reg(j, ECX, rs, next);
+			emit_movzx_mem(j, EDX, OFF_FLAGS);
+			/* eax = (C << 17) | (rs << 9) | (rd << 1) */
+			EMIT(j, 0x01, 0xC0);
+			EMIT(j, 0xC1, 0xE1, 0x09);
+			EMIT(j, 0x09, 0xC8);
+			EMIT(j, 0x89, 0xD1);
+			EMIT(j, 0x83, 0xE1, FLAG_C);
+			EMIT(j, 0xC1, 0xE1, 0x11);
+			EMIT(j, 0x09, 0xC8);
+			if (opcode == OP_SHRI) {
+				/* shr eax, imm5 */
+				EMIT(j, 0xC1, 0xE8);
+				emit8(j, imm5);
+			} else {
+				/* and ecx, 0x1F; shr eax, cl */
+				emit_load_reg(j, ECX, rt, next);
+				EMIT(j, 0x83, 0xE1, 0x1F);
+				EMIT(j, 0xD3, 0xE8);
+			}
+			/* bt eax, 0 */
+			EMIT(j, 0x0F, 0xBA, 0xE0, 0x00);
+			emit_update_carry(j);
+			/* shr eax, 1 */
+			EMIT(j, 0xD1, 0xE8);
+			return emit_store_reg(j, rd, slots);
+
+		case OP_MOV:
+			emit_load_reg(j, EAX, rs, next);
+			return emit_store_reg(j, rd, slots);
+
+		case OP_LDB:
+			emit_movzx_mem(j, EAX, OFF_RAM(imm8));
+			return emit_store_reg(j, rd, slots);
+
+		case OP_STB:
+			emit_load_reg(j, EAX, rd, next);
+			emit_store_mem(j, EAX, OFF_RAM(imm8));
+			return 0;
+
+		case OP_JUMP:
+			if (cond == COND_NV) {
+				return 0;
+			}
+			jc = NULL;
+			if (cond != COND_AL) {
+				/* jc taken */
+				emit_cond(j, cond);
+				EMIT(j, 0x0F, 0x82);
+				jc = j->cur;
+				j->cur += 4;
+				emit_account(j, slots, 0);
+				emit_exit_direct(j, next, EDGE_NOT_TAKEN);
+				patch_rel32(jc, j->cur);
+			}
+			/* ecx = (rs << 8) | rt */
+			emit_load_reg(j, ECX, rs, next);
+			emit_load_reg(j, EAX, rt, next);
+			EMIT(j, 0xC1, 0xE1, 0x08);
+			EMIT(j, 0x09, 0xC1);
+			emit_account(j, slots, 1);
+			emit_exit_indirect(j, EDGE_TAKEN);
+			return 1;
+
+		case OP_BRANCH:
+			if (cond == COND_NV) {
+				return 0;
+			}
+			if (cond != COND_AL) {
+				emit_cond(j, cond);
+				EMIT(j, 0x0F, 0x82);
+				jc = j->cur;
+				j->cur += 4;
+				emit_account(j, slots, 0);
+				emit_exit_direct(j, next, EDGE_NOT_TAKEN);
+				patch_rel32(jc, j->cur);
+			}
+			emit_account(j, slots, 1);
+			emit_exit_direct(j, next + (int8_t)imm8, EDGE_TAKEN);
+			return 1;
+
+		default:
+			/* NOP and not implemented instructions */
+			return 0;
+	}
+}
+
+static void jit_flush(struct lotec_jit *j)
+{
+	memset(j->entry, 0, sizeof(j->entry));
+	j->cur = j->code;
+	j->num_exits = 0;
+	j->generation++;
+}
+
+static void jit_protect(uint8_t *start, uint8_t *end, int prot)
+{
+	if (mprotect(start, end - start, prot) != 0) {
+		fprintf(stderr, "Error: Failed to change the protection of the JIT code cache.\n");
+		exit(2);
+	}
+}
+
+/* Make the pages from p to p + size writable. They aren't executable until
+ * jit_exec(), no page of the code cache is writable and executable at once.
+ */
+static void jit_write(struct lotec_jit *j, uint8_t *p, size_t size)
+{
+	uint8_t *start;
+	uint8_t *end;
+
+	start = (uint8_t *)((uintptr_t)p & ~(j->page_size - 1));
+	end = (uint8_t *)(((uintptr_t)p + size + j->page_size - 1) & ~(j->page_size - 1));
+	if (end > j->end) {
+		end = j->end;
+	}
+	if (j->write_start != NULL) {
+		if ((start >= j->write_start) && (end <= j->write_end)) {
+			return;
+		}
+		/* One range, the pages between are written to as well */
+		if (j->write_start < start) {
+			start = j->write_start;
+		}
+		if (j->write_end > end) {
+			end = j->write_end;
+		}
+	}
+	jit_protect(start, end, PROT_READ | PROT_WRITE);
+	j->write_start = start;
+	j->write_end = end;
+}
+
+/* Make the pages written since the last call executable again. */
+static void jit_exec(struct lotec_jit *j)
+{
+	if (j->write_start == NULL) {
+		return;
+	}
+	jit_protect(j->write_start, j->write_end, PROT_READ | PROT_EXEC);
+	j->write_start = NULL;
+	j->write_end = NULL;
+}
+
+static void emit_stubs(struct lotec_jit *j)
+{
+	j->cur = j->mem;
+
+	/* uint32_t enter(cpu, regs, code) */
+	j->enter = (jit_enter_t)(void *)j->cur;
+	/* push rbx; push r12; push r13; push r14; push r15 */
+	EMIT(j, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57);
+	/* mov rbx, rdi; mov r14, rsi; mov r12, [r14]; mov r13, [r14 + 8]; jmp rdx */
+	EMIT(j, 0x48, 0x89, 0xFB);
+	EMIT(j, 0x49, 0x89, 0xF6);
+	EMIT(j, 0x4D, 0x8B, 0x26);
+	EMIT(j, 0x4D, 0x8B, 0x6E, 0x08);
+	EMIT(j, 0xFF, 0xE2);
+
+	j->exit_stub = j->cur;
+	/* mov [r14], r12; mov [r14 + 8], r13 */
+	EMIT(j, 0x4D, 0x89, 0x26);
+	EMIT(j, 0x4D, 0x89, 0x6E, 0x08);
+	/* pop r15; pop r14; pop r13; pop r12; pop rbx; ret */
+	EMIT(j, 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3);
+
+	j->code = j->cur;
+}
+
+static struct lotec_jit *jit_alloc(void)
+{
+	struct lotec_jit *j;
+
+	j = calloc(1, sizeof(*j));
+	if (j == NULL) {
+		return NULL;
+	}
+	j->mem = mmap(NULL, CODE_CACHE_SIZE, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (j->mem == MAP_FAILED) {
+		fprintf(stderr, "Error: Failed to allocate JIT code cache.\n");
+		free(j);
+		return NULL;
+	}
+	j->end = j->mem + CODE_CACHE_SIZE;
+	j->page_size = sysconf(_SC_PAGESIZE);
+	emit_stubs(j);
+	j->write_start = j->mem;
+	j->write_end = j->end;
+	jit_exec(j);
+	jit_flush(j);
+	return j;
+}
+
+void lotec_jit_free(struct lotec_jit *j)
+{
+	if (j == NULL) {
+		return;
+	}
+	munmap(j->mem, CODE_CACHE_SIZE);
+	free(j->exits);
+	free(j);
+}
+
+/* Translate the block starting at pc. Returns NULL for a halt. */
+static uint8_t *translate_block(struct lotec_jit *j, const struct lotec_rom *rom, uint16_t pc)
+{
+	uint8_t *entry;
+	uint8_t *jl;
+	unsigned int n;
+	uint16_t addr;
+
+	if (rom->ops[pc].uop == UOP_HALT) {
+		return NULL;
+	}
+	if (j->end - j->cur < MAX_BLOCK_SIZE) {
+		jit_flush(j);
+	}
+	jit_write(j, j->cur, MAX_BLOCK_SIZE);
+	entry = j->cur;
+
+	/* cmp r12, slots; jl bail */
+	EMIT(j, 0x49, 0x81, 0xFC);
+	emit32(j, 0);
+	EMIT(j, 0x0F, 0x8C);
+	jl = j->cur;
+	j->cur += 4;
+
+	addr = pc;
+	n = 0;
+	for (;;) {
+		n++;
+		if (translate_insn(j, rom->words[addr], addr, n)) {
+			/* The block ends with a taken branch. */
+			j->slots[pc] = n + 1;
+			break;
+		}
+		addr++;
+		if ((n >= MAX_BLOCK_INSNS) || (addr == 0) || (rom->ops[addr].uop == UOP_HALT)) {
+			emit_account(j, n, 0);
+			emit_exit_direct(j, addr, EDGE_NONE);
+			j->slots[pc] = n;
+			break;
+		}
+	}
+	memcpy(entry + 3, &(uint32_t){ j->slots[pc] }, 4);
+	j->length[pc] = n;
+
+	/* bail: mov word [rbx + pc], pc; mov eax, NO_EXIT; jmp exit_stub */
+	patch_rel32(jl, j->cur);
+	EMIT(j, 0x66, 0xC7, 0x83);
+	emit32(j, OFF_PC);
+	emit8(j, pc & 0xFF);
+	emit8(j, pc >> 8);
+	emit_mov_imm(j, EAX, NO_EXIT);
+	emit8(j, 0xE9);
+	j->cur += 4;
+	patch_rel32(j->cur - 4, j->exit_stub);
+
+	j->entry[pc] = entry;
+	return entry;
+}
+
+/* Chain the exit taken last time to the block at pc. */
+static void chain_exit(struct lotec_jit *j, uint32_t exit, uint16_t pc, uint8_t *entry)
+{
+	struct jit_exit *e;
+	uint32_t target = pc;
+
+	e = &j->exits[exit];
+	if (e->cmp != NULL) {
+		jit_write(j, e->cmp, sizeof(target));
+		memcpy(e->cmp, &target, sizeof(target));
+	}
+	jit_write(j, e->jmp, 4);
+	patch_rel32(e->jmp, entry);
+}
+
+static int jit_prepare(struct lotec_rom *rom)
+{
+	if (rom->jit == NULL) {
+		rom->jit = jit_alloc();
+		if (rom->jit == NULL) {
+			return 1;
+		}
+	} else if (!rom->jit_valid) {
+		jit_flush(rom->jit);
+	}
+	rom->jit_valid = 1;
+	return 0;
+}
+
+/* Mark the instructions of the block at pc as executed. The direction of a
+ * branch or jump ending it is marked by its exit.
+ */
+static void cover_block(struct lotec_coverage *cov, const struct lotec_jit *j,
+	const struct lotec_rom *rom, uint16_t pc)
+{
+	unsigned int i;
+	uint16_t insn;
+	uint16_t addr;
+
+	for (i = 0; i < j->length[pc]; i++) {
+		addr = pc + i;
+		insn = rom->words[addr];
+		if (((INSN_OPCODE(insn) == OP_BRANCH) || (INSN_OPCODE(insn) == OP_JUMP)) &&
+			(INSN_COND(insn) != COND_NV)) {
+			COVERAGE_SET(cov->insns, addr);
+		} else {
+			cover_insn(cov, insn, addr, 0);
+		}
+	}
+}
+
+static void cover_exit(struct lotec_coverage *cov, const struct jit_exit *e)
+{
+	if (e->edge == EDGE_TAKEN) {
+		COVERAGE_SET(cov->taken, e->pc);
+	} else if (e->edge == EDGE_NOT_TAKEN) {
+		COVERAGE_SET(cov->not_taken, e->pc);
+	}
+}
+
+static int run_jit(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles, int check,
+	struct lotec_coverage *cov)
+{
+	struct lotec_jit *j;
+	struct jit_regs regs;
+	struct lotec_cpu ref;
+	uint8_t *entry;
+	uint32_t exit;
+	uint32_t generation;
+	int64_t slots;
+	int64_t used;
+	uint16_t insn;
+	uint16_t pc;
+	int branch;
+	int reason;
+
+	if (jit_prepare(rom) != 0) {
+		return lotec_run_threaded(cpu, rom, max_cycles);
+	}
+	j = rom->jit;
+
+	if (cpu->cycles >= max_cycles) {
+		return EXIT_LIMIT;
+	}
+	slots = (max_cycles - cpu->cycles + CYCLES_INSN - 1) / CYCLES_INSN;
+	regs.budget = slots;
+	regs.bubbles = 0;
+	reason = EXIT_LIMIT;
+	exit = NO_EXIT;
+
+	while (regs.budget > 0) {
+		if (rom->ops[cpu->pc].uop == UOP_HALT) {
+			if (cov != NULL) {
+				cover_insn(cov, rom->words[cpu->pc], cpu->pc, 1);
+			}
+			reason = EXIT_HALT;
+			break;
+		}
+		entry = j->entry[cpu->pc];
+		if (entry == NULL) {
+			generation = j->generation;
+			entry = translate_block(j, rom, cpu->pc);
+			if (j->generation != generation) {
+				/* The code cache was flushed, with the exit. */
+				exit = NO_EXIT;
+			}
+		}
+		if (j->slots[cpu->pc] > regs.budget) {
+			/* Not enough cycles left for the whole block. Its entry
+			 * isn't chained, so it is only entered from here.
+			 */
+			exit = NO_EXIT;
+			insn = rom->words[cpu->pc];
+			if (cov != NULL) {
+				pc = cpu->pc;
+				branch = lotec_exec(cpu, insn);
+				cover_insn(cov, insn, pc, branch);
+			} else {
+				branch = lotec_exec(cpu, insn);
+			}
+			regs.budget -= 1 + branch;
+			regs.bubbles += branch;
+			continue;
+		}
+
+		if ((exit != NO_EXIT) && !check) {
+			chain_exit(j, exit, cpu->pc, entry);
+		}
+		exit = NO_EXIT;
+		if (cov != NULL) {
+			cover_block(cov, j, rom, cpu->pc);
+		}
+
+		jit_exec(j);
+		if (!check) {
+			exit = j->enter(cpu, &regs, entry);
+			if ((exit != NO_EXIT) && (cov != NULL)) {
+				cover_exit(cov, &j->exits[exit]);
+			}
+			continue;
+		}
+
+		/* Run a single block and compare with the interpreter. */
+		ref = *cpu;
+		used = regs.budget;
+		j->enter(cpu, &regs, entry);
+		used -= regs.budget;
+		while (used > 0) {
+			used -= 1 + lotec_exec(&ref, rom->words[ref.pc]);
+		}
+		if ((used != 0) || !lotec_state_equal(&ref, cpu)) {
+			fprintf(stderr, "Error: JIT and interpreter differ after block $%04X.\n", ref.pc << 1);
+			fprintf(stderr, "JIT:         ");
+			lotec_print_state(stderr, cpu);
+			fprintf(stderr, "Interpreter: ");
+			lotec_print_state(stderr, &ref);
+			reason = EXIT_ERROR;
+			break;
+		}
+	}
+
+	slots -= regs.budget;
+	cpu->insns += slots - regs.bubbles;
+	cpu->cycles += slots * CYCLES_INSN;
+	return reason;
+}
+
+int lotec_run_jit(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles)
+{
+	return run_jit(cpu, rom, max_cycles, 0, NULL);
+}
+
+/* Like lotec_run_jit(), but run every block alone and compare the state
+ * with the interpreter after it.
+ */
+int lotec_run_jit_check(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles)
+{
+	return run_jit(cpu, rom, max_cycles, 1, NULL);
+}
+
+/* Like lotec_run_jit(), but mark the executed instructions and the
+ * directions taken by B and J in cov.
+ */
+int lotec_run_coverage(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles,
+	struct lotec_coverage *cov)
+{
+	return run_jit(cpu, rom, max_cycles, 0, cov);
+}
+
+#else
+
+/* No code generator for this host, use the interpreter. */
+int lotec_run_jit(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles)
+{
+	return lotec_run_threaded(cpu, rom, max_cycles);
+}
+
+int lotec_run_jit_check(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles)
+{
+	return lotec_run(cpu, rom, max_cycles);
+}
+
+/* Step with lotec_step(), marking every instruction. */
+int lotec_run_coverage(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles,
+	struct lotec_coverage *cov)
+{
+	uint16_t insn;
+	uint16_t pc;
+	int branch;
+
+	while (cpu->cycles < max_cycles) {
+		pc = cpu->pc;
+		insn = rom->words[pc];
+		if (rom->ops[pc].uop == UOP_HALT) {
+			cover_insn(cov, insn, pc, 1);
+			return EXIT_HALT;
+		}
+		branch = lotec_step(cpu, rom);
+		cover_insn(cov, insn, pc, branch);
+	}
+	return EXIT_LIMIT;
+}
+
+void lotec_jit_free(struct lotec_jit *j)
+{
+	(void)j;
+}
+
+#endif
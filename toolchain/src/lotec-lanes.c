@@ -0,0 +1,634 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lotec-cpu.h"
+
+/* Lockstep execution of many CPUs running the same ROM with different RAM
+ * contents. The lanes are grouped in warps of WARP lanes, whose state is kept
+ * as structure of arrays, so one vector holds a register of all lanes of a
+ * warp and the RAM is stored byte address major. A warp executes the
+ * instruction at the lowest program counter of its lanes for all lanes at
+ * this address (SIMT with min-PC reconvergence). When the lanes diverged too
+ * much, all lanes are sorted by program counter and regrouped into new warps.
+ * The vectors use the GCC vector extensions, warp_run() is built for AVX2
+ * and for the SSE2 baseline and the version is selected when loading.
+ */
+
+#if defined(__GNUC__) && (__GNUC__ >= 9)
+
+#define WARP 32
+
+/* Steps each warp runs before the efficiency is checked */
+#define ROUND_STEPS 1024
+
+/* Steps after which the byte counters of a warp are added to the 32 bit
+ * counters, at most two slots are used per step.
+ */
+#define FLUSH_STEPS 64
+
+/* Regroup when less than this percentage of the lanes executes per step */
+#define REGROUP_PERCENT 50
+
+typedef uint8_t v8 __attribute__((vector_size(WARP)));
+typedef uint16_t v16 __attribute__((vector_size(WARP * 2)));
+typedef uint32_t v32 __attribute__((vector_size(WARP * 4)));
+typedef uint64_t v64 __attribute__((vector_size(WARP)));
+
+/* The program counter is split in two byte vectors, so all per instruction
+ * work is done on bytes.
+ */
+struct warp {
+	v8 r[5];
+	v8 flags;
+	v8 pch;
+	v8 pc_lo;
+	v8 pc_hi;
+	v8 done;		/* 0xFF when the lane stopped */
+	v8 halted;		/* 0xFF when it stopped at a branch to itself */
+	v8 new_slots;		/* slots not yet added to slots */
+	v8 new_bubbles;
+	v32 slots;		/* instruction slots used */
+	v32 bubbles;		/* NOPs after taken branches */
+	v8 ram[RAM_SIZE];
+	uint32_t id[WARP];	/* index of the lane in the batch */
+	uint32_t active;	/* non-zero while lanes run */
+	uint32_t lead;		/* lane tried first */
+};
+
+/* State of one lane while regrouping */
+struct lane {
+	struct lotec_cpu cpu;
+	uint32_t slots;
+	uint32_t bubbles;
+	uint32_t id;
+	uint8_t done;
+	uint8_t halted;
+};
+
+/* Conversions between byte and 32 bit lanes go through 16 bit lanes, GCC
+ * only vectorizes these steps.
+ */
+#define BYTES32(v) __builtin_convertvector(__builtin_convertvector((v), v16), v32)
+#define BYTES8(v) __builtin_convertvector(__builtin_convertvector((v), v16), v8)
+
+/* Broadcast through 64 bit lanes, (v8){ 0 } + v is built byte by byte in
+ * the AVX2 clone and a shuffle in the default one.
+ */
+static inline __attribute__((always_inline)) v8 splat8(uint8_t v)
+{
+	uint64_t q = v * 0x0101010101010101ULL;
+
+	return (v8)(v64){ q, q, q, q };
+}
+
+static inline __attribute__((always_inline)) v8 blend8(v8 old, v8 value, v8 mask)
+{
+	return (old & ~mask) | (value & mask);
+}
+
+/* Masks are built with arithmetic only, GCC splits vector compares wider
+ * than the SSE2 registers of the default clone into single bytes.
+ */
+
+/* 0xFF in the lanes where bit is set in x */
+static inline __attribute__((always_inline)) v8 bit_mask8(v8 x, unsigned int bit)
+{
+	return -((x >> bit) & 1);
+}
+
+static inline __attribute__((always_inline)) v8 equal8(v8 a, v8 b)
+{
+	v8 x = a ^ b;
+
+	return ~bit_mask8(x | -x, 7);
+}
+
+/* Unsigned a > b, the borrow out of b - a */
+static inline __attribute__((always_inline)) v8 above8(v8 a, v8 b)
+{
+	return bit_mask8((~b & a) | ((~b | a) & (b - a)), 7);
+}
+
+/* Read a register, reading PCL and PCH gives the address after the
+ * instruction in next_lo and next_hi.
+ */
+static inline __attribute__((always_inline)) v8 read_reg(const struct warp *w, uint8_t reg, v8 next_lo,
+	v8 next_hi)
+{
+	switch (reg) {
+		case REG_FLAGS:
+			return w->flags;
+		case REG_PCL:
+			return next_lo;
+		case REG_PCH:
+			return next_hi;
+		default:
+			return w->r[reg];
+	}
+}
+
+/* Write the masked lanes of a register. Returns the lanes which jumped. */
+static inline __attribute__((always_inline)) v8 write_reg(struct warp *w, uint8_t reg, v8 value,
+	v8 mask, v8 *target_lo, v8 *target_hi)
+{
+	switch (reg) {
+		case REG_FLAGS:
+			w->flags = blend8(w->flags, value & FLAG_MASK, mask);
+			return (v8){ 0 };
+		case REG_PCL:
+			*target_lo = value;
+			*target_hi = w->pch;
+			return mask;
+		case REG_PCH:
+			w->pch = blend8(w->pch, value, mask);
+			return (v8){ 0 };
+		default:
+			w->r[reg] = blend8(w->r[reg], value, mask);
+			return (v8){ 0 };
+	}
+}
+
+/* Set the carry of the masked lanes to bit 7 of carry */
+static inline __attribute__((always_inline)) void set_carry(struct warp *w, v8 carry, v8 mask)
+{
+	w->flags = blend8(w->flags, (w->flags & ~FLAG_C) | ((carry >> 7) & FLAG_C), mask);
+}
+
+/* Lanes of the warp for which the condition is true */
+static inline __attribute__((always_inline)) v8 cond_true(const struct warp *w, uint8_t cond)
+{
+	v8 gt = bit_mask8(w->flags, 1);
+	v8 eq = bit_mask8(w->flags, 2);
+	v8 lt = bit_mask8(w->flags, 3);
+
+	switch (cond) {
+		case COND_AL:
+			return splat8(0xFF);
+		case COND_EQ:
+			return eq;
+		case COND_GT:
+			return gt;
+		case COND_LT:
+			return lt;
+		case COND_NE:
+			return ~eq;
+		case COND_GE:
+			return gt | eq;
+		case COND_LE:
+			return lt | eq;
+		default:
+			return (v8){ 0 };
+	}
+}
+
+/* Execute the instruction at pc for the masked lanes. */
+static inline __attribute__((always_inline)) void warp_exec(struct warp *w, uint16_t insn,
+	uint16_t pc, v8 mask)
+{
+	uint8_t opcode;
+	uint8_t rd;
+	uint8_t rs;
+	uint8_t rt;
+	uint8_t imm8;
+	uint16_t next;
+	v8 next_lo;
+	v8 next_hi;
+	v8 a;
+	v8 b;
+	v8 c;
+	v8 v;
+	v8 jumped = { 0 };
+	v8 target_lo = { 0 };
+	v8 target_hi = { 0 };
+	v32 t32;
+	v32 n32;
+
+	opcode = INSN_OPCODE(insn);
+	rd = INSN_RD(insn);
+	rs = INSN_RS(insn);
+	rt = INSN_RT(insn);
+	imm8 = INSN_IMM8(insn);
+	next = pc + 1;
+	next_lo = splat8(next & 0xFF);
+	next_hi = splat8(next >> 8);
+
+	switch (opcode) {
+		case OP_LI:
+			jumped = write_reg(w, rd, splat8(imm8), mask, &target_lo, &target_hi);
+			break;
+
+		case OP_ADDI:
+		case OP_ADD:
+			a = read_reg(w, rd, next_lo, next_hi);
+			b = (opcode == OP_ADDI) ? splat8(imm8) : read_reg(w, rs, next_lo, next_hi);
+			c = w->flags & FLAG_C;
+			v = a + b + c;
+			if (opcode == OP_ADDI) {
+				/* Carry out of bit 7 */
+				set_carry(w, (a & b) | ((a | b) & ~v), mask);
+			}
+			jumped = write_reg(w, rd, v, mask, &target_lo, &target_hi);
+			break;
+
+		case OP_SUBI:
+		case OP_SUB:
+			a = read_reg(w, rd, next_lo, next_hi);
+			b = (opcode == OP_SUBI) ? splat8(imm8) : read_reg(w, rs, next_lo, next_hi);
+			c = w->flags & FLAG_C;
+			v = a - b - c;
+			if (opcode == OP_SUBI) {
+				/* Borrow out of bit 7 */
+				set_carry(w, (~a & b) | ((~a | b) & v), mask);
+			}
+			jumped = write_reg(w, rd, v, mask, &target_lo, &target_hi);
+			break;
+
+		case OP_ANDI:
+		case OP_AND:
+		case OP_ORI:
+		case OP_OR:
+		case OP_XORI:
+		case OP_XOR:
+			a = read_reg(w, rd, next_lo, next_hi);
+			b = (opcode < OP_MOV) ? splat8(imm8) : read_reg(w, rs, next_lo, next_hi);
+			if ((opcode == OP_ANDI) || (opcode == OP_AND)) {
+				v = a & b;
+			} else if ((opcode == OP_ORI) || (opcode == OP_OR)) {
+				v = a | b;
+			} else {
+				v = a ^ b;
+			}
+			jumped = write_reg(w, rd, v, mask, &target_lo, &target_hi);
+			break;
+
+		case OP_CMPI:
+		case OP_CMP:
+			a = read_reg(w, rd, next_lo, next_hi);
+			b = (opcode == OP_CMPI) ? splat8(imm8) : read_reg(w, rs, next_lo, next_hi);
+			v = (w->flags & FLAG_C) | (above8(a, b) & FLAG_GT) | (equal8(a, b) & FLAG_EQ) |
+				(above8(b, a) & FLAG_LT);
+			w->flags = blend8(w->flags, v, mask);
+			break;
+
+		case OP_SHRI:
+		case OP_SHR:
+		case OP_SHLI:
+		case OP_SHL:
+			/* Shift the 18 bit value of carry, Rd and Rs in 32 bit lanes */
+			a = read_reg(w, rd, next_lo, next_hi);
+			b = read_reg(w, rs, next_lo, next_hi);
+			c = w->flags & FLAG_C;
+			if ((opcode == OP_SHRI) || (opcode == OP_SHLI)) {
+				n32 = BYTES32(splat8(INSN_IMM5(insn)));
+			} else {
+				n32 = BYTES32(read_reg(w, rt, next_lo, next_hi) & 0x1F);
+			}
+			if ((opcode == OP_SHLI) || (opcode == OP_SHL)) {
+				t32 = BYTES32(c) | (BYTES32(b) << 1) | (BYTES32(a) << 9);
+				t32 <<= n32;
+				set_carry(w, BYTES8((t32 >> 17) << 7), mask);
+				v = BYTES8((t32 >> 9) & 0xFF);
+			} else {
+				t32 = (BYTES32(a) << 1) | (BYTES32(b) << 9) | (BYTES32(c) << 17);
+				t32 >>= n32;
+				set_carry(w, BYTES8((t32 & 1) << 7), mask);
+				v = BYTES8((t32 >> 1) & 0xFF);
+			}
+			jumped = write_reg(w, rd, v, mask, &target_lo, &target_hi);
+			break;
+
+		case OP_MOV:
+			jumped = write_reg(w, rd, read_reg(w, rs, next_lo, next_hi), mask, &target_lo, &target_hi);
+			break;
+
+		case OP_LDB:
+			jumped = write_reg(w, rd, w->ram[imm8], mask, &target_lo, &target_hi);
+			break;
+
+		case OP_STB:
+			w->ram[imm8] = blend8(w->ram[imm8], read_reg(w, rd, next_lo, next_hi), mask);
+			break;
+
+		case OP_JUMP:
+			jumped = cond_true(w, INSN_COND(insn)) & mask;
+			target_lo = read_reg(w, rt, next_lo, next_hi);
+			target_hi = read_reg(w, rs, next_lo, next_hi);
+			break;
+
+		case OP_BRANCH:
+			jumped = cond_true(w, INSN_COND(insn)) & mask;
+			target_lo = splat8((next + (int8_t)imm8) & 0xFF);
+			target_hi = splat8(((uint16_t)(next + (int8_t)imm8)) >> 8);
+			break;
+
+		default:
+			/* NOP and not implemented instructions */
+			break;
+	}
+
+	w->pc_lo = blend8(w->pc_lo, blend8(next_lo, target_lo, jumped), mask);
+	w->pc_hi = blend8(w->pc_hi, blend8(next_hi, target_hi, jumped), mask);
+	w->new_slots += (mask & 1) + (jumped & 1);
+	w->new_bubbles += jumped & 1;
+}
+
+static inline __attribute__((always_inline)) uint16_t lane_pc(const struct warp *w, unsigned int i)
+{
+	return w->pc_lo[i] | (w->pc_hi[i] << 8);
+}
+
+/* Add the byte counters to the 32 bit counters, GCC handles the vectors of
+ * 32 bit lanes badly, so this isn't done in every step.
+ */
+static inline __attribute__((always_inline)) void warp_flush(struct warp *w)
+{
+	w->slots += BYTES32(w->new_slots);
+	w->bubbles += BYTES32(w->new_bubbles);
+	w->new_slots = (v8){ 0 };
+	w->new_bubbles = (v8){ 0 };
+}
+
+/* Any lane set in a mask */
+static inline __attribute__((always_inline)) int any_lane(const v8 *mask)
+{
+	uint64_t q[WARP / 8];
+	uint64_t v = 0;
+	unsigned int i;
+
+	memcpy(q, mask, sizeof(q));
+	for (i = 0; i < WARP / 8; i++) {
+		v |= q[i];
+	}
+	return v != 0;
+}
+
+/* Run up to steps steps of a warp, returns the steps run. The lead lane is a running lane, its
+ * address is tried first: when the lanes run converged, all running lanes are
+ * there and no minimum has to be searched.
+ */
+__attribute__((target_clones("avx2", "default")))
+static unsigned int warp_run(struct warp *w, const struct lotec_rom *rom, uint32_t budget,
+	unsigned int steps)
+{
+	unsigned int safe;
+	unsigned int n;
+	unsigned int i;
+	uint32_t max;
+	uint16_t pc;
+	v8 diverged;
+	v8 live;
+	v8 mask;
+
+	/* Each step uses at most two slots, so no lane runs out of them in the
+	 * first safe steps.
+	 */
+	max = 0;
+	for (i = 0; i < WARP; i++) {
+		if (!w->done[i] && (w->slots[i] > max)) {
+			max = w->slots[i];
+		}
+	}
+	safe = (max < budget) ? ((budget - max) / 2) : 0;
+
+	for (n = 0; n < steps; n++) {
+		if ((n >= safe) || ((n % FLUSH_STEPS) == 0)) {
+			warp_flush(w);
+		}
+		if (n >= safe) {
+			/* Bit 31 is set for the lanes below the budget. */
+			w->done |= BYTES8((w->slots - budget) >> 31) - 1;
+		}
+		if (w->done[w->lead]) {
+			for (i = 0; (i < WARP) && w->done[i]; i++) {
+			}
+			if (i == WARP) {
+				w->active = 0;
+				break;
+			}
+			w->lead = i;
+		}
+		live = ~w->done;
+		pc = lane_pc(w, w->lead);
+		mask = equal8(w->pc_lo, splat8(pc & 0xFF)) & equal8(w->pc_hi, splat8(pc >> 8)) & live;
+		diverged = live & ~mask;
+		if (any_lane(&diverged)) {
+			/* Run the lanes at the lowest address. */
+			for (i = 0; i < WARP; i++) {
+				if (!w->done[i] && (lane_pc(w, i) < pc)) {
+					pc = lane_pc(w, i);
+				}
+			}
+			mask = equal8(w->pc_lo, splat8(pc & 0xFF)) & equal8(w->pc_hi, splat8(pc >> 8)) & live;
+		}
+
+		if (rom->ops[pc].uop == UOP_HALT) {
+			w->halted |= mask;
+			w->done |= mask;
+			continue;
+		}
+		warp_exec(w, rom->words[pc], pc, mask);
+	}
+	warp_flush(w);
+	return n;
+}
+
+/* Instructions executed by the lanes of a warp */
+static uint64_t warp_insns(const struct warp *w)
+{
+	uint64_t insns = 0;
+	unsigned int i;
+
+	for (i = 0; i < WARP; i++) {
+		insns += w->slots[i] - w->bubbles[i];
+	}
+	return insns;
+}
+
+/* Empty warp, all lanes done and not part of the batch */
+static void warp_init(struct warp *w)
+{
+	unsigned int i;
+
+	memset(w, 0, sizeof(*w));
+	w->done = (v8){ 0 } + 0xFF;
+	for (i = 0; i < WARP; i++) {
+		w->id[i] = UINT32_MAX;
+	}
+}
+
+static void warp_put(struct warp *w, unsigned int i, const struct lane *l)
+{
+	unsigned int a;
+
+	for (a = 0; a < 5; a++) {
+		w->r[a][i] = l->cpu.r[a];
+	}
+	w->flags[i] = l->cpu.flags;
+	w->pch[i] = l->cpu.pch;
+	w->pc_lo[i] = l->cpu.pc & 0xFF;
+	w->pc_hi[i] = l->cpu.pc >> 8;
+	w->slots[i] = l->slots;
+	w->bubbles[i] = l->bubbles;
+	w->done[i] = l->done ? 0xFF : 0;
+	w->halted[i] = l->halted ? 0xFF : 0;
+	for (a = 0; a < RAM_SIZE; a++) {
+		w->ram[a][i] = l->cpu.ram[a];
+	}
+	w->id[i] = l->id;
+	if (!l->done) {
+		w->active++;
+	}
+}
+
+static void warp_get(const struct warp *w, unsigned int i, struct lane *l)
+{
+	unsigned int a;
+
+	for (a = 0; a < 5; a++) {
+		l->cpu.r[a] = w->r[a][i];
+	}
+	l->cpu.flags = w->flags[i];
+	l->cpu.pch = w->pch[i];
+	l->cpu.pc = lane_pc(w, i);
+	l->slots = w->slots[i];
+	l->bubbles = w->bubbles[i];
+	l->done = w->done[i] != 0;
+	l->halted = w->halted[i] != 0;
+	for (a = 0; a < RAM_SIZE; a++) {
+		l->cpu.ram[a] = w->ram[a][i];
+	}
+	l->id = w->id[i];
+}
+
+static int lane_cmp(const void *a, const void *b)
+{
+	const struct lane *la = a;
+	const struct lane *lb = b;
+
+	if (la->done != lb->done) {
+		return la->done - lb->done;
+	}
+	if (la->cpu.pc != lb->cpu.pc) {
+		return la->cpu.pc - lb->cpu.pc;
+	}
+	return (la->id > lb->id) - (la->id < lb->id);
+}
+
+/* Sort the lanes by program counter and put them into new warps, so lanes
+ * at the same address execute together again.
+ */
+static void regroup(struct warp *warps, unsigned int num_warps, struct lane *lanes)
+{
+	unsigned int n;
+	unsigned int i;
+
+	n = 0;
+	for (i = 0; i < num_warps * WARP; i++) {
+		warp_get(&warps[i / WARP], i % WARP, &lanes[n++]);
+	}
+	qsort(lanes, n, sizeof(*lanes), lane_cmp);
+	for (i = 0; i < num_warps; i++) {
+		warp_init(&warps[i]);
+	}
+	for (i = 0; i < n; i++) {
+		warp_put(&warps[i / WARP], i % WARP, &lanes[i]);
+	}
+}
+
+int lotec_run_lanes(const struct lotec_rom *rom, unsigned int n, const uint8_t (*ram)[RAM_SIZE],
+	uint64_t max_cycles, struct lotec_cpu *out, int *reasons, struct lotec_lanes_stats *stats)
+{
+	struct warp *warps;
+	struct lane *lanes;
+	unsigned int num_warps;
+	unsigned int active;
+	uint64_t executed;
+	uint64_t steps;
+	uint64_t budget;
+	unsigned int i;
+
+	memset(stats, 0, sizeof(*stats));
+	budget = (max_cycles + CYCLES_INSN - 1) / CYCLES_INSN;
+	if (budget > INT32_MAX) {
+		fprintf(stderr, "Error: Cycle limit too large for lockstep execution.\n");
+		return 1;
+	}
+	num_warps = (n + WARP - 1) / WARP;
+	warps = aligned_alloc(sizeof(v32), num_warps * sizeof(*warps));
+	lanes = malloc(num_warps * WARP * sizeof(*lanes));
+	if ((warps == NULL) || (lanes == NULL)) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		free(warps);
+		free(lanes);
+		return 2;
+	}
+
+	for (i = 0; i < num_warps; i++) {
+		warp_init(&warps[i]);
+	}
+	for (i = 0; i < n; i++) {
+		memset(&lanes[i], 0, sizeof(lanes[i]));
+		lotec_reset(&lanes[i].cpu);
+		memcpy(lanes[i].cpu.ram, ram[i], RAM_SIZE);
+		lanes[i].id = i;
+		warp_put(&warps[i / WARP], i % WARP, &lanes[i]);
+	}
+
+	do {
+		active = 0;
+		executed = 0;
+		steps = 0;
+		for (i = 0; i < num_warps; i++) {
+			if (warps[i].active == 0) {
+				continue;
+			}
+			executed -= warp_insns(&warps[i]);
+			steps += warp_run(&warps[i], rom, budget, ROUND_STEPS);
+			executed += warp_insns(&warps[i]);
+			active += (warps[i].active > 0);
+		}
+		stats->insns += executed;
+		stats->slots += steps * WARP;
+		if ((active > 1) && (executed * 100 < steps * WARP * REGROUP_PERCENT)) {
+			regroup(warps, num_warps, lanes);
+			stats->regroups++;
+		}
+	} while (active > 0);
+
+	for (i = 0; i < num_warps * WARP; i++) {
+		warp_get(&warps[i / WARP], i % WARP, &lanes[0]);
+		if (lanes[0].id >= n) {
+			continue;
+		}
+		out[lanes[0].id] = lanes[0].cpu;
+		out[lanes[0].id].insns = lanes[0].slots - lanes[0].bubbles;
+		out[lanes[0].id].cycles = (uint64_t)lanes[0].slots * CYCLES_INSN;
+		reasons[lanes[0].id] = lanes[0].halted ? EXIT_HALT : EXIT_LIMIT;
+	}
+	free(warps);
+	free(lanes);
+	return 0;
+}
+
+#else
+
+/* Without vector extensions every lane is run alone. */
+int lotec_run_lanes(const struct lotec_rom *rom, unsigned int n, const uint8_t (*ram)[RAM_SIZE],
+	uint64_t max_cycles, struct lotec_cpu *out, int *reasons, struct lotec_lanes_stats *stats)
+{
+	unsigned int i;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < n; i++) {
+		lotec_reset(&out[i]);
+		memcpy(out[i].ram, ram[i], RAM_SIZE);
+		reasons[i] = lotec_run(&out[i], rom, max_cycles);
+		stats->insns += out[i].insns;
+	}
+	return 0;
+}
+
+#endif
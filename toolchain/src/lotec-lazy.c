@@ -0,0 +1,331 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lotec-cpu.h"
+#include "lotec-alu.h"
+
+/* Lazy evaluation of FLAGS. Instead of updating the FLAGS byte, the ALU
+ * instructions only record their result: the carry is kept as the
+ * intermediate result of the last ADDI, SUBI or shift together with the
+ * number of the bit holding it, the greater, equal and less flags as the
+ * operands of the last CMP or CMPI. Conditions are evaluated from the
+ * compare operands directly, the FLAGS byte is only built when it is read as
+ * a register or an instruction is executed by lotec_exec().
+ */
+struct lazy_flags {
+	uint32_t cv;		/* carry is bit cs of cv */
+	uint8_t cs;
+	uint8_t cmp;		/* GT, EQ and LT from a and b, else from bits */
+	uint8_t a;
+	uint8_t b;
+	uint8_t bits;
+};
+
+static inline uint8_t lazy_carry(const struct lazy_flags *lf)
+{
+	return (lf->cv >> lf->cs) & FLAG_C;
+}
+
+static inline uint8_t lazy_get(const struct lazy_flags *lf)
+{
+	if (lf->cmp) {
+		return alu_cmp(lf->a, lf->b, lazy_carry(lf));
+	}
+	return lf->bits | lazy_carry(lf);
+}
+
+static inline void lazy_set(struct lazy_flags *lf, uint8_t flags)
+{
+	lf->cv = flags & FLAG_C;
+	lf->cs = 0;
+	lf->cmp = 0;
+	lf->bits = flags & (FLAG_MASK & ~FLAG_C);
+}
+
+static inline int lazy_cond(const struct lazy_flags *lf, uint8_t cond)
+{
+	if (!lf->cmp) {
+		return COND_TRUE(cond, lf->bits);
+	}
+	switch (cond) {
+		case COND_AL:
+			return 1;
+		case COND_EQ:
+			return lf->a == lf->b;
+		case COND_GT:
+			return lf->a > lf->b;
+		case COND_LT:
+			return lf->a < lf->b;
+		case COND_NE:
+			return lf->a != lf->b;
+		case COND_GE:
+			return lf->a >= lf->b;
+		case COND_LE:
+			return lf->a <= lf->b;
+		default:
+			return 0;
+	}
+}
+
+/* Compare the state after an instruction with the reference implementation
+ * using eager flags, which executed the same instruction.
+ */
+static int lazy_check(const struct lotec_cpu *c, uint16_t pc, const struct lazy_flags *lf,
+	const struct lotec_cpu *ref)
+{
+	struct lotec_cpu t;
+
+	t = *c;
+	t.pc = pc;
+	t.flags = lazy_get(lf);
+	if (lotec_state_equal(&t, ref)) {
+		return 0;
+	}
+	fprintf(stderr, "Error: Lazy and eager flags differ.\n");
+	fprintf(stderr, "Lazy:  ");
+	lotec_print_state(stderr, &t);
+	fprintf(stderr, "Eager: ");
+	lotec_print_state(stderr, ref);
+	return 1;
+}
+
+static inline int run_lazy(struct lotec_cpu *cpu, const struct lotec_rom *rom, uint64_t max_cycles,
+	int check)
+{
+	const struct lotec_op *ops = rom->ops;
+	const struct lotec_op *op;
+	struct lotec_cpu c;
+	struct lotec_cpu ref;
+	struct lazy_flags lf;
+	int64_t budget;
+	int64_t slots;
+	uint64_t bubbles;
+	uint32_t t;
+	uint16_t pc;
+	int reason;
+
+	if (cpu->cycles >= max_cycles) {
+		return EXIT_LIMIT;
+	}
+	slots = (max_cycles - cpu->cycles + CYCLES_INSN - 1) / CYCLES_INSN;
+	budget = slots;
+	bubbles = 0;
+	reason = EXIT_LIMIT;
+
+	c = *cpu;
+	ref = c;
+	pc = c.pc;
+	memset(&lf, 0, sizeof(lf));
+	lazy_set(&lf, c.flags);
+
+	while (budget > 0) {
+		op = &ops[pc];
+		budget--;
+
+		switch (op->uop) {
+			case UOP_NOP:
+				pc++;
+				break;
+
+			case UOP_LI:
+				c.r[op->rd] = op->imm;
+				pc++;
+				break;
+
+			case UOP_ADDI:
+				t = c.r[op->rd] + op->imm + lazy_carry(&lf);
+				c.r[op->rd] = t;
+				lf.cv = t;
+				lf.cs = 8;
+				pc++;
+				break;
+
+			case UOP_ANDI:
+				c.r[op->rd] &= op->imm;
+				pc++;
+				break;
+
+			case UOP_ORI:
+				c.r[op->rd] |= op->imm;
+				pc++;
+				break;
+
+			case UOP_XORI:
+				c.r[op->rd] ^= op->imm;
+				pc++;
+				break;
+
+			case UOP_SUBI:
+				t = c.r[op->rd] - op->imm - lazy_carry(&lf);
+				c.r[op->rd] = t;
+				lf.cv = t;
+				lf.cs = 8;
+				pc++;
+				break;
+
+			case UOP_CMPI:
+				lf.a = c.r[op->rd];
+				lf.b = op->imm;
+				lf.cmp = 1;
+				pc++;
+				break;
+
+			case UOP_SHRI:
+			case UOP_SHR:
+				t = ((uint32_t)c.r[op->rd] << 1) | ((uint32_t)c.r[op->rs] << 9) |
+					((uint32_t)lazy_carry(&lf) << 17);
+				t >>= (op->uop == UOP_SHRI) ? op->imm : (c.r[op->rt] & 0x1F);
+				c.r[op->rd] = t >> 1;
+				lf.cv = t;
+				lf.cs = 0;
+				pc++;
+				break;
+
+			case UOP_SHLI:
+			case UOP_SHL:
+				t = lazy_carry(&lf) | ((uint32_t)c.r[op->rs] << 1) | ((uint32_t)c.r[op->rd] << 9);
+				t <<= (op->uop == UOP_SHLI) ? op->imm : (c.r[op->rt] & 0x1F);
+				c.r[op->rd] = t >> 9;
+				lf.cv = t;
+				lf.cs = 17;
+				pc++;
+				break;
+
+			case UOP_MOV:
+				c.r[op->rd] = c.r[op->rs];
+				pc++;
+				break;
+
+			case UOP_ADD:
+				c.r[op->rd] += c.r[op->rs] + lazy_carry(&lf);
+				pc++;
+				break;
+
+			case UOP_AND:
+				c.r[op->rd] &= c.r[op->rs];
+				pc++;
+				break;
+
+			case UOP_OR:
+				c.r[op->rd] |= c.r[op->rs];
+				pc++;
+				break;
+
+			case UOP_XOR:
+				c.r[op->rd] ^= c.r[op->rs];
+				pc++;
+				break;
+
+			case UOP_SUB:
+				c.r[op->rd] -= c.r[op->rs] + lazy_carry(&lf);
+				pc++;
+				break;
+
+			case UOP_CMP:
+				lf.a = c.r[op->rd];
+				lf.b = c.r[op->rs];
+				lf.cmp = 1;
+				pc++;
+				break;
+
+			case UOP_LDB:
+				c.r[op->rd] = c.ram[op->imm];
+				pc++;
+				break;
+
+			case UOP_STB:
+				c.ram[op->imm] = c.r[op->rd];
+				pc++;
+				break;
+
+			case UOP_J:
+				if (lazy_cond(&lf, op->cond)) {
+					pc = (c.r[op->rs] << 8) | c.r[op->rt];
+					budget--;
+					bubbles++;
+				} else {
+					pc++;
+				}
+				break;
+
+			case UOP_B:
+				if (lazy_cond(&lf, op->cond)) {
+					pc = op->target;
+					budget--;
+					bubbles++;
+				} else {
+					pc++;
+				}
+				break;
+
+			case UOP_LIF:
+				lazy_set(&lf, op->imm);
+				pc++;
+				break;
+
+			case UOP_MOVF:
+				c.r[op->rd] = lazy_get(&lf);
+				pc++;
+				break;
+
+			case UOP_LIH:
+				c.pch = op->imm;
+				pc++;
+				break;
+
+			case UOP_LJ:
+				pc = (c.pch << 8) | op->imm;
+				budget--;
+				bubbles++;
+				break;
+
+			case UOP_HALT:
+				budget++;
+				reason = EXIT_HALT;
+				goto out;
+
+			default:
+				c.pc = pc;
+				c.flags = lazy_get(&lf);
+				if (lotec_exec(&c, rom->words[pc])) {
+					budget--;
+					bubbles++;
+				}
+				pc = c.pc;
+				lazy_set(&lf, c.flags);
+				break;
+		}
+
+		if (check) {
+			lotec_exec(&ref, rom->words[ref.pc]);
+			if (lazy_check(&c, pc, &lf, &ref) != 0) {
+				reason = EXIT_ERROR;
+				break;
+			}
+		}
+	}
+out:
+	slots -= budget;
+	c.pc = pc;
+	c.flags = lazy_get(&lf);
+	c.insns += slots - bubbles;
+	c.cycles += slots * CYCLES_INSN;
+	*cpu = c;
+	return reason;
+}
+
+/* Same as lotec_run(), but with lazy evaluation of FLAGS. */
+int lotec_run_lazy(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles)
+{
+	return run_lazy(cpu, rom, max_cycles, 0);
+}
+
+/* Like lotec_run_lazy(), but compare the state with lotec_exec() using eager
+ * flags after every instruction.
+ */
+int lotec_run_lazy_check(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles)
+{
+	return run_lazy(cpu, rom, max_cycles, 1);
+}
@@ -0,0 +1,483 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lotec-cpu.h"
+
+/* Memoization of basic blocks. A block starts at any program counter and
+ * ends with B, J, a write to PCL or after MEMO_MAX_INSNS instructions, like
+ * the blocks of the JIT. Its live-in state are the registers, the PCH latch
+ * and the RAM bytes read before the block writes them, its effect the
+ * registers and RAM bytes it writes and the program counter after it.
+ * Reading PCH or PCL as a register gives the program counter, which is
+ * constant for a block.
+ *
+ * Each time a block is entered its live-in values are looked up in a direct
+ * mapped table of MEMO_ENTRIES summaries. On a hit the live-out values are
+ * written and the block is skipped, else it is executed with lotec_exec()
+ * and the summary replaces the one in its slot. Blocks with more than
+ * MEMO_MAX_RAM RAM bytes in or out are always executed.
+ */
+
+#define MEMO_MAX_INSNS 32
+#define MEMO_MAX_RAM 8
+#define MEMO_ENTRIES (1 << 16)
+
+/* Bits of the state in the register masks */
+#define STATE_FLAGS 5
+#define STATE_PCH 6
+#define NUM_STATE 7
+
+#define BLOCK_UNKNOWN 0
+#define BLOCK_CACHED 1
+#define BLOCK_UNCACHED 2
+
+struct memo_block {
+	uint8_t kind;
+	uint8_t length;
+	uint8_t branch;		/* last instruction may branch */
+	uint8_t regs_in;
+	uint8_t regs_out;
+	uint8_t num_in;		/* live-in values, registers first */
+	uint8_t num_out;
+	uint8_t num_ram_in;
+	uint8_t num_ram_out;
+	uint8_t ram_in[MEMO_MAX_RAM];
+	uint8_t ram_out[MEMO_MAX_RAM];
+};
+
+struct memo_entry {
+	uint16_t pc;		/* start of the block */
+	uint16_t next;		/* program counter after it */
+	uint8_t branch;		/* the last instruction branched */
+	uint8_t in[NUM_STATE + MEMO_MAX_RAM];
+	uint8_t out[NUM_STATE + MEMO_MAX_RAM];
+};
+
+struct lotec_memo {
+	struct memo_block blocks[ROM_WORDS];
+	struct memo_entry *entries;
+	uint8_t used[MEMO_ENTRIES];	/* entry holds a summary */
+	struct lotec_memo_stats stats;
+};
+
+/* State index of a register read as a source, -1 for PCH and PCL */
+static int src_state(uint8_t reg)
+{
+	if (reg <= REG_R4) {
+		return reg;
+	}
+	return (reg == REG_FLAGS) ? STATE_FLAGS : -1;
+}
+
+/* Registers read and written and RAM bytes read and written by an
+ * instruction. Returns 1 if it may branch.
+ */
+static int insn_effect(uint16_t insn, uint8_t *rd_mask, uint8_t *wr_mask, int *ram_rd, int *ram_wr)
+{
+	uint8_t opcode = INSN_OPCODE(insn);
+	uint8_t rd = INSN_RD(insn);
+	uint8_t rs = INSN_RS(insn);
+	uint8_t rt = INSN_RT(insn);
+	uint8_t cond = INSN_COND(insn);
+	int srcs[3] = { -1, -1, -1 };
+	int writes_rd = 1;
+	int flags_in = 0;
+	int flags_out = 0;
+	int branch = 0;
+	int i;
+
+	*rd_mask = 0;
+	*wr_mask = 0;
+	*ram_rd = -1;
+	*ram_wr = -1;
+
+	switch (opcode) {
+		case OP_LI:
+			break;
+		case OP_ADDI:
+		case OP_SUBI:
+			srcs[0] = rd;
+			flags_in = 1;
+			flags_out = 1;
+			break;
+		case OP_ADD:
+		case OP_SUB:
+			srcs[0] = rd;
+			srcs[1] = rs;
+			flags_in = 1;
+			break;
+		case OP_ANDI:
+		case OP_ORI:
+		case OP_XORI:
+			srcs[0] = rd;
+			break;
+		case OP_AND:
+		case OP_OR:
+		case OP_XOR:
+			srcs[0] = rd;
+			srcs[1] = rs;
+			break;
+		case OP_CMPI:
+		case OP_CMP:
+			srcs[0] = rd;
+			srcs[1] = (opcode == OP_CMP) ? rs : -1;
+			flags_in = 1;
+			flags_out = 1;
+			writes_rd = 0;
+			break;
+		case OP_SHRI:
+		case OP_SHLI:
+		case OP_SHR:
+		case OP_SHL:
+			srcs[0] = rd;
+			srcs[1] = rs;
+			srcs[2] = ((opcode == OP_SHR) || (opcode == OP_SHL)) ? rt : -1;
+			flags_in = 1;
+			flags_out = 1;
+			break;
+		case OP_MOV:
+			srcs[0] = rs;
+			break;
+		case OP_LDB:
+			*ram_rd = INSN_IMM8(insn);
+			break;
+		case OP_STB:
+			srcs[0] = rd;
+			*ram_wr = INSN_IMM8(insn);
+			writes_rd = 0;
+			break;
+		case OP_JUMP:
+		case OP_BRANCH:
+			writes_rd = 0;
+			if (cond == COND_NV) {
+				break;
+			}
+			if (opcode == OP_JUMP) {
+				srcs[0] = rs;
+				srcs[1] = rt;
+			}
+			flags_in = (cond != COND_AL);
+			branch = 1;
+			break;
+		default:
+			/* NOP and not implemented instructions */
+			writes_rd = 0;
+			break;
+	}
+
+	for (i = 0; i < 3; i++) {
+		if ((srcs[i] >= 0) && (src_state(srcs[i]) >= 0)) {
+			*rd_mask |= 1 << src_state(srcs[i]);
+		}
+	}
+	if (flags_in) {
+		*rd_mask |= 1 << STATE_FLAGS;
+	}
+	if (flags_out) {
+		*wr_mask |= 1 << STATE_FLAGS;
+	}
+	if (writes_rd) {
+		if (rd == REG_PCL) {
+			/* Jumps to the PCH latch */
+			*rd_mask |= 1 << STATE_PCH;
+			branch = 1;
+		} else if (rd == REG_PCH) {
+			*wr_mask |= 1 << STATE_PCH;
+		} else {
+			*wr_mask |= 1 << src_state(rd);
+		}
+	}
+	return branch;
+}
+
+static int has_byte(const uint8_t *list, unsigned int n, uint8_t v)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		if (list[i] == v) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void analyze_block(struct memo_block *b, const struct lotec_rom *rom, uint16_t pc)
+{
+	uint8_t written = 0;
+	uint8_t rd_mask;
+	uint8_t wr_mask;
+	int ram_rd;
+	int ram_wr;
+	uint16_t addr = pc;
+	unsigned int i;
+
+	memset(b, 0, sizeof(*b));
+	b->kind = BLOCK_CACHED;
+	for (;;) {
+		b->branch = insn_effect(rom->words[addr], &rd_mask, &wr_mask, &ram_rd, &ram_wr);
+		b->length++;
+		b->regs_in |= rd_mask & ~written;
+		written |= wr_mask;
+		if ((ram_rd >= 0) && !has_byte(b->ram_out, b->num_ram_out, ram_rd) &&
+			!has_byte(b->ram_in, b->num_ram_in, ram_rd)) {
+			if (b->num_ram_in == MEMO_MAX_RAM) {
+				b->kind = BLOCK_UNCACHED;
+				return;
+			}
+			b->ram_in[b->num_ram_in++] = ram_rd;
+		}
+		if ((ram_wr >= 0) && !has_byte(b->ram_out, b->num_ram_out, ram_wr)) {
+			if (b->num_ram_out == MEMO_MAX_RAM) {
+				b->kind = BLOCK_UNCACHED;
+				return;
+			}
+			b->ram_out[b->num_ram_out++] = ram_wr;
+		}
+		addr++;
+		if (b->branch || (b->length >= MEMO_MAX_INSNS) || (addr == 0) ||
+			(rom->ops[addr].uop == UOP_HALT)) {
+			break;
+		}
+	}
+	b->regs_out = written;
+	for (i = 0; i < NUM_STATE; i++) {
+		b->num_in += (b->regs_in >> i) & 1;
+		b->num_out += (b->regs_out >> i) & 1;
+	}
+	b->num_in += b->num_ram_in;
+	b->num_out += b->num_ram_out;
+}
+
+static uint8_t *state_byte(struct lotec_cpu *cpu, unsigned int i)
+{
+	if (i == STATE_FLAGS) {
+		return &cpu->flags;
+	}
+	if (i == STATE_PCH) {
+		return &cpu->pch;
+	}
+	return &cpu->r[i];
+}
+
+/* Pack the registers in mask and the RAM bytes of list. */
+static void pack(uint8_t *v, struct lotec_cpu *cpu, uint8_t mask, const uint8_t *ram, unsigned int num_ram)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_STATE; i++) {
+		if ((mask >> i) & 1) {
+			*v++ = *state_byte(cpu, i);
+		}
+	}
+	for (i = 0; i < num_ram; i++) {
+		*v++ = cpu->ram[ram[i]];
+	}
+}
+
+static void unpack(struct lotec_cpu *cpu, const uint8_t *v, uint8_t mask, const uint8_t *ram,
+	unsigned int num_ram)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_STATE; i++) {
+		if ((mask >> i) & 1) {
+			*state_byte(cpu, i) = *v++;
+		}
+	}
+	for (i = 0; i < num_ram; i++) {
+		cpu->ram[ram[i]] = *v++;
+	}
+}
+
+static uint32_t memo_hash(uint16_t pc, const uint8_t *in, unsigned int n)
+{
+	uint32_t h = 0x811C9DC5u ^ pc;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		h = (h ^ in[i]) * 0x01000193u;
+	}
+	return (h ^ (h >> 16)) & (MEMO_ENTRIES - 1);
+}
+
+static int memo_prepare(struct lotec_rom *rom)
+{
+	struct lotec_memo *m = rom->memo;
+
+	if (m == NULL) {
+		m = calloc(1, sizeof(*m));
+		if (m != NULL) {
+			m->entries = malloc(MEMO_ENTRIES * sizeof(*m->entries));
+		}
+		if ((m == NULL) || (m->entries == NULL)) {
+			fprintf(stderr, "Error: Out of memory.\n");
+			free(m);
+			return 1;
+		}
+		rom->memo = m;
+	} else if (!rom->memo_valid) {
+		memset(m->blocks, 0, sizeof(m->blocks));
+		memset(m->used, 0, sizeof(m->used));
+		memset(&m->stats, 0, sizeof(m->stats));
+	}
+	rom->memo_valid = 1;
+	return 0;
+}
+
+/* Execute the block at the program counter with lotec_exec(). Returns the
+ * number of slots used.
+ */
+static int64_t exec_block(struct lotec_cpu *cpu, const struct lotec_rom *rom, const struct memo_block *b,
+	uint8_t *branch)
+{
+	unsigned int i;
+
+	*branch = 0;
+	for (i = 0; i < b->length; i++) {
+		*branch = lotec_exec(cpu, rom->words[cpu->pc]);
+	}
+	return b->length + *branch;
+}
+
+static int memo_check(const struct lotec_cpu *cpu, const struct lotec_cpu *ref, uint16_t pc)
+{
+	if (memcmp(cpu, ref, sizeof(*cpu)) == 0) {
+		return 0;
+	}
+	fprintf(stderr, "Error: Summary and execution differ after block $%04X.\n", pc << 1);
+	fprintf(stderr, "Summary:   ");
+	lotec_print_state(stderr, cpu);
+	fprintf(stderr, "Execution: ");
+	lotec_print_state(stderr, ref);
+	return 1;
+}
+
+static int run_memo(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles, int check)
+{
+	struct lotec_memo *m;
+	struct memo_block *b;
+	struct memo_entry *e;
+	struct lotec_cpu c;
+	struct lotec_cpu ref;
+	uint8_t in[NUM_STATE + MEMO_MAX_RAM];
+	uint8_t branch;
+	int64_t budget;
+	int64_t slots;
+	int64_t used;
+	uint64_t bubbles;
+	uint32_t slot;
+	uint16_t pc;
+	int reason;
+
+	if (memo_prepare(rom) != 0) {
+		return lotec_run(cpu, rom, max_cycles);
+	}
+	m = rom->memo;
+
+	if (cpu->cycles >= max_cycles) {
+		return EXIT_LIMIT;
+	}
+	slots = (max_cycles - cpu->cycles + CYCLES_INSN - 1) / CYCLES_INSN;
+	budget = slots;
+	bubbles = 0;
+	reason = EXIT_LIMIT;
+	c = *cpu;
+
+	while (budget > 0) {
+		pc = c.pc;
+		if (rom->ops[pc].uop == UOP_HALT) {
+			reason = EXIT_HALT;
+			break;
+		}
+		b = &m->blocks[pc];
+		if (b->kind == BLOCK_UNKNOWN) {
+			analyze_block(b, rom, pc);
+		}
+		if ((b->kind == BLOCK_UNCACHED) || (b->length + b->branch > budget)) {
+			/* Execute a single instruction */
+			m->stats.uncached++;
+			branch = lotec_exec(&c, rom->words[pc]);
+			budget -= 1 + branch;
+			bubbles += branch;
+			continue;
+		}
+
+		m->stats.lookups++;
+		pack(in, &c, b->regs_in, b->ram_in, b->num_ram_in);
+		slot = memo_hash(pc, in, b->num_in);
+		e = &m->entries[slot];
+		if (m->used[slot] && (e->pc == pc) && (memcmp(e->in, in, b->num_in) == 0)) {
+			m->stats.hits++;
+			m->stats.insns += b->length;
+			if (check) {
+				ref = c;
+				exec_block(&ref, rom, b, &branch);
+			}
+			unpack(&c, e->out, b->regs_out, b->ram_out, b->num_ram_out);
+			c.pc = e->next;
+			budget -= b->length + e->branch;
+			bubbles += e->branch;
+			if (check && (memo_check(&c, &ref, pc) != 0)) {
+				reason = EXIT_ERROR;
+				break;
+			}
+			continue;
+		}
+
+		used = exec_block(&c, rom, b, &branch);
+		budget -= used;
+		bubbles += branch;
+		if (m->used[slot]) {
+			m->stats.evictions++;
+		}
+		m->used[slot] = 1;
+		e->pc = pc;
+		e->next = c.pc;
+		e->branch = branch;
+		memcpy(e->in, in, b->num_in);
+		pack(e->out, &c, b->regs_out, b->ram_out, b->num_ram_out);
+	}
+
+	slots -= budget;
+	c.insns += slots - bubbles;
+	c.cycles += slots * CYCLES_INSN;
+	*cpu = c;
+	return reason;
+}
+
+/* Run like lotec_run(), skipping blocks which were executed before with the
+ * same live-in values.
+ */
+int lotec_run_memo(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles)
+{
+	return run_memo(cpu, rom, max_cycles, 0);
+}
+
+/* Like lotec_run_memo(), but execute the blocks found in the table as well
+ * and compare the state.
+ */
+int lotec_run_memo_check(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles)
+{
+	return run_memo(cpu, rom, max_cycles, 1);
+}
+
+void lotec_memo_stats(const struct lotec_rom *rom, struct lotec_memo_stats *stats)
+{
+	if ((rom->memo == NULL) || !rom->memo_valid) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+	*stats = rom->memo->stats;
+}
+
+void lotec_memo_free(struct lotec_memo *memo)
+{
+	if (memo != NULL) {
+		free(memo->entries);
+	}
+	free(memo);
+}
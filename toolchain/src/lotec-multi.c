@@ -0,0 +1,365 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "lotec-cpu.h"
+
+/* Simulates a board with several CPUs sharing one RAM. Time advances in
+ * quanta of the same number of cycles: every CPU runs a quantum on its own
+ * copy of the shared RAM as it was at the start of the quantum, then the
+ * bytes the CPUs changed are written back. A store is seen by the other CPUs
+ * only at the next quantum boundary, not in the cycle after it as on the
+ * board, so the CPUs of a quantum run in parallel on worker threads without
+ * rollback. This is not conservative: a CPU loading a byte which another one
+ * stored earlier in the quantum reads the old value, and the results change
+ * with the quantum. Only a quantum of 1 cycle is exact, every instruction
+ * then sees the stores of all earlier ones. Stores of the same byte within a
+ * quantum are arbitrated by a fixed or rotating priority, the result only
+ * depends on the quantum and the policy, not on the threads.
+ */
+
+#define DEFAULT_QUANTUM 1000ULL
+
+#define MAX_CPUS 256
+
+#define POLICY_FIXED 0	/* the lowest CPU number wins */
+#define POLICY_ROUND_ROBIN 1	/* the priority rotates every quantum */
+
+#define RUNNING -1
+
+struct multi {
+	const struct lotec_engine *engine;
+	unsigned int num_cpus;
+	struct lotec_cpu *cpus;
+	struct lotec_rom **roms;	/* one per CPU, the engines change them */
+	int *reasons;			/* exit reason or RUNNING */
+	uint8_t *active;		/* running in the current quantum */
+	uint8_t ram[RAM_SIZE];		/* shared RAM at the start of the quantum */
+	uint64_t quantum;
+	uint64_t max_cycles;
+	uint64_t end;			/* end of the current quantum */
+	int policy;
+	unsigned int num_workers;
+	pthread_barrier_t start;
+	pthread_barrier_t done;
+	int stop;
+	uint64_t quanta;
+	uint64_t stores;
+	uint64_t conflicts;
+};
+
+struct worker {
+	struct multi *m;
+	unsigned int id;
+	pthread_t thread;
+};
+
+/* Worker n runs the CPUs n, n + workers, ... of every quantum. */
+static void *worker_main(void *arg)
+{
+	struct worker *w = arg;
+	struct multi *m = w->m;
+	struct lotec_cpu *cpu;
+	unsigned int i;
+	int reason;
+
+	for (;;) {
+		pthread_barrier_wait(&m->start);
+		if (m->stop) {
+			break;
+		}
+		for (i = w->id; i < m->num_cpus; i += m->num_workers) {
+			if (!m->active[i]) {
+				continue;
+			}
+			cpu = &m->cpus[i];
+			memcpy(cpu->ram, m->ram, RAM_SIZE);
+			reason = m->engine->run(cpu, m->roms[i], m->end);
+			if (reason != EXIT_LIMIT) {
+				m->reasons[i] = reason;
+			}
+		}
+		pthread_barrier_wait(&m->done);
+	}
+	return NULL;
+}
+
+/* Write the bytes changed by the CPUs of the quantum to the shared RAM. Of
+ * several CPUs writing different values to a byte the one with the highest
+ * priority wins.
+ */
+static void merge_stores(struct multi *m)
+{
+	uint8_t ram[RAM_SIZE];
+	uint8_t written[RAM_SIZE];
+	const struct lotec_cpu *cpu;
+	unsigned int first;
+	unsigned int n;
+	unsigned int i;
+	unsigned int a;
+
+	first = (m->policy == POLICY_ROUND_ROBIN) ? (m->quanta % m->num_cpus) : 0;
+	memcpy(ram, m->ram, RAM_SIZE);
+	memset(written, 0, sizeof(written));
+	for (n = 0; n < m->num_cpus; n++) {
+		i = (first + n) % m->num_cpus;
+		if (!m->active[i]) {
+			continue;
+		}
+		cpu = &m->cpus[i];
+		for (a = 0; a < RAM_SIZE; a++) {
+			if (cpu->ram[a] == m->ram[a]) {
+				continue;
+			}
+			m->stores++;
+			if (!written[a]) {
+				ram[a] = cpu->ram[a];
+				written[a] = 1;
+			} else if (ram[a] != cpu->ram[a]) {
+				m->conflicts++;
+			}
+		}
+	}
+	memcpy(m->ram, ram, RAM_SIZE);
+}
+
+/* Run quanta until all CPUs stopped or the cycle limit is reached. */
+static void run_quanta(struct multi *m)
+{
+	unsigned int running;
+	unsigned int i;
+
+	for (;;) {
+		running = 0;
+		for (i = 0; i < m->num_cpus; i++) {
+			m->active[i] = (m->reasons[i] == RUNNING) && (m->cpus[i].cycles < m->max_cycles);
+			running += m->active[i];
+		}
+		if (running == 0) {
+			break;
+		}
+		m->end = (m->quanta + 1) * m->quantum;
+		if ((m->end > m->max_cycles) || (m->end / m->quantum != m->quanta + 1)) {
+			m->end = m->max_cycles;
+		}
+		pthread_barrier_wait(&m->start);
+		pthread_barrier_wait(&m->done);
+		merge_stores(m);
+		m->quanta++;
+	}
+	m->stop = 1;
+	pthread_barrier_wait(&m->start);
+}
+
+static void usage(void)
+{
+	unsigned int i;
+
+	printf("lotec-multi [-c cycles] [-e engine] [-n cpus] [-q quantum] [-a policy]\n");
+	printf("            [-j workers] [-r ram file] [-m] [-t] rom...\n");
+	printf("Simulates CPUs sharing one RAM, one CPU per ROM file\n");
+	printf(" -c cycles    Stop after cycles clock cycles (default %llu)\n", DEFAULT_MAX_CYCLES);
+	printf(" -e engine    Execution engine:");
+	for (i = 0; i < LOTEC_NUM_ENGINES; i++) {
+		printf(" %s", lotec_engines[i].name);
+	}
+	printf(" (default %s)\n", lotec_engines[0].name);
+	printf(" -n cpus      Number of CPUs, the ROM files are repeated (default: one\n");
+	printf("              per ROM file, at most %u)\n", MAX_CPUS);
+	printf(" -q quantum   Cycles run before the stores are exchanged (default %llu).\n",
+		DEFAULT_QUANTUM);
+	printf("              The results depend on it, only -q 1 is exact\n");
+	printf(" -a policy    Winner of stores to the same byte within a quantum: fixed\n");
+	printf("              (lowest CPU number) or rr (rotating every quantum, default)\n");
+	printf(" -j workers   Number of worker threads (default: online cores)\n");
+	printf(" -r file      Load initial RAM content from binary file\n");
+	printf(" -m           Print RAM content at exit\n");
+	printf(" -t           Print simulation speed\n");
+	printf("R0 of every CPU starts with its number.\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct multi m;
+	struct worker *workers = NULL;
+	struct lotec_cpu cpu;
+	const char *ramfile = NULL;
+	double start;
+	double duration;
+	uint64_t insns;
+	long cores;
+	unsigned int num_roms;
+	unsigned int i;
+	int dump_ram = 0;
+	int timing = 0;
+	int rv = 0;
+	int opt;
+
+	memset(&m, 0, sizeof(m));
+	m.engine = &lotec_engines[0];
+	m.max_cycles = DEFAULT_MAX_CYCLES;
+	m.quantum = DEFAULT_QUANTUM;
+	m.policy = POLICY_ROUND_ROBIN;
+	cores = sysconf(_SC_NPROCESSORS_ONLN);
+	m.num_workers = (cores > 0) ? cores : 1;
+
+	while ((opt = getopt(argc, argv, "c:e:n:q:a:j:r:mt")) != -1) {
+		switch (opt) {
+			case 'c':
+				m.max_cycles = strtoull(optarg, NULL, 0);
+				break;
+			case 'e':
+				m.engine = lotec_find_engine(optarg);
+				if (m.engine == NULL) {
+					fprintf(stderr, "Error: Unknown engine '%s'.\n", optarg);
+					return 1;
+				}
+				break;
+			case 'n':
+				m.num_cpus = strtoul(optarg, NULL, 0);
+				if ((m.num_cpus == 0) || (m.num_cpus > MAX_CPUS)) {
+					usage();
+					return 1;
+				}
+				break;
+			case 'q':
+				m.quantum = strtoull(optarg, NULL, 0);
+				if (m.quantum == 0) {
+					usage();
+					return 1;
+				}
+				break;
+			case 'a':
+				if (strcmp(optarg, "fixed") == 0) {
+					m.policy = POLICY_FIXED;
+				} else if (strcmp(optarg, "rr") == 0) {
+					m.policy = POLICY_ROUND_ROBIN;
+				} else {
+					fprintf(stderr, "Error: Unknown policy '%s'.\n", optarg);
+					return 1;
+				}
+				break;
+			case 'j':
+				m.num_workers = strtoul(optarg, NULL, 0);
+				if (m.num_workers == 0) {
+					usage();
+					return 1;
+				}
+				break;
+			case 'r':
+				ramfile = optarg;
+				break;
+			case 'm':
+				dump_ram = 1;
+				break;
+			case 't':
+				timing = 1;
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+	if (optind >= argc) {
+		usage();
+		return 1;
+	}
+	num_roms = argc - optind;
+	if (m.num_cpus == 0) {
+		m.num_cpus = num_roms;
+	}
+	if (m.num_cpus > MAX_CPUS) {
+		fprintf(stderr, "Error: More than %u CPUs.\n", MAX_CPUS);
+		return 1;
+	}
+	if (m.num_workers > m.num_cpus) {
+		m.num_workers = m.num_cpus;
+	}
+
+	lotec_reset(&cpu);
+	if ((ramfile != NULL) && (lotec_ram_load(&cpu, ramfile) != 0)) {
+		return 2;
+	}
+	memcpy(m.ram, cpu.ram, RAM_SIZE);
+
+	m.cpus = calloc(m.num_cpus, sizeof(*m.cpus));
+	m.roms = calloc(m.num_cpus, sizeof(*m.roms));
+	m.reasons = calloc(m.num_cpus, sizeof(*m.reasons));
+	m.active = calloc(m.num_cpus, sizeof(*m.active));
+	workers = calloc(m.num_workers, sizeof(*workers));
+	if ((m.cpus == NULL) || (m.roms == NULL) || (m.reasons == NULL) || (m.active == NULL) ||
+		(workers == NULL)) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		rv = 2;
+		goto out;
+	}
+	/* Every CPU gets its own ROM for the engine, the images are shared. */
+	for (i = 0; i < m.num_cpus; i++) {
+		m.roms[i] = lotec_rom_alloc();
+		if ((m.roms[i] == NULL) || (lotec_rom_load_cached(m.roms[i], argv[optind + i % num_roms]) != 0)) {
+			rv = 2;
+			goto out;
+		}
+		lotec_reset(&m.cpus[i]);
+		m.cpus[i].r[REG_R0] = i;
+		m.reasons[i] = RUNNING;
+	}
+
+	pthread_barrier_init(&m.start, NULL, m.num_workers + 1);
+	pthread_barrier_init(&m.done, NULL, m.num_workers + 1);
+	for (i = 0; i < m.num_workers; i++) {
+		workers[i].m = &m;
+		workers[i].id = i;
+		if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0) {
+			/* The started workers wait for the first quantum until exit. */
+			fprintf(stderr, "Error: Failed to start worker %u.\n", i);
+			rv = 2;
+			goto out;
+		}
+	}
+
+	start = lotec_get_time();
+	run_quanta(&m);
+	for (i = 0; i < m.num_workers; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+	duration = lotec_get_time() - start;
+	pthread_barrier_destroy(&m.start);
+	pthread_barrier_destroy(&m.done);
+
+	insns = 0;
+	for (i = 0; i < m.num_cpus; i++) {
+		printf("cpu=%u exit=%s\n", i,
+			lotec_exit_name((m.reasons[i] == RUNNING) ? EXIT_LIMIT : m.reasons[i]));
+		lotec_print_state(stdout, &m.cpus[i]);
+		insns += m.cpus[i].insns;
+	}
+	printf("quanta=%llu stores=%llu conflicts=%llu\n", (unsigned long long)m.quanta,
+		(unsigned long long)m.stores, (unsigned long long)m.conflicts);
+	if (dump_ram) {
+		memcpy(cpu.ram, m.ram, RAM_SIZE);
+		lotec_print_ram(stdout, &cpu);
+	}
+	if (timing) {
+		fprintf(stderr, "%u CPUs on %u workers, %.3f s, %.1f M instructions/s\n",
+			m.num_cpus, m.num_workers, duration,
+			(duration > 0) ? (insns / duration / 1e6) : 0.0);
+	}
+
+out:
+	if (m.roms != NULL) {
+		for (i = 0; i < m.num_cpus; i++) {
+			lotec_rom_free(m.roms[i]);
+		}
+	}
+	free(m.cpus);
+	free(m.roms);
+	free(m.reasons);
+	free(m.active);
+	free(workers);
+	return rv;
+}
@@ -0,0 +1,183 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lotec-cpu.h"
+#include "lotec-netcpu.h"
+
+/* Runs the netlist of dig/lotec.dig like lotec_step() runs the model. The
+ * clock divider of the circuit derives CLK1 and CLK2 from the master clock,
+ * two periods apart. At the rising edge of CLK1 the instruction register
+ * loads the word at the program counter, or a NOP while the Branch register
+ * is set, and the program counter increments or loads the branch target. At
+ * the rising edge of CLK2 the registers and the RAM take the results. So an
+ * instruction takes four periods of the master clock, which lotec_step()
+ * counts as CYCLES_INSN cycles, and a taken branch, jump or write to PCL
+ * additionally runs the NOP fetched after it.
+ *
+ * The address of the RAM is the immediate sign extended to 16 bit, the byte
+ * i of the model is at (int8_t)i in the RAM of the netlist.
+ */
+
+#define FETCH_NONE 0
+#define FETCH_NOP 1
+#define FETCH_INSN 2
+
+/* An instruction or NOP takes 4 periods, give up on a circuit which doesn't */
+#define MAX_CLOCKS_STEP 64
+
+#define CLOCK_CLK1 0x01
+#define CLOCK_CLK2 0x02
+
+static const char *const net_names[NUM_NETCPU_NETS] = {
+	"R0", "R1", "R2", "R3", "R4", "Carryflag", "Greaterflag", "Equalflag", "Lessflag",
+	"PCH", "Programcounter", "Instruction Register", "Branch", "CLK1", "CLK2",
+};
+
+static inline uint32_t get(const struct lotec_netcpu *nc, int i)
+{
+	return lotec_netlist_get(nc->nl, nc->net[i]);
+}
+
+static inline uint32_t ram_index(const struct lotec_netcpu *nc, unsigned int addr)
+{
+	return (uint32_t)(int32_t)(int8_t)addr & (nc->ram_size - 1);
+}
+
+/* Set up the netlist with the ROM and the registers and RAM of cpu. Returns 0
+ * on success.
+ */
+int lotec_netcpu_init(struct lotec_netcpu *nc, const struct lotec_rom *rom, const struct lotec_cpu *cpu)
+{
+	uint16_t *words;
+	uint32_t size;
+	unsigned int i;
+
+	memset(nc, 0, sizeof(*nc));
+	for (i = 0; i < NUM_NETCPU_NETS; i++) {
+		nc->net[i] = lotec_netlist_find(net_names[i]);
+		if (nc->net[i] < 0) {
+			fprintf(stderr, "Error: No net '%s' in the netlist.\n", net_names[i]);
+			return 3;
+		}
+	}
+	nc->nl = lotec_netlist_alloc();
+	if (nc->nl == NULL) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		return 2;
+	}
+	nc->rom = rom;
+
+	words = lotec_netlist_rom(nc->nl, &size);
+	nc->ram = lotec_netlist_ram(nc->nl, &nc->ram_size);
+	if ((words == NULL) || (nc->ram == NULL) || (nc->ram_size < RAM_SIZE)) {
+		fprintf(stderr, "Error: The netlist has no ROM or RAM.\n");
+		lotec_netcpu_free(nc);
+		return 3;
+	}
+	memcpy(words, rom->words, ((size < ROM_WORDS) ? size : ROM_WORDS) * sizeof(*words));
+	for (i = 0; i < RAM_SIZE; i++) {
+		nc->ram[ram_index(nc, i)] = cpu->ram[i];
+	}
+
+	for (i = 0; i < 5; i++) {
+		lotec_netlist_set(nc->nl, nc->net[NET_R0 + i], cpu->r[i]);
+	}
+	lotec_netlist_set(nc->nl, nc->net[NET_CARRY], (cpu->flags & FLAG_C) != 0);
+	lotec_netlist_set(nc->nl, nc->net[NET_GT], (cpu->flags & FLAG_GT) != 0);
+	lotec_netlist_set(nc->nl, nc->net[NET_EQ], (cpu->flags & FLAG_EQ) != 0);
+	lotec_netlist_set(nc->nl, nc->net[NET_LT], (cpu->flags & FLAG_LT) != 0);
+	lotec_netlist_set(nc->nl, nc->net[NET_PCH], cpu->pch);
+	lotec_netlist_set(nc->nl, nc->net[NET_PC], cpu->pc);
+	lotec_netlist_eval(nc->nl);
+	nc->cycles = cpu->cycles;
+	nc->insns = cpu->insns;
+	return 0;
+}
+
+void lotec_netcpu_free(struct lotec_netcpu *nc)
+{
+	lotec_netlist_free(nc->nl);
+	nc->nl = NULL;
+}
+
+/* One period of the master clock, returns which of CLK1 and CLK2 rose */
+static unsigned int clock(struct lotec_netcpu *nc)
+{
+	uint32_t clk1 = get(nc, NET_CLK1);
+	uint32_t clk2 = get(nc, NET_CLK2);
+	uint32_t branch = get(nc, NET_BRANCH);
+	unsigned int rose = 0;
+
+	lotec_netlist_clock(nc->nl);
+	nc->clocks++;
+	if (!clk1 && get(nc, NET_CLK1)) {
+		rose |= CLOCK_CLK1;
+		nc->fetch = branch ? FETCH_NOP : FETCH_INSN;
+	}
+	if (!clk2 && get(nc, NET_CLK2)) {
+		rose |= CLOCK_CLK2;
+	}
+	return rose;
+}
+
+/* Clock the netlist until the CLK2 edge of the next instruction and of the
+ * NOP after it if it branched. Returns EXIT_HALT without clocking if the
+ * instruction is a branch to itself, EXIT_ERROR if the clocks don't rise.
+ */
+int lotec_netcpu_step(struct lotec_netcpu *nc)
+{
+	unsigned int i;
+	int insn = 0;
+
+	if (nc->rom->ops[get(nc, NET_PC) & (ROM_WORDS - 1)].uop == UOP_HALT) {
+		return EXIT_HALT;
+	}
+	for (i = 0; i < MAX_CLOCKS_STEP; i++) {
+		if (!(clock(nc) & CLOCK_CLK2) || (nc->fetch == FETCH_NONE)) {
+			continue;
+		}
+		nc->cycles += CYCLES_INSN;
+		if (nc->fetch == FETCH_INSN) {
+			nc->insns++;
+			insn = 1;
+		}
+		if (insn && !get(nc, NET_BRANCH)) {
+			return EXIT_LIMIT;
+		}
+	}
+	fprintf(stderr, "Error: The netlist doesn't execute instructions.\n");
+	return EXIT_ERROR;
+}
+
+/* Run until a halt or max_cycles, like lotec_run() */
+int lotec_netcpu_run(struct lotec_netcpu *nc, uint64_t max_cycles)
+{
+	int reason = EXIT_LIMIT;
+
+	while ((nc->cycles < max_cycles) && (reason == EXIT_LIMIT)) {
+		reason = lotec_netcpu_step(nc);
+	}
+	return reason;
+}
+
+/* The state of the netlist as the model keeps it */
+void lotec_netcpu_state(const struct lotec_netcpu *nc, struct lotec_cpu *cpu)
+{
+	unsigned int i;
+
+	for (i = 0; i < 5; i++) {
+		cpu->r[i] = get(nc, NET_R0 + i);
+	}
+	cpu->flags = (get(nc, NET_CARRY) ? FLAG_C : 0) | (get(nc, NET_GT) ? FLAG_GT : 0) |
+		(get(nc, NET_EQ) ? FLAG_EQ : 0) | (get(nc, NET_LT) ? FLAG_LT : 0);
+	cpu->pch = get(nc, NET_PCH);
+	cpu->pc = get(nc, NET_PC);
+	cpu->cycles = nc->cycles;
+	cpu->insns = nc->insns;
+	for (i = 0; i < RAM_SIZE; i++) {
+		cpu->ram[i] = nc->ram[ram_index(nc, i)];
+	}
+}
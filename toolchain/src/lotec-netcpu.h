@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef LOTECNETCPU_H
+#define LOTECNETCPU_H
+
+#include <stdint.h>
+
+#include "lotec-cpu.h"
+#include "lotec-netlist.h"
+
+/* The LoTec netlist run instruction by instruction, see lotec-netcpu.c */
+enum {
+	NET_R0 = 0,
+	NET_R1,
+	NET_R2,
+	NET_R3,
+	NET_R4,
+	NET_CARRY,
+	NET_GT,
+	NET_EQ,
+	NET_LT,
+	NET_PCH,
+	NET_PC,
+	NET_IR,
+	NET_BRANCH,
+	NET_CLK1,
+	NET_CLK2,
+	NUM_NETCPU_NETS
+};
+
+struct lotec_netcpu {
+	struct lotec_netlist *nl;
+	const struct lotec_rom *rom;
+	int net[NUM_NETCPU_NETS];
+	uint8_t *ram;
+	uint32_t ram_size;
+	uint64_t clocks;	/* periods of the master clock */
+	uint64_t cycles;
+	uint64_t insns;
+	int fetch;		/* what the last CLK1 fetched, FETCH_NONE before the first */
+};
+
+int lotec_netcpu_init(struct lotec_netcpu *nc, const struct lotec_rom *rom, const struct lotec_cpu *cpu);
+void lotec_netcpu_free(struct lotec_netcpu *nc);
+int lotec_netcpu_step(struct lotec_netcpu *nc);
+int lotec_netcpu_run(struct lotec_netcpu *nc, uint64_t max_cycles);
+void lotec_netcpu_state(const struct lotec_netcpu *nc, struct lotec_cpu *cpu);
+
+#endif
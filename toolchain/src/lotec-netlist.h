@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef LOTECNETLIST_H
+#define LOTECNETLIST_H
+
+#include <stdint.h>
+
+/* Netlist of a circuit compiled to C by dig2c.py, the Makefile generates
+ * bin/lotec-netlist.c from dig/lotec.dig. Nets are found by the names of
+ * their tunnels or the labels of the elements driving them.
+ */
+struct lotec_netlist;
+
+struct lotec_netlist *lotec_netlist_alloc(void);
+void lotec_netlist_free(struct lotec_netlist *g);
+void lotec_netlist_reset(struct lotec_netlist *g);
+void lotec_netlist_eval(struct lotec_netlist *g);
+void lotec_netlist_clock(struct lotec_netlist *g);
+int lotec_netlist_find(const char *name);
+uint32_t lotec_netlist_get(const struct lotec_netlist *g, int net);
+void lotec_netlist_set(struct lotec_netlist *g, int net, uint32_t value);
+void *lotec_netlist_rom(struct lotec_netlist *g, uint32_t *size);
+void *lotec_netlist_ram(struct lotec_netlist *g, uint32_t *size);
+
+#endif
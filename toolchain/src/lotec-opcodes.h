@@ -2,6 +2,15 @@
 #ifndef LOTECOPCODES_H
 #define LOTECOPCODES_H
 
+/* Instruction word fields */
+#define INSN_OPCODE(insn) (((insn) >> 11) & 0x1F)
+#define INSN_RD(insn) (((insn) >> 8) & 0x07)
+#define INSN_COND(insn) (((insn) >> 8) & 0x07)
+#define INSN_RS(insn) (((insn) >> 5) & 0x07)
+#define INSN_RT(insn) (((insn) >> 2) & 0x07)
+#define INSN_IMM5(insn) (((insn) >> 0) & 0x1F)
+#define INSN_IMM8(insn) (((insn) >> 0) & 0xFF)
+
 enum lotec_opcode {
 	OP_NOP = 0,
 	OP_LI,
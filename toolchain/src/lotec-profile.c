@@ -0,0 +1,495 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "lotec-cpu.h"
+#include "lotec-disasm.h"
+#include "lotec-profile.h"
+
+/* Reports of the counts of lotec_run_profile(). Loops are found from the
+ * taken B instructions branching back, the body is everything from the
+ * target to the branch. They are ranked by the cycles spent in the body.
+ */
+
+struct loop {
+	uint16_t head;
+	uint16_t tail;		/* address of the B back to head */
+	uint64_t cycles;
+	uint64_t iterations;
+};
+
+static uint64_t pc_cycles(const struct lotec_profile *prof, uint32_t pc)
+{
+	return prof->hits[pc] * CYCLES_INSN + prof->taken[pc] * CYCLES_BRANCH;
+}
+
+static int loop_cmp(const void *a, const void *b)
+{
+	const struct loop *la = a;
+	const struct loop *lb = b;
+
+	if (la->cycles != lb->cycles) {
+		return (la->cycles < lb->cycles) ? 1 : -1;
+	}
+	return (int)la->head - (int)lb->head;
+}
+
+/* Find the executed loops, sorted by cycles. Returns NULL if out of memory. */
+static struct loop *find_loops(const struct lotec_rom *rom, const struct lotec_profile *prof,
+	unsigned int *num)
+{
+	struct loop *loops;
+	uint32_t pc;
+	uint32_t a;
+	unsigned int n = 0;
+
+	loops = malloc((rom->size + 1) * sizeof(*loops));
+	if (loops == NULL) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		return NULL;
+	}
+	for (pc = 0; pc < rom->size; pc++) {
+		if ((rom->ops[pc].uop != UOP_B) || (rom->ops[pc].target > pc) || (prof->taken[pc] == 0)) {
+			continue;
+		}
+		loops[n].head = rom->ops[pc].target;
+		loops[n].tail = pc;
+		loops[n].iterations = prof->taken[pc];
+		loops[n].cycles = 0;
+		for (a = loops[n].head; a <= pc; a++) {
+			loops[n].cycles += pc_cycles(prof, a);
+		}
+		n++;
+	}
+	qsort(loops, n, sizeof(*loops), loop_cmp);
+	*num = n;
+	return loops;
+}
+
+/* Print the annotated disassembly of the ROM: executions, share of the
+ * cycles, how often a branch was taken and the rank of the innermost loop
+ * around the instruction, followed by the loops. Basic blocks are separated
+ * by empty lines.
+ */
+int lotec_profile_report(FILE *fout, const struct lotec_rom *rom, const struct lotec_profile *prof)
+{
+	struct loop *loops;
+	uint64_t total = 0;
+	uint64_t insns = 0;
+	unsigned int num;
+	unsigned int i;
+	uint32_t pc;
+	uint32_t size;
+	char taken[16];
+	char rank[16];
+
+	loops = find_loops(rom, prof, &num);
+	if (loops == NULL) {
+		return 2;
+	}
+	for (pc = 0; pc < rom->size; pc++) {
+		total += pc_cycles(prof, pc);
+		insns += prof->hits[pc];
+	}
+
+	fprintf(fout, "cycles=%llu insns=%llu\n", (unsigned long long)total, (unsigned long long)insns);
+	fprintf(fout, "%12s %7s %7s %5s\n", "hits", "cycles", "taken", "loop");
+	for (pc = 0; pc < rom->size; pc++) {
+		/* Separate the basic blocks */
+		if ((pc > 0) && ROM_LEADER(rom, pc)) {
+			fprintf(fout, "\n");
+		}
+		taken[0] = '\0';
+		if (prof->taken[pc] > 0) {
+			snprintf(taken, sizeof(taken), "%6.2f%%", 100.0 * prof->taken[pc] / prof->hits[pc]);
+		}
+		/* Rank of the innermost loop */
+		rank[0] = '\0';
+		size = ROM_WORDS;
+		for (i = 0; i < num; i++) {
+			if ((loops[i].head <= pc) && (pc <= loops[i].tail) &&
+				((uint32_t)(loops[i].tail - loops[i].head) < size)) {
+				size = loops[i].tail - loops[i].head;
+				snprintf(rank, sizeof(rank), "#%u", i + 1);
+			}
+		}
+		fprintf(fout, "%12llu %6.2f%% %7s %5s ", (unsigned long long)prof->hits[pc],
+			(total > 0) ? (100.0 * pc_cycles(prof, pc) / total) : 0.0, taken, rank);
+		decode_insn(fout, pc << 1, rom->words[pc]);
+	}
+
+	fprintf(fout, "\n%5s %-11s %14s %7s %12s\n", "loop", "range", "cycles", "share", "iterations");
+	for (i = 0; i < num; i++) {
+		snprintf(rank, sizeof(rank), "#%u", i + 1);
+		fprintf(fout, "%5s $%04X-$%04X %14llu %6.2f%% %12llu\n", rank, loops[i].head << 1,
+			loops[i].tail << 1, (unsigned long long)loops[i].cycles,
+			(total > 0) ? (100.0 * loops[i].cycles / total) : 0.0,
+			(unsigned long long)loops[i].iterations);
+	}
+	free(loops);
+	return 0;
+}
+
+/* Mnemonic of an instruction without the comment, which would split the
+ * frame at its semicolon.
+ */
+static const char *insn_text(uint32_t pc, uint16_t insn, char *text, size_t size)
+{
+	FILE *f;
+	char *end;
+
+	memset(text, 0, size);
+	f = fmemopen(text, size - 1, "w");
+	if (f == NULL) {
+		return "?";
+	}
+	print_insn(f, pc << 1, insn);
+	fclose(f);
+	end = strchr(text, ';');
+	if (end != NULL) {
+		while ((end > text) && (end[-1] == ' ')) {
+			end--;
+		}
+		*end = '\0';
+	}
+	return text;
+}
+
+/* Print the cycles of every executed instruction in the collapsed stack
+ * format of flame graph tools. The loops around it, outermost first, are
+ * the frames between the ROM name and the instruction.
+ */
+int lotec_profile_folded(FILE *fout, const char *name, const struct lotec_rom *rom,
+	const struct lotec_profile *prof)
+{
+	struct loop *loops;
+	const struct loop **frames;
+	const struct loop *t;
+	unsigned int num;
+	unsigned int depth;
+	unsigned int i;
+	unsigned int j;
+	uint32_t pc;
+	char text[64];
+
+	loops = find_loops(rom, prof, &num);
+	if (loops == NULL) {
+		return 2;
+	}
+	frames = malloc((num + 1) * sizeof(*frames));
+	if (frames == NULL) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		free(loops);
+		return 2;
+	}
+	for (pc = 0; pc < rom->size; pc++) {
+		if (prof->hits[pc] == 0) {
+			continue;
+		}
+		/* Insert the loops around pc sorted by size, largest first */
+		depth = 0;
+		for (i = 0; i < num; i++) {
+			if ((loops[i].head > pc) || (pc > loops[i].tail)) {
+				continue;
+			}
+			for (j = depth; (j > 0) && (frames[j - 1]->tail - frames[j - 1]->head <
+				loops[i].tail - loops[i].head); j--) {
+				frames[j] = frames[j - 1];
+			}
+			frames[j] = &loops[i];
+			depth++;
+		}
+		fprintf(fout, "%s", name);
+		for (i = 0; i < depth; i++) {
+			t = frames[i];
+			fprintf(fout, ";loop $%04X-$%04X", t->head << 1, t->tail << 1);
+		}
+		fprintf(fout, ";%04X: %s %llu\n", pc << 1, insn_text(pc, rom->words[pc], text, sizeof(text)),
+			(unsigned long long)pc_cycles(prof, pc));
+	}
+	free(frames);
+	free(loops);
+	return 0;
+}
+
+/* Registers an instruction reads as operands and the one it writes */
+static void insn_regs(uint16_t insn, uint8_t *reads, int *num_reads, int *write)
+{
+	uint8_t rd = INSN_RD(insn);
+	uint8_t rs = INSN_RS(insn);
+	uint8_t rt = INSN_RT(insn);
+
+	*num_reads = 0;
+	*write = -1;
+	switch (INSN_OPCODE(insn)) {
+		case OP_LI:
+		case OP_LDB:
+			*write = rd;
+			break;
+		case OP_ADDI:
+		case OP_ANDI:
+		case OP_ORI:
+		case OP_XORI:
+		case OP_SUBI:
+			reads[(*num_reads)++] = rd;
+			*write = rd;
+			break;
+		case OP_CMPI:
+		case OP_STB:
+			reads[(*num_reads)++] = rd;
+			break;
+		case OP_SHRI:
+		case OP_SHLI:
+		case OP_ADD:
+		case OP_AND:
+		case OP_OR:
+		case OP_XOR:
+		case OP_SUB:
+			reads[(*num_reads)++] = rd;
+			reads[(*num_reads)++] = rs;
+			*write = rd;
+			break;
+		case OP_SHR:
+		case OP_SHL:
+			reads[(*num_reads)++] = rd;
+			reads[(*num_reads)++] = rs;
+			reads[(*num_reads)++] = rt;
+			*write = rd;
+			break;
+		case OP_CMP:
+			reads[(*num_reads)++] = rd;
+			reads[(*num_reads)++] = rs;
+			break;
+		case OP_MOV:
+			reads[(*num_reads)++] = rs;
+			*write = rd;
+			break;
+		default:
+			break;
+	}
+}
+
+/* Add the events of an instruction executed hits times, taken times with
+ * the PC changed.
+ */
+static void count_insn(struct lotec_counters *cnt, uint16_t insn, uint64_t hits, uint64_t taken)
+{
+	uint8_t reads[3];
+	uint8_t opcode;
+	uint8_t cond;
+	int num_reads;
+	int write;
+	int i;
+
+	opcode = INSN_OPCODE(insn);
+	cond = INSN_COND(insn);
+	cnt->insns += hits;
+	cnt->cycles += hits * CYCLES_INSN + taken * CYCLES_BRANCH;
+
+	switch (opcode) {
+		case OP_LI:
+		case OP_ADDI:
+		case OP_ANDI:
+		case OP_ORI:
+		case OP_XORI:
+		case OP_SUBI:
+		case OP_CMPI:
+			cnt->alu_imm += hits;
+			break;
+		case OP_MOV:
+		case OP_ADD:
+		case OP_AND:
+		case OP_OR:
+		case OP_XOR:
+		case OP_SUB:
+		case OP_CMP:
+			cnt->alu_reg += hits;
+			break;
+		case OP_SHRI:
+		case OP_SHLI:
+		case OP_SHR:
+		case OP_SHL:
+			cnt->shift += hits;
+			break;
+		case OP_LDB:
+			cnt->load += hits;
+			cnt->ram_reads += hits;
+			break;
+		case OP_STB:
+			cnt->store += hits;
+			cnt->ram_writes += hits;
+			break;
+		case OP_BRANCH:
+			cnt->branch_taken += taken;
+			cnt->branch_not_taken += hits - taken;
+			break;
+		case OP_JUMP:
+			cnt->jump_taken += taken;
+			cnt->jump_not_taken += hits - taken;
+			break;
+		default:
+			cnt->other += hits;
+			break;
+	}
+
+	/* FLAGS as carry input and compare or shift result */
+	switch (opcode) {
+		case OP_ADDI:
+		case OP_SUBI:
+		case OP_SHRI:
+		case OP_SHLI:
+		case OP_SHR:
+		case OP_SHL:
+		case OP_CMPI:
+		case OP_CMP:
+			cnt->flags_reads += hits;
+			cnt->flags_writes += hits;
+			break;
+		case OP_ADD:
+		case OP_SUB:
+			cnt->flags_reads += hits;
+			break;
+		case OP_BRANCH:
+		case OP_JUMP:
+			if ((cond != COND_AL) && (cond != COND_NV)) {
+				cnt->flags_reads += hits;
+			}
+			if ((opcode == OP_JUMP) && ((INSN_RS(insn) == REG_FLAGS) || (INSN_RT(insn) == REG_FLAGS))) {
+				cnt->flags_reads += taken;
+			}
+			break;
+		default:
+			break;
+	}
+
+	/* FLAGS, PCH and PCL as operand registers */
+	insn_regs(insn, reads, &num_reads, &write);
+	for (i = 0; i < num_reads; i++) {
+		if (reads[i] == REG_FLAGS) {
+			cnt->flags_reads += hits;
+		}
+	}
+	if (write == REG_FLAGS) {
+		cnt->flags_writes += hits;
+	} else if (write == REG_PCH) {
+		cnt->pch_writes += hits;
+	} else if (write == REG_PCL) {
+		cnt->pcl_writes += hits;
+	}
+}
+
+/* Compute the event counters from the counts of lotec_run_profile(). Can be
+ * called between runs to read them in the middle of a simulation.
+ */
+void lotec_counters_read(struct lotec_counters *cnt, const struct lotec_rom *rom,
+	const struct lotec_profile *prof)
+{
+	uint32_t pc;
+
+	memset(cnt, 0, sizeof(*cnt));
+	for (pc = 0; pc < ROM_WORDS; pc++) {
+		if (prof->hits[pc] > 0) {
+			count_insn(cnt, rom->words[pc], prof->hits[pc], prof->taken[pc]);
+		}
+	}
+}
+
+/* Counters grouped into metrics with one label */
+struct counter_name {
+	const char *metric;
+	const char *label;
+	const char *value;
+	size_t offset;
+};
+
+#define COUNTER(metric, label, value, field) \
+	{ metric, label, value, offsetof(struct lotec_counters, field) }
+
+static const struct counter_name counter_names[] = {
+	COUNTER("instructions", "class", "alu_imm", alu_imm),
+	COUNTER("instructions", "class", "alu_reg", alu_reg),
+	COUNTER("instructions", "class", "shift", shift),
+	COUNTER("instructions", "class", "load", load),
+	COUNTER("instructions", "class", "store", store),
+	COUNTER("instructions", "class", "branch_taken", branch_taken),
+	COUNTER("instructions", "class", "branch_not_taken", branch_not_taken),
+	COUNTER("instructions", "class", "jump_taken", jump_taken),
+	COUNTER("instructions", "class", "jump_not_taken", jump_not_taken),
+	COUNTER("instructions", "class", "other", other),
+	COUNTER("pc_writes", "reg", "pch", pch_writes),
+	COUNTER("pc_writes", "reg", "pcl", pcl_writes),
+	COUNTER("ram_accesses", "access", "read", ram_reads),
+	COUNTER("ram_accesses", "access", "write", ram_writes),
+	COUNTER("flags_accesses", "access", "read", flags_reads),
+	COUNTER("flags_accesses", "access", "write", flags_writes),
+};
+
+#define NUM_COUNTERS (sizeof(counter_names) / sizeof(counter_names[0]))
+
+static unsigned long long counter_value(const struct lotec_counters *cnt, unsigned int i)
+{
+	return *(const uint64_t *)((const char *)cnt + counter_names[i].offset);
+}
+
+/* Print a string quoted for JSON or as a Prometheus label value. Both
+ * escape '"', '\\' and newlines, JSON also the other control characters.
+ */
+static void write_quoted(FILE *fout, const char *s, int format)
+{
+	fputc('"', fout);
+	for (; *s != 0; s++) {
+		if ((*s == '"') || (*s == '\\')) {
+			fprintf(fout, "\\%c", *s);
+		} else if (*s == '\n') {
+			fputs("\\n", fout);
+		} else if ((format == COUNTERS_JSON) && ((unsigned char)*s < 0x20)) {
+			fprintf(fout, "\\u%04x", (unsigned char)*s);
+		} else {
+			fputc(*s, fout);
+		}
+	}
+	fputc('"', fout);
+}
+
+/* Print the counters as JSON or in the Prometheus text format, labeled with
+ * the ROM name.
+ */
+void lotec_counters_write(FILE *fout, const struct lotec_counters *cnt, const char *name, int format)
+{
+	unsigned int i;
+	int first;
+
+	if (format == COUNTERS_JSON) {
+		fprintf(fout, "{\n\t\"rom\": ");
+		write_quoted(fout, name, format);
+		fprintf(fout, ",\n\t\"cycles\": %llu,\n\t\"instructions_total\": %llu",
+			(unsigned long long)cnt->cycles, (unsigned long long)cnt->insns);
+		for (i = 0; i < NUM_COUNTERS; i++) {
+			first = (i == 0) || (strcmp(counter_names[i - 1].metric, counter_names[i].metric) != 0);
+			if (first) {
+				fprintf(fout, "%s,\n\t\"%s\": {", (i == 0) ? "" : "\n\t}", counter_names[i].metric);
+			}
+			fprintf(fout, "%s\n\t\t\"%s\": %llu", first ? "" : ",", counter_names[i].value,
+				counter_value(cnt, i));
+		}
+		fprintf(fout, "\n\t}\n}\n");
+		return;
+	}
+
+	fprintf(fout, "# TYPE lotec_cycles_total counter\n");
+	fprintf(fout, "lotec_cycles_total{rom=");
+	write_quoted(fout, name, format);
+	fprintf(fout, "} %llu\n", (unsigned long long)cnt->cycles);
+	for (i = 0; i < NUM_COUNTERS; i++) {
+		if ((i == 0) || (strcmp(counter_names[i - 1].metric, counter_names[i].metric) != 0)) {
+			fprintf(fout, "# TYPE lotec_%s_total counter\n", counter_names[i].metric);
+		}
+		fprintf(fout, "lotec_%s_total{rom=", counter_names[i].metric);
+		write_quoted(fout, name, format);
+		fprintf(fout, ",%s=\"%s\"} %llu\n", counter_names[i].label, counter_names[i].value,
+			counter_value(cnt, i));
+	}
+}
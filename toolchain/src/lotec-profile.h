@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef LOTECPROFILE_H
+#define LOTECPROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "lotec-cpu.h"
+
+/* Event counters derived from the counts of lotec_run_profile() */
+struct lotec_counters {
+	uint64_t cycles;
+	uint64_t insns;
+	uint64_t alu_imm;		/* LI, ADDI, ANDI, ORI, XORI, SUBI, CMPI */
+	uint64_t alu_reg;		/* MOV, ADD, AND, OR, XOR, SUB, CMP */
+	uint64_t shift;
+	uint64_t load;
+	uint64_t store;
+	uint64_t branch_taken;
+	uint64_t branch_not_taken;
+	uint64_t jump_taken;
+	uint64_t jump_not_taken;
+	uint64_t other;			/* NOP and not implemented */
+	uint64_t pch_writes;
+	uint64_t pcl_writes;
+	uint64_t ram_reads;
+	uint64_t ram_writes;
+	uint64_t flags_reads;		/* carry, conditions and FLAGS operands */
+	uint64_t flags_writes;
+};
+
+enum lotec_counters_format {
+	COUNTERS_JSON = 0,
+	COUNTERS_PROMETHEUS,
+};
+
+int lotec_profile_report(FILE *fout, const struct lotec_rom *rom, const struct lotec_profile *prof);
+int lotec_profile_folded(FILE *fout, const char *name, const struct lotec_rom *rom,
+	const struct lotec_profile *prof);
+void lotec_counters_read(struct lotec_counters *cnt, const struct lotec_rom *rom,
+	const struct lotec_profile *prof);
+void lotec_counters_write(FILE *fout, const struct lotec_counters *cnt, const char *name, int format);
+
+#endif
@@ -0,0 +1,939 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "lotec-cpu.h"
+#include "lotec-profile.h"
+#include "lotec-tracefile.h"
+#include "lotec-timing.h"
+#include "lotec-coverage.h"
+
+/* Defaults of the debugger snapshots, see lotec-snap.c */
+#define DEFAULT_SNAP_INTERVAL 1000000ULL
+#define DEFAULT_SNAP_MEMORY 64
+
+/* Counts of -p and -F */
+static struct lotec_profile *profile;
+
+static int run_profiled(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles)
+{
+	return lotec_run_profile(cpu, rom, max_cycles, profile);
+}
+
+/* Bitmaps of -v */
+static struct lotec_coverage *coverage;
+
+static int run_covered(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles)
+{
+	return lotec_run_coverage(cpu, rom, max_cycles, coverage);
+}
+
+/* Run the ROM from reset with every engine until max_cycles have been
+ * simulated and compare the speed to the switch engine.
+ */
+static int bench(struct lotec_rom *rom, const struct lotec_cpu *init, uint64_t max_cycles)
+{
+	const struct lotec_engine *base;
+	struct lotec_cpu first;
+	struct lotec_cpu cpu;
+	uint64_t cycles;
+	uint64_t insns;
+	double speed[LOTEC_NUM_ENGINES];
+	double duration[LOTEC_NUM_ENGINES];
+	double start;
+	unsigned int runs;
+	unsigned int i;
+	int rv = 0;
+
+	base = lotec_find_engine("switch");
+	for (i = 0; i < LOTEC_NUM_ENGINES; i++) {
+		if (lotec_engines[i].check) {
+			continue;
+		}
+		cycles = 0;
+		insns = 0;
+		runs = 0;
+		start = lotec_get_time();
+		do {
+			cpu = *init;
+			lotec_engines[i].run(&cpu, rom, max_cycles - cycles);
+			if (runs == 0) {
+				if (i == 0) {
+					first = cpu;
+				} else if (!lotec_state_equal(&first, &cpu)) {
+					fprintf(stderr, "Error: Engine %s differs from %s.\n",
+						lotec_engines[i].name, lotec_engines[0].name);
+					rv = 1;
+				}
+			}
+			runs++;
+			cycles += cpu.cycles - init->cycles;
+			insns += cpu.insns - init->insns;
+			/* Again from the start until the cycles are used up, also
+			 * after a halt, as long as the runs make progress
+			 */
+		} while ((cpu.cycles > init->cycles) && (cycles < max_cycles));
+		duration[i] = lotec_get_time() - start;
+		speed[i] = (duration[i] > 0) ? (insns / duration[i] / 1e6) : 0.0;
+	}
+	for (i = 0; i < LOTEC_NUM_ENGINES; i++) {
+		if (lotec_engines[i].check) {
+			continue;
+		}
+		printf("%-10s %.3f s, %.1f M instructions/s, %.2fx\n",
+			lotec_engines[i].name, duration[i], speed[i],
+			(speed[base - lotec_engines] > 0) ? (speed[i] / speed[base - lotec_engines]) : 0.0);
+	}
+	return rv;
+}
+
+/* RAM images of the lanes: consecutive images from the RAM file, repeated if
+ * there are less than lanes, or pseudo random bytes from seed.
+ */
+static uint8_t (*lane_images(unsigned int lanes, const char *ramfile, uint32_t seed))[RAM_SIZE]
+{
+	uint8_t (*ram)[RAM_SIZE];
+	uint32_t x;
+	FILE *fin;
+	size_t n;
+	unsigned int i;
+	unsigned int a;
+
+	ram = calloc(lanes, RAM_SIZE);
+	if (ram == NULL) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		return NULL;
+	}
+	if (ramfile == NULL) {
+		for (i = 0; i < lanes; i++) {
+			x = (seed ^ (i * 0x9E3779B9)) | 1;
+			for (a = 0; a < RAM_SIZE; a++) {
+				/* xorshift32 */
+				x ^= x << 13;
+				x ^= x >> 17;
+				x ^= x << 5;
+				ram[i][a] = x;
+			}
+		}
+		return ram;
+	}
+
+	fin = fopen(ramfile, "rb");
+	if (fin == NULL) {
+		fprintf(stderr, "Error: Failed to open '%s'.\n", ramfile);
+		free(ram);
+		return NULL;
+	}
+	n = fread(ram, RAM_SIZE, lanes, fin);
+	fclose(fin);
+	if (n == 0) {
+		fprintf(stderr, "Error: '%s' contains no complete RAM image.\n", ramfile);
+		free(ram);
+		return NULL;
+	}
+	for (i = n; i < lanes; i++) {
+		memcpy(ram[i], ram[i % n], RAM_SIZE);
+	}
+	return ram;
+}
+
+static void print_memo_stats(const struct lotec_rom *rom)
+{
+	struct lotec_memo_stats st;
+
+	lotec_memo_stats(rom, &st);
+	fprintf(stderr, "%llu blocks looked up, %llu hits (%.1f %%), %llu instructions skipped\n",
+		(unsigned long long)st.lookups, (unsigned long long)st.hits,
+		(st.lookups > 0) ? (100.0 * st.hits / st.lookups) : 0.0, (unsigned long long)st.insns);
+	fprintf(stderr, "%llu summaries evicted, %llu instructions executed alone\n",
+		(unsigned long long)st.evictions, (unsigned long long)st.uncached);
+}
+
+/* Run the ROM for many RAM images in lockstep. With benchmark set, run every
+ * lane alone with the engine as well and compare speed and results.
+ */
+static int run_lanes(struct lotec_rom *rom, unsigned int lanes, const uint8_t (*ram)[RAM_SIZE],
+	uint64_t max_cycles, const struct lotec_engine *engine, int dump_ram, int timing, int benchmark)
+{
+	struct lotec_lanes_stats stats;
+	struct lotec_cpu *out;
+	struct lotec_cpu cpu;
+	int *reasons;
+	double start;
+	double duration;
+	double single;
+	unsigned int i;
+	int rv;
+
+	out = malloc(lanes * sizeof(*out));
+	reasons = malloc(lanes * sizeof(*reasons));
+	if ((out == NULL) || (reasons == NULL)) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		free(out);
+		free(reasons);
+		return 2;
+	}
+
+	start = lotec_get_time();
+	rv = lotec_run_lanes(rom, lanes, ram, max_cycles, out, reasons, &stats);
+	duration = lotec_get_time() - start;
+	if (rv != 0) {
+		free(out);
+		free(reasons);
+		return rv;
+	}
+
+	if (benchmark) {
+		start = lotec_get_time();
+		for (i = 0; i < lanes; i++) {
+			lotec_reset(&cpu);
+			memcpy(cpu.ram, ram[i], RAM_SIZE);
+			if ((engine->run(&cpu, rom, max_cycles) != reasons[i]) ||
+				!lotec_state_equal(&cpu, &out[i])) {
+				fprintf(stderr, "Error: Lane %u differs from engine %s.\n", i, engine->name);
+				fprintf(stderr, "Lanes: ");
+				lotec_print_state(stderr, &out[i]);
+				fprintf(stderr, "%-7s", engine->name);
+				lotec_print_state(stderr, &cpu);
+				rv = 1;
+				break;
+			}
+		}
+		single = lotec_get_time() - start;
+		printf("lanes      %.3f s, %.1f M instructions/s, %.2fx\n", duration,
+			(duration > 0) ? (stats.insns / duration / 1e6) : 0.0,
+			(duration > 0) ? (single / duration) : 0.0);
+		printf("%-10s %.3f s, %.1f M instructions/s\n", engine->name, single,
+			(single > 0) ? (stats.insns / single / 1e6) : 0.0);
+	} else {
+		for (i = 0; i < lanes; i++) {
+			printf("lane=%u exit=%s\n", i, lotec_exit_name(reasons[i]));
+			lotec_print_state(stdout, &out[i]);
+			if (dump_ram) {
+				lotec_print_ram(stdout, &out[i]);
+			}
+		}
+	}
+	if (timing) {
+		fprintf(stderr, "%.3f s, %u instances, %.1f M instance instructions/s\n", duration, lanes,
+			(duration > 0) ? (stats.insns / duration / 1e6) : 0.0);
+		fprintf(stderr, "%.1f %% of the lanes active per step, %u regroups\n",
+			(stats.slots > 0) ? (100.0 * stats.insns / stats.slots) : 0.0, stats.regroups);
+	}
+	free(out);
+	free(reasons);
+	return rv;
+}
+
+/* Why the debugger stopped */
+enum debug_stop {
+	STOP_STEP = 0,
+	STOP_BREAK,
+	STOP_HALT,
+	STOP_LIMIT,
+	STOP_START,
+	STOP_ERROR,
+};
+
+static const char *const stop_names[] = {
+	[STOP_STEP] = "step",
+	[STOP_BREAK] = "break",
+	[STOP_HALT] = "halt",
+	[STOP_LIMIT] = "limit",
+	[STOP_START] = "start",
+	[STOP_ERROR] = "error",
+};
+
+struct debug {
+	struct lotec_rom *rom;
+	struct lotec_system *sys;
+	struct lotec_history hist;
+	struct lotec_cpu cpu;
+	uint64_t max_cycles;
+	uint8_t breaks[ROM_WORDS / 8];
+};
+
+static int is_break(const struct debug *d, uint16_t pc)
+{
+	return (d->breaks[pc / 8] >> (pc % 8)) & 1;
+}
+
+static int any_break(const struct debug *d)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(d->breaks); i++) {
+		if (d->breaks[i] != 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Run forward until stop_insns instructions, a breakpoint, a halt or the
+ * cycle limit, taking snapshots on the way. A breakpoint stops before its
+ * instruction is executed, the one at the current PC is passed. Without
+ * breakpoints and step count the engine runs up to the next snapshot.
+ */
+static int forward(struct debug *d, uint64_t stop_insns, int breaks)
+{
+	uint64_t end;
+	int first = 1;
+	int reason;
+
+	breaks = breaks && any_break(d);
+	for (;;) {
+		if (lotec_history_update(&d->hist, &d->cpu, d->sys->next_event) != 0) {
+			return STOP_ERROR;
+		}
+		if (d->cpu.insns >= stop_insns) {
+			return STOP_STEP;
+		}
+		if (d->cpu.cycles >= d->max_cycles) {
+			return STOP_LIMIT;
+		}
+		if (breaks && !first && is_break(d, d->cpu.pc)) {
+			return STOP_BREAK;
+		}
+		first = 0;
+
+		if (!breaks && (stop_insns == UINT64_MAX)) {
+			end = lotec_history_next(&d->hist);
+			if (end > d->max_cycles) {
+				end = d->max_cycles;
+			}
+			reason = lotec_run_system(&d->cpu, d->rom, end, d->sys);
+		} else {
+			reason = lotec_step_system(&d->cpu, d->rom, d->sys);
+		}
+		if (reason == EXIT_HALT) {
+			return STOP_HALT;
+		}
+		if (reason == EXIT_ERROR) {
+			return STOP_ERROR;
+		}
+	}
+}
+
+static void restore(struct debug *d, unsigned int index)
+{
+	d->sys->next_event = lotec_history_restore(&d->hist, &d->cpu, index);
+}
+
+/* Go back n instructions: restore the latest snapshot before and replay. */
+static int reverse_step(struct debug *d, uint64_t n)
+{
+	uint64_t target;
+
+	target = (d->cpu.insns > n) ? d->cpu.insns - n : 0;
+	restore(d, lotec_history_find(&d->hist, target));
+	return forward(d, target, 0);
+}
+
+/* Go back to the last time a breakpoint was reached. The intervals between
+ * the snapshots are replayed from the newest to the oldest, looking for the
+ * last breakpoint in each.
+ */
+static int reverse_continue(struct debug *d)
+{
+	uint64_t now;
+	uint64_t last;
+	unsigned int i;
+
+	now = d->cpu.insns;
+	if (now == 0) {
+		return STOP_START;
+	}
+	for (i = lotec_history_find(&d->hist, now - 1); ; i--) {
+		restore(d, i);
+		last = UINT64_MAX;
+		while (d->cpu.insns < now) {
+			if (is_break(d, d->cpu.pc)) {
+				last = d->cpu.insns;
+			}
+			if (lotec_step_system(&d->cpu, d->rom, d->sys) != EXIT_LIMIT) {
+				break;
+			}
+		}
+		if (last != UINT64_MAX) {
+			restore(d, i);
+			return (forward(d, last, 0) == STOP_STEP) ? STOP_BREAK : STOP_ERROR;
+		}
+		if (i == 0) {
+			restore(d, 0);
+			return STOP_START;
+		}
+		now = d->hist.snaps[i].insns;
+	}
+}
+
+static void debug_help(void)
+{
+	printf("s [n]   Step n instructions (default 1)\n");
+	printf("c       Continue to a breakpoint, a halt or the cycle limit\n");
+	printf("rs [n]  Reverse step n instructions (default 1)\n");
+	printf("rc      Reverse continue to the previous breakpoint or the start\n");
+	printf("b addr  Set a breakpoint at addr\n");
+	printf("d       Delete all breakpoints\n");
+	printf("p       Print registers\n");
+	printf("m       Print RAM\n");
+	printf("i       Print snapshot usage\n");
+	printf("q       Quit\n");
+}
+
+/* Read debugger commands from stdin until q or the end of the input. */
+static int run_debug(struct lotec_rom *rom, struct lotec_system *sys, const struct lotec_cpu *init,
+	uint64_t max_cycles, uint64_t interval, size_t max_bytes)
+{
+	struct debug *d;
+	char line[256];
+	char cmd[16];
+	unsigned long long arg;
+	int stop;
+	int n;
+
+	d = calloc(1, sizeof(*d));
+	if (d == NULL) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		return 2;
+	}
+	d->rom = rom;
+	d->sys = sys;
+	d->cpu = *init;
+	d->max_cycles = max_cycles;
+	if (lotec_history_init(&d->hist, &d->cpu, sys->next_event, interval, max_bytes) != 0) {
+		free(d);
+		return 2;
+	}
+
+	lotec_print_state(stdout, &d->cpu);
+	for (;;) {
+		if (isatty(STDIN_FILENO)) {
+			printf("> ");
+		}
+		fflush(stdout);
+		if (fgets(line, sizeof(line), stdin) == NULL) {
+			break;
+		}
+		arg = 1;
+		n = sscanf(line, "%15s %lli", cmd, &arg);
+		if (n < 1) {
+			continue;
+		}
+
+		stop = -1;
+		if (strcmp(cmd, "s") == 0) {
+			stop = forward(d, d->cpu.insns + arg, 1);
+		} else if (strcmp(cmd, "c") == 0) {
+			stop = forward(d, UINT64_MAX, 1);
+		} else if (strcmp(cmd, "rs") == 0) {
+			stop = reverse_step(d, arg);
+		} else if (strcmp(cmd, "rc") == 0) {
+			stop = reverse_continue(d);
+		} else if ((strcmp(cmd, "b") == 0) && (n == 2)) {
+			d->breaks[(arg >> 1) / 8 % sizeof(d->breaks)] |= 1 << ((arg >> 1) % 8);
+		} else if (strcmp(cmd, "d") == 0) {
+			memset(d->breaks, 0, sizeof(d->breaks));
+		} else if (strcmp(cmd, "p") == 0) {
+			lotec_print_state(stdout, &d->cpu);
+		} else if (strcmp(cmd, "m") == 0) {
+			lotec_print_ram(stdout, &d->cpu);
+		} else if (strcmp(cmd, "i") == 0) {
+			printf("snapshots=%u interval=%llu bytes=%llu\n", d->hist.num,
+				(unsigned long long)d->hist.interval, (unsigned long long)d->hist.bytes);
+		} else if (strcmp(cmd, "q") == 0) {
+			break;
+		} else {
+			debug_help();
+		}
+
+		if (stop >= 0) {
+			printf("stop=%s\n", stop_names[stop]);
+			lotec_print_state(stdout, &d->cpu);
+			if (stop == STOP_ERROR) {
+				break;
+			}
+		}
+	}
+	lotec_history_free(&d->hist);
+	free(d);
+	return 0;
+}
+
+/* Write the profile report, the collapsed stacks and the counters given as
+ * format:file to their files.
+ */
+static int write_profile(const struct lotec_rom *rom, const char *romfile, const char *report,
+	const char *folded, const char *counters)
+{
+	struct lotec_counters cnt;
+	const char *name;
+	FILE *fout;
+	int format;
+	int rv;
+
+	name = strrchr(romfile, '/');
+	name = (name != NULL) ? name + 1 : romfile;
+
+	if (report != NULL) {
+		fout = fopen(report, "w");
+		if (fout == NULL) {
+			fprintf(stderr, "Error: Failed to open file '%s'.\n", report);
+			return 2;
+		}
+		rv = lotec_profile_report(fout, rom, profile);
+		fclose(fout);
+		if (rv != 0) {
+			return rv;
+		}
+	}
+	if (folded != NULL) {
+		fout = fopen(folded, "w");
+		if (fout == NULL) {
+			fprintf(stderr, "Error: Failed to open file '%s'.\n", folded);
+			return 2;
+		}
+		rv = lotec_profile_folded(fout, name, rom, profile);
+		fclose(fout);
+		if (rv != 0) {
+			return rv;
+		}
+	}
+	if (counters != NULL) {
+		if (strncmp(counters, "json:", 5) == 0) {
+			format = COUNTERS_JSON;
+		} else if (strncmp(counters, "prom:", 5) == 0) {
+			format = COUNTERS_PROMETHEUS;
+		} else {
+			fprintf(stderr, "Error: Invalid counter output '%s'.\n", counters);
+			return 1;
+		}
+		counters += 5;
+		fout = (strcmp(counters, "-") == 0) ? stdout : fopen(counters, "w");
+		if (fout == NULL) {
+			fprintf(stderr, "Error: Failed to open file '%s'.\n", counters);
+			return 2;
+		}
+		lotec_counters_read(&cnt, rom, profile);
+		lotec_counters_write(fout, &cnt, name, format);
+		if (fout != stdout) {
+			fclose(fout);
+		}
+	}
+	return 0;
+}
+
+/* Run one instruction at a time and write each to the trace file. Returns
+ * the exit reason, or -1 if the trace couldn't be written.
+ */
+static int run_traced(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles,
+	struct lotec_system *sys, const char *filename)
+{
+	struct lotec_trace_writer *tw;
+	struct lotec_cpu before;
+	int reason = EXIT_LIMIT;
+	int rv = 0;
+
+	tw = lotec_trace_create(filename, cpu);
+	if (tw == NULL) {
+		return -1;
+	}
+	while ((cpu->cycles < max_cycles) && (rv == 0)) {
+		before = *cpu;
+		if (lotec_step_system(cpu, rom, sys) == EXIT_HALT) {
+			reason = EXIT_HALT;
+			break;
+		}
+		rv = lotec_trace_step(tw, &before, cpu, cpu->cycles - before.cycles > CYCLES_INSN);
+	}
+	if (lotec_trace_close(tw, cpu) != 0) {
+		rv = 2;
+	}
+	return (rv != 0) ? -1 : reason;
+}
+
+/* Run one instruction at a time and feed it to the timing models. */
+static int run_timed(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles,
+	struct lotec_system *sys, struct lotec_timing *t)
+{
+	uint64_t cycles;
+	uint16_t pc;
+
+	while (cpu->cycles < max_cycles) {
+		pc = cpu->pc;
+		cycles = cpu->cycles;
+		if (lotec_step_system(cpu, rom, sys) == EXIT_HALT) {
+			return EXIT_HALT;
+		}
+		lotec_timing_step(t, pc, rom->words[pc], cpu->cycles - cycles > CYCLES_INSN, cpu->pc);
+	}
+	return EXIT_LIMIT;
+}
+
+/* Parse an event given as cycle:address=value */
+static int add_event(struct lotec_event **events, unsigned int *num, const char *arg)
+{
+	struct lotec_event ev;
+	struct lotec_event *p;
+	unsigned long v;
+	char *end;
+	unsigned int i;
+
+	ev.cycle = strtoull(arg, &end, 0);
+	if (*end != ':') {
+		fprintf(stderr, "Error: Invalid event '%s'.\n", arg);
+		return 1;
+	}
+	v = strtoul(end + 1, &end, 0);
+	if ((*end != '=') || (v >= RAM_SIZE)) {
+		fprintf(stderr, "Error: Invalid event '%s'.\n", arg);
+		return 1;
+	}
+	ev.addr = v;
+	v = strtoul(end + 1, &end, 0);
+	if ((*end != 0) || (v > 0xFF)) {
+		fprintf(stderr, "Error: Invalid event '%s'.\n", arg);
+		return 1;
+	}
+	ev.value = v;
+
+	p = realloc(*events, (*num + 1) * sizeof(*p));
+	if (p == NULL) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		return 2;
+	}
+	/* Keep the events sorted, in command line order for the same cycle */
+	for (i = *num; (i > 0) && (p[i - 1].cycle > ev.cycle); i--) {
+		p[i] = p[i - 1];
+	}
+	p[i] = ev;
+	*events = p;
+	(*num)++;
+	return 0;
+}
+
+static void usage(void)
+{
+	unsigned int i;
+
+	printf("lotec-sim [-c cycles] [-e engine] [-r ram file] [-w event] [-i] [-m] [-t] [-b]\n");
+	printf("          [-n lanes [-s seed]] [-d [-S cycles] [-M MiB]] [-p report] [-F stacks]\n");
+	printf("          [-C format:file] [-T trace] [-v coverage] [-a models] [-N]\n");
+	printf("          [hex or bin file]\n");
+	printf("Simulator for LoTec 8-Bit CPU\n");
+	printf(" -c cycles    Stop after cycles clock cycles (default %llu)\n", DEFAULT_MAX_CYCLES);
+	printf(" -e engine    Execution engine:");
+	for (i = 0; i < LOTEC_NUM_ENGINES; i++) {
+		printf(" %s", lotec_engines[i].name);
+	}
+	printf(" (default %s)\n", lotec_engines[0].name);
+	printf(" -r file      Load initial RAM content from binary file\n");
+	printf(" -w c:a=v     Write value v to RAM address a at cycle c, may be repeated\n");
+	printf(" -i           Don't stop at a branch to itself, skip idle loops up to the\n");
+	printf("              next event or the cycle limit\n");
+	printf(" -m           Print RAM content at exit\n");
+	printf(" -t           Print simulation speed\n");
+	printf(" -b           Benchmark all engines, running the ROM from reset until\n");
+	printf("              the cycle limit is reached\n");
+	printf(" -n lanes     Run lanes instances in lockstep, each with its own RAM image\n");
+	printf("              from the RAM file or random. With -b, compare with running\n");
+	printf("              each instance alone with the engine\n");
+	printf(" -s seed      Seed of the random RAM images (default 0)\n");
+	printf(" -d           Debug with commands from stdin, including reverse execution\n");
+	printf(" -S cycles    Cycles between snapshots for -d (default %llu)\n", DEFAULT_SNAP_INTERVAL);
+	printf(" -M MiB       Memory for snapshots, the interval is doubled when it is\n");
+	printf("              used up (default %u)\n", DEFAULT_SNAP_MEMORY);
+	printf(" -p report    Run with the profiling switch interpreter and write the\n");
+	printf("              disassembly annotated with counts and the hottest loops\n");
+	printf(" -F stacks    Same, but write the cycles as collapsed stacks of loops\n");
+	printf(" -C fmt:file  Same, but write event counters as json or prom (Prometheus\n");
+	printf("              text), file - is stdout\n");
+	printf(" -T trace     Run one instruction at a time and write a binary trace, see\n");
+	printf("              lotec-trace\n");
+	printf(" -v coverage  Run with the JIT and write the executed instructions and\n");
+	printf("              branch directions, see lotec-cov\n");
+	printf(" -a models    Run one instruction at a time and print the cycles and stalls\n");
+	printf("              of timing models: serial, pipe, btb or all, with\n");
+	printf("              :key=value to change fetch, branch, jump, pcl, pch or\n");
+	printf("              entries, separated by commas\n");
+	printf(" -N           Load the ROM file itself, not its pre-decoded image <file>.img,\n");
+	printf("              which is written when it is missing or older than the file\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const struct lotec_engine *engine = &lotec_engines[0];
+	const char *ramfile = NULL;
+	struct lotec_event *events = NULL;
+	unsigned int num_events = 0;
+	struct lotec_system sys;
+	struct lotec_rom *rom;
+	struct lotec_cpu cpu;
+	uint8_t (*images)[RAM_SIZE];
+	uint64_t max_cycles = DEFAULT_MAX_CYCLES;
+	unsigned int lanes = 0;
+	uint32_t seed = 0;
+	int dump_ram = 0;
+	int timing = 0;
+	int benchmark = 0;
+	int idle = 0;
+	int debug = 0;
+	uint64_t interval = DEFAULT_SNAP_INTERVAL;
+	unsigned long snap_memory = DEFAULT_SNAP_MEMORY;
+	const char *report = NULL;
+	const char *folded = NULL;
+	const char *counters = NULL;
+	const char *tracefile = NULL;
+	const char *covfile = NULL;
+	const char *models = NULL;
+	struct lotec_timing *timing_models = NULL;
+	int no_image = 0;
+	double start;
+	double duration;
+	int reason;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "c:e:r:w:imtbn:s:dS:M:p:F:C:T:v:Na:")) != -1) {
+		switch (opt) {
+			case 'c':
+				max_cycles = strtoull(optarg, NULL, 0);
+				break;
+			case 'e':
+				engine = lotec_find_engine(optarg);
+				if (engine == NULL) {
+					fprintf(stderr, "Error: Unknown engine '%s'.\n", optarg);
+					return 1;
+				}
+				break;
+			case 'r':
+				ramfile = optarg;
+				break;
+			case 'w':
+				opt = add_event(&events, &num_events, optarg);
+				if (opt != 0) {
+					free(events);
+					return opt;
+				}
+				break;
+			case 'i':
+				idle = 1;
+				break;
+			case 'm':
+				dump_ram = 1;
+				break;
+			case 't':
+				timing = 1;
+				break;
+			case 'b':
+				benchmark = 1;
+				break;
+			case 'n':
+				lanes = strtoul(optarg, NULL, 0);
+				break;
+			case 's':
+				seed = strtoul(optarg, NULL, 0);
+				break;
+			case 'd':
+				debug = 1;
+				break;
+			case 'S':
+				interval = strtoull(optarg, NULL, 0);
+				break;
+			case 'M':
+				snap_memory = strtoul(optarg, NULL, 0);
+				break;
+			case 'p':
+				report = optarg;
+				break;
+			case 'F':
+				folded = optarg;
+				break;
+			case 'C':
+				counters = optarg;
+				break;
+			case 'T':
+				tracefile = optarg;
+				break;
+			case 'v':
+				covfile = optarg;
+				break;
+			case 'N':
+				no_image = 1;
+				break;
+			case 'a':
+				models = optarg;
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+	if (optind >= argc) {
+		usage();
+		free(events);
+		return 1;
+	}
+
+	rom = lotec_rom_alloc();
+	if (rom == NULL) {
+		free(events);
+		return 2;
+	}
+	opt = no_image ? lotec_rom_load(rom, argv[optind]) : lotec_rom_load_cached(rom, argv[optind]);
+	if (opt != 0) {
+		lotec_rom_free(rom);
+		free(events);
+		return 2;
+	}
+
+	if (lanes > 0) {
+		images = lane_images(lanes, ramfile, seed);
+		if (images == NULL) {
+			lotec_rom_free(rom);
+			free(events);
+			return 2;
+		}
+		opt = run_lanes(rom, lanes, (const uint8_t (*)[RAM_SIZE])images, max_cycles, engine,
+			dump_ram, timing, benchmark);
+		free(images);
+		lotec_rom_free(rom);
+		free(events);
+		return opt;
+	}
+
+	lotec_reset(&cpu);
+	if ((ramfile != NULL) && (lotec_ram_load(&cpu, ramfile) != 0)) {
+		lotec_rom_free(rom);
+		free(events);
+		return 2;
+	}
+
+	if (benchmark) {
+		opt = bench(rom, &cpu, max_cycles);
+		lotec_rom_free(rom);
+		free(events);
+		return opt;
+	}
+
+	if ((tracefile != NULL) && ((report != NULL) || (folded != NULL) || (counters != NULL) || debug)) {
+		fprintf(stderr, "Error: -T can't be combined with -d, -p, -F or -C.\n");
+		lotec_rom_free(rom);
+		free(events);
+		return 1;
+	}
+	if ((covfile != NULL) && ((report != NULL) || (folded != NULL) || (counters != NULL) || debug ||
+		(tracefile != NULL))) {
+		fprintf(stderr, "Error: -v can't be combined with -d, -p, -F, -C or -T.\n");
+		lotec_rom_free(rom);
+		free(events);
+		return 1;
+	}
+	if ((models != NULL) && ((report != NULL) || (folded != NULL) || (counters != NULL) || debug ||
+		(tracefile != NULL) || (covfile != NULL))) {
+		fprintf(stderr, "Error: -a can't be combined with -d, -p, -F, -C, -T or -v.\n");
+		lotec_rom_free(rom);
+		free(events);
+		return 1;
+	}
+	if (models != NULL) {
+		timing_models = lotec_timing_create(models);
+		if (timing_models == NULL) {
+			lotec_rom_free(rom);
+			free(events);
+			return 1;
+		}
+	}
+
+	memset(&sys, 0, sizeof(sys));
+	sys.run = engine->run;
+	if ((report != NULL) || (folded != NULL) || (counters != NULL)) {
+#ifdef LOTEC_FAST
+		fprintf(stderr, "Error: Profiling is compiled out of this build.\n");
+		lotec_rom_free(rom);
+		free(events);
+		return 1;
+#endif
+		profile = calloc(1, sizeof(*profile));
+		if (profile == NULL) {
+			fprintf(stderr, "Error: Out of memory.\n");
+			lotec_rom_free(rom);
+			free(events);
+			return 2;
+		}
+		sys.run = run_profiled;
+	}
+	if (covfile != NULL) {
+		coverage = calloc(1, sizeof(*coverage));
+		if (coverage == NULL) {
+			fprintf(stderr, "Error: Out of memory.\n");
+			lotec_rom_free(rom);
+			free(events);
+			return 2;
+		}
+		sys.run = run_covered;
+	}
+	sys.events = events;
+	sys.num_events = num_events;
+	sys.idle = idle;
+
+	if (debug) {
+		opt = run_debug(rom, &sys, &cpu, max_cycles, interval, (size_t)snap_memory << 20);
+		lotec_rom_free(rom);
+		free(events);
+		return opt;
+	}
+
+	start = lotec_get_time();
+	if (tracefile != NULL) {
+		reason = run_traced(&cpu, rom, max_cycles, &sys, tracefile);
+		if (reason < 0) {
+			lotec_rom_free(rom);
+			free(events);
+			free(profile);
+			return 2;
+		}
+	} else if (timing_models != NULL) {
+		reason = run_timed(&cpu, rom, max_cycles, &sys, timing_models);
+	} else {
+		reason = lotec_run_system(&cpu, rom, max_cycles, &sys);
+	}
+	duration = lotec_get_time() - start;
+
+	printf("exit=%s\n", lotec_exit_name(reason));
+	lotec_print_state(stdout, &cpu);
+	if (dump_ram) {
+		lotec_print_ram(stdout, &cpu);
+	}
+	if (timing_models != NULL) {
+		lotec_timing_report(stdout, timing_models);
+		lotec_timing_free(timing_models);
+	}
+	if (timing) {
+		fprintf(stderr, "%.3f s, %.1f M instructions/s\n",
+			duration, (duration > 0) ? (cpu.insns / duration / 1e6) : 0.0);
+		if (idle) {
+			fprintf(stderr, "%llu idle cycles skipped\n", (unsigned long long)sys.idle_cycles);
+		}
+		if ((engine->run == lotec_run_memo) || (engine->run == lotec_run_memo_check)) {
+			print_memo_stats(rom);
+		}
+	}
+	opt = 0;
+	if (profile != NULL) {
+		opt = write_profile(rom, argv[optind], report, folded, counters);
+		free(profile);
+	}
+	if (coverage != NULL) {
+		opt = lotec_coverage_write(covfile, coverage, rom);
+		free(coverage);
+	}
+	lotec_rom_free(rom);
+	free(events);
+	if (opt != 0) {
+		return opt;
+	}
+	return (reason == EXIT_ERROR) ? 3 : 0;
+}
@@ -0,0 +1,228 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lotec-cpu.h"
+
+/* Incremental snapshots for going back in time. A snapshot keeps the
+ * registers and counters, and the RAM bytes written since the previous
+ * snapshot with their value at that time. The RAM at the last snapshot is
+ * kept whole, so it is diffed against the current RAM instead of tracking
+ * the writes of the engines. Restoring an older snapshot undoes the bytes of
+ * the snapshots after it, newest first.
+ *
+ * When the snapshots use more than max_bytes, every second one is merged
+ * into the one after it and the interval is doubled, so the snapshots cover
+ * the whole run with a coarser spacing.
+ */
+
+/* Memory of a snapshot with n undo bytes */
+#define SNAP_BYTES(n) (sizeof(struct lotec_snap) + 2 * (n))
+
+static int take(struct lotec_history *h, const struct lotec_cpu *cpu, unsigned int next_event)
+{
+	struct lotec_snap *s;
+	uint8_t undo[2 * RAM_SIZE];
+	unsigned int n = 0;
+	unsigned int i;
+	void *p;
+
+	for (i = 0; i < RAM_SIZE; i++) {
+		if (cpu->ram[i] != h->ram[i]) {
+			undo[2 * n] = i;
+			undo[2 * n + 1] = h->ram[i];
+			h->ram[i] = cpu->ram[i];
+			n++;
+		}
+	}
+
+	if (h->num == h->size) {
+		p = realloc(h->snaps, (h->size * 2 + 64) * sizeof(*h->snaps));
+		if (p == NULL) {
+			fprintf(stderr, "Error: Out of memory.\n");
+			return 2;
+		}
+		h->snaps = p;
+		h->size = h->size * 2 + 64;
+	}
+	s = &h->snaps[h->num];
+	memcpy(s->r, cpu->r, sizeof(s->r));
+	s->flags = cpu->flags;
+	s->pch = cpu->pch;
+	s->pc = cpu->pc;
+	s->cycles = cpu->cycles;
+	s->insns = cpu->insns;
+	s->next_event = next_event;
+	s->num_undo = n;
+	s->undo = NULL;
+	if (n > 0) {
+		s->undo = malloc(2 * n);
+		if (s->undo == NULL) {
+			fprintf(stderr, "Error: Out of memory.\n");
+			return 2;
+		}
+		memcpy(s->undo, undo, 2 * n);
+	}
+	h->num++;
+	h->bytes += SNAP_BYTES(n);
+	return 0;
+}
+
+/* Merge snapshot i into i + 1: the undo bytes of both, with the older value
+ * where both have an address.
+ */
+static int merge(struct lotec_history *h, unsigned int i)
+{
+	struct lotec_snap *a = &h->snaps[i];
+	struct lotec_snap *b = &h->snaps[i + 1];
+	uint8_t undo[2 * RAM_SIZE];
+	uint8_t seen[RAM_SIZE];
+	unsigned int n = 0;
+	unsigned int j;
+	uint8_t *p;
+
+	memset(seen, 0, sizeof(seen));
+	for (j = 0; j < a->num_undo; j++) {
+		undo[2 * n] = a->undo[2 * j];
+		undo[2 * n + 1] = a->undo[2 * j + 1];
+		seen[a->undo[2 * j]] = 1;
+		n++;
+	}
+	for (j = 0; j < b->num_undo; j++) {
+		if (!seen[b->undo[2 * j]]) {
+			undo[2 * n] = b->undo[2 * j];
+			undo[2 * n + 1] = b->undo[2 * j + 1];
+			n++;
+		}
+	}
+
+	p = NULL;
+	if (n > 0) {
+		p = malloc(2 * n);
+		if (p == NULL) {
+			fprintf(stderr, "Error: Out of memory.\n");
+			return 2;
+		}
+		memcpy(p, undo, 2 * n);
+	}
+	h->bytes -= SNAP_BYTES(a->num_undo) + SNAP_BYTES(b->num_undo);
+	h->bytes += SNAP_BYTES(n);
+	free(a->undo);
+	free(b->undo);
+	b->undo = p;
+	b->num_undo = n;
+	memmove(a, b, (h->num - i - 1) * sizeof(*a));
+	h->num--;
+	return 0;
+}
+
+/* Drop every second snapshot, keeping the first and the last. */
+static int thin(struct lotec_history *h)
+{
+	unsigned int i;
+	int rv;
+
+	for (i = 1; i + 1 < h->num; i++) {
+		rv = merge(h, i);
+		if (rv != 0) {
+			return rv;
+		}
+	}
+	h->interval *= 2;
+	return 0;
+}
+
+/* Start the history with a snapshot of cpu. */
+int lotec_history_init(struct lotec_history *h, const struct lotec_cpu *cpu, unsigned int next_event,
+	uint64_t interval, size_t max_bytes)
+{
+	memset(h, 0, sizeof(*h));
+	h->interval = (interval > 0) ? interval : 1;
+	h->max_bytes = max_bytes;
+	memcpy(h->ram, cpu->ram, sizeof(h->ram));
+	return take(h, cpu, next_event);
+}
+
+void lotec_history_free(struct lotec_history *h)
+{
+	unsigned int i;
+
+	for (i = 0; i < h->num; i++) {
+		free(h->snaps[i].undo);
+	}
+	free(h->snaps);
+	h->snaps = NULL;
+	h->num = 0;
+	h->size = 0;
+}
+
+/* Take a snapshot if the interval has passed since the last one. */
+int lotec_history_update(struct lotec_history *h, const struct lotec_cpu *cpu, unsigned int next_event)
+{
+	int rv;
+
+	if (cpu->cycles < h->snaps[h->num - 1].cycles + h->interval) {
+		return 0;
+	}
+	rv = take(h, cpu, next_event);
+	while ((rv == 0) && (h->bytes > h->max_bytes) && (h->num > 2)) {
+		rv = thin(h);
+	}
+	return rv;
+}
+
+/* Cycles at which the next snapshot is due */
+uint64_t lotec_history_next(const struct lotec_history *h)
+{
+	return h->snaps[h->num - 1].cycles + h->interval;
+}
+
+/* Latest snapshot at or before insns instructions */
+unsigned int lotec_history_find(const struct lotec_history *h, uint64_t insns)
+{
+	unsigned int lo = 0;
+	unsigned int hi = h->num;
+	unsigned int mid;
+
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if (h->snaps[mid].insns <= insns) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/* Go back to snapshot index and drop the snapshots after it. Only the bytes
+ * written since it are touched. Returns the next event of the snapshot.
+ */
+unsigned int lotec_history_restore(struct lotec_history *h, struct lotec_cpu *cpu, unsigned int index)
+{
+	const struct lotec_snap *s;
+	unsigned int i;
+
+	memcpy(cpu->ram, h->ram, sizeof(cpu->ram));
+	while (h->num > index + 1) {
+		s = &h->snaps[h->num - 1];
+		for (i = 0; i < s->num_undo; i++) {
+			cpu->ram[s->undo[2 * i]] = s->undo[2 * i + 1];
+		}
+		h->bytes -= SNAP_BYTES(s->num_undo);
+		free(s->undo);
+		h->num--;
+	}
+	memcpy(h->ram, cpu->ram, sizeof(h->ram));
+
+	s = &h->snaps[index];
+	memcpy(cpu->r, s->r, sizeof(cpu->r));
+	cpu->flags = s->flags;
+	cpu->pch = s->pch;
+	cpu->pc = s->pc;
+	cpu->cycles = s->cycles;
+	cpu->insns = s->insns;
+	return s->next_event;
+}
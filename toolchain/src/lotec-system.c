@@ -0,0 +1,185 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lotec-cpu.h"
+
+/* Longest loop body checked for idling, in instructions */
+#define IDLE_MAX_LOOP 16
+
+/* Cycles an engine runs before checking for an idle loop */
+#define IDLE_CHUNK 0x10000ULL
+
+/* Apply all events due at the current cycle. */
+static void apply_events(struct lotec_cpu *cpu, struct lotec_system *sys)
+{
+	const struct lotec_event *ev;
+
+	while (sys->next_event < sys->num_events) {
+		ev = &sys->events[sys->next_event];
+		if (ev->cycle > cpu->cycles) {
+			break;
+		}
+		cpu->ram[ev->addr] = ev->value;
+		sys->next_event++;
+	}
+}
+
+/* Instructions which neither branch nor write PCL */
+static int straight_insn(uint16_t insn)
+{
+	uint8_t opcode;
+
+	opcode = INSN_OPCODE(insn);
+	switch (opcode) {
+		case OP_JUMP:
+			return INSN_COND(insn) == COND_NV;
+		case OP_BRANCH:
+			return INSN_COND(insn) == COND_NV;
+		case OP_CMPI:
+		case OP_CMP:
+		case OP_STB:
+			return 1;
+		default:
+			return INSN_RD(insn) != REG_PCL;
+	}
+}
+
+/* Find a loop around pc: straight code from head to a B back to head.
+ * Returns the head or -1.
+ */
+static int32_t find_loop(const struct lotec_rom *rom, uint16_t pc)
+{
+	uint32_t target;
+	uint32_t addr;
+	uint16_t insn;
+
+	for (addr = pc; addr < (uint32_t)pc + IDLE_MAX_LOOP; addr++) {
+		insn = rom->words[addr & 0xFFFF];
+		if ((INSN_OPCODE(insn) == OP_BRANCH) && (INSN_COND(insn) != COND_NV)) {
+			target = rom->ops[addr & 0xFFFF].target;
+			if ((target <= pc) && (target + IDLE_MAX_LOOP > addr)) {
+				return target;
+			}
+			return -1;
+		}
+		if (!straight_insn(insn)) {
+			return -1;
+		}
+	}
+	return -1;
+}
+
+static int same_state(const struct lotec_cpu *a, const struct lotec_cpu *b)
+{
+	return (memcmp(a->r, b->r, sizeof(a->r)) == 0) && (a->flags == b->flags) &&
+		(a->pch == b->pch) && (a->pc == b->pc) && (memcmp(a->ram, b->ram, sizeof(a->ram)) == 0);
+}
+
+/* Step to the head of the loop and run one iteration. If it ends in the same
+ * state, the loop can only be left after an event changed the RAM, so whole
+ * iterations are skipped up to stop. Returns 1 if cycles were skipped.
+ */
+static int skip_idle(struct lotec_cpu *cpu, const struct lotec_rom *rom, uint64_t stop,
+	struct lotec_system *sys)
+{
+	struct lotec_cpu start;
+	uint64_t period;
+	uint64_t n;
+	int32_t head;
+	int i;
+
+	head = find_loop(rom, cpu->pc);
+	if (head < 0) {
+		return 0;
+	}
+	/* Both iterations must end before stop. */
+	if (cpu->cycles + 4 * (IDLE_MAX_LOOP + 1) * (CYCLES_INSN + CYCLES_BRANCH) > stop) {
+		return 0;
+	}
+	for (i = 0; (cpu->pc != head) && (i <= IDLE_MAX_LOOP); i++) {
+		lotec_step(cpu, rom);
+	}
+	if (cpu->pc != head) {
+		return 0;
+	}
+	start = *cpu;
+	for (i = 0; (i == 0) || ((cpu->pc != head) && (i <= IDLE_MAX_LOOP)); i++) {
+		lotec_step(cpu, rom);
+	}
+	if (!same_state(cpu, &start)) {
+		return 0;
+	}
+
+	period = cpu->cycles - start.cycles;
+	n = (stop - cpu->cycles) / period;
+	cpu->cycles += n * period;
+	cpu->insns += n * (cpu->insns - start.insns);
+	sys->idle_cycles += n * period;
+	return n > 0;
+}
+
+/* Run the CPU with the engine of sys and apply the events when they are
+ * due, before the first instruction starting at or after their cycle. With
+ * sys->idle set, a branch to itself doesn't stop the simulation and idle
+ * loops are skipped, giving the same result as executing them.
+ */
+int lotec_run_system(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles,
+	struct lotec_system *sys)
+{
+	uint64_t stop;
+	uint64_t end;
+	uint64_t n;
+	int reason;
+
+	for (;;) {
+		apply_events(cpu, sys);
+		if (cpu->cycles >= max_cycles) {
+			return EXIT_LIMIT;
+		}
+		stop = max_cycles;
+		if ((sys->next_event < sys->num_events) && (sys->events[sys->next_event].cycle < stop)) {
+			stop = sys->events[sys->next_event].cycle;
+		}
+
+		end = stop;
+		if (sys->idle) {
+			if (skip_idle(cpu, rom, stop, sys)) {
+				continue;
+			}
+			if (end - cpu->cycles > IDLE_CHUNK) {
+				end = cpu->cycles + IDLE_CHUNK;
+			}
+		}
+
+		reason = sys->run(cpu, rom, end);
+		if (reason == EXIT_HALT) {
+			if (!sys->idle) {
+				return EXIT_HALT;
+			}
+			/* Iterations of the branch to itself up to stop */
+			n = (stop - cpu->cycles + (CYCLES_INSN + CYCLES_BRANCH) - 1) /
+				(CYCLES_INSN + CYCLES_BRANCH);
+			cpu->cycles += n * (CYCLES_INSN + CYCLES_BRANCH);
+			cpu->insns += n;
+			sys->idle_cycles += n * (CYCLES_INSN + CYCLES_BRANCH);
+		} else if (reason != EXIT_LIMIT) {
+			return reason;
+		}
+	}
+}
+
+/* Execute one instruction of cpu after applying the events due. Returns
+ * EXIT_HALT without executing it if it is a branch to itself and sys->idle
+ * isn't set, else EXIT_LIMIT.
+ */
+int lotec_step_system(struct lotec_cpu *cpu, const struct lotec_rom *rom, struct lotec_system *sys)
+{
+	apply_events(cpu, sys);
+	if (!sys->idle && (rom->ops[cpu->pc].uop == UOP_HALT)) {
+		return EXIT_HALT;
+	}
+	lotec_step(cpu, rom);
+	return EXIT_LIMIT;
+}
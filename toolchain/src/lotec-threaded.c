@@ -0,0 +1,363 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "lotec-cpu.h"
+#include "lotec-alu.h"
+
+#ifdef __GNUC__
+
+/* Replace common instruction pairs by superinstructions. Only the first slot
+ * is replaced, so a jump to the second instruction still works.
+ */
+static void fuse_op(struct lotec_top *t, const struct lotec_op *op,
+	const struct lotec_op *next, const void *const *labels)
+{
+	int uop = -1;
+
+	switch (op->uop) {
+		case UOP_LIF:
+			switch (next->uop) {
+				case UOP_ADDI:
+					uop = UOP_LIF_ADDI;
+					break;
+				case UOP_SUBI:
+					uop = UOP_LIF_SUBI;
+					break;
+				case UOP_ADD:
+					uop = UOP_LIF_ADD;
+					break;
+				case UOP_SUB:
+					uop = UOP_LIF_SUB;
+					break;
+				default:
+					return;
+			}
+			t->imm2 = op->imm;
+			t->rd = next->rd;
+			t->rs = next->rs;
+			t->imm = next->imm;
+			break;
+
+		case UOP_CMPI:
+		case UOP_CMP:
+			if (next->uop != UOP_B) {
+				return;
+			}
+			uop = (op->uop == UOP_CMPI) ? UOP_CMPI_B : UOP_CMP_B;
+			t->cond = next->cond;
+			t->target = next->target;
+			break;
+
+		case UOP_LIH:
+			if (next->uop != UOP_LJ) {
+				return;
+			}
+			uop = UOP_LIH_LJ;
+			t->imm2 = op->imm;
+			t->imm = next->imm;
+			break;
+
+		default:
+			return;
+	}
+	t->handler = labels[uop];
+}
+
+static int thread_rom(struct lotec_rom *rom, const void *const *labels)
+{
+	const struct lotec_op *op;
+	struct lotec_top *t;
+	uint32_t i;
+
+	if (rom->code == NULL) {
+		rom->code = malloc(ROM_WORDS * sizeof(*rom->code));
+		if (rom->code == NULL) {
+			fprintf(stderr, "Error: Out of memory.\n");
+			return 1;
+		}
+	}
+	for (i = 0; i < ROM_WORDS; i++) {
+		op = &rom->ops[i];
+		t = &rom->code[i];
+
+		t->handler = labels[op->uop];
+		t->rd = op->rd;
+		t->rs = op->rs;
+		t->rt = op->rt;
+		t->imm = op->imm;
+		t->imm2 = 0;
+		t->cond = op->cond;
+		t->target = op->target;
+		if (i + 1 < ROM_WORDS) {
+			fuse_op(t, op, &rom->ops[i + 1], labels);
+		}
+	}
+	rom->code_valid = 1;
+	return 0;
+}
+
+/* Same as lotec_run(), but with direct threaded dispatch using computed goto
+ * and superinstructions. The threaded code is created on the first call.
+ */
+int lotec_run_threaded(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles)
+{
+	static const void *const labels[UOP_COUNT] = {
+		[UOP_NOP] = &&do_nop,
+		[UOP_LI] = &&do_li,
+		[UOP_ADDI] = &&do_addi,
+		[UOP_ANDI] = &&do_andi,
+		[UOP_ORI] = &&do_ori,
+		[UOP_XORI] = &&do_xori,
+		[UOP_SUBI] = &&do_subi,
+		[UOP_CMPI] = &&do_cmpi,
+		[UOP_SHRI] = &&do_shri,
+		[UOP_SHLI] = &&do_shli,
+		[UOP_MOV] = &&do_mov,
+		[UOP_ADD] = &&do_add,
+		[UOP_AND] = &&do_and,
+		[UOP_OR] = &&do_or,
+		[UOP_XOR] = &&do_xor,
+		[UOP_SUB] = &&do_sub,
+		[UOP_CMP] = &&do_cmp,
+		[UOP_SHR] = &&do_shr,
+		[UOP_SHL] = &&do_shl,
+		[UOP_LDB] = &&do_ldb,
+		[UOP_STB] = &&do_stb,
+		[UOP_J] = &&do_j,
+		[UOP_B] = &&do_b,
+		[UOP_LIF] = &&do_lif,
+		[UOP_MOVF] = &&do_movf,
+		[UOP_LIH] = &&do_lih,
+		[UOP_LJ] = &&do_lj,
+		[UOP_HALT] = &&do_halt,
+		[UOP_GENERIC] = &&do_generic,
+		[UOP_LIF_ADDI] = &&do_lif_addi,
+		[UOP_LIF_SUBI] = &&do_lif_subi,
+		[UOP_LIF_ADD] = &&do_lif_add,
+		[UOP_LIF_SUB] = &&do_lif_sub,
+		[UOP_CMPI_B] = &&do_cmpi_b,
+		[UOP_CMP_B] = &&do_cmp_b,
+		[UOP_LIH_LJ] = &&do_lih_lj,
+	};
+	const struct lotec_top *code;
+	const struct lotec_top *op;
+	struct lotec_cpu c;
+	int64_t budget;
+	int64_t slots;
+	uint64_t bubbles;
+	uint16_t pc;
+	uint8_t flags;
+	int reason;
+
+	if (!rom->code_valid && (thread_rom(rom, labels) != 0)) {
+		return lotec_run(cpu, rom, max_cycles);
+	}
+	if (cpu->cycles >= max_cycles) {
+		return EXIT_LIMIT;
+	}
+	slots = (max_cycles - cpu->cycles + CYCLES_INSN - 1) / CYCLES_INSN;
+	budget = slots;
+	bubbles = 0;
+	reason = EXIT_LIMIT;
+	code = rom->code;
+
+	c = *cpu;
+	pc = c.pc;
+	flags = c.flags;
+
+#define DISPATCH() do { \
+		if (budget <= 0) { \
+			goto out; \
+		} \
+		op = &code[pc]; \
+		budget--; \
+		goto *op->handler; \
+	} while (0)
+#define NEXT() do { \
+		pc++; \
+		DISPATCH(); \
+	} while (0)
+#define TAKEN(t) do { \
+		pc = (t); \
+		budget--; \
+		bubbles++; \
+		DISPATCH(); \
+	} while (0)
+/* A superinstruction needs a second slot, else only the first is executed. */
+#define FUSED() do { \
+		if (budget <= 0) { \
+			goto do_generic; \
+		} \
+		budget--; \
+	} while (0)
+
+	DISPATCH();
+
+do_nop:
+	NEXT();
+do_li:
+	c.r[op->rd] = op->imm;
+	NEXT();
+do_addi:
+	c.r[op->rd] = alu_add(c.r[op->rd], op->imm, &flags);
+	NEXT();
+do_andi:
+	c.r[op->rd] &= op->imm;
+	NEXT();
+do_ori:
+	c.r[op->rd] |= op->imm;
+	NEXT();
+do_xori:
+	c.r[op->rd] ^= op->imm;
+	NEXT();
+do_subi:
+	c.r[op->rd] = alu_sub(c.r[op->rd], op->imm, &flags);
+	NEXT();
+do_cmpi:
+	flags = alu_cmp(c.r[op->rd], op->imm, flags);
+	NEXT();
+do_shri:
+	c.r[op->rd] = alu_shr(c.r[op->rd], c.r[op->rs], op->imm, &flags);
+	NEXT();
+do_shli:
+	c.r[op->rd] = alu_shl(c.r[op->rd], c.r[op->rs], op->imm, &flags);
+	NEXT();
+do_mov:
+	c.r[op->rd] = c.r[op->rs];
+	NEXT();
+do_add:
+	c.r[op->rd] += c.r[op->rs] + (flags & FLAG_C);
+	NEXT();
+do_and:
+	c.r[op->rd] &= c.r[op->rs];
+	NEXT();
+do_or:
+	c.r[op->rd] |= c.r[op->rs];
+	NEXT();
+do_xor:
+	c.r[op->rd] ^= c.r[op->rs];
+	NEXT();
+do_sub:
+	c.r[op->rd] -= c.r[op->rs] + (flags & FLAG_C);
+	NEXT();
+do_cmp:
+	flags = alu_cmp(c.r[op->rd], c.r[op->rs], flags);
+	NEXT();
+do_shr:
+	c.r[op->rd] = alu_shr(c.r[op->rd], c.r[op->rs], c.r[op->rt] & 0x1F, &flags);
+	NEXT();
+do_shl:
+	c.r[op->rd] = alu_shl(c.r[op->rd], c.r[op->rs], c.r[op->rt] & 0x1F, &flags);
+	NEXT();
+do_ldb:
+	c.r[op->rd] = c.ram[op->imm];
+	NEXT();
+do_stb:
+	c.ram[op->imm] = c.r[op->rd];
+	NEXT();
+do_j:
+	if (COND_TRUE(op->cond, flags)) {
+		TAKEN((c.r[op->rs] << 8) | c.r[op->rt]);
+	}
+	NEXT();
+do_b:
+	if (COND_TRUE(op->cond, flags)) {
+		TAKEN(op->target);
+	}
+	NEXT();
+do_lif:
+	flags = op->imm;
+	NEXT();
+do_movf:
+	c.r[op->rd] = flags;
+	NEXT();
+do_lih:
+	c.pch = op->imm;
+	NEXT();
+do_lj:
+	TAKEN((c.pch << 8) | op->imm);
+do_halt:
+	budget++;
+	reason = EXIT_HALT;
+	goto out;
+do_generic:
+	c.pc = pc;
+	c.flags = flags;
+	if (lotec_exec(&c, rom->words[pc])) {
+		budget--;
+		bubbles++;
+	}
+	pc = c.pc;
+	flags = c.flags;
+	DISPATCH();
+
+do_lif_addi:
+	FUSED();
+	flags = op->imm2;
+	c.r[op->rd] = alu_add(c.r[op->rd], op->imm, &flags);
+	pc += 2;
+	DISPATCH();
+do_lif_subi:
+	FUSED();
+	flags = op->imm2;
+	c.r[op->rd] = alu_sub(c.r[op->rd], op->imm, &flags);
+	pc += 2;
+	DISPATCH();
+do_lif_add:
+	FUSED();
+	flags = op->imm2;
+	c.r[op->rd] += c.r[op->rs] + (flags & FLAG_C);
+	pc += 2;
+	DISPATCH();
+do_lif_sub:
+	FUSED();
+	flags = op->imm2;
+	c.r[op->rd] -= c.r[op->rs] + (flags & FLAG_C);
+	pc += 2;
+	DISPATCH();
+do_cmpi_b:
+	FUSED();
+	flags = alu_cmp(c.r[op->rd], op->imm, flags);
+	if (COND_TRUE(op->cond, flags)) {
+		TAKEN(op->target);
+	}
+	pc += 2;
+	DISPATCH();
+do_cmp_b:
+	FUSED();
+	flags = alu_cmp(c.r[op->rd], c.r[op->rs], flags);
+	if (COND_TRUE(op->cond, flags)) {
+		TAKEN(op->target);
+	}
+	pc += 2;
+	DISPATCH();
+do_lih_lj:
+	FUSED();
+	c.pch = op->imm2;
+	TAKEN((op->imm2 << 8) | op->imm);
+
+#undef DISPATCH
+#undef NEXT
+#undef TAKEN
+#undef FUSED
+
+out:
+	slots -= budget;
+	c.pc = pc;
+	c.flags = flags;
+	c.insns += slots - bubbles;
+	c.cycles += slots * CYCLES_INSN;
+	*cpu = c;
+	return reason;
+}
+
+#else
+
+int lotec_run_threaded(struct lotec_cpu *cpu, struct lotec_rom *rom, uint64_t max_cycles)
+{
+	return lotec_run(cpu, rom, max_cycles);
+}
+
+#endif
@@ -0,0 +1,322 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lotec-cpu.h"
+#include "lotec-timing.h"
+
+/* What-if timing models. They are fed with every executed instruction and
+ * count the cycles a CPU built differently would take for the same run,
+ * with the stalls by cause. A model is given as name[:key=value...], models
+ * are separated by commas, "all" selects the presets:
+ *
+ *	serial	the LoTec as built: a fetch cycle before every execute cycle,
+ *		a taken branch, jump or write to PCL also runs the NOP fetched
+ *		after it (2 + 2 cycles)
+ *	pipe	fetch overlapped with execute: one cycle per instruction, a
+ *		taken branch or jump discards the fetched instruction (1
+ *		cycle), a write to PCL comes out of the ALU or RAM one cycle
+ *		later (2 cycles) and one more if PCH was written just before
+ *	btb	pipe with a direct mapped branch target buffer of 16 entries,
+ *		predicted B, J and writes to PCL cost nothing, wrong
+ *		predictions the penalty of the instruction
+ *
+ * The keys fetch, branch, jump, pcl and pch set the penalties in cycles,
+ * entries the size of the branch target buffer (0 for none).
+ */
+
+#define MAX_MODELS 16
+#define MAX_NAME_SIZE 64
+
+enum {
+	STALL_FETCH = 0,
+	STALL_BRANCH,
+	STALL_JUMP,
+	STALL_PCL,
+	STALL_PCH,
+	STALL_MISPREDICT,
+	NUM_STALLS
+};
+
+static const char *const stall_names[NUM_STALLS] = {
+	"fetch", "branch", "jump", "pcl", "pch", "mispred",
+};
+
+struct timing_params {
+	unsigned int penalty[STALL_MISPREDICT];	/* by stall, fetch per instruction */
+	unsigned int entries;
+};
+
+static const struct {
+	const char *name;
+	struct timing_params params;
+} presets[] = {
+	{ "serial", { { 1, 2, 2, 2, 0 }, 0 } },
+	{ "pipe", { { 0, 1, 1, 2, 1 }, 0 } },
+	{ "btb", { { 0, 1, 1, 2, 1 }, 16 } },
+};
+
+#define NUM_PRESETS (sizeof(presets) / sizeof(presets[0]))
+
+struct model {
+	char name[MAX_NAME_SIZE];
+	struct timing_params params;
+	uint64_t cycles;
+	uint64_t stalls[NUM_STALLS];
+	uint32_t *btb_pc;	/* address of the entry, UINT32_MAX if empty */
+	uint16_t *btb_target;
+	int pch_written;	/* by the previous instruction */
+};
+
+struct lotec_timing {
+	struct model models[MAX_MODELS];
+	unsigned int num_models;
+	uint64_t insns;
+};
+
+/* Whether the instruction writes register rd */
+static int writes_rd(uint16_t insn)
+{
+	switch (INSN_OPCODE(insn)) {
+		case OP_LI:
+		case OP_ADDI:
+		case OP_ANDI:
+		case OP_ORI:
+		case OP_XORI:
+		case OP_SUBI:
+		case OP_SHRI:
+		case OP_SHLI:
+		case OP_MOV:
+		case OP_ADD:
+		case OP_AND:
+		case OP_OR:
+		case OP_XOR:
+		case OP_SUB:
+		case OP_SHR:
+		case OP_SHL:
+		case OP_LDB:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+static int add_model(struct lotec_timing *t, const char *spec)
+{
+	struct model *m;
+	char buf[MAX_NAME_SIZE];
+	char *save;
+	char *key;
+	char *value;
+	char *end;
+	unsigned long v;
+	unsigned int i;
+
+	if (t->num_models >= MAX_MODELS) {
+		fprintf(stderr, "Error: More than %u timing models.\n", MAX_MODELS);
+		return 1;
+	}
+	if (strlen(spec) >= sizeof(buf)) {
+		fprintf(stderr, "Error: Invalid timing model '%s'.\n", spec);
+		return 1;
+	}
+	m = &t->models[t->num_models];
+	strcpy(m->name, spec);
+	strcpy(buf, spec);
+
+	key = strtok_r(buf, ":", &save);
+	for (i = 0; (key != NULL) && (i < NUM_PRESETS) && (strcmp(presets[i].name, key) != 0); i++) {
+	}
+	if ((key == NULL) || (i == NUM_PRESETS)) {
+		fprintf(stderr, "Error: Unknown timing model '%s'.\n", spec);
+		return 1;
+	}
+	m->params = presets[i].params;
+
+	while ((key = strtok_r(NULL, ":", &save)) != NULL) {
+		value = strchr(key, '=');
+		if (value == NULL) {
+			fprintf(stderr, "Error: Invalid timing model '%s'.\n", spec);
+			return 1;
+		}
+		*value++ = '\0';
+		v = strtoul(value, &end, 0);
+		if ((*value == '\0') || (*end != '\0')) {
+			fprintf(stderr, "Error: Invalid timing model '%s'.\n", spec);
+			return 1;
+		}
+		if (strcmp(key, "entries") == 0) {
+			if (v > ROM_WORDS) {
+				fprintf(stderr, "Error: Invalid timing model '%s'.\n", spec);
+				return 1;
+			}
+			m->params.entries = v;
+			continue;
+		}
+		for (i = 0; (i < STALL_MISPREDICT) && (strcmp(stall_names[i], key) != 0); i++) {
+		}
+		if ((i == STALL_MISPREDICT) || (v > 1000)) {
+			fprintf(stderr, "Error: Invalid timing model '%s'.\n", spec);
+			return 1;
+		}
+		m->params.penalty[i] = v;
+	}
+
+	if (m->params.entries > 0) {
+		m->btb_pc = malloc(m->params.entries * sizeof(*m->btb_pc));
+		m->btb_target = calloc(m->params.entries, sizeof(*m->btb_target));
+		if ((m->btb_pc == NULL) || (m->btb_target == NULL)) {
+			fprintf(stderr, "Error: Out of memory.\n");
+			free(m->btb_pc);
+			free(m->btb_target);
+			return 2;
+		}
+		memset(m->btb_pc, 0xFF, m->params.entries * sizeof(*m->btb_pc));
+	}
+	t->num_models++;
+	return 0;
+}
+
+/* Create the models of spec, see above. Returns NULL on errors. */
+struct lotec_timing *lotec_timing_create(const char *spec)
+{
+	struct lotec_timing *t;
+	char *buf;
+	char *save;
+	char *name;
+	unsigned int i;
+	int rv = 0;
+
+	t = calloc(1, sizeof(*t));
+	buf = strdup(spec);
+	if ((t == NULL) || (buf == NULL)) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		free(t);
+		free(buf);
+		return NULL;
+	}
+	for (name = strtok_r(buf, ",", &save); (name != NULL) && (rv == 0); name = strtok_r(NULL, ",", &save)) {
+		if (strcmp(name, "all") != 0) {
+			rv = add_model(t, name);
+			continue;
+		}
+		for (i = 0; (i < NUM_PRESETS) && (rv == 0); i++) {
+			rv = add_model(t, presets[i].name);
+		}
+	}
+	free(buf);
+	if ((rv == 0) && (t->num_models == 0)) {
+		fprintf(stderr, "Error: No timing model.\n");
+		rv = 1;
+	}
+	if (rv != 0) {
+		lotec_timing_free(t);
+		return NULL;
+	}
+	return t;
+}
+
+void lotec_timing_free(struct lotec_timing *t)
+{
+	unsigned int i;
+
+	if (t == NULL) {
+		return;
+	}
+	for (i = 0; i < t->num_models; i++) {
+		free(t->models[i].btb_pc);
+		free(t->models[i].btb_target);
+	}
+	free(t);
+}
+
+static void model_step(struct model *m, uint16_t pc, uint16_t insn, int taken, uint16_t next)
+{
+	const struct timing_params *p = &m->params;
+	unsigned int kind;
+	unsigned int penalty;
+	uint32_t index;
+
+	m->cycles += 1 + p->penalty[STALL_FETCH];
+	m->stalls[STALL_FETCH] += p->penalty[STALL_FETCH];
+
+	if (INSN_OPCODE(insn) == OP_BRANCH) {
+		kind = STALL_BRANCH;
+	} else if (INSN_OPCODE(insn) == OP_JUMP) {
+		kind = STALL_JUMP;
+	} else {
+		kind = STALL_PCL;
+	}
+	penalty = p->penalty[kind];
+
+	if (p->entries > 0) {
+		index = pc % p->entries;
+		if (m->btb_pc[index] == pc) {
+			if (taken && (m->btb_target[index] == next)) {
+				taken = 0;
+				penalty = 0;
+			} else {
+				m->cycles += penalty;
+				m->stalls[STALL_MISPREDICT] += penalty;
+				if (!taken) {
+					m->btb_pc[index] = UINT32_MAX;
+				}
+				taken = 0;
+			}
+			m->btb_target[index] = next;
+		} else if (taken) {
+			m->btb_pc[index] = pc;
+			m->btb_target[index] = next;
+		}
+	}
+	if (taken) {
+		m->cycles += penalty;
+		m->stalls[kind] += penalty;
+		if ((kind == STALL_PCL) && m->pch_written) {
+			m->cycles += p->penalty[STALL_PCH];
+			m->stalls[STALL_PCH] += p->penalty[STALL_PCH];
+		}
+	}
+	m->pch_written = writes_rd(insn) && (INSN_RD(insn) == REG_PCH);
+}
+
+/* Count an executed instruction at pc, next is the address after it and
+ * taken is set if it branched, jumped or wrote PCL.
+ */
+void lotec_timing_step(struct lotec_timing *t, uint16_t pc, uint16_t insn, int taken, uint16_t next)
+{
+	unsigned int i;
+
+	t->insns++;
+	for (i = 0; i < t->num_models; i++) {
+		model_step(&t->models[i], pc, insn, taken, next);
+	}
+}
+
+/* Print the cycles of every model, the cycles per instruction, the speedup
+ * against the first model and the stall cycles by cause.
+ */
+void lotec_timing_report(FILE *fout, const struct lotec_timing *t)
+{
+	const struct model *m;
+	unsigned int i;
+	unsigned int j;
+
+	fprintf(fout, "%-20s %14s %6s %7s", "model", "cycles", "CPI", "speedup");
+	for (j = 0; j < NUM_STALLS; j++) {
+		fprintf(fout, " %12s", stall_names[j]);
+	}
+	fprintf(fout, "\n");
+	for (i = 0; i < t->num_models; i++) {
+		m = &t->models[i];
+		fprintf(fout, "%-20s %14llu %6.3f %6.3fx", m->name, (unsigned long long)m->cycles,
+			(t->insns > 0) ? ((double)m->cycles / t->insns) : 0.0,
+			(m->cycles > 0) ? ((double)t->models[0].cycles / m->cycles) : 1.0);
+		for (j = 0; j < NUM_STALLS; j++) {
+			fprintf(fout, " %12llu", (unsigned long long)m->stalls[j]);
+		}
+		fprintf(fout, "\n");
+	}
+}
@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef LOTECTIMING_H
+#define LOTECTIMING_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "lotec-cpu.h"
+
+/* Timing models fed with the executed instructions, see lotec-timing.c */
+struct lotec_timing;
+
+struct lotec_timing *lotec_timing_create(const char *spec);
+void lotec_timing_free(struct lotec_timing *t);
+void lotec_timing_step(struct lotec_timing *t, uint16_t pc, uint16_t insn, int taken, uint16_t next);
+void lotec_timing_report(FILE *fout, const struct lotec_timing *t);
+
+#endif
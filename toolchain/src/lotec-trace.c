@@ -0,0 +1,145 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "lotec-cpu.h"
+#include "lotec-disasm.h"
+#include "lotec-tracefile.h"
+
+/* Disassembly of insn without the comment of print_insn() */
+static const char *insn_text(uint16_t pc, uint16_t insn, char *text, size_t size)
+{
+	FILE *f;
+	char *end;
+
+	memset(text, 0, size);
+	f = fmemopen(text, size - 1, "w");
+	if (f == NULL) {
+		return "?";
+	}
+	print_insn(f, pc << 1, insn);
+	fclose(f);
+	end = strchr(text, ';');
+	if (end != NULL) {
+		while ((end > text) && (end[-1] == ' ')) {
+			end--;
+		}
+		*end = '\0';
+	}
+	return text;
+}
+
+static void print_step(FILE *fout, const struct lotec_trace_step *step, const struct lotec_rom *rom)
+{
+	char text[64];
+	uint16_t insn;
+	unsigned int i;
+
+	fprintf(fout, "%12llu %04X:", (unsigned long long)step->cycles, step->pc << 1);
+	if (rom != NULL) {
+		insn = rom->words[step->pc];
+		fprintf(fout, " %02X %02X %-*s", (insn >> 8) & 0xFF, (insn >> 0) & 0xFF,
+			(step->num_regs + step->num_ram + step->branch > 0) ? 20 : 0,
+			insn_text(step->pc, insn, text, sizeof(text)));
+	}
+	for (i = 0; i < step->num_regs; i++) {
+		fprintf(fout, " %s=%02X", decode_reg(step->regs[i]), step->values[i]);
+	}
+	for (i = 0; i < step->num_ram; i++) {
+		fprintf(fout, " [%02X]=%02X", step->ram_addr[i], step->ram_values[i]);
+	}
+	if (step->branch) {
+		fprintf(fout, " taken");
+	}
+	fprintf(fout, "\n");
+}
+
+static void usage(void)
+{
+	printf("lotec-trace [-s cycle] [-n count] [-r rom] [-f] trace\n");
+	printf("Print a trace written by lotec-sim -T\n");
+	printf(" -s cycle     Start at the first instruction at or after cycle\n");
+	printf(" -n count     Print count instructions\n");
+	printf(" -r rom       Disassemble the instructions of the ROM (hex or bin file)\n");
+	printf(" -f           Only print the state after the last printed instruction\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct lotec_trace_cursor cur;
+	struct lotec_trace_step step;
+	struct lotec_trace trace;
+	struct lotec_rom *rom = NULL;
+	const char *romfile = NULL;
+	uint64_t start = 0;
+	uint64_t count = UINT64_MAX;
+	uint64_t n;
+	int final = 0;
+	int rv = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:n:r:f")) != -1) {
+		switch (opt) {
+			case 's':
+				start = strtoull(optarg, NULL, 0);
+				break;
+			case 'n':
+				count = strtoull(optarg, NULL, 0);
+				break;
+			case 'r':
+				romfile = optarg;
+				break;
+			case 'f':
+				final = 1;
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+	if (optind >= argc) {
+		usage();
+		return 1;
+	}
+
+	if (romfile != NULL) {
+		rom = lotec_rom_alloc();
+		if (rom == NULL) {
+			return 2;
+		}
+		if (lotec_rom_load(rom, romfile) != 0) {
+			lotec_rom_free(rom);
+			return 2;
+		}
+	}
+	opt = lotec_trace_map(&trace, argv[optind]);
+	if (opt != 0) {
+		lotec_rom_free(rom);
+		return opt;
+	}
+
+	opt = lotec_trace_seek(&trace, start, &cur);
+	for (n = 0; (opt >= 0) && (n < count); n++) {
+		opt = lotec_trace_next(&cur, &step);
+		if (opt <= 0) {
+			break;
+		}
+		if (!final) {
+			print_step(stdout, &step, rom);
+		}
+	}
+	if (opt < 0) {
+		fprintf(stderr, "Error: Trace '%s' is truncated.\n", argv[optind]);
+		rv = 3;
+	}
+	if (final) {
+		lotec_print_state(stdout, &cur.cpu);
+	}
+
+	lotec_trace_unmap(&trace);
+	lotec_rom_free(rom);
+	return rv;
+}
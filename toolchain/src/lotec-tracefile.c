@@ -0,0 +1,490 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lotec-cpu.h"
+#include "lotec-tracefile.h"
+
+/* Binary execution traces. The file starts with a header:
+ *
+ *	"LTRC", version and keyframe interval (32 bit each)
+ *
+ * followed by one record per executed instruction. The first byte of a
+ * record holds:
+ *
+ *	bits 0 - 1	PC after the instruction: 0 next address, 1 signed 8 bit
+ *			offset to the next address, 2 absolute 16 bit, 3 keyframe
+ *	bit 2		taken branch, 2 more cycles
+ *	bit 3		one RAM byte written: address and value follow
+ *	bit 4		more RAM bytes written: count and pairs follow
+ *	bits 5 - 7	number of registers changed
+ *
+ * The changed registers follow as their numbers packed into nibbles and
+ * their values. A keyframe holds the whole state before the next record.
+ * Keyframes are written at the start and every TRACE_KEYFRAME_INTERVAL
+ * records. close appends the index of the keyframes (cycles and offset, 64
+ * bit each), its offset, its length and "LTRI". All numbers are little
+ * endian.
+ */
+
+#define TRACE_MAGIC "LTRC"
+#define TRACE_INDEX_MAGIC "LTRI"
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 12
+#define TRACE_FOOTER_SIZE 20
+
+#define REC_PC_NEXT 0
+#define REC_PC_REL 1
+#define REC_PC_ABS 2
+#define REC_KEYFRAME 3
+#define REC_PC_MASK 0x03
+#define REC_BRANCH 0x04
+#define REC_STORE 0x08
+#define REC_RAM 0x10
+#define REC_REGS_SHIFT 5
+
+#define KEYFRAME_SIZE (1 + 5 + 1 + 1 + 2 + 8 + 8 + RAM_SIZE)
+
+/* Registers of the state in record order */
+static const uint8_t trace_regs[7] = {
+	REG_R0, REG_R1, REG_R2, REG_R3, REG_R4, REG_FLAGS, REG_PCH,
+};
+
+struct lotec_trace_writer {
+	FILE *fout;
+	uint64_t offset;
+	uint64_t records;
+	uint64_t *index;
+	uint64_t num_index;
+	uint64_t size_index;
+	int error;
+};
+
+static void put_le(uint8_t *p, uint64_t v, unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		p[i] = v >> (8 * i);
+	}
+}
+
+static uint64_t get_le(const uint8_t *p, unsigned int n)
+{
+	uint64_t v = 0;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		v |= (uint64_t)p[i] << (8 * i);
+	}
+	return v;
+}
+
+static void put(struct lotec_trace_writer *tw, const uint8_t *buf, size_t n)
+{
+	if (fwrite(buf, 1, n, tw->fout) != n) {
+		tw->error = 1;
+	}
+	tw->offset += n;
+}
+
+static uint8_t *get_reg(struct lotec_cpu *cpu, uint8_t reg)
+{
+	if (reg == REG_FLAGS) {
+		return &cpu->flags;
+	}
+	if (reg == REG_PCH) {
+		return &cpu->pch;
+	}
+	return &cpu->r[reg];
+}
+
+static uint8_t reg_value(const struct lotec_cpu *cpu, uint8_t reg)
+{
+	if (reg == REG_FLAGS) {
+		return cpu->flags;
+	}
+	if (reg == REG_PCH) {
+		return cpu->pch;
+	}
+	return cpu->r[reg];
+}
+
+static int keyframe(struct lotec_trace_writer *tw, const struct lotec_cpu *cpu)
+{
+	uint8_t buf[KEYFRAME_SIZE];
+	void *p;
+
+	if (tw->num_index == tw->size_index) {
+		p = realloc(tw->index, (tw->size_index * 2 + 64) * 2 * sizeof(*tw->index));
+		if (p == NULL) {
+			fprintf(stderr, "Error: Out of memory.\n");
+			return 2;
+		}
+		tw->index = p;
+		tw->size_index = tw->size_index * 2 + 64;
+	}
+	tw->index[2 * tw->num_index] = cpu->cycles;
+	tw->index[2 * tw->num_index + 1] = tw->offset;
+	tw->num_index++;
+
+	buf[0] = REC_KEYFRAME;
+	memcpy(&buf[1], cpu->r, 5);
+	buf[6] = cpu->flags;
+	buf[7] = cpu->pch;
+	put_le(&buf[8], cpu->pc, 2);
+	put_le(&buf[10], cpu->cycles, 8);
+	put_le(&buf[18], cpu->insns, 8);
+	memcpy(&buf[26], cpu->ram, RAM_SIZE);
+	put(tw, buf, sizeof(buf));
+	return 0;
+}
+
+/* Create a trace starting in state cpu. Returns NULL on error. */
+struct lotec_trace_writer *lotec_trace_create(const char *filename, const struct lotec_cpu *cpu)
+{
+	struct lotec_trace_writer *tw;
+	uint8_t header[TRACE_HEADER_SIZE];
+
+	tw = calloc(1, sizeof(*tw));
+	if (tw == NULL) {
+		fprintf(stderr, "Error: Out of memory.\n");
+		return NULL;
+	}
+	tw->fout = fopen(filename, "wb");
+	if (tw->fout == NULL) {
+		fprintf(stderr, "Error: Failed to open file '%s'.\n", filename);
+		free(tw);
+		return NULL;
+	}
+	setvbuf(tw->fout, NULL, _IOFBF, 1 << 20);
+
+	memcpy(header, TRACE_MAGIC, 4);
+	put_le(&header[4], TRACE_VERSION, 4);
+	put_le(&header[8], TRACE_KEYFRAME_INTERVAL, 4);
+	put(tw, header, sizeof(header));
+	if (keyframe(tw, cpu) != 0) {
+		fclose(tw->fout);
+		free(tw);
+		return NULL;
+	}
+	return tw;
+}
+
+/* Append the record of an instruction executed in state before, giving
+ * after. branch is the return value of lotec_step().
+ */
+int lotec_trace_step(struct lotec_trace_writer *tw, const struct lotec_cpu *before,
+	const struct lotec_cpu *after, int branch)
+{
+	uint8_t buf[1 + 2 + 4 + 7 + 2 + 1 + 2 * RAM_SIZE];
+	uint8_t changed[7];
+	uint8_t *p;
+	unsigned int num_regs = 0;
+	unsigned int num_ram = 0;
+	unsigned int i;
+	uint16_t next;
+	int16_t delta;
+
+	if ((tw->records > 0) && (tw->records % TRACE_KEYFRAME_INTERVAL == 0)) {
+		if (keyframe(tw, before) != 0) {
+			return 2;
+		}
+	}
+	tw->records++;
+
+	p = &buf[1];
+	buf[0] = branch ? REC_BRANCH : 0;
+	next = before->pc + 1;
+	delta = after->pc - next;
+	if (after->pc == next) {
+		buf[0] |= REC_PC_NEXT;
+	} else if ((delta >= -128) && (delta <= 127)) {
+		buf[0] |= REC_PC_REL;
+		*p++ = delta;
+	} else {
+		buf[0] |= REC_PC_ABS;
+		put_le(p, after->pc, 2);
+		p += 2;
+	}
+
+	for (i = 0; i < 7; i++) {
+		if (reg_value(before, trace_regs[i]) != reg_value(after, trace_regs[i])) {
+			changed[num_regs++] = trace_regs[i];
+		}
+	}
+	buf[0] |= num_regs << REC_REGS_SHIFT;
+	for (i = 0; i < num_regs; i += 2) {
+		*p++ = changed[i] | (((i + 1 < num_regs) ? changed[i + 1] : 0) << 4);
+	}
+	for (i = 0; i < num_regs; i++) {
+		*p++ = reg_value(after, changed[i]);
+	}
+
+	if (memcmp(before->ram, after->ram, RAM_SIZE) != 0) {
+		for (i = 0; i < RAM_SIZE; i++) {
+			if (before->ram[i] != after->ram[i]) {
+				num_ram++;
+			}
+		}
+		buf[0] |= REC_STORE;
+		if (num_ram > 1) {
+			buf[0] |= REC_RAM;
+			*p++ = num_ram - 1;
+		}
+		for (i = 0; i < RAM_SIZE; i++) {
+			if (before->ram[i] != after->ram[i]) {
+				*p++ = i;
+				*p++ = after->ram[i];
+			}
+		}
+	}
+	put(tw, buf, p - buf);
+	return tw->error ? 2 : 0;
+}
+
+/* Append a keyframe of the final state cpu and the keyframe index, and
+ * close the trace.
+ */
+int lotec_trace_close(struct lotec_trace_writer *tw, const struct lotec_cpu *cpu)
+{
+	uint8_t buf[TRACE_FOOTER_SIZE];
+	uint64_t index_offset;
+	uint64_t i;
+	int rv;
+
+	rv = keyframe(tw, cpu);
+	if (rv != 0) {
+		tw->error = 1;
+	}
+	index_offset = tw->offset;
+	for (i = 0; i < 2 * tw->num_index; i++) {
+		put_le(buf, tw->index[i], 8);
+		put(tw, buf, 8);
+	}
+	put_le(&buf[0], index_offset, 8);
+	put_le(&buf[8], tw->num_index, 8);
+	memcpy(&buf[16], TRACE_INDEX_MAGIC, 4);
+	put(tw, buf, sizeof(buf));
+
+	if (fclose(tw->fout) != 0) {
+		tw->error = 1;
+	}
+	rv = tw->error;
+	if (rv != 0) {
+		fprintf(stderr, "Error: Failed to write trace.\n");
+	}
+	free(tw->index);
+	free(tw);
+	return rv ? 2 : 0;
+}
+
+/* Map a trace for reading. A trace without index, e.g. of a simulation which
+ * was killed, is read from the start.
+ */
+int lotec_trace_map(struct lotec_trace *t, const char *filename)
+{
+	const uint8_t *footer;
+	struct stat st;
+	uint64_t index_offset;
+	uint64_t num;
+	void *p;
+	int fd;
+
+	memset(t, 0, sizeof(*t));
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Error: Failed to open file '%s'.\n", filename);
+		return 2;
+	}
+	if ((fstat(fd, &st) != 0) || (st.st_size < TRACE_HEADER_SIZE + KEYFRAME_SIZE)) {
+		fprintf(stderr, "Error: '%s' is no trace.\n", filename);
+		close(fd);
+		return 3;
+	}
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		fprintf(stderr, "Error: Failed to map file '%s'.\n", filename);
+		return 2;
+	}
+	t->data = p;
+	t->size = st.st_size;
+	if ((memcmp(t->data, TRACE_MAGIC, 4) != 0) || (get_le(&t->data[4], 4) != TRACE_VERSION)) {
+		fprintf(stderr, "Error: '%s' is no trace.\n", filename);
+		lotec_trace_unmap(t);
+		return 3;
+	}
+
+	t->end = t->size;
+	footer = &t->data[t->size - TRACE_FOOTER_SIZE];
+	if (memcmp(&footer[16], TRACE_INDEX_MAGIC, 4) == 0) {
+		index_offset = get_le(&footer[0], 8);
+		num = get_le(&footer[8], 8);
+		if ((index_offset >= TRACE_HEADER_SIZE) && (num <= t->size / 16) &&
+			(index_offset + 16 * num + TRACE_FOOTER_SIZE == t->size)) {
+			t->end = index_offset;
+			t->index = &t->data[index_offset];
+			t->num_keyframes = num;
+		}
+	}
+	return 0;
+}
+
+void lotec_trace_unmap(struct lotec_trace *t)
+{
+	if (t->data != NULL) {
+		munmap((void *)t->data, t->size);
+	}
+	memset(t, 0, sizeof(*t));
+}
+
+/* Load the keyframes at the cursor. Returns 0, or -1 if one is truncated. */
+static int load_keyframes(struct lotec_trace_cursor *cur)
+{
+	const struct lotec_trace *t = cur->trace;
+	const uint8_t *p;
+
+	while ((cur->offset < t->end) && (t->data[cur->offset] == REC_KEYFRAME)) {
+		if (cur->offset + KEYFRAME_SIZE > t->end) {
+			return -1;
+		}
+		p = &t->data[cur->offset];
+		memcpy(cur->cpu.r, &p[1], 5);
+		cur->cpu.flags = p[6];
+		cur->cpu.pch = p[7];
+		cur->cpu.pc = get_le(&p[8], 2);
+		cur->cpu.cycles = get_le(&p[10], 8);
+		cur->cpu.insns = get_le(&p[18], 8);
+		memcpy(cur->cpu.ram, &p[26], RAM_SIZE);
+		cur->offset += KEYFRAME_SIZE;
+	}
+	return 0;
+}
+
+/* Decode the next record into step and update the state of the cursor.
+ * Returns 1, 0 at the end of the trace or -1 for a truncated record.
+ */
+int lotec_trace_next(struct lotec_trace_cursor *cur, struct lotec_trace_step *step)
+{
+	const struct lotec_trace *t = cur->trace;
+	const uint8_t *p;
+	const uint8_t *end;
+	uint8_t header;
+	unsigned int i;
+
+	if (load_keyframes(cur) != 0) {
+		return -1;
+	}
+	if (cur->offset >= t->end) {
+		return 0;
+	}
+	p = &t->data[cur->offset];
+	end = &t->data[t->end];
+	header = *p++;
+
+	step->pc = cur->cpu.pc;
+	step->cycles = cur->cpu.cycles;
+	step->branch = (header & REC_BRANCH) != 0;
+	switch (header & REC_PC_MASK) {
+		case REC_PC_NEXT:
+			cur->cpu.pc++;
+			break;
+		case REC_PC_REL:
+			if (p + 1 > end) {
+				return -1;
+			}
+			cur->cpu.pc += 1 + (int8_t)*p++;
+			break;
+		default:
+			if (p + 2 > end) {
+				return -1;
+			}
+			cur->cpu.pc = get_le(p, 2);
+			p += 2;
+			break;
+	}
+
+	step->num_regs = header >> REC_REGS_SHIFT;
+	if (p + (step->num_regs + 1) / 2 + step->num_regs > end) {
+		return -1;
+	}
+	for (i = 0; i < step->num_regs; i++) {
+		step->regs[i] = (p[i / 2] >> (4 * (i % 2))) & 0x07;
+	}
+	p += (step->num_regs + 1) / 2;
+	for (i = 0; i < step->num_regs; i++) {
+		step->values[i] = *p++;
+		*get_reg(&cur->cpu, step->regs[i]) = step->values[i];
+	}
+
+	step->num_ram = 0;
+	if (header & REC_STORE) {
+		step->num_ram = 1;
+		if (header & REC_RAM) {
+			if (p + 1 > end) {
+				return -1;
+			}
+			step->num_ram += *p++;
+		}
+		if (p + 2 * step->num_ram > end) {
+			return -1;
+		}
+		for (i = 0; i < step->num_ram; i++) {
+			step->ram_addr[i] = *p++;
+			step->ram_values[i] = *p++;
+			cur->cpu.ram[step->ram_addr[i]] = step->ram_values[i];
+		}
+	}
+
+	cur->cpu.insns++;
+	cur->cpu.cycles += CYCLES_INSN + (step->branch ? CYCLES_BRANCH : 0);
+	cur->offset = p - t->data;
+	return 1;
+}
+
+/* Position the cursor at the first instruction starting at or after cycles,
+ * starting from the last keyframe before it. Returns 0 on success.
+ */
+int lotec_trace_seek(const struct lotec_trace *t, uint64_t cycles, struct lotec_trace_cursor *cur)
+{
+	struct lotec_trace_step step;
+	uint64_t lo = 0;
+	uint64_t hi = t->num_keyframes;
+	uint64_t mid;
+	int rv;
+
+	memset(cur, 0, sizeof(*cur));
+	cur->trace = t;
+	cur->offset = TRACE_HEADER_SIZE;
+	if (t->num_keyframes > 0) {
+		while (hi - lo > 1) {
+			mid = lo + (hi - lo) / 2;
+			if (get_le(&t->index[16 * mid], 8) <= cycles) {
+				lo = mid;
+			} else {
+				hi = mid;
+			}
+		}
+		cur->offset = get_le(&t->index[16 * lo + 8], 8);
+	}
+
+	for (;;) {
+		if (load_keyframes(cur) != 0) {
+			return -1;
+		}
+		if ((cur->cpu.cycles >= cycles) || (cur->offset >= t->end)) {
+			return 0;
+		}
+		rv = lotec_trace_next(cur, &step);
+		if (rv <= 0) {
+			return rv;
+		}
+	}
+}
@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef LOTECTRACEFILE_H
+#define LOTECTRACEFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "lotec-cpu.h"
+
+/* Instructions between keyframes */
+#define TRACE_KEYFRAME_INTERVAL 16384
+
+struct lotec_trace_writer;
+
+/* Trace file mapped for reading */
+struct lotec_trace {
+	const uint8_t *data;
+	size_t size;
+	size_t end;			/* end of the records */
+	const uint8_t *index;		/* cycles and offset of each keyframe */
+	uint64_t num_keyframes;
+};
+
+/* Position in a trace and the state before the next record */
+struct lotec_trace_cursor {
+	const struct lotec_trace *trace;
+	size_t offset;
+	struct lotec_cpu cpu;
+};
+
+/* One executed instruction decoded from a trace */
+struct lotec_trace_step {
+	uint16_t pc;			/* address of the instruction */
+	uint64_t cycles;		/* cycles before it */
+	int branch;
+	unsigned int num_regs;
+	uint8_t regs[7];		/* enum lotec_register of the changed registers */
+	uint8_t values[7];
+	unsigned int num_ram;
+	uint8_t ram_addr[RAM_SIZE];	/* changed RAM bytes */
+	uint8_t ram_values[RAM_SIZE];
+};
+
+struct lotec_trace_writer *lotec_trace_create(const char *filename, const struct lotec_cpu *cpu);
+int lotec_trace_step(struct lotec_trace_writer *tw, const struct lotec_cpu *before,
+	const struct lotec_cpu *after, int branch);
+int lotec_trace_close(struct lotec_trace_writer *tw, const struct lotec_cpu *cpu);
+
+int lotec_trace_map(struct lotec_trace *t, const char *filename);
+void lotec_trace_unmap(struct lotec_trace *t);
+int lotec_trace_seek(const struct lotec_trace *t, uint64_t cycles, struct lotec_trace_cursor *cur);
+int lotec_trace_next(struct lotec_trace_cursor *cur, struct lotec_trace_step *step);
+
+#endif